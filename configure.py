@@ -93,6 +93,16 @@ add_tristate(
     name = 'alloc-failure-injector',
     dest = 'alloc_failure_injection',
     help = 'allocation failure injection')
+add_tristate(
+    arg_parser,
+    name = 'timer-wheel',
+    dest = 'timer_wheel',
+    help = 'hierarchical timer wheel for reactor timers')
+add_tristate(
+    arg_parser,
+    name = 'heap-profiling',
+    dest = 'heap_profiling',
+    help = 'sampled heap profiling in the seastar allocator')
 add_tristate(
     arg_parser,
     name = 'experimental-coroutines-ts',
@@ -186,6 +196,8 @@ def configure_mode(mode):
         tr(args.gcc6_concepts, 'GCC6_CONCEPTS'),
         tr(args.alloc_failure_injection, 'ALLOC_FAILURE_INJECTION'),
         tr(args.alloc_page_size, 'ALLOC_PAGE_SIZE'),
+        tr(args.timer_wheel, 'TIMER_WHEEL'),
+        tr(args.heap_profiling, 'HEAP_PROFILING'),
         tr(args.cpp17_goodies, 'STD_OPTIONAL_VARIANT_STRINGVIEW'),
         tr(args.split_dwarf, 'SPLIT_DWARF'),
         tr(args.coroutines_ts, 'EXPERIMENTAL_COROUTINES_TS'),
@@ -0,0 +1,289 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/align.hh>
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <utility>
+
+namespace seastar {
+
+/// \addtogroup memory-module
+/// @{
+
+/// \brief Allocates memory for objects that die together, and frees it at once
+///
+/// An arena hands out memory from chunks it takes from the seastar
+/// allocator, by bumping a pointer, and frees all of it when it is reset
+/// or destroyed. This suits the many small allocations made for a request,
+/// which all die when the request finishes: allocating them is cheaper,
+/// freeing them costs nothing, and they don't fragment the small object
+/// pools.
+///
+/// Memory is taken from an arena explicitly, with allocate() or through an
+/// \ref arena_allocator, or, while an \ref arena::scope makes it the
+/// current arena, for the objects created by make_lw_shared() and, if the
+/// scope asks for it, for continuations. Objects in an arena may still be
+/// destroyed, and deleted, one by one, which doesn't free their memory.
+///
+/// Nothing in an arena may be used after the arena is reset or destroyed,
+/// which must happen on the shard that created it.
+class arena {
+    struct chunk {
+        chunk* next;
+    };
+    chunk* _chunks = nullptr;
+    char* _pos = nullptr;
+    char* _end = nullptr;
+    size_t _next_chunk_size;
+    size_t _memory = 0;
+public:
+    static constexpr size_t default_chunk_size = 16 * 1024;
+    static constexpr size_t max_chunk_size = 1024 * 1024;
+
+    class scope;
+
+    /// Creates an empty arena, which allocates its first chunk of
+    /// \c chunk_size bytes when first used. Later chunks double in size,
+    /// up to max_chunk_size.
+    explicit arena(size_t chunk_size = default_chunk_size) noexcept
+        : _next_chunk_size(chunk_size) {}
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+    ~arena() {
+        reset();
+    }
+
+    /// Allocates \c size bytes aligned to \c align, which must be a power
+    /// of two. Throws std::bad_alloc if out of memory.
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        auto pos = align_up(reinterpret_cast<uintptr_t>(_pos), uintptr_t(align));
+        auto end = reinterpret_cast<uintptr_t>(_end);
+        if (__builtin_expect(pos && pos <= end && size <= end - pos, true)) {
+            _pos = reinterpret_cast<char*>(pos + size);
+            return reinterpret_cast<void*>(pos);
+        }
+        return allocate_slow(size, align);
+    }
+
+    /// Frees all the memory of the arena, which can then be used again
+    void reset() noexcept;
+
+    /// Memory (in bytes) taken from the allocator by the arena
+    size_t memory() const noexcept {
+        return _memory;
+    }
+private:
+    void* allocate_slow(size_t size, size_t align);
+};
+
+/// \cond internal
+namespace internal {
+
+struct current_arenas {
+    arena* objects = nullptr;
+    arena* continuations = nullptr;
+};
+
+inline
+current_arenas& current_arena_state() noexcept {
+    static thread_local current_arenas a;
+    return a;
+}
+
+inline
+arena*& current_arena_ptr() noexcept {
+    return current_arena_state().objects;
+}
+
+inline
+arena*& current_continuation_arena_ptr() noexcept {
+    return current_arena_state().continuations;
+}
+
+}
+/// \endcond
+
+/// The arena made current by the innermost \ref arena::scope, if any
+inline
+arena* current_arena() noexcept {
+    return internal::current_arena_ptr();
+}
+
+/// \brief Makes an arena the current arena
+///
+/// While the scope lives, make_lw_shared() allocates the objects it
+/// creates in the arena, which must outlive them. A scope is meant to
+/// cover the synchronous part of a request's handler; it must not span a
+/// suspension of a coroutine or of a continuation chain, since the tasks
+/// that run in the meantime would allocate in the arena too. In a seastar
+/// thread, a scope may span waiting for a future: the thread gives up the
+/// current arena while it waits.
+///
+/// Continuations are only allocated in the arena if \c continuations is
+/// true. A continuation lives until its future resolves, so this is only
+/// safe if the arena is known to outlive every future waited for in the
+/// scope, typically because the request waits for all of them before its
+/// arena is reset.
+///
+/// With the default allocator (SEASTAR_DEFAULT_ALLOCATOR), each object
+/// allocated through a scope records whether it is in an arena, so that
+/// deleting it doesn't free arena memory. This lets the address sanitizer
+/// of debug builds report objects used after their arena is reset.
+class arena::scope {
+    arena* _arena;
+    internal::current_arenas _prev;
+public:
+    explicit scope(arena& a, bool continuations = false) noexcept
+        : _arena(&a)
+        , _prev(std::exchange(internal::current_arena_state(), {&a, continuations ? &a : nullptr})) {}
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+    ~scope() {
+        assert(internal::current_arena_ptr() == _arena);
+        internal::current_arena_state() = _prev;
+    }
+};
+
+/// \brief A standard allocator that allocates in an arena
+///
+/// Lets containers allocate their storage in an arena, for example
+/// \c std::vector<int, arena_allocator<int>>. Deallocating does nothing,
+/// so a container that reallocates its storage as it grows leaves the old
+/// storage in the arena until it is reset.
+template <typename T>
+class arena_allocator {
+    arena* _arena;
+public:
+    using value_type = T;
+
+    explicit arena_allocator(arena& a) noexcept : _arena(&a) {}
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& x) noexcept : _arena(x._arena) {}
+
+    T* allocate(size_t n) {
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, size_t) noexcept {
+    }
+
+    template <typename U>
+    bool operator==(const arena_allocator<U>& x) const noexcept {
+        return _arena == x._arena;
+    }
+    template <typename U>
+    bool operator!=(const arena_allocator<U>& x) const noexcept {
+        return _arena != x._arena;
+    }
+
+    template <typename U>
+    friend class arena_allocator;
+};
+
+/// \cond internal
+namespace internal {
+
+// A base class for objects that are allocated in the arena returned by
+// CurrentArena, if any, and deleted with the global operator delete. The
+// seastar allocator ignores frees of memory in an arena; with the default
+// allocator, objects are preceded by a header telling whether they are in
+// one.
+template <arena*& (*CurrentArena)() noexcept>
+struct allocated_in_arena {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    static void* operator new(size_t size) {
+        if (auto a = CurrentArena()) {
+            return a->allocate(size);
+        }
+        return ::operator new(size);
+    }
+    static void operator delete(void* p, size_t size) noexcept {
+        ::operator delete(p, size);
+    }
+#ifdef __cpp_aligned_new
+    static void* operator new(size_t size, std::align_val_t align) {
+        if (auto a = CurrentArena()) {
+            return a->allocate(size, size_t(align));
+        }
+        return ::operator new(size, align);
+    }
+    static void operator delete(void* p, size_t size, std::align_val_t align) noexcept {
+        ::operator delete(p, size, align);
+    }
+#endif
+#else
+    static void* operator new(size_t size) {
+        return allocate(size, alignof(std::max_align_t), [] (size_t n) { return ::operator new(n); });
+    }
+    static void operator delete(void* p, size_t size) noexcept {
+        if (auto header = free(p, alignof(std::max_align_t))) {
+            ::operator delete(header, size + alignof(std::max_align_t));
+        }
+    }
+#ifdef __cpp_aligned_new
+    static void* operator new(size_t size, std::align_val_t align) {
+        auto header_size = std::max(size_t(align), alignof(std::max_align_t));
+        return allocate(size, header_size, [align] (size_t n) { return ::operator new(n, align); });
+    }
+    static void operator delete(void* p, size_t size, std::align_val_t align) noexcept {
+        auto header_size = std::max(size_t(align), alignof(std::max_align_t));
+        if (auto header = free(p, header_size)) {
+            ::operator delete(header, size + header_size, align);
+        }
+    }
+#endif
+private:
+    template <typename Alloc>
+    static void* allocate(size_t size, size_t header_size, Alloc alloc) {
+        if (size > std::numeric_limits<size_t>::max() - header_size) {
+            throw std::bad_alloc();
+        }
+        auto a = CurrentArena();
+        auto header = static_cast<char*>(a ? a->allocate(size + header_size, header_size) : alloc(size + header_size));
+        *reinterpret_cast<bool*>(header) = a;
+        return header + header_size;
+    }
+    // Returns the header to free, if the object isn't in an arena
+    static void* free(void* p, size_t header_size) noexcept {
+        auto header = static_cast<char*>(p) - header_size;
+        return *reinterpret_cast<bool*>(header) ? nullptr : header;
+    }
+#endif
+};
+
+using allocated_in_current_arena = allocated_in_arena<current_arena_ptr>;
+using allocated_in_continuation_arena = allocated_in_arena<current_continuation_arena_ptr>;
+
+}
+/// \endcond
+
+/// @}
+
+}
@@ -28,6 +28,7 @@
 #endif
 
 #include <seastar/core/std-coroutine.hh>
+#include <seastar/core/internal/coroutine_frame_allocator.hh>
 
 namespace std::experimental {
 
@@ -41,6 +42,14 @@ class coroutine_traits<seastar::future<T...>, Args...> {
         promise_type(promise_type&&) = delete;
         promise_type(const promise_type&) = delete;
 
+        // Frames are recycled through a per-shard cache
+        static void* operator new(size_t size) {
+            return seastar::internal::local_coroutine_frame_allocator().allocate(size);
+        }
+        static void operator delete(void* p, size_t size) noexcept {
+            seastar::internal::local_coroutine_frame_allocator().deallocate(p, size);
+        }
+
         template<typename... U>
         void return_value(U&&... value) {
             _promise.set_value(std::forward<U>(value)...);
@@ -73,6 +82,13 @@ class coroutine_traits<seastar::future<>, Args...> {
         promise_type(promise_type&&) = delete;
         promise_type(const promise_type&) = delete;
 
+        static void* operator new(size_t size) {
+            return seastar::internal::local_coroutine_frame_allocator().allocate(size);
+        }
+        static void operator delete(void* p, size_t size) noexcept {
+            seastar::internal::local_coroutine_frame_allocator().deallocate(p, size);
+        }
+
         void return_void() noexcept {
             _promise.set_value();
         }
@@ -100,6 +116,9 @@ namespace seastar {
 
 namespace internal {
 
+// Awaiting never allocates: an available future is consumed without
+// suspending, and otherwise the coroutine's promise, which lives in its
+// frame, becomes the future's continuation.
 template<typename... T>
 struct awaiter {
     seastar::future<T...> _future;
@@ -0,0 +1,102 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+#pragma once
+
+#include <chrono>
+#include <exception>
+#include <utility>
+
+namespace seastar {
+
+/// Clock of task deadlines; see with_deadline()
+using deadline_clock = std::chrono::steady_clock;
+
+/// Exception with which a continuation fails if its deadline passed
+/// before it could run, in a scheduling group that orders its tasks by
+/// deadline (see scheduling_group::set_deadline_ordering()).
+class deadline_exceeded_error : public std::exception {
+public:
+    virtual const char* what() const noexcept override {
+        return "deadline exceeded";
+    }
+};
+
+/// \cond internal
+namespace internal {
+
+// The deadline new tasks inherit; the clock's epoch means none
+inline
+deadline_clock::time_point* current_deadline_ptr() noexcept {
+    // Slow unless zero-initialized
+    static thread_local deadline_clock::time_point deadline;
+    return &deadline;
+}
+
+// A shared instance of deadline_exceeded_error, so that cancelling a task
+// doesn't have to allocate an exception
+const std::exception_ptr& deadline_exceeded_exception() noexcept;
+
+// Sets the deadline new tasks inherit for the duration of a scope, unless
+// the current one is earlier.
+class deadline_scope {
+    deadline_clock::time_point _saved;
+public:
+    explicit deadline_scope(deadline_clock::time_point deadline) noexcept
+            : _saved(*current_deadline_ptr()) {
+        if (_saved == deadline_clock::time_point() || deadline < _saved) {
+            *current_deadline_ptr() = deadline;
+        }
+    }
+    deadline_scope(const deadline_scope&) = delete;
+    ~deadline_scope() {
+        *current_deadline_ptr() = _saved;
+    }
+};
+
+}
+/// \endcond
+
+/// Returns the deadline of the running task, or the clock's epoch if it
+/// has none.
+inline
+deadline_clock::time_point current_deadline() noexcept {
+    return *internal::current_deadline_ptr();
+}
+
+/// \brief Clears the deadline new tasks inherit, for the duration of a scope
+///
+/// Tasks inherit the deadline of the task that created them, including
+/// those of work that outlives the request that started it, such as a
+/// background fiber. Start such work in a \c no_deadline scope, so that it
+/// isn't cancelled once the request's deadline passes.
+class no_deadline {
+    deadline_clock::time_point _saved;
+public:
+    no_deadline() noexcept
+            : _saved(std::exchange(*internal::current_deadline_ptr(), deadline_clock::time_point())) {}
+    no_deadline(const no_deadline&) = delete;
+    ~no_deadline() {
+        *internal::current_deadline_ptr() = _saved;
+    }
+};
+
+}
@@ -27,6 +27,7 @@
 #include <seastar/core/sstring.hh>
 #include <seastar/core/metrics.hh>
 #include <seastar/core/scheduling.hh>
+#include <seastar/core/internal/log_histogram.hh>
 #include <seastar/util/reference_wrapper.hh>
 #include <seastar/util/gcc6-concepts.hh>
 #include <seastar/util/noncopyable_function.hh>
@@ -35,6 +36,7 @@
 #include <seastar/util/std-compat.hh>
 #include <fmt/format.h>
 #include <fmt/ostream.h>
+#include <chrono>
 #include <vector>
 #include <boost/range/irange.hpp>
 #include <boost/range/adaptor/transformed.hpp>
@@ -61,6 +63,14 @@ namespace seastar {
 /// would execute these function calls is scheduled. Execution stages are also
 /// flushed when the reactor polls for events.
 ///
+/// The threshold is picked by each stage from its latency budget (see
+/// execution_stage::set_latency_budget()) and from how long its function
+/// calls were observed to take: the stage batches as many calls as can be
+/// executed within the budget. With no budget, which is the default unless
+/// --execution-stage-latency-budget-us is given, every call is flushed
+/// right away, and batches only form from calls made before the flush task
+/// gets to run.
+///
 /// When calling a function that is wrapped inside execution stage it is
 /// important to remember that the actual function call will happen at some
 /// later time and it has to be guaranteed the objects passed by lvalue
@@ -126,15 +136,40 @@ class execution_stage {
         uint64_t function_calls_enqueued = 0;
         uint64_t function_calls_executed = 0;
     };
+    using clock_type = std::chrono::steady_clock;
+    /// Upper bound of the batch size picked from the latency budget
+    static constexpr size_t max_batch_size = 1024;
 protected:
     bool _empty = true;
     bool _flush_scheduled = false;
     scheduling_group _sg;
     stats _stats;
+    // Flush once this many calls are queued
+    size_t _batch_size = 1;
+    compat::optional<std::chrono::nanoseconds> _latency_budget;
+    // Moving average of the time it takes to execute one call, in ns
+    double _call_cost = 0;
+    clock_type::time_point _first_enqueued;
+    internal::log_histogram _batch_sizes;
+    internal::log_histogram _queue_delays;
     sstring _name;
     metrics::metric_group _metric_group;
 protected:
     virtual void do_flush() noexcept = 0;
+    // Called by the stage when it queues a call
+    void enqueued() noexcept {
+        if (_empty) {
+            _empty = false;
+            _first_enqueued = clock_type::now();
+        }
+        _stats.function_calls_enqueued++;
+    }
+    bool batch_full(size_t queued) const noexcept {
+        return queued >= _batch_size;
+    }
+private:
+    void run_batch() noexcept;
+    void update_batch_size() noexcept;
 public:
     explicit execution_stage(const sstring& name, scheduling_group sg = {});
     virtual ~execution_stage();
@@ -170,6 +205,20 @@ class execution_stage {
     bool poll() const noexcept {
         return !_empty;
     }
+
+    /// Sets how much latency batching may add to a call
+    ///
+    /// Queued calls are flushed once executing them would take about this
+    /// long, or when the reactor next polls, whichever comes first. A
+    /// budget of zero flushes every call as soon as it is queued.
+    /// Overrides the default set with --execution-stage-latency-budget-us.
+    void set_latency_budget(std::chrono::nanoseconds budget) noexcept;
+
+    /// Returns the current latency budget
+    std::chrono::nanoseconds latency_budget() const noexcept;
+
+    /// Returns the number of queued calls at which the stage flushes
+    size_t batch_size() const noexcept { return _batch_size; }
 };
 
 /// \cond internal
@@ -178,6 +227,7 @@ namespace internal {
 class execution_stage_manager {
     std::vector<execution_stage*> _execution_stages;
     std::unordered_map<sstring, execution_stage*> _stages_by_name;
+    std::chrono::nanoseconds _default_latency_budget{0};
 private:
     execution_stage_manager() = default;
     execution_stage_manager(const execution_stage_manager&) = delete;
@@ -189,6 +239,13 @@ class execution_stage_manager {
     execution_stage* get_stage(const sstring& name);
     bool flush() noexcept;
     bool poll() const noexcept;
+    // Latency budget of stages which don't set their own
+    void set_default_latency_budget(std::chrono::nanoseconds budget) noexcept {
+        _default_latency_budget = budget;
+    }
+    std::chrono::nanoseconds default_latency_budget() const noexcept {
+        return _default_latency_budget;
+    }
 public:
     static execution_stage_manager& get() noexcept;
 };
@@ -285,10 +342,11 @@ class concrete_execution_stage final : public execution_stage {
     /// \return future containing the result of the call to the stage's function
     return_type operator()(typename internal::wrap_for_es<Args>::type... args) {
         _queue.emplace_back(std::move(args)...);
-        _empty = false;
-        _stats.function_calls_enqueued++;
+        enqueued();
         auto f = _queue.back()._ready.get_future();
-        flush();
+        if (batch_full(_queue.size())) {
+            flush();
+        }
         return f;
     }
 };
@@ -314,7 +372,9 @@ class inheriting_concrete_execution_stage final {
 
     sstring _name;
     noncopyable_function<ReturnType (Args...)> _function;
-    std::vector<compat::optional<per_group_stage_type>> _stage_for_group{max_scheduling_groups()};
+    // Indexed by scheduling group; grown as groups are seen
+    std::vector<std::unique_ptr<per_group_stage_type>> _stage_for_group;
+    compat::optional<std::chrono::nanoseconds> _latency_budget;
 private:
     per_group_stage_type make_stage_for_group(scheduling_group sg) {
         // We can't use std::ref(function), because reference_wrapper decays to noncopyable_function& and
@@ -323,7 +383,11 @@ class inheriting_concrete_execution_stage final {
             return _function(std::forward<Args>(args)...);
         };
         auto name = fmt::format("{}.{}", _name, sg.name());
-        return per_group_stage_type(name, sg, wrapped_function);
+        auto stage = per_group_stage_type(name, sg, wrapped_function);
+        if (_latency_budget) {
+            stage.set_latency_budget(*_latency_budget);
+        }
+        return stage;
     }
 public:
     /// Construct an inheriting concrete execution stage.
@@ -359,12 +423,27 @@ class inheriting_concrete_execution_stage final {
     return_type operator()(typename internal::wrap_for_es<Args>::type... args) {
         auto sg = current_scheduling_group();
         auto sg_id = internal::scheduling_group_index(sg);
+        if (sg_id >= _stage_for_group.size()) {
+            _stage_for_group.resize(sg_id + 1);
+        }
         auto& slot = _stage_for_group[sg_id];
         if (!slot) {
-            slot.emplace(make_stage_for_group(sg));
+            slot = std::make_unique<per_group_stage_type>(make_stage_for_group(sg));
         }
         return (*slot)(std::move(args)...);
     }
+
+    /// Sets the latency budget of the stages of all scheduling groups
+    ///
+    /// \see execution_stage::set_latency_budget()
+    void set_latency_budget(std::chrono::nanoseconds budget) noexcept {
+        _latency_budget = budget;
+        for (auto&& stage : _stage_for_group) {
+            if (stage) {
+                stage->set_latency_budget(budget);
+            }
+        }
+    }
 };
 
 
@@ -379,6 +458,14 @@ struct concrete_execution_stage_helper<Ret, std::tuple<Args...>> {
     using type = concrete_execution_stage<Ret, Args...>;
 };
 
+template <typename Ret, typename ArgsTuple>
+struct inheriting_concrete_execution_stage_helper;
+
+template <typename Ret, typename... Args>
+struct inheriting_concrete_execution_stage_helper<Ret, std::tuple<Args...>> {
+    using type = inheriting_concrete_execution_stage<Ret, Args...>;
+};
+
 }
 /// \endcond
 
@@ -504,6 +591,27 @@ make_execution_stage(const sstring& name, Ret (Object::*fn)(Args...) const) {
     return make_execution_stage(name, scheduling_group(), fn);
 }
 
+/// Creates a new execution stage which runs each call in the caller's
+/// scheduling group
+///
+/// Like make_execution_stage(), but returns an
+/// inheriting_concrete_execution_stage, which keeps a separate queue for
+/// each scheduling group it is called from, so that calls are batched with
+/// calls from the same group and run under that group's shares.
+///
+/// \param name unique name of the execution stage; the stage of each
+///        scheduling group is named after it and the group
+/// \param fn function to be executed by the stage
+/// \return inheriting_concrete_execution_stage
+template<typename Function>
+auto make_inheriting_execution_stage(const sstring& name, Function&& fn) {
+    using traits = function_traits<Function>;
+    using ret_type = typename traits::return_type;
+    using args_as_tuple = typename traits::args_as_tuple;
+    using stage_type = typename internal::inheriting_concrete_execution_stage_helper<ret_type, args_as_tuple>::type;
+    return stage_type(name, std::forward<Function>(fn));
+}
+
 /// @}
 
 }
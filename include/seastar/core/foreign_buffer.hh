@@ -0,0 +1,145 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/deleter.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/temporary_buffer.hh>
+
+namespace seastar {
+
+/// \cond internal
+namespace internal {
+
+// Queues d for destruction on shard owner. Deleters are sent in batches,
+// so that freeing many buffers costs one cross-shard message, rather
+// than one per buffer.
+void return_foreign_deleter(unsigned owner, deleter d) noexcept;
+
+// Wraps the owner's deleter in a buffer released on another shard. It is
+// created and destroyed on the consuming shard, and only hands the
+// original deleter back, without running it.
+struct foreign_deleter_impl final : deleter::impl {
+    unsigned owner;
+    foreign_deleter_impl(deleter d, unsigned owner) : impl(std::move(d)), owner(owner) {}
+    virtual ~foreign_deleter_impl() override {
+        return_foreign_deleter(owner, std::move(next));
+    }
+};
+
+}
+/// \endcond
+
+/// \addtogroup smp-module
+/// @{
+
+/// A \ref temporary_buffer that can be moved to, and consumed on, another shard.
+///
+/// A \c temporary_buffer's \ref deleter must run on the shard that created
+/// the buffer, so moving the buffer to another shard normally means copying
+/// it, or wrapping it in a \ref foreign_ptr and freeing it with one
+/// cross-shard message per buffer.
+///
+/// A \c foreign_buffer remembers its owner shard. On any other shard,
+/// release() gives back a \c temporary_buffer over the same memory, which
+/// can be shared, trimmed and destroyed there like a local one. When its
+/// last reference goes away, the original deleter is queued for its
+/// owner, and queued deleters are sent to the owner in batches. The
+/// memory is then freed by the owner's allocator, without going through
+/// the cross-shard free list.
+template <typename CharType>
+class foreign_buffer {
+    temporary_buffer<CharType> _buf;
+    unsigned _cpu;
+public:
+    /// Constructs an empty \c foreign_buffer.
+    foreign_buffer() : _cpu(engine().cpu_id()) {}
+    /// Wraps a buffer, and remembers the current shard as its owner.
+    explicit foreign_buffer(temporary_buffer<CharType> buf)
+        : _buf(std::move(buf)), _cpu(engine().cpu_id()) {}
+    foreign_buffer(foreign_buffer&&) noexcept = default;
+    foreign_buffer& operator=(foreign_buffer&& x) noexcept {
+        if (this != &x) {
+            reset();
+            _buf = std::move(x._buf);
+            _cpu = x._cpu;
+        }
+        return *this;
+    }
+    /// Returns the buffer's deleter to its owner shard, if necessary.
+    ~foreign_buffer() {
+        reset();
+    }
+    /// Gets a pointer to the beginning of the buffer.
+    const CharType* get() const { return _buf.get(); }
+    /// Gets the buffer size.
+    size_t size() const { return _buf.size(); }
+    /// Checks whether the buffer is empty.
+    bool empty() const { return _buf.empty(); }
+    /// Checks whether the buffer is not empty.
+    explicit operator bool() const { return bool(_buf); }
+    /// Returns the shard whose allocator owns the buffer.
+    unsigned get_owner_shard() const { return _cpu; }
+    /// Releases the buffer, for consumption on the current shard.
+    ///
+    /// On the owner shard, this returns the original buffer. On other
+    /// shards, it returns a buffer over the same memory, whose deleter
+    /// hands the original one back to the owner.
+    temporary_buffer<CharType> release() {
+        if (_cpu == engine().cpu_id()) {
+            return std::move(_buf);
+        }
+        auto p = _buf.get_write();
+        auto size = _buf.size();
+        auto d = _buf.release();
+        _buf = {};
+        if (!d) {
+            return temporary_buffer<CharType>(p, size, deleter());
+        }
+        return temporary_buffer<CharType>(p, size, deleter(new internal::foreign_deleter_impl(std::move(d), _cpu)));
+    }
+    /// Drops the buffer, returning its deleter to the owner shard if
+    /// this is not the owner.
+    void reset() {
+        if (_cpu != engine().cpu_id()) {
+            auto d = _buf.release();
+            if (d) {
+                internal::return_foreign_deleter(_cpu, std::move(d));
+            }
+        }
+        _buf = {};
+    }
+};
+
+/// Wraps a \ref temporary_buffer in a \ref foreign_buffer owned by the
+/// current shard.
+///
+/// \related foreign_buffer
+template <typename CharType>
+inline
+foreign_buffer<CharType> make_foreign_buffer(temporary_buffer<CharType> buf) {
+    return foreign_buffer<CharType>(std::move(buf));
+}
+
+/// @}
+
+}
@@ -1169,6 +1169,28 @@ future<T...> with_timeout(std::chrono::time_point<Clock, Duration> timeout, futu
     return result;
 }
 
+/// \brief Runs a function with a deadline for the tasks it creates
+///
+/// The continuations and other tasks created by \c func, and by the tasks
+/// they create in turn, carry \c deadline, unless they already inherited
+/// an earlier one. Scheduling groups which order their tasks by deadline
+/// run them earliest deadline first, and drop them once their deadline
+/// has passed; see scheduling_group::set_deadline_ordering(). Elsewhere
+/// the deadline has no effect. Background work started by \c func
+/// inherits the deadline too, unless started in a \ref no_deadline scope.
+///
+/// \param deadline time point after which the work is no longer useful
+/// \param func function to run
+///
+/// \return the result of \c func, as a future
+template <typename Func>
+inline
+futurize_t<std::result_of_t<Func()>>
+with_deadline(deadline_clock::time_point deadline, Func&& func) {
+    internal::deadline_scope scope(deadline);
+    return futurize_apply(std::forward<Func>(func));
+}
+
 namespace internal {
 
 template<typename Future>
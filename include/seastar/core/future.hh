@@ -22,6 +22,7 @@
 #pragma once
 
 #include <seastar/core/apply.hh>
+#include <seastar/core/arena.hh>
 #include <seastar/core/task.hh>
 #include <seastar/core/preempt.hh>
 #include <seastar/core/thread_impl.hh>
@@ -387,12 +388,21 @@ class continuation_base : public task {
     void set_state(future_state<T...>&& state) {
         _state = std::move(state);
     }
+    // Fails the continuation, so that then() skips its function and
+    // passes the error on; functions which see exceptions, such as
+    // finally(), still run.
+    virtual void cancel_and_dispose() noexcept override {
+        _state = future_state<T...>(exception_future_marker(), std::exception_ptr(internal::deadline_exceeded_exception()));
+        this->run_and_dispose();
+    }
     friend class promise<T...>;
     friend class future<T...>;
 };
 
+// Allocated in the current arena, if the arena::scope that made it
+// current allows it
 template <typename Func, typename... T>
-struct continuation final : continuation_base<T...> {
+struct continuation final : continuation_base<T...>, internal::allocated_in_continuation_arena {
     continuation(Func&& func, future_state<T...>&& state) : continuation_base<T...>(std::move(state)), _func(std::move(func)) {}
     continuation(Func&& func) : _func(std::move(func)) {}
     virtual void run_and_dispose() noexcept override {
@@ -426,6 +436,13 @@ class promise_base {
     promise_base(promise_base&& x) noexcept;
     void check_during_destruction() noexcept;
 
+#if SEASTAR_COROUTINES_TS
+    void set_coroutine(future_state_base& state, task& coroutine) noexcept {
+        _state = &state;
+        _task = std::unique_ptr<task>(&coroutine);
+    }
+#endif
+
     void operator=(const promise_base&) = delete;
     promise_base& operator=(promise_base&& x) noexcept {
         this->~promise_base();
@@ -526,12 +543,6 @@ class promise : private internal::promise_base {
         set_exception(make_exception_ptr(std::forward<Exception>(e)));
     }
 
-#if SEASTAR_COROUTINES_TS
-    void set_coroutine(future_state<T...>& state, task& coroutine) noexcept {
-        _state = &state;
-        _task = std::unique_ptr<task>(&coroutine);
-    }
-#endif
 private:
     template <typename Func>
     void schedule(Func&& func) {
@@ -1206,9 +1217,9 @@ class future : private internal::future_base {
 
 #if SEASTAR_COROUTINES_TS
     void set_coroutine(task& coroutine) noexcept {
-        assert(!state()->available());
+        assert(!_state.available());
         assert(_promise);
-        detach_promise()->set_coroutine(_local_state, coroutine);
+        detach_promise()->set_coroutine(_state, coroutine);
     }
 #endif
 private:
@@ -0,0 +1,308 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/circular_buffer.hh>
+#include <seastar/core/iostream.hh>
+#include <seastar/core/pipe.hh>
+#include <seastar/util/std-compat.hh>
+#include <algorithm>
+
+namespace seastar {
+
+/// \addtogroup fiber-module
+/// @{
+
+/// \brief An asynchronous stream of values, produced by a coroutine.
+///
+/// A coroutine returning a generator<T> produces its values with
+/// \c co_yield and ends with \c co_return (or by running off its end).
+/// It may \c co_await futures in between, but no other awaitables.
+///
+/// The coroutine only runs when its values are asked for: next() resumes
+/// it, and it then runs until it has yielded a batch of up to
+/// max_buffered() values, or until it waits for a future, whichever comes
+/// first. The values it yielded are buffered in the generator and are
+/// returned by the following calls to next() without resuming it again,
+/// so consuming a buffered value costs no allocation. Once the buffer is
+/// full, the coroutine stays suspended until the consumer drains it, so a
+/// slow consumer holds back the producer.
+///
+/// An exception thrown by the coroutine is returned by next() once the
+/// values yielded before it are consumed.
+///
+/// Destroying the generator destroys the coroutine. If the coroutine is
+/// waiting for a future at that time, it is destroyed when it next
+/// yields or returns, and the values it yields are dropped.
+template <typename T>
+class generator {
+public:
+    class promise_type;
+private:
+    using handle_type = std::experimental::coroutine_handle<promise_type>;
+    handle_type _coro;
+private:
+    explicit generator(handle_type coro) noexcept : _coro(coro) {}
+    static future<compat::optional<T>> next(handle_type coro);
+public:
+    generator(generator&& x) noexcept : _coro(std::exchange(x._coro, handle_type())) {}
+    generator(const generator&) = delete;
+    generator& operator=(generator&& x) noexcept {
+        if (this != &x) {
+            this->~generator();
+            new (this) generator(std::move(x));
+        }
+        return *this;
+    }
+    ~generator();
+
+    /// Returns the next value, or a disengaged optional once the
+    /// coroutine returned and all its values were consumed.
+    ///
+    /// Must not be called again until the returned future resolves.
+    future<compat::optional<T>> next() {
+        return next(_coro);
+    }
+
+    /// The number of values the coroutine may yield ahead of the consumer
+    size_t max_buffered() const noexcept {
+        return _coro.promise()._max_buffered;
+    }
+    /// Sets the number of values the coroutine may yield ahead of the
+    /// consumer, which is also how many it yields at most each time it is
+    /// resumed. Defaults to 16.
+    void set_max_buffered(size_t n) noexcept {
+        _coro.promise()._max_buffered = std::max<size_t>(n, 1);
+    }
+};
+
+template <typename T>
+class generator<T>::promise_type final : public task {
+    enum class state {
+        // Not started yet, or stopped after yielding a full buffer
+        suspended,
+        running,
+        awaiting,
+        done,
+    };
+    circular_buffer<T> _buffer;
+    size_t _max_buffered = 16;
+    compat::optional<promise<>> _consumer;
+    std::exception_ptr _ex;
+    state _state = state::suspended;
+    bool _abandoned = false;
+
+    friend class generator;
+
+    // Suspends the coroutine if \c ready is false; used for co_yield
+    // and for the final suspend point.
+    struct yield_awaiter {
+        promise_type& _p;
+        bool _ready;
+
+        bool await_ready() const noexcept {
+            return _ready;
+        }
+        void await_suspend(handle_type coro) noexcept {
+            _p.on_suspend(coro);
+        }
+        void await_resume() noexcept { }
+    };
+
+    // Awaits a future, first letting a waiting consumer have the values
+    // yielded so far.
+    template <typename... U>
+    struct future_awaiter : internal::awaiter<U...> {
+        promise_type& _p;
+
+        future_awaiter(promise_type& p, future<U...>&& f) noexcept
+            : internal::awaiter<U...>(std::move(f)), _p(p) { }
+
+        void await_suspend(handle_type coro) noexcept {
+            _p._state = state::awaiting;
+            if (!_p._buffer.empty()) {
+                _p.wake_consumer();
+            }
+            internal::awaiter<U...>::await_suspend(coro);
+        }
+    };
+
+    void wake_consumer() noexcept {
+        if (_consumer) {
+            _consumer->set_value();
+            _consumer = compat::nullopt;
+        }
+    }
+    void on_suspend(handle_type coro) noexcept {
+        if (_abandoned) {
+            coro.destroy();
+            return;
+        }
+        if (_state != state::done) {
+            _state = state::suspended;
+        }
+        wake_consumer();
+    }
+public:
+    promise_type() = default;
+    promise_type(promise_type&&) = delete;
+    promise_type(const promise_type&) = delete;
+
+    static void* operator new(size_t size) {
+        return internal::local_coroutine_frame_allocator().allocate(size);
+    }
+    static void operator delete(void* p, size_t size) noexcept {
+        internal::local_coroutine_frame_allocator().deallocate(p, size);
+    }
+
+    generator get_return_object() noexcept {
+        return generator(handle_type::from_promise(*this));
+    }
+
+    std::experimental::suspend_always initial_suspend() noexcept { return { }; }
+    yield_awaiter final_suspend() noexcept {
+        _state = state::done;
+        return yield_awaiter{*this, false};
+    }
+
+    template <typename U>
+    yield_awaiter yield_value(U&& value) {
+        if (_abandoned) {
+            return yield_awaiter{*this, false};
+        }
+        _buffer.push_back(std::forward<U>(value));
+        return yield_awaiter{*this, _buffer.size() < _max_buffered};
+    }
+
+    template <typename... U>
+    future_awaiter<U...> await_transform(future<U...>&& f) noexcept {
+        return future_awaiter<U...>(*this, std::move(f));
+    }
+
+    void return_void() noexcept { }
+    void unhandled_exception() noexcept {
+        _ex = std::current_exception();
+    }
+
+    virtual void run_and_dispose() noexcept override {
+        _state = state::running;
+        handle_type::from_promise(*this).resume();
+    }
+};
+
+template <typename T>
+future<compat::optional<T>> generator<T>::next(handle_type coro) {
+    auto& p = coro.promise();
+    if (p._buffer.empty() && p._state == promise_type::state::suspended) {
+        p._state = promise_type::state::running;
+        coro.resume();
+    }
+    if (!p._buffer.empty()) {
+        auto value = std::move(p._buffer.front());
+        p._buffer.pop_front();
+        return make_ready_future<compat::optional<T>>(std::move(value));
+    }
+    if (p._state == promise_type::state::done) {
+        if (p._ex) {
+            return make_exception_future<compat::optional<T>>(p._ex);
+        }
+        return make_ready_future<compat::optional<T>>();
+    }
+    p._consumer.emplace();
+    return p._consumer->get_future().then([coro] {
+        return next(coro);
+    });
+}
+
+template <typename T>
+generator<T>::~generator() {
+    if (_coro) {
+        auto& p = _coro.promise();
+        if (p._state == promise_type::state::awaiting) {
+            p._abandoned = true;
+            p._buffer.clear();
+        } else {
+            _coro.destroy();
+        }
+    }
+}
+
+/// Returns a generator of the buffers read from an input stream, which
+/// it closes at end of stream.
+inline
+generator<temporary_buffer<char>> make_generator(input_stream<char> in) {
+    while (true) {
+        auto buf = co_await in.read();
+        if (buf.empty()) {
+            break;
+        }
+        co_yield std::move(buf);
+    }
+    co_await in.close();
+}
+
+/// Returns a generator of the values read from a pipe.
+template <typename T>
+generator<T> make_generator(pipe_reader<T> in) {
+    while (auto value = co_await in.read()) {
+        co_yield std::move(*value);
+    }
+}
+
+/// \cond internal
+namespace internal {
+
+class generator_data_source_impl final : public data_source_impl {
+    generator<temporary_buffer<char>> _gen;
+public:
+    explicit generator_data_source_impl(generator<temporary_buffer<char>> gen) noexcept
+        : _gen(std::move(gen)) { }
+    virtual future<temporary_buffer<char>> get() override {
+        return _gen.next().then([] (compat::optional<temporary_buffer<char>> buf) {
+            return buf ? std::move(*buf) : temporary_buffer<char>();
+        });
+    }
+};
+
+}
+/// \endcond
+
+/// Returns an input stream of the buffers yielded by a generator, which
+/// must not yield empty buffers, since those mark the end of a stream.
+inline
+input_stream<char> make_generator_input_stream(generator<temporary_buffer<char>> gen) {
+    return input_stream<char>(data_source(std::make_unique<internal::generator_data_source_impl>(std::move(gen))));
+}
+
+/// Writes the values of a generator to a pipe, and closes it once the
+/// generator is exhausted.
+template <typename T>
+future<> write_to(generator<T> gen, pipe_writer<T> out) {
+    while (auto value = co_await gen.next()) {
+        co_await out.write(std::move(*value));
+    }
+}
+
+/// @}
+
+}
@@ -0,0 +1,113 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace seastar {
+
+namespace internal {
+
+// Caches freed coroutine frames, so that the frame of a new coroutine can
+// usually be taken from a free list instead of the general allocator.
+//
+// A given coroutine function always needs a frame of the same size, and a
+// request handler calls the same few coroutines over and over, so frames
+// are kept in free lists by size class, each holding up to a bounded
+// number of frames. Frames larger than the largest class are not cached.
+//
+// Frames are returned to the free lists of the thread that frees them,
+// which for coroutines is the shard they ran on.
+class coroutine_frame_allocator {
+public:
+    static constexpr size_t granularity = 64;
+    static constexpr unsigned nr_classes = 16;
+    static constexpr size_t max_cached_size = granularity * nr_classes;
+    static constexpr unsigned max_cached_per_class = 128;
+private:
+    struct free_frame {
+        free_frame* next;
+    };
+    std::array<free_frame*, nr_classes> _free{};
+    std::array<unsigned, nr_classes> _nr_free{};
+private:
+    static unsigned size_class(size_t size) noexcept {
+        return (size - 1) / granularity;
+    }
+    static size_t class_size(unsigned c) noexcept {
+        return (c + 1) * granularity;
+    }
+public:
+    coroutine_frame_allocator() = default;
+    coroutine_frame_allocator(const coroutine_frame_allocator&) = delete;
+    ~coroutine_frame_allocator() {
+        for (auto& head : _free) {
+            while (head) {
+                ::operator delete(std::exchange(head, head->next));
+            }
+        }
+    }
+    void* allocate(size_t size) {
+        if (size > max_cached_size) {
+            return ::operator new(size);
+        }
+        auto c = size_class(size);
+        if (auto f = _free[c]) {
+            _free[c] = f->next;
+            --_nr_free[c];
+            return f;
+        }
+        // Round up, so that the frame can be reused by any coroutine
+        // of the same class.
+        return ::operator new(class_size(c));
+    }
+    void deallocate(void* p, size_t size) noexcept {
+        if (size > max_cached_size) {
+            ::operator delete(p);
+            return;
+        }
+        auto c = size_class(size);
+        if (_nr_free[c] == max_cached_per_class) {
+            ::operator delete(p);
+            return;
+        }
+        _free[c] = new (p) free_frame{_free[c]};
+        ++_nr_free[c];
+    }
+    // Number of frames cached for sizes in the class of \c size
+    unsigned cached(size_t size) const noexcept {
+        return size > max_cached_size ? 0 : _nr_free[size_class(size)];
+    }
+};
+
+inline
+coroutine_frame_allocator& local_coroutine_frame_allocator() noexcept {
+    static thread_local coroutine_frame_allocator allocator;
+    return allocator;
+}
+
+}
+
+}
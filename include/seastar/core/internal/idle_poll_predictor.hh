@@ -0,0 +1,93 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright 2019 ScyllaDB
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+
+namespace seastar {
+
+namespace internal {
+
+// Learns how long an idle shard should poll before going to sleep, from
+// the lengths of its recent idle periods, that is, from how long it took
+// for new work to arrive once the shard ran out of it.
+//
+// Polling only pays off if work usually arrives before the poll time
+// runs out. If most idle periods are longer than the maximum poll time,
+// as on a mostly idle shard, the shard goes to sleep right away. If they
+// are shorter, it polls for a little longer than nearly all of them
+// took, up to the maximum poll time.
+class idle_poll_predictor {
+public:
+    using duration = std::chrono::nanoseconds;
+    // Idle periods are collected in windows of this many, and the poll
+    // time is recomputed at the end of every window.
+    static constexpr unsigned window = 32;
+private:
+    std::array<duration, window> _periods{};
+    unsigned _recorded = 0;
+    duration _max_poll_time;
+    duration _poll_time;
+public:
+    explicit idle_poll_predictor(duration max_poll_time) noexcept
+        : _max_poll_time(max_poll_time), _poll_time(max_poll_time) {}
+    // Sets the upper bound on the poll time, and starts learning anew.
+    void set_max_poll_time(duration max_poll_time) noexcept {
+        _max_poll_time = _poll_time = max_poll_time;
+        _recorded = 0;
+    }
+    duration max_poll_time() const noexcept {
+        return _max_poll_time;
+    }
+    // How long to poll, from the start of an idle period, before sleeping
+    duration poll_time() const noexcept {
+        return _poll_time;
+    }
+    // Records the length of an idle period which ended with new work.
+    void record(duration idle_period) noexcept {
+        _periods[_recorded++] = idle_period;
+        if (_recorded == window) {
+            _recorded = 0;
+            recompute();
+        }
+    }
+private:
+    void recompute() noexcept {
+        auto periods = _periods;
+        auto median = periods.begin() + window / 2;
+        std::nth_element(periods.begin(), median, periods.end());
+        if (*median > _max_poll_time) {
+            _poll_time = duration(0);
+            return;
+        }
+        auto p90 = periods.begin() + window * 9 / 10;
+        std::nth_element(median, p90, periods.end());
+        // Leave some slack for arrivals which are a bit late
+        _poll_time = *p90 < _max_poll_time / 2 ? 2 * *p90 : _max_poll_time;
+    }
+};
+
+}
+
+}
@@ -0,0 +1,104 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright 2019 ScyllaDB
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <seastar/core/metrics_types.hh>
+
+namespace seastar {
+
+namespace internal {
+
+// A histogram of durations with log-linear buckets: every power-of-two
+// range of microseconds is split into 2^sub_bucket_bits (8) equal buckets,
+// so a quantile estimated from the bucket bounds is at most 12.5% above
+// the true value, at every scale. This takes 184 buckets (1.5KB).
+// Recording a sample costs a few instructions and never allocates, so it
+// can be done on every scheduling decision.
+class log_histogram {
+public:
+    static constexpr unsigned sub_bucket_bits = 3;
+    static constexpr unsigned sub_buckets = 1u << sub_bucket_bits;
+    // Samples of 2^max_exponent microseconds (~33s) and above are only
+    // counted in the implicit +Inf bucket
+    static constexpr unsigned max_exponent = 25;
+    static constexpr unsigned nr_buckets = sub_buckets * (max_exponent - sub_bucket_bits + 1);
+private:
+    std::array<uint64_t, nr_buckets> _buckets{};
+    uint64_t _count = 0;
+    uint64_t _sum = 0; // in microseconds
+public:
+    // Values below 2 * sub_buckets have a bucket of their own; above that,
+    // the bucket is given by the value's exponent and its top
+    // sub_bucket_bits bits below the leading one.
+    static unsigned bucket_of(uint64_t us) {
+        unsigned log2 = 63 - __builtin_clzll(us | 1);
+        unsigned e = log2 > sub_bucket_bits ? log2 - sub_bucket_bits : 0;
+        return sub_buckets * e + (us >> e);
+    }
+    // Inclusive upper bound of a bucket, in microseconds
+    static uint64_t upper_bound(unsigned bucket) {
+        if (bucket < 2 * sub_buckets) {
+            return bucket;
+        }
+        unsigned e = bucket / sub_buckets - 1;
+        uint64_t mantissa = bucket % sub_buckets + sub_buckets;
+        return ((mantissa + 1) << e) - 1;
+    }
+    void add(uint64_t us) {
+        auto b = bucket_of(us);
+        if (b < nr_buckets) {
+            ++_buckets[b];
+        }
+        ++_count;
+        _sum += us;
+    }
+    template <typename Rep, typename Period>
+    void add(std::chrono::duration<Rep, Period> d) {
+        add(std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(d).count(), 0));
+    }
+    uint64_t count() const {
+        return _count;
+    }
+    // Exports the histogram with cumulative bucket counts, as expected by
+    // the metrics layer; upper bounds and sum are in microseconds.
+    metrics::histogram to_metrics_histogram() const {
+        metrics::histogram h;
+        h.sample_count = _count;
+        h.sample_sum = _sum;
+        h.buckets.resize(nr_buckets);
+        uint64_t cumulative = 0;
+        for (unsigned i = 0; i < nr_buckets; ++i) {
+            cumulative += _buckets[i];
+            h.buckets[i].count = cumulative;
+            h.buckets[i].upper_bound = upper_bound(i);
+        }
+        return h;
+    }
+};
+
+}
+
+}
@@ -57,6 +57,11 @@ class pollable_fd_state {
     int events_requested = 0; // wanted by pollin/pollout promises
     int events_epoll = 0;     // installed in epoll
     int events_known = 0;     // returned from epoll
+    // Socket operations submitted to the kernel as a whole by the reactor
+    // backend, identified by a backend-specific token (0 if none); they are
+    // cancelled before the fd is forgotten.
+    uint64_t async_read = 0;  // recv or accept
+    uint64_t async_write = 0; // send or sendmsg
     promise<> pollin;
     promise<> pollout;
     friend class reactor;
@@ -0,0 +1,120 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright 2019 ScyllaDB
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <seastar/core/cacheline.hh>
+
+namespace seastar {
+
+namespace internal {
+
+// A bounded single-producer, single-consumer ring for cross-shard messages.
+//
+// Each side owns one index and keeps a private copy of the other side's,
+// which it only refreshes when the copy says the ring is full (producer) or
+// empty (consumer). Indices are published once per push()/pop() call, so a
+// batch of messages costs one cache line transfer per index, rather than one
+// per message. The indices and the private copies live on separate cache
+// lines so neither side's bookkeeping invalidates the other's.
+template <typename T, size_t Capacity>
+class spsc_ring {
+    static_assert((Capacity & (Capacity - 1)) == 0, "spsc_ring capacity must be a power of two");
+    static constexpr size_t mask = Capacity - 1;
+
+    // written by the producer
+    alignas(cache_line_size) std::atomic<size_t> _tail = { 0 };
+    alignas(cache_line_size) size_t _head_cache = 0;
+    // written by the consumer
+    alignas(cache_line_size) std::atomic<size_t> _head = { 0 };
+    alignas(cache_line_size) size_t _tail_cache = 0;
+    alignas(cache_line_size) std::array<T, Capacity> _items;
+public:
+    static constexpr size_t capacity() {
+        return Capacity;
+    }
+
+    // Producer side. Pushes as many elements of [begin, end) as fit, and
+    // returns an iterator past the last pushed one.
+    template <typename Iterator>
+    Iterator push(Iterator begin, Iterator end) {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        size_t want = std::distance(begin, end);
+        if (Capacity - (tail - _head_cache) < want) {
+            _head_cache = _head.load(std::memory_order_acquire);
+        }
+        auto n = std::min(want, Capacity - (tail - _head_cache));
+        for (size_t i = 0; i != n; ++i) {
+            _items[(tail + i) & mask] = *begin++;
+        }
+        if (n) {
+            _tail.store(tail + n, std::memory_order_release);
+        }
+        return begin;
+    }
+
+    // Consumer side. Pops up to max elements into out, and returns their number.
+    size_t pop(T* out, size_t max) {
+        auto head = _head.load(std::memory_order_relaxed);
+        if (_tail_cache == head) {
+            _tail_cache = _tail.load(std::memory_order_acquire);
+        }
+        auto n = std::min(max, _tail_cache - head);
+        for (size_t i = 0; i != n; ++i) {
+            out[i] = std::move(_items[(head + i) & mask]);
+        }
+        if (n) {
+            _head.store(head + n, std::memory_order_release);
+        }
+        return n;
+    }
+
+    // Consumer side; does not refresh the private copy, so that it can be
+    // used for polling from const contexts.
+    bool empty() const {
+        return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_relaxed);
+    }
+
+    // Number of elements pushed but not yet popped. May be called from
+    // either side, or from a third party, in which case it's approximate.
+    size_t occupancy() const {
+        auto head = _head.load(std::memory_order_relaxed);
+        auto tail = _tail.load(std::memory_order_relaxed);
+        return tail - std::min(head, tail);
+    }
+
+    // Pops all remaining elements; only safe once the producer has stopped.
+    template <typename Func>
+    void consume_all(Func&& func) {
+        T item;
+        while (pop(&item, 1)) {
+            func(item);
+        }
+    }
+};
+
+}
+
+}
@@ -0,0 +1,93 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/task.hh>
+#include <cstddef>
+#include <memory>
+
+namespace seastar {
+
+namespace internal {
+
+// A FIFO of tasks, linked through the tasks themselves.
+//
+// Queueing a task costs no memory of its own, and the run loop finds the
+// next task without going through a separately allocated array of
+// pointers. The list owns its tasks: they enter and leave it as
+// std::unique_ptr, and those left in it when it is destroyed are deleted.
+class task_list {
+    task* _head = nullptr;
+    task* _tail = nullptr;
+    size_t _size = 0;
+public:
+    task_list() = default;
+    task_list(const task_list&) = delete;
+    ~task_list() {
+        while (!empty()) {
+            pop_front();
+        }
+    }
+    bool empty() const noexcept {
+        return !_head;
+    }
+    size_t size() const noexcept {
+        return _size;
+    }
+    // The task that pop_front() would return, or nullptr
+    task* front() const noexcept {
+        return _head;
+    }
+    void push_back(std::unique_ptr<task> t) noexcept {
+        auto p = t.release();
+        p->_next = nullptr;
+        if (_tail) {
+            _tail->_next = p;
+        } else {
+            _head = p;
+        }
+        _tail = p;
+        ++_size;
+    }
+    void push_front(std::unique_ptr<task> t) noexcept {
+        auto p = t.release();
+        p->_next = _head;
+        _head = p;
+        if (!_tail) {
+            _tail = p;
+        }
+        ++_size;
+    }
+    std::unique_ptr<task> pop_front() noexcept {
+        auto p = _head;
+        _head = p->_next;
+        if (!_head) {
+            _tail = nullptr;
+        }
+        --_size;
+        return std::unique_ptr<task>(p);
+    }
+};
+
+}
+
+}
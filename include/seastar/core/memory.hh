@@ -25,10 +25,14 @@
 #include <seastar/core/bitops.hh>
 #include <new>
 #include <functional>
+#include <iosfwd>
 #include <vector>
 
 namespace seastar {
 
+template <typename... T>
+class future;
+
 /// \defgroup memory-module Memory management
 ///
 /// Functions and classes for managing memory.
@@ -73,8 +77,27 @@ static constexpr size_t huge_page_size =
 #error "Huge page size is not defined for this architecture"
 #endif
 
+// How a shard's memory is backed by huge pages, unless it is mapped
+// from a hugetlbfs mount.
+enum class huge_pages_mode {
+    // Transparent huge pages, requested with madvise(MADV_HUGEPAGE)
+    transparent,
+    // The kernel's pool of reserved huge pages (MAP_HUGETLB). Memory the
+    // pool can't provide falls back to transparent huge pages.
+    hugetlb,
+    // Base pages only
+    none,
+};
+
 void configure(std::vector<resource::memory> m, bool mbind,
-        compat::optional<std::string> hugetlbfs_path = {});
+        compat::optional<std::string> hugetlbfs_path = {},
+        huge_pages_mode hp_mode = huge_pages_mode::transparent);
+
+// Faults in all of the current shard's memory, which configure() only
+// reserves, so that allocations don't take page faults later. Pages are
+// placed according to the policy configure() set, or on the faulting
+// thread's NUMA node.
+void prefault();
 
 void enable_abort_on_allocation_failure();
 
@@ -84,8 +107,71 @@ class disable_abort_on_alloc_failure_temporarily {
     ~disable_abort_on_alloc_failure_temporarily() noexcept;
 };
 
+/// \endcond
+
+/// Enables or disables heap profiling on this shard.
+///
+/// Enabling it samples one allocation every 512KiB allocated, on average;
+/// see set_heap_profiling_sample_period().
 void set_heap_profiling_enabled(bool);
 
+/// Sets the mean number of bytes allocated on this shard between two
+/// sampled allocations; 0 disables heap profiling.
+///
+/// A sampled allocation has its backtrace recorded, and is accounted to
+/// that backtrace until it is freed. Larger allocations are more likely
+/// to be sampled: an allocation of \c s bytes is sampled with probability
+/// \c 1-exp(-s/period), which is what lets pprof estimate the number and
+/// size of all allocations from the samples. Other allocations only pay
+/// for decrementing a counter.
+///
+/// Heap profiling requires Seastar to be built with it enabled
+/// (\c Seastar_HEAP_PROFILING), which adds a pointer to every small
+/// object; otherwise this function only logs a warning.
+void set_heap_profiling_sample_period(size_t bytes);
+
+/// Returns this shard's heap profiling sample period, or 0 if heap
+/// profiling is disabled.
+size_t heap_profiling_sample_period();
+
+/// The allocations sampled by the heap profiler.
+struct heap_profile {
+    /// The samples taken at one backtrace
+    struct site {
+        /// Return addresses, innermost first
+        std::vector<uintptr_t> backtrace;
+        /// Number of sampled objects that are still allocated
+        size_t live_objects = 0;
+        /// Total size of the sampled objects that are still allocated
+        size_t live_bytes = 0;
+        /// Number of objects ever sampled
+        size_t total_objects = 0;
+        /// Total size of the objects ever sampled
+        size_t total_bytes = 0;
+    };
+    /// The sample period the profile was taken with
+    size_t sample_period = 0;
+    std::vector<site> sites;
+
+    /// Adds the samples of \c o, taken with the same sample period, to
+    /// this profile, merging sites with equal backtraces.
+    void merge(const heap_profile& o);
+};
+
+/// Returns the allocations sampled so far on this shard.
+heap_profile sample_heap_profile();
+
+/// Returns the allocations sampled so far on all shards, merged into
+/// a single profile.
+future<heap_profile> sample_heap_profile_on_all_shards();
+
+/// Writes \c profile in the legacy text format of the gperftools heap
+/// profiler, followed by this process' memory mappings, which pprof
+/// needs to symbolize it. Reads \c /proc/self/maps synchronously.
+void write_heap_profile(std::ostream& out, const heap_profile& profile);
+
+/// \cond internal
+
 enum class reclaiming_result {
     reclaimed_nothing,
     reclaimed_something
@@ -166,11 +252,17 @@ class statistics {
     size_t _free_memory;
     uint64_t _reclaims;
     uint64_t _large_allocs;
+    size_t _free_huge_pages;
+    size_t _released_memory;
+    uint64_t _total_released_memory;
 private:
     statistics(uint64_t mallocs, uint64_t frees, uint64_t cross_cpu_frees,
-            uint64_t total_memory, uint64_t free_memory, uint64_t reclaims, uint64_t large_allocs)
+            uint64_t total_memory, uint64_t free_memory, uint64_t reclaims, uint64_t large_allocs,
+            size_t free_huge_pages, size_t released_memory, uint64_t total_released_memory)
         : _mallocs(mallocs), _frees(frees), _cross_cpu_frees(cross_cpu_frees)
-        , _total_memory(total_memory), _free_memory(free_memory), _reclaims(reclaims), _large_allocs(large_allocs) {}
+        , _total_memory(total_memory), _free_memory(free_memory), _reclaims(reclaims), _large_allocs(large_allocs)
+        , _free_huge_pages(free_huge_pages), _released_memory(released_memory)
+        , _total_released_memory(total_released_memory) {}
 public:
     /// Total number of memory allocations calls since the system was started.
     uint64_t mallocs() const { return _mallocs; }
@@ -191,6 +283,20 @@ class statistics {
     uint64_t reclaims() const { return _reclaims; }
     /// Number of allocations which violated the large allocation threshold
     uint64_t large_allocations() const { return _large_allocs; }
+    /// Number of huge pages (of \ref huge_page_size bytes) in this lcore's
+    /// memory
+    size_t huge_pages() const { return _total_memory / huge_page_size; }
+    /// Number of huge pages holding no allocated memory
+    size_t free_huge_pages() const { return _free_huge_pages; }
+    /// Number of huge pages holding allocated memory. Since each takes one
+    /// TLB entry when backed by a huge page, this approximates the number
+    /// of TLB entries needed to cover all allocated memory.
+    size_t huge_pages_in_use() const { return huge_pages() - free_huge_pages(); }
+    /// Free memory (in bytes) currently returned to the kernel; see
+    /// release_idle_free_memory()
+    size_t released_memory() const { return _released_memory; }
+    /// Total memory (in bytes) ever returned to the kernel
+    uint64_t total_released_memory() const { return _total_released_memory; }
     friend statistics stats();
 };
 
@@ -203,6 +309,20 @@ struct memory_layout {
 // Supported only when seastar allocator is enabled.
 memory::memory_layout get_memory_layout();
 
+/// Returns free memory that has stayed unused for a while to the kernel.
+///
+/// Releases the free memory of this shard that was already free at the
+/// previous call, in free spans of at least a huge page, while keeping
+/// at least min_free_memory() in memory. Called periodically, it releases
+/// memory that stayed free for one to two periods. Released memory stays
+/// free memory of the shard; allocating it costs a page fault, and the
+/// kernel provides it zeroed.
+///
+/// The reactor calls this every \c --release-idle-memory-ms.
+///
+/// \return the number of bytes released
+size_t release_idle_free_memory();
+
 /// Returns the value of free memory low water mark in bytes.
 /// When free memory is below this value, reclaimers are invoked until it goes above again.
 size_t min_free_memory();
@@ -210,6 +330,48 @@ size_t min_free_memory();
 /// Sets the value of free memory low water mark in memory::page_size units.
 void set_min_free_pages(size_t pages);
 
+/// \cond internal
+
+// Memory is accounted to the scheduling group that allocates it, by the
+// group's index (see internal::scheduling_group_index()). Groups with an
+// index of max_accounted_scheduling_groups or more are accounted with the
+// default group. The spans of the small object pools of a group count in
+// full, including the free objects cached in them.
+//
+// Each accounted group has small object pools of its own, which take
+// about 2.7KB per thread, and may cache free objects once the group
+// allocates. 16 covers the groups of typical applications for under
+// 45KB per thread.
+static constexpr unsigned max_accounted_scheduling_groups = 16;
+
+// Memory (in bytes) accounted to a scheduling group on this shard
+size_t scheduling_group_memory_usage(unsigned group);
+
+// Number of allocations that failed since they would have taken the
+// group over its hard limit
+uint64_t scheduling_group_memory_limit_failures(unsigned group);
+
+// See scheduling_group::set_memory_limits()
+void set_scheduling_group_memory_limits(unsigned group, size_t soft_limit, size_t hard_limit);
+
+// See scheduling_group::set_memory_pressure_handler()
+void set_scheduling_group_memory_pressure_handler(unsigned group, std::function<void (bool)> handler);
+
+// Called when a group is destroyed, and its index may be reused: the
+// memory it still uses is charged to the default group, and its limits
+// and pressure handler are dropped.
+void reset_scheduling_group_memory(unsigned group);
+
+// Allocates a page aligned chunk of at least \c size bytes for an arena.
+// Freeing an object in the chunk does nothing. Throws std::bad_alloc if
+// out of memory.
+void* allocate_arena_chunk(size_t size);
+
+// Frees a chunk allocated with allocate_arena_chunk(), on the same shard
+void free_arena_chunk(void* chunk) noexcept;
+
+/// \endcond
+
 /// Enable the large allocation warning threshold.
 ///
 /// Warn when allocation above a given threshold are performed.
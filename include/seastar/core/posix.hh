@@ -120,6 +120,11 @@ class file_desc {
         return file_desc(fd);
     }
     static file_desc temporary(sstring directory);
+    // Takes ownership of a file descriptor obtained outside of file_desc,
+    // e.g. from an asynchronous accept completed by the kernel.
+    static file_desc from_fd(int fd) {
+        return file_desc(fd);
+    }
     file_desc dup() const {
         int fd = ::dup(get());
         throw_system_error_on(fd == -1, "dup");
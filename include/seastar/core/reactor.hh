@@ -25,6 +25,7 @@
 #include <seastar/core/iostream.hh>
 #include <seastar/core/aligned_buffer.hh>
 #include <seastar/core/cacheline.hh>
+#include <seastar/core/bitops.hh>
 #include <seastar/core/circular_buffer_fixed_capacity.hh>
 #include <memory>
 #include <type_traits>
@@ -48,7 +49,6 @@
 #include <stack>
 #include <seastar/util/std-compat.hh>
 #include <boost/next_prior.hpp>
-#include <boost/lockfree/spsc_queue.hpp>
 #include <boost/optional.hpp>
 #include <boost/program_options.hpp>
 #include <boost/thread/barrier.hpp>
@@ -78,7 +78,12 @@
 #include <seastar/core/manual_clock.hh>
 #include <seastar/core/metrics_registration.hh>
 #include <seastar/core/scheduling.hh>
+#include <seastar/core/tracing.hh>
 #include "internal/pollable_fd.hh"
+#include "internal/log_histogram.hh"
+#include "internal/task_list.hh"
+#include "internal/spsc_ring.hh"
+#include "internal/idle_poll_predictor.hh"
 
 #ifdef HAVE_OSV
 #include <osv/sched.hh>
@@ -232,30 +237,110 @@ struct smp_service_group_config {
 };
 
 
+// The peers a shard needs to poll cross-shard queues for.
+//
+// Peers mark themselves here when they publish requests or completions to
+// the shard; the shard marks peers it has requests or responses to publish
+// to. Polling then only touches the queues of marked peers, instead of all
+// 2 * (smp::count - 1) queues. Peers are numbered in polling order: those
+// on the shard's own NUMA node first.
+class smp_peer_summary {
+    static constexpr unsigned bits_per_word = 64;
+    unsigned _nr_words;
+    // written by peers
+    std::unique_ptr<std::atomic<uint64_t>[]> _remote;
+    // written by the owning shard
+    std::unique_ptr<uint64_t[]> _local;
+    // peer shard at each position, and position of each shard
+    std::vector<unsigned> _peers;
+    std::vector<unsigned> _index_of;
+public:
+    explicit smp_peer_summary(unsigned self);
+    unsigned index_of(unsigned shard) const {
+        return _index_of[shard];
+    }
+    // Called by a peer, after publishing to one of the shard's queues
+    void mark_remote(unsigned index) {
+        _remote[index / bits_per_word].fetch_or(uint64_t(1) << (index % bits_per_word), std::memory_order_release);
+    }
+    // Called by the owning shard
+    void mark_local(unsigned index) {
+        _local[index / bits_per_word] |= uint64_t(1) << (index % bits_per_word);
+    }
+    // Clears the set of marked peers, and calls func(shard, index) for each.
+    template <typename Func>
+    void consume(Func&& func) {
+        for (unsigned w = 0; w < _nr_words; ++w) {
+            auto bits = _local[w];
+            if (_remote[w].load(std::memory_order_relaxed)) {
+                bits |= _remote[w].exchange(0, std::memory_order_acquire);
+            }
+            _local[w] = 0;
+            while (bits) {
+                auto index = w * bits_per_word + count_trailing_zeros(bits);
+                bits &= bits - 1;
+                func(_peers[index], index);
+            }
+        }
+    }
+    // Like consume(), for peers marked by the owning shard only
+    template <typename Func>
+    void consume_local(Func&& func) {
+        for (unsigned w = 0; w < _nr_words; ++w) {
+            auto bits = _local[w];
+            _local[w] = 0;
+            while (bits) {
+                auto index = w * bits_per_word + count_trailing_zeros(bits);
+                bits &= bits - 1;
+                func(_peers[index], index);
+            }
+        }
+    }
+    bool has_remote() const {
+        for (unsigned w = 0; w < _nr_words; ++w) {
+            if (_remote[w].load(std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
 class smp_message_queue {
     static constexpr size_t queue_length = 128;
     static constexpr size_t batch_size = 16;
     static constexpr size_t prefetch_cnt = 2;
+    // Work items up to this size are allocated from a per-queue pool of
+    // cache-line-aligned slots, recycled when the item completes, instead
+    // of from the general-purpose allocator; at most queue_length free
+    // slots are retained.
+    static constexpr size_t pooled_item_size = 2 * cache_line_size;
     struct work_item;
     struct lf_queue_remote {
         reactor* remote;
     };
-    using lf_queue_base = boost::lockfree::spsc_queue<work_item*,
-                            boost::lockfree::capacity<queue_length>>;
+    using lf_queue_base = internal::spsc_ring<work_item*, queue_length>;
     // use inheritence to control placement order
     struct lf_queue : lf_queue_remote, lf_queue_base {
         lf_queue(reactor* remote) : lf_queue_remote{remote} {}
         void maybe_wakeup();
-        ~lf_queue();
     };
     lf_queue _pending;
     lf_queue _completed;
+    // Summaries of the receiving and sending shard, and the position of
+    // the other shard in each
+    smp_peer_summary* _to_summary;
+    unsigned _from_index;
+    smp_peer_summary* _from_summary;
+    unsigned _to_index;
     struct alignas(seastar::cache_line_size) {
         size_t _sent = 0;
         size_t _compl = 0;
         size_t _last_snt_batch = 0;
         size_t _last_cmpl_batch = 0;
         size_t _current_queue_length = 0;
+        size_t _send_ring_full = 0;
+        size_t _unpooled_items = 0;
     };
     // keep this between two structures with statistics
     // this makes sure that they have at least one cache line
@@ -270,10 +355,19 @@ class smp_message_queue {
         explicit work_item(smp_service_group ssg) : ssg(ssg) {}
         smp_service_group ssg;
         scheduling_group sg = current_scheduling_group();
+        bool pooled = false;
+        tracing::trace_context trace = tracing::current_trace_context();
         virtual ~work_item() {}
         virtual void process() = 0;
         virtual void complete() = 0;
     };
+    struct work_item_deleter {
+        smp_message_queue* queue;
+        void operator()(work_item* wi) const {
+            queue->destroy_work_item(wi);
+        }
+    };
+    using work_item_ptr = std::unique_ptr<work_item, work_item_deleter>;
     template <typename Func>
     struct async_work_item : work_item {
         smp_message_queue& _queue;
@@ -286,9 +380,13 @@ class smp_message_queue {
         typename futurator::promise_type _promise; // used on local side
         async_work_item(smp_message_queue& queue, smp_service_group ssg, Func&& func) : work_item(ssg), _queue(queue), _func(std::move(func)) {}
         virtual void process() override {
+            // Continue the sender's trace, if it's sampled, until func completes
+            internal::trace_slot_scope scope;
+            tracing::span span(this->trace, "submit_to");
             try {
-              with_scheduling_group(this->sg, [this] {
-                futurator::apply(this->_func).then_wrapped([this] (auto f) {
+              with_scheduling_group(this->sg, [this, span = std::move(span)] () mutable {
+                futurator::apply(this->_func).then_wrapped([this, span = std::move(span)] (auto f) mutable {
+                    span.end();
                     if (f.failed()) {
                         _ex = f.get_exception();
                     } else {
@@ -318,6 +416,10 @@ class smp_message_queue {
         void init() { new (&a) aa; }
         struct aa {
             std::deque<work_item*> pending_fifo;
+            // singly-linked list of free pooled slots
+            void* free_slots = nullptr;
+            size_t nr_free_slots = 0;
+            ~aa();
         } a;
     } _tx;
     std::vector<work_item*> _completed_fifo;
@@ -326,9 +428,22 @@ class smp_message_queue {
     ~smp_message_queue();
     template <typename Func>
     futurize_t<std::result_of_t<Func()>> submit(shard_id t, smp_service_group ssg, Func&& func) {
-        auto wi = std::make_unique<async_work_item<Func>>(*this, ssg, std::forward<Func>(func));
+        using item_type = async_work_item<Func>;
+        constexpr bool pooled = sizeof(item_type) <= pooled_item_size && alignof(item_type) <= cache_line_size;
+        void* p = pooled ? allocate_pooled_slot() : ::operator new(sizeof(item_type));
+        item_type* wi;
+        try {
+            wi = new (p) item_type(*this, ssg, std::forward<Func>(func));
+        } catch (...) {
+            pooled ? release_pooled_slot(p) : ::operator delete(p);
+            throw;
+        }
+        wi->pooled = pooled;
+        if (!pooled) {
+            ++_unpooled_items;
+        }
         auto fut = wi->get_future();
-        submit_item(t, std::move(wi));
+        submit_item(t, work_item_ptr(wi, work_item_deleter{this}));
         return fut;
     }
     void start(unsigned cpuid);
@@ -339,14 +454,16 @@ class smp_message_queue {
     void stop();
 private:
     void work();
-    void submit_item(shard_id t, std::unique_ptr<work_item> wi);
+    void submit_item(shard_id t, work_item_ptr wi);
     void respond(work_item* wi);
     void move_pending();
     void flush_request_batch();
     void flush_response_batch();
     bool has_unflushed_responses() const;
-    bool pure_poll_rx() const;
-    bool pure_poll_tx() const;
+    bool has_unflushed_requests() const;
+    void* allocate_pooled_slot();
+    void release_pooled_slot(void* slot) noexcept;
+    void destroy_work_item(work_item* wi) noexcept;
 
     friend class smp;
 };
@@ -359,6 +476,7 @@ namespace internal {
 
 class reactor_stall_sampler;
 class cpu_stall_detector;
+class cpu_profiler;
 
 }
 
@@ -385,8 +503,10 @@ class reactor {
         virtual bool try_enter_interrupt_mode() { return false; }
         virtual void exit_interrupt_mode() {}
     };
+    struct sched_entity;
     struct task_queue;
-    using task_queue_list = circular_buffer_fixed_capacity<task_queue*, max_scheduling_groups()>;
+    struct task_queue_group;
+    using sched_entity_list = circular_buffer<sched_entity*>;
 
     class io_pollfn;
     class signal_pollfn;
@@ -394,6 +514,7 @@ class reactor {
     class batch_flush_pollfn;
     class smp_pollfn;
     class drain_cross_cpu_freelist_pollfn;
+    class cpu_profiler_pollfn;
     class lowres_timer_pollfn;
     class manual_timer_pollfn;
     class epoll_pollfn;
@@ -405,6 +526,7 @@ class reactor {
     friend batch_flush_pollfn;
     friend smp_pollfn;
     friend drain_cross_cpu_freelist_pollfn;
+    friend cpu_profiler_pollfn;
     friend lowres_timer_pollfn;
     friend class manual_clock;
     friend class epoll_pollfn;
@@ -414,6 +536,8 @@ class reactor {
     friend class internal::reactor_stall_sampler;
     friend class reactor_backend_epoll;
     friend class reactor_backend_aio;
+    friend class reactor_backend_uring;
+    friend class preempt_io_context;
 public:
     class poller {
         std::unique_ptr<pollfn> _pollfn;
@@ -497,12 +621,20 @@ class reactor {
     std::atomic<uint64_t> _tasks_processed = { 0 };
     std::atomic<uint64_t> _polls = { 0 };
     std::unique_ptr<internal::cpu_stall_detector> _cpu_stall_detector;
+    std::unique_ptr<internal::cpu_profiler> _cpu_profiler;
 
     unsigned _max_task_backlog = 1000;
-    timer_set<timer<>, &timer<>::_link> _timers;
-    timer_set<timer<>, &timer<>::_link>::timer_list_t _expired_timers;
-    timer_set<timer<lowres_clock>, &timer<lowres_clock>::_link> _lowres_timers;
-    timer_set<timer<lowres_clock>, &timer<lowres_clock>::_link>::timer_list_t _expired_lowres_timers;
+#ifdef SEASTAR_TIMER_WHEEL
+    template <typename Clock>
+    using reactor_timer_set = timer_wheel<timer<Clock>, &timer<Clock>::_link>;
+#else
+    template <typename Clock>
+    using reactor_timer_set = timer_set<timer<Clock>, &timer<Clock>::_link>;
+#endif
+    reactor_timer_set<steady_clock_type> _timers;
+    reactor_timer_set<steady_clock_type>::timer_list_t _expired_timers;
+    reactor_timer_set<lowres_clock> _lowres_timers;
+    reactor_timer_set<lowres_clock>::timer_list_t _expired_lowres_timers;
     timer_set<timer<manual_clock>, &timer<manual_clock>::_link> _manual_timers;
     timer_set<timer<manual_clock>, &timer<manual_clock>::_link>::timer_list_t _expired_manual_timers;
     internal::linux_abi::aio_context_t _io_context;
@@ -513,29 +645,90 @@ class reactor {
     io_stats _io_stats;
     uint64_t _fsyncs = 0;
     uint64_t _cxx_exceptions = 0;
-    struct task_queue {
-        explicit task_queue(unsigned id, sstring name, float shares);
+    // A node in the scheduling tree: a task_queue (scheduling_group) or a
+    // task_queue_group (scheduling_supergroup), competing for its parent's
+    // CPU time with its active siblings in proportion to its shares.
+    struct sched_entity {
+        sched_entity(task_queue_group* parent, bool is_group, sstring name, float shares);
         int64_t _vruntime = 0;
         float _shares;
         int64_t _reciprocal_shares_times_2_power_32;
-        bool _current = false;
-        bool _active = false;
-        uint8_t _id;
+        bool _active = false; // queued in the parent, or running
+        const bool _is_group;
+        task_queue_group* _parent; // nullptr for the root
         sched_clock::duration _runtime = {};
-        uint64_t _tasks_processed = 0;
-        circular_buffer<std::unique_ptr<task>> _q;
         sstring _name;
         int64_t to_vruntime(sched_clock::duration runtime) const;
         void set_shares(float shares);
         struct indirect_compare;
+    };
+    struct task_queue : sched_entity {
+        explicit task_queue(task_queue_group* parent, unsigned id, sstring name, float shares);
+        bool _current = false;
+        unsigned _id;
+        uint64_t _tasks_processed = 0;
+        internal::task_list _q;
         sched_clock::duration _time_spent_on_task_quota_violations = {};
+        // When the queue last became runnable: activated, or put back
+        // after being preempted
+        sched_clock::time_point _runnable_since;
+        internal::log_histogram _delay_histogram;
+        internal::log_histogram _quantum_histogram;
+        // When set, tasks that carry a deadline are kept in _by_deadline
+        // and run earliest deadline first, and dropped once it passed;
+        // see scheduling_group::set_deadline_ordering()
+        bool _deadline_ordering = false;
+        struct deadline_task {
+            deadline_clock::time_point deadline;
+            uint64_t seq; // keeps tasks with equal deadlines in FIFO order
+            std::unique_ptr<task> t;
+        };
+        struct later_deadline {
+            bool operator()(const deadline_task& a, const deadline_task& b) const {
+                return a.deadline > b.deadline || (a.deadline == b.deadline && a.seq > b.seq);
+            }
+        };
+        std::vector<deadline_task> _by_deadline; // heap, earliest at front
+        uint64_t _deadline_seq = 0;
+        unsigned _deadline_turn = 0;
+        uint64_t _tasks_cancelled = 0;
+        seastar::metrics::metric_groups _metrics;
+        bool empty() const {
+            return _q.empty() && _by_deadline.empty();
+        }
+        size_t size() const {
+            return _q.size() + _by_deadline.size();
+        }
+        void push_by_deadline(std::unique_ptr<task> t);
+        std::unique_ptr<task> pop_by_deadline();
+        std::unique_ptr<task> pop_front() {
+            if (__builtin_expect(!_by_deadline.empty(), false)) {
+                return pop_by_deadline();
+            }
+            return _q.pop_front();
+        }
+        void set_deadline_ordering(bool enabled);
+    };
+    struct task_queue_group : sched_entity {
+        explicit task_queue_group(task_queue_group* parent, unsigned id, sstring name, float shares);
+        unsigned _id;
+        unsigned _nr_children = 0;
+        int64_t _last_vruntime = 0;
+        sched_entity_list _active;
+        sched_entity_list _activating;
         seastar::metrics::metric_groups _metrics;
+        bool has_active() const { return !_active.empty() || !_activating.empty(); }
+        void insert_active(sched_entity* se);
+        void insert_activating();
     };
-    boost::container::static_vector<std::unique_ptr<task_queue>, max_scheduling_groups()> _task_queues;
-    int64_t _last_vruntime = 0;
-    task_queue_list _active_task_queues;
-    task_queue_list _activating_task_queues;
+    // Indexed by scheduling group and supergroup id respectively; destroyed
+    // groups leave a null entry until their id is reused.
+    std::vector<std::unique_ptr<task_queue>> _task_queues;
+    std::vector<std::unique_ptr<task_queue_group>> _task_queue_groups; // [0] is the root
     task_queue* _at_destroy_tasks;
+    // Tasks queued in all task queues; kept as they are pushed and popped,
+    // rather than summed over the queues when needed
+    uint64_t _tasks_pending = 0;
     sched_clock::duration _task_quota;
     /// Handler that will be called when there is no task to execute on cpu.
     /// It represents a low priority work.
@@ -559,16 +752,27 @@ class reactor {
     sched_clock::duration _total_sleep;
     sched_clock::time_point _start_time = sched_clock::now();
     std::chrono::nanoseconds _max_poll_time = calculate_poll_time();
+    std::chrono::milliseconds _release_idle_memory_period{0};
+    // Armed by run(), once the profiler's signal is handled
+    std::chrono::microseconds _cpu_profiler_period{0};
+    // Polling time spent idle, as opposed to sleeping
+    sched_clock::duration _total_idle_poll{};
+    uint64_t _sleeps = 0;
+    internal::log_histogram _idle_periods;
+    bool _idle_poll_adaptive = false;
+    internal::idle_poll_predictor _idle_poll_predictor{_max_poll_time};
     circular_buffer<output_stream<char>* > _flush_batching;
     std::atomic<bool> _sleeping alignas(seastar::cache_line_size);
     pthread_t _thread_id alignas(seastar::cache_line_size) = pthread_self();
     bool _strict_o_direct = true;
     bool _force_io_getevents_syscall = false;
+    // Submit socket operations to the kernel instead of waiting for readiness
+    bool _async_socket_io = false;
     bool _bypass_fsync = false;
     std::atomic<bool> _dying{false};
 private:
     static std::chrono::nanoseconds calculate_poll_time();
-    static void block_notifier(int);
+    static void block_notifier(int, siginfo_t* si, void* uctx);
     void wakeup();
     size_t handle_aio_error(internal::linux_abi::iocb* iocb, int ec);
     bool flush_pending_aio();
@@ -631,13 +835,18 @@ class reactor {
     bool posix_reuseport_detect();
     void task_quota_timer_thread_fn();
     void run_some_tasks();
-    void activate(task_queue& tq);
-    void insert_active_task_queue(task_queue* tq);
-    void insert_activating_task_queues();
+    void activate(sched_entity& se);
+    task_queue* pop_next_task_queue();
+    void requeue(task_queue& tq, sched_clock::time_point now);
     void account_runtime(task_queue& tq, sched_clock::duration runtime);
     void account_idle(sched_clock::duration idletime);
-    void init_scheduling_group(scheduling_group sg, sstring name, float shares);
+    std::chrono::nanoseconds idle_poll_time() const;
+    bool timer_due_within(sched_clock::time_point now, std::chrono::nanoseconds d) const;
+    void init_scheduling_group(scheduling_group sg, sstring name, float shares, scheduling_supergroup parent);
     void destroy_scheduling_group(scheduling_group sg);
+    void init_scheduling_supergroup(scheduling_supergroup sg, sstring name, float shares, scheduling_supergroup parent);
+    void destroy_scheduling_supergroup(scheduling_supergroup sg);
+    void check_scheduling_supergroup(scheduling_supergroup sg, bool empty) const;
     uint64_t tasks_processed() const;
     uint64_t min_vruntime() const;
     void request_preemption();
@@ -751,20 +960,28 @@ class reactor {
     template <typename Func>
     void at_destroy(Func&& func) {
         _at_destroy_tasks->_q.push_back(make_task(default_scheduling_group(), std::forward<Func>(func)));
+        ++_tasks_pending;
     }
 
 #ifdef SEASTAR_SHUFFLE_TASK_QUEUE
-    void shuffle(std::unique_ptr<task>&, task_queue&);
+    // Queues a task first or last, at random
+    void shuffle(std::unique_ptr<task>&&, task_queue&);
 #endif
 
     void add_task(std::unique_ptr<task>&& t) {
         auto sg = t->group();
         auto* q = _task_queues[sg._id].get();
-        bool was_empty = q->_q.empty();
-        q->_q.push_back(std::move(t));
+        bool was_empty = q->empty();
+        ++_tasks_pending;
+        if (__builtin_expect(q->_deadline_ordering, false) && t->deadline() != deadline_clock::time_point()) {
+            q->push_by_deadline(std::move(t));
+        } else {
 #ifdef SEASTAR_SHUFFLE_TASK_QUEUE
-        shuffle(q->_q.back(), *q);
+            shuffle(std::move(t), *q);
+#else
+            q->_q.push_back(std::move(t));
 #endif
+        }
         if (was_empty) {
             activate(*q);
         }
@@ -772,10 +989,12 @@ class reactor {
     void add_urgent_task(std::unique_ptr<task>&& t) {
         auto sg = t->group();
         auto* q = _task_queues[sg._id].get();
-        bool was_empty = q->_q.empty();
-        q->_q.push_front(std::move(t));
+        bool was_empty = q->empty();
+        ++_tasks_pending;
 #ifdef SEASTAR_SHUFFLE_TASK_QUEUE
-        shuffle(q->_q.front(), *q);
+        shuffle(std::move(t), *q);
+#else
+        q->_q.push_front(std::move(t));
 #endif
         if (was_empty) {
             activate(*q);
@@ -828,6 +1047,7 @@ class reactor {
     future<> write_all_part(pollable_fd_state& fd, const void* buffer, size_t size, size_t completed);
 
     bool process_io();
+    void complete_aio(internal::linux_abi::io_event& ev);
 
     void add_timer(timer<steady_clock_type>*);
     bool queue_timer(timer<steady_clock_type>*);
@@ -854,11 +1074,14 @@ class reactor {
     friend class smp_message_queue;
     friend class poller;
     friend class scheduling_group;
+    friend class scheduling_supergroup;
     friend void add_to_flush_poller(output_stream<char>* os);
     friend int ::_Unwind_RaiseException(struct _Unwind_Exception *h);
     metrics::metric_groups _metric_groups;
-    friend future<scheduling_group> create_scheduling_group(sstring name, float shares);
+    friend future<scheduling_group> create_scheduling_group(sstring name, float shares, scheduling_supergroup parent);
     friend future<> seastar::destroy_scheduling_group(scheduling_group);
+    friend future<scheduling_supergroup> create_scheduling_supergroup(sstring name, float shares, scheduling_supergroup parent);
+    friend future<> seastar::destroy_scheduling_supergroup(scheduling_supergroup);
 public:
     bool wait_and_process(int timeout = 0, const sigset_t* active_sigmask = nullptr);
     future<> readable(pollable_fd_state& fd);
@@ -884,6 +1107,16 @@ class reactor {
     // For testing:
     void set_stall_detector_report_function(std::function<void ()> report);
     std::function<void ()> get_stall_detector_report_function() const;
+    /// Sets the interval, in CPU time of the reactor thread, between the
+    /// CPU profiler's samples of this shard. Zero stops the profiler;
+    /// samples already collected are kept.
+    void set_cpu_profiler_period(std::chrono::microseconds period);
+    std::chrono::microseconds get_cpu_profiler_period() const;
+    /// Returns the number of samples taken by the CPU profiler on this
+    /// shard for each distinct stack, in folded format (see collect_cpu_profile()).
+    ///
+    /// \param reset whether to discard the returned samples
+    std::unordered_map<sstring, uint64_t> get_cpu_profile(bool reset = false);
 };
 
 template <typename Func> // signature: bool ()
@@ -914,6 +1147,107 @@ inline bool engine_is_ready() {
     return local_engine != nullptr;
 }
 
+/// Collects the stacks sampled by the CPU profiler on all shards (see
+/// the \c --cpu-profiler-period-us option and
+/// reactor::set_cpu_profiler_period()).
+///
+/// The result is in the folded format consumed by flame graph tools:
+/// one line per distinct stack, with the scheduling group and the frames
+/// from the outermost one, separated by semicolons, followed by a space
+/// and the number of samples, most sampled stacks first. Frames are
+/// unsymbolized object+offset addresses, like in stall reports.
+///
+/// \param reset whether to discard the returned samples
+future<sstring> collect_cpu_profile(bool reset = false);
+
+namespace tracing {
+
+/// \addtogroup tracing-module
+/// @{
+
+/// Collects the spans recorded on all shards, in Chrome's trace event
+/// format (viewable in chrome://tracing or Perfetto), with shards shown
+/// as threads. Each shard keeps the last 16384 spans that ended.
+///
+/// \param reset whether to discard the returned spans
+future<sstring> collect_chrome_trace(bool reset = true);
+
+/// Writes the spans recorded on all shards to a file, in the format of
+/// collect_chrome_trace().
+///
+/// \param path file to create or overwrite
+/// \param reset whether to discard the written spans
+future<> write_chrome_trace(sstring path, bool reset = true);
+
+/// @}
+
+}
+
+namespace internal {
+
+// The shards a broadcast is delivered to, ordered for fan-out: the calling
+// shard first, then the rest of its NUMA node, then every other node's
+// shards, node after node. Each shard forwards the broadcast to the heads
+// of the ranges returned by children(), which then handle those ranges in
+// turn; the calling shard sends one message per remote NUMA node, so that
+// only one message per node crosses the interconnect.
+struct broadcast_plan {
+    static constexpr unsigned fanout = 4;
+    std::vector<unsigned> order;
+    // end of each NUMA node's shards in order; the caller's node comes first
+    std::vector<unsigned> node_ends;
+
+    explicit broadcast_plan(unsigned caller);
+    // Ranges of order that the shard at order[b] forwards to, when handling [b, e)
+    std::vector<std::pair<unsigned, unsigned>> children(unsigned b, unsigned e) const;
+};
+
+struct broadcast_unit {};
+
+template <typename Func>
+struct broadcast_state : broadcast_plan {
+    using value_type = broadcast_unit;
+    Func func;
+    template <typename F>
+    broadcast_state(unsigned caller, F&& f) : broadcast_plan(caller), func(std::forward<F>(f)) {}
+    future<broadcast_unit> map() const {
+        return futurize_apply(func).then([] {
+            return broadcast_unit{};
+        });
+    }
+    broadcast_unit reduce(broadcast_unit, broadcast_unit) const {
+        return {};
+    }
+};
+
+template <typename Mapper, typename T, typename Reduce>
+struct broadcast_map_reduce_state : broadcast_plan {
+    using value_type = T;
+    Mapper mapper;
+    Reduce reducer;
+    template <typename M>
+    broadcast_map_reduce_state(unsigned caller, M&& m, Reduce&& r)
+            : broadcast_plan(caller), mapper(std::forward<M>(m)), reducer(std::move(r)) {}
+    future<T> map() const {
+        return futurize_apply(mapper);
+    }
+    T reduce(T a, T b) const {
+        return reducer(std::move(a), std::move(b));
+    }
+};
+
+}
+
+/// A shard's load, as last published by it; see smp::load()
+struct shard_load {
+    /// Fraction of the last second the shard spent running tasks and
+    /// polling, rather than idle, from 0 to 1
+    float busy = 0;
+    /// Tasks that were waiting to run, in all scheduling groups, when the
+    /// shard last finished running tasks
+    uint32_t tasks_pending = 0;
+};
+
 class smp {
     static std::vector<posix_thread> _threads;
     static std::vector<std::function<void ()>> _thread_loops; // for dpdk
@@ -930,6 +1264,44 @@ class smp {
     using returns_future = is_future<std::result_of_t<Func()>>;
     template <typename Func>
     using returns_void = std::is_same<std::result_of_t<Func()>, void>;
+
+    static std::vector<unsigned> _numa_nodes;
+    static std::vector<std::unique_ptr<smp_peer_summary>> _peer_summaries;
+    // Written by each shard to its own entry, read by any
+    struct alignas(cache_line_size) published_load {
+        std::atomic<float> busy{0};
+        std::atomic<uint32_t> tasks_pending{0};
+    };
+    static std::unique_ptr<published_load[]> _loads;
+
+    // Runs the broadcast on this shard, which is st.order[b], and forwards it
+    // to the rest of [b, e); resolves with the reduction of the results.
+    template <typename State>
+    static future<typename State::value_type> broadcast_subtree(const State& st, unsigned b, unsigned e) {
+        using value_type = typename State::value_type;
+        struct reducer {
+            const State& st;
+            compat::optional<value_type> result;
+            void operator()(value_type v) {
+                result = result ? st.reduce(std::move(*result), std::move(v)) : std::move(v);
+            }
+            value_type get() && {
+                return std::move(*result);
+            }
+        };
+        auto ranges = st.children(b, e);
+        // Forward before running locally, so that a deferring func doesn't
+        // hold up the rest of the tree
+        ranges.emplace_back(b, b + 1);
+        return map_reduce(ranges.begin(), ranges.end(), [&st, b] (std::pair<unsigned, unsigned> r) {
+            if (r.first == b) {
+                return st.map();
+            }
+            return smp::submit_to(st.order[r.first], [&st, r] {
+                return broadcast_subtree(st, r.first, r.second);
+            });
+        }, reducer{st, {}});
+    }
 public:
     static boost::program_options::options_description get_options_description();
     static void register_network_stacks();
@@ -1012,13 +1384,103 @@ class smp {
             return smp::submit_to(id, Func(func));
         });
     }
+    /// Invokes func on all shards, fanning out over a tree of shards.
+    ///
+    /// Unlike invoke_on_all(), which sends a copy of func from the calling
+    /// shard to every other shard, broadcast() sends at most a few
+    /// messages from each shard: the calling shard forwards to one shard on
+    /// each other NUMA node and a few on its own, which forward to a few
+    /// more, and so on. Completions are collected the same way. This makes
+    /// it cheaper for the calling shard when there are many shards.
+    ///
+    /// \param func a callable returning void or future<>. A single copy of it,
+    ///             kept on the calling shard, is invoked on all shards
+    ///             concurrently, through a const reference; it must therefore
+    ///             be safe to call from several threads at once, and must not
+    ///             copy or modify shard-local state it captures (such as
+    ///             lw_shared_ptr or sstring objects).
+    /// \return a future that resolves when func has completed on all
+    ///         shards. If func fails on some shards, the future fails with
+    ///         one of the exceptions, after all shards complete.
+    template <typename Func>
+    static future<> broadcast(Func&& func) {
+        using state_type = internal::broadcast_state<std::decay_t<Func>>;
+        static_assert(std::is_same<future<>, typename futurize<std::result_of_t<const std::decay_t<Func>&()>>::type>::value, "bad Func signature");
+        auto st = std::make_unique<state_type>(engine().cpu_id(), std::forward<Func>(func));
+        auto f = broadcast_subtree(*st, 0, st->order.size());
+        return f.then_wrapped([st = std::move(st)] (future<internal::broadcast_unit> f) {
+            return f.discard_result();
+        });
+    }
+    /// Invokes mapper on all shards and reduces the results, fanning out
+    /// over a tree of shards as broadcast() does.
+    ///
+    /// Results are reduced on the way back up the tree, so that each shard
+    /// receives a few partial results instead of the calling shard receiving
+    /// all of them.
+    ///
+    /// \param mapper a callable returning \c Initial or future<Initial>;
+    ///               the same restrictions as for broadcast()'s func apply.
+    /// \param initial initial value to reduce with
+    /// \param reduce an associative and commutative binary function taking
+    ///               two \c Initial values and returning an \c Initial, such
+    ///               as std::plus<>; it is called on any of the shards,
+    ///               through a const reference.
+    /// \return reduce(initial, reduction of mapper's results, in unspecified order)
+    template <typename Mapper, typename Initial, typename Reduce>
+    static future<Initial> broadcast_map_reduce(Mapper&& mapper, Initial initial, Reduce reduce) {
+        using state_type = internal::broadcast_map_reduce_state<std::decay_t<Mapper>, Initial, Reduce>;
+        static_assert(std::is_same<future<Initial>, typename futurize<std::result_of_t<const std::decay_t<Mapper>&()>>::type>::value,
+                "mapper must return Initial or future<Initial>");
+        auto st = std::make_unique<state_type>(engine().cpu_id(), std::forward<Mapper>(mapper), std::move(reduce));
+        auto f = broadcast_subtree(*st, 0, st->order.size());
+        return f.then([st = std::move(st), initial = std::move(initial)] (Initial v) mutable {
+            return st->reduce(std::move(initial), std::move(v));
+        });
+    }
+    /// Returns the NUMA node the given shard's memory was allocated on.
+    static unsigned numa_node_of(unsigned shard) {
+        return shard < _numa_nodes.size() ? _numa_nodes[shard] : 0;
+    }
+    /// Returns the load of a shard, as last published by it.
+    ///
+    /// Each shard publishes its busy ratio once a second, and its queue
+    /// depth whenever it finishes running tasks, to memory any shard can
+    /// read, so this is cheap to call but the result may be slightly stale.
+    /// Together with connected_socket::move_to(), it lets an application
+    /// move work off overloaded shards; nothing is moved automatically.
+    static shard_load load(shard_id shard) {
+        if (!_loads) {
+            return {};
+        }
+        auto& l = _loads[shard];
+        shard_load ret;
+        ret.busy = l.busy.load(std::memory_order_relaxed);
+        ret.tasks_pending = l.tasks_pending.load(std::memory_order_relaxed);
+        return ret;
+    }
+    /// Returns the shard with the lowest load, by busy ratio and then
+    /// queue depth; see load().
+    static shard_id least_loaded_shard();
+    /// Of two shards picked at random, returns the less loaded one.
+    ///
+    /// Unlike least_loaded_shard(), it doesn't send every placement made
+    /// before the loads are next published to the same shard.
+    static shard_id less_loaded_of_two_shards();
 private:
+    static void publish_busy(shard_id shard, float busy);
+    static void publish_tasks_pending(shard_id shard, uint32_t tasks);
+
     static void start_all_queues();
     static void pin(unsigned cpu_id);
     static void allocate_reactor(unsigned id, reactor_backend_selector rbs, reactor_config cfg);
+    static void allocate_incoming_queues(unsigned id);
     static void create_thread(std::function<void ()> thread_loop);
 public:
     static unsigned count;
+
+    friend class smp_message_queue;
+    friend class reactor;
 };
 
 inline
@@ -22,12 +22,25 @@
 #pragma once
 
 #include <seastar/core/sstring.hh>
+#include <functional>
+#include <limits>
 
 /// \file
 
 namespace seastar {
 
-constexpr unsigned max_scheduling_groups() { return 16; }
+namespace internal {
+
+// Limits the number of scheduling groups (and, separately, supergroups)
+// that exist at a time. Their indices are below it.
+constexpr unsigned scheduling_group_limit = 1024;
+
+}
+
+/// The number of scheduling groups that can exist at a time, which no
+/// longer is small enough to size arrays by.
+[[deprecated("scheduling group indices should index vectors grown on demand")]]
+constexpr unsigned max_scheduling_groups() { return internal::scheduling_group_limit; }
 
 template <typename... T>
 class future;
@@ -38,12 +51,71 @@ class scheduling_group;
 
 namespace internal {
 
-// Returns an index between 0 and max_scheduling_groups()
+// Returns a small index, suitable for indexing a vector; indices of
+// destroyed groups are reused, so they stay dense.
 unsigned scheduling_group_index(scheduling_group sg);
 scheduling_group scheduling_group_from_index(unsigned index);
 
 }
 
+/// \brief Groups scheduling groups, dividing CPU time among them hierarchically
+///
+/// Scheduling groups and supergroups form a tree, rooted at the default
+/// (root) supergroup. CPU time is divided among the root's members according
+/// to their shares; a supergroup's portion is in turn divided among its own
+/// members (scheduling groups, or nested supergroups) according to theirs.
+/// For example, each tenant can be given a supergroup, holding the tenant's
+/// query, compaction and streaming scheduling groups: a tenant running many
+/// tasks then cannot take CPU time away from other tenants, only from its
+/// own groups.
+///
+/// Tasks always run in a \ref scheduling_group; a supergroup is only a node
+/// in the tree.
+class scheduling_supergroup {
+    unsigned _id;
+private:
+    explicit scheduling_supergroup(unsigned id) : _id(id) {}
+public:
+    /// Creates a `scheduling_supergroup` object denoting the root of the tree
+    constexpr scheduling_supergroup() noexcept : _id(0) {}
+    const sstring& name() const;
+    bool operator==(scheduling_supergroup x) const { return _id == x._id; }
+    bool operator!=(scheduling_supergroup x) const { return _id != x._id; }
+    bool is_root() const { return _id == 0; }
+    /// Adjusts the number of shares allotted to the supergroup, relative to
+    /// its siblings. The adjustment is local to the shard.
+    ///
+    /// \param shares number of shares allotted to the supergroup. Use numbers
+    ///               in the 1-1000 range.
+    void set_shares(float shares);
+    friend future<scheduling_supergroup> create_scheduling_supergroup(sstring name, float shares, scheduling_supergroup parent);
+    friend future<> destroy_scheduling_supergroup(scheduling_supergroup sg);
+    friend class reactor;
+};
+
+/// Creates a scheduling supergroup with a specified number of shares.
+///
+/// The operation is global and affects all shards. The returned supergroup
+/// can then be used as the parent of scheduling groups and supergroups.
+///
+/// \param name A name that identifies the supergroup; will be used as a label
+///             in its metrics
+/// \param shares number of shares of the parent's CPU time allotted to the
+///              supergroup; use numbers in the 1-1000 range (but can go above).
+/// \param parent the supergroup to nest the new supergroup in
+/// \return a scheduling supergroup that can be used on any shard
+future<scheduling_supergroup> create_scheduling_supergroup(sstring name, float shares,
+        scheduling_supergroup parent = scheduling_supergroup());
+
+/// Destroys a scheduling supergroup.
+///
+/// The supergroup must not have any members (scheduling groups or
+/// supergroups) left. The operation is global and affects all shards.
+///
+/// \param sg The supergroup to be destroyed
+/// \return a future that is ready when the supergroup has been torn down
+future<> destroy_scheduling_supergroup(scheduling_supergroup sg);
+
 
 /// Creates a scheduling group with a specified number of shares.
 ///
@@ -57,6 +129,19 @@ scheduling_group scheduling_group_from_index(unsigned index);
 /// \return a scheduling group that can be used on any shard
 future<scheduling_group> create_scheduling_group(sstring name, float shares);
 
+/// Creates a scheduling group within a supergroup.
+///
+/// Like create_scheduling_group(sstring, float), but the group's shares are
+/// relative to the other members of \c parent, and it competes only for
+/// the CPU time allotted to \c parent.
+///
+/// \param name A name that identifiers the group; will be used as a label
+///             in the group's metrics
+/// \param shares number of shares of the parent's CPU time allotted to the group
+/// \param parent the supergroup the group belongs to
+/// \return a scheduling group that can be used on any shard
+future<scheduling_group> create_scheduling_group(sstring name, float shares, scheduling_supergroup parent);
+
 /// Destroys a scheduling group.
 ///
 /// Destroys a \ref scheduling_group previously created with create_scheduling_group().
@@ -97,7 +182,44 @@ class scheduling_group {
     /// \param shares number of shares allotted to the group. Use numbers
     ///               in the 1-1000 range.
     void set_shares(float shares);
-    friend future<scheduling_group> create_scheduling_group(sstring name, float shares);
+    /// Makes the group run its tasks that carry a deadline (see with_deadline())
+    /// earliest deadline first, ahead of its tasks without one, and drop those
+    /// whose deadline passed before they could run. The setting is local to
+    /// the shard.
+    ///
+    /// A dropped continuation fails with deadline_exceeded_error instead of
+    /// running its function, which fails the continuations chained to it
+    /// in turn; finally() and then_wrapped() continuations still run. Tasks
+    /// without a deadline are still run in FIFO order, and get at least one
+    /// in every four turns so that they are not starved.
+    ///
+    /// \param enabled whether to order tasks by deadline; disabled by default
+    void set_deadline_ordering(bool enabled);
+    /// Limits the memory allocated in the group on this shard.
+    ///
+    /// Memory is accounted to the group running the code that allocates
+    /// it, until freed. When the group goes over \c soft_limit, the
+    /// reclaimers are run to bring it back under it, and if they can't,
+    /// the group is under memory pressure (see set_memory_pressure_handler())
+    /// until it goes back under the limit. An allocation that would take
+    /// the group over \c hard_limit, even after running the reclaimers,
+    /// fails with std::bad_alloc, so that a runaway group fails instead of
+    /// the others.
+    ///
+    /// Only the first memory::max_accounted_scheduling_groups groups to be
+    /// created can be limited; others are accounted with the default group.
+    ///
+    /// \param soft_limit memory usage (in bytes) above which memory is reclaimed
+    /// \param hard_limit memory usage (in bytes) that allocations may not exceed
+    void set_memory_limits(size_t soft_limit, size_t hard_limit = std::numeric_limits<size_t>::max());
+    /// Sets a function called with \c true when the group comes under memory
+    /// pressure, and with \c false when it stops being under pressure, for
+    /// example to take units from a semaphore admitting new work to the group
+    /// and return them. It runs in a task of its own, and must not throw.
+    void set_memory_pressure_handler(std::function<void (bool under_pressure)> handler);
+    /// Memory (in bytes) accounted to the group on this shard
+    size_t memory_usage() const;
+    friend future<scheduling_group> create_scheduling_group(sstring name, float shares, scheduling_supergroup parent);
     friend future<> destroy_scheduling_group(scheduling_group sg);
     friend class reactor;
     friend unsigned internal::scheduling_group_index(scheduling_group sg);
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <seastar/core/arena.hh>
 #include <seastar/core/shared_ptr_debug_helper.hh>
 #include <utility>
 #include <type_traits>
@@ -153,8 +154,9 @@ class enable_lw_shared_from_this : private lw_shared_ptr_counter_base {
     friend struct internal::lw_shared_ptr_accessors;
 };
 
+// Allocated in the current arena, if any (see arena::scope)
 template <typename T>
-struct shared_ptr_no_esft : private lw_shared_ptr_counter_base {
+struct shared_ptr_no_esft : private lw_shared_ptr_counter_base, internal::allocated_in_current_arena {
     T _value;
 
     shared_ptr_no_esft() = default;
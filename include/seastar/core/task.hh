@@ -23,16 +23,41 @@
 
 #include <memory>
 #include <seastar/core/scheduling.hh>
+#include <seastar/core/tracing.hh>
+#include <seastar/core/deadline.hh>
 
 namespace seastar {
 
+namespace internal {
+
+class task_list;
+
+}
+
 class task {
+    // Link in the reactor's run queue; see internal::task_list
+    task* _next = nullptr;
     scheduling_group _sg;
+    // Span inherited from the creating task; see tracing.hh
+    uint32_t _trace_slot = internal::inherit_trace_slot();
+    // Deadline inherited from the creating task; see deadline.hh
+    deadline_clock::time_point _deadline = *internal::current_deadline_ptr();
 public:
     explicit task(scheduling_group sg = current_scheduling_group()) : _sg(sg) {}
-    virtual ~task() noexcept {}
+    virtual ~task() noexcept {
+        internal::release_trace_slot(_trace_slot);
+    }
     virtual void run_and_dispose() noexcept = 0;
+    // Called instead of run_and_dispose() when the task's deadline has
+    // passed. Tasks that can fail without doing their work, such as
+    // continuations, override it; others just run.
+    virtual void cancel_and_dispose() noexcept {
+        run_and_dispose();
+    }
     scheduling_group group() const { return _sg; }
+    uint32_t trace_slot() const { return _trace_slot; }
+    deadline_clock::time_point deadline() const { return _deadline; }
+    friend class internal::task_list;
 };
 
 void schedule(std::unique_ptr<task>&& t) noexcept;
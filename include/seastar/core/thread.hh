@@ -112,6 +112,9 @@ class thread_context {
     bool _joined = false;
     timer<> _sched_timer{[this] { reschedule(); }};
     compat::optional<promise<>> _sched_promise;
+    // The current arenas (see arena::scope) of the thread while it is
+    // switched out, and of the context that switched to it while it runs
+    internal::current_arenas _arenas;
 
     boost::intrusive::list_member_hook<> _preempted_link;
     using preempted_thread_list = boost::intrusive::list<thread_context,
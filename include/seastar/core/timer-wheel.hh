@@ -0,0 +1,296 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <boost/intrusive/list.hpp>
+
+namespace seastar {
+
+/**
+ * A hierarchical timer wheel, with the same interface as timer_set.
+ *
+ * Timestamps are split into groups of slot_bits bits; each group
+ * corresponds to a level of the wheel with 2^slot_bits slots. A timer is
+ * kept at the level of the most significant group in which its timestamp
+ * differs from the time of the last expire() call, in the slot given by
+ * that group. So lower levels hold earlier timers, and within a level, the
+ * occupied slot with the lowest index holds the earliest ones.
+ *
+ * insert() and remove() are O(1). expire() hands over whole slots of
+ * timers that are due, and redistributes the single slot that contains
+ * the new time into lower levels; each timer is moved at most once per
+ * level, so expiry is amortized O(1) per timer. Unlike timer_set, which
+ * re-scans every timer sharing the leading bits of the current time, only
+ * timers within 2^(slot_bits * (level + 1)) ticks of it are re-scanned.
+ *
+ * The template type "Timer" should have a method named get_timeout()
+ * which returns Timer::time_point which denotes timer's expiration.
+ */
+template<typename Timer, boost::intrusive::list_member_hook<> Timer::*link>
+class timer_wheel {
+public:
+    using time_point = typename Timer::time_point;
+    using timer_list_t = boost::intrusive::list<Timer, boost::intrusive::member_hook<Timer, boost::intrusive::list_member_hook<>, link>>;
+private:
+    using duration = typename Timer::duration;
+    using timestamp_t = typename Timer::duration::rep;
+
+    static constexpr timestamp_t max_timestamp = std::numeric_limits<timestamp_t>::max();
+    static constexpr unsigned slot_bits = 6;
+    static constexpr unsigned n_slots = 1u << slot_bits;
+    static constexpr unsigned n_levels = (64 + slot_bits - 1) / slot_bits;
+
+    std::array<std::array<timer_list_t, n_slots>, n_levels> _slots;
+    // Occupied slots of each level, and levels with occupied slots
+    std::array<uint64_t, n_levels> _occupied{};
+    uint32_t _occupied_levels = 0;
+    // Timers inserted with a timeout that has already passed
+    timer_list_t _due;
+    timestamp_t _last;
+    timestamp_t _next;
+private:
+    static timestamp_t get_timestamp(time_point _time_point) {
+        return _time_point.time_since_epoch().count();
+    }
+
+    static timestamp_t get_timestamp(Timer& timer) {
+        return get_timestamp(timer.get_timeout());
+    }
+
+    static unsigned slot_of(timestamp_t timestamp, unsigned level) {
+        return (uint64_t(timestamp) >> (level * slot_bits)) & (n_slots - 1);
+    }
+
+    // Must only be called for timestamp > _last
+    unsigned level_of(timestamp_t timestamp) const {
+        auto diff = uint64_t(timestamp) ^ uint64_t(_last);
+        return (63 - __builtin_clzll(diff)) / slot_bits;
+    }
+
+    void place(Timer& timer, timestamp_t timestamp) {
+        auto level = level_of(timestamp);
+        auto slot = slot_of(timestamp, level);
+        _slots[level][slot].push_back(timer);
+        _occupied[level] |= uint64_t(1) << slot;
+        _occupied_levels |= 1u << level;
+    }
+
+    void mark_empty(unsigned level, unsigned slot) {
+        _occupied[level] &= ~(uint64_t(1) << slot);
+        if (!_occupied[level]) {
+            _occupied_levels &= ~(1u << level);
+        }
+    }
+
+    void expire_slots(timer_list_t& exp, unsigned level, uint64_t mask) {
+        auto slots = _occupied[level] & mask;
+        while (slots) {
+            auto slot = __builtin_ctzll(slots);
+            slots &= slots - 1;
+            exp.splice(exp.end(), _slots[level][slot]);
+        }
+        _occupied[level] &= ~mask;
+        if (!_occupied[level]) {
+            _occupied_levels &= ~(1u << level);
+        }
+    }
+
+    // The earliest timer is in the lowest occupied slot of the lowest
+    // occupied level; scan that slot for its exact timeout.
+    void update_next() {
+        _next = max_timestamp;
+        if (!_due.empty()) {
+            _next = _last;
+            return;
+        }
+        if (!_occupied_levels) {
+            return;
+        }
+        auto level = __builtin_ctz(_occupied_levels);
+        auto slot = __builtin_ctzll(_occupied[level]);
+        for (auto& timer : _slots[level][slot]) {
+            _next = std::min(_next, get_timestamp(timer));
+        }
+    }
+public:
+    timer_wheel()
+        : _last(0)
+        , _next(max_timestamp) {
+    }
+
+    ~timer_wheel() {
+        while (!_due.empty()) {
+            _due.begin()->cancel();
+        }
+        for (auto&& level : _slots) {
+            for (auto&& list : level) {
+                while (!list.empty()) {
+                    auto& timer = *list.begin();
+                    timer.cancel();
+                }
+            }
+        }
+    }
+
+    /**
+     * Adds timer to the active set. Same contract as timer_set::insert().
+     *
+     * Returns true if and only if this timer's timeout is less than get_next_timeout().
+     */
+    bool insert(Timer& timer) {
+        auto timestamp = get_timestamp(timer);
+        if (timestamp <= _last) {
+            _due.push_back(timer);
+        } else {
+            place(timer, timestamp);
+        }
+        if (timestamp < _next) {
+            _next = timestamp;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Removes timer from the active set. Same contract as timer_set::remove().
+     */
+    void remove(Timer& timer) {
+        auto timestamp = get_timestamp(timer);
+        if (timestamp <= _last) {
+            _due.erase(_due.iterator_to(timer));
+            return;
+        }
+        auto level = level_of(timestamp);
+        auto slot = slot_of(timestamp, level);
+        auto& list = _slots[level][slot];
+        list.erase(list.iterator_to(timer));
+        if (list.empty()) {
+            mark_empty(level, slot);
+        }
+    }
+
+    /**
+     * Expires active timers. Same contract as timer_set::expire().
+     */
+    timer_list_t expire(time_point now) {
+        timer_list_t exp;
+        auto timestamp = get_timestamp(now);
+
+        if (timestamp < _last) {
+            abort();
+        }
+
+        exp.splice(exp.end(), _due);
+
+        if (timestamp != _last) {
+            auto top = level_of(timestamp);
+            // Timers below the top level share the slot of the previous
+            // time at the top level, which is now wholly in the past.
+            for (unsigned level = 0; level < top; ++level) {
+                if (_occupied_levels & (1u << level)) {
+                    expire_slots(exp, level, ~uint64_t(0));
+                }
+            }
+            // At the top level, slots up to the new time's are in the past,
+            // and the new time's slot needs to be redistributed.
+            auto slot = slot_of(timestamp, top);
+            expire_slots(exp, top, (uint64_t(1) << slot) - 1);
+            _last = timestamp;
+            if (_occupied[top] & (uint64_t(1) << slot)) {
+                timer_list_t cascade;
+                cascade.swap(_slots[top][slot]);
+                mark_empty(top, slot);
+                while (!cascade.empty()) {
+                    auto& timer = *cascade.begin();
+                    cascade.pop_front();
+                    auto t = get_timestamp(timer);
+                    if (t <= timestamp) {
+                        exp.push_back(timer);
+                    } else {
+                        place(timer, t);
+                    }
+                }
+            }
+        }
+
+        update_next();
+        return exp;
+    }
+
+    /**
+     * Returns a time point at which expire() should be called
+     * in order to ensure timers are expired in a timely manner.
+     *
+     * Returned values are monotonically increasing.
+     */
+    time_point get_next_timeout() const {
+        return time_point(duration(std::max(_last, _next)));
+    }
+
+    /**
+     * Clears both active and expired timer sets.
+     */
+    void clear() {
+        _due.clear();
+        for (unsigned level = 0; level < n_levels; ++level) {
+            auto slots = _occupied[level];
+            while (slots) {
+                auto slot = __builtin_ctzll(slots);
+                slots &= slots - 1;
+                _slots[level][slot].clear();
+            }
+            _occupied[level] = 0;
+        }
+        _occupied_levels = 0;
+    }
+
+    size_t size() const {
+        size_t res = _due.size();
+        for (unsigned level = 0; level < n_levels; ++level) {
+            auto slots = _occupied[level];
+            while (slots) {
+                auto slot = __builtin_ctzll(slots);
+                slots &= slots - 1;
+                res += _slots[level][slot].size();
+            }
+        }
+        return res;
+    }
+
+    /**
+     * Returns true if and only if there are no timers in the active set.
+     */
+    bool empty() const {
+        return _due.empty() && !_occupied_levels;
+    }
+
+    time_point now() {
+        return Timer::clock::now();
+    }
+};
+
+}
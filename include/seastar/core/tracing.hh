@@ -0,0 +1,195 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+/// \file
+
+/// \defgroup tracing-module Request tracing
+///
+/// Request-scoped tracing follows one logical request through continuation
+/// chains, smp::submit_to() calls, I/O queue waits and RPC calls.
+///
+/// A trace is started with tracing::start_trace(), which samples a fraction
+/// of calls (see tracing::set_sample_rate()). While a sampled span is
+/// current, every task created on the shard (such as a continuation
+/// attached with future::then()) inherits it, and becomes current again
+/// when it runs. Spans created while a span is current become its
+/// children. Each shard records its finished spans in a ring buffer, which
+/// can be collected with tracing::collect_chrome_trace().
+///
+/// When no sampled span is current, tasks carry an empty context and
+/// creating a span does nothing.
+
+namespace seastar {
+
+namespace tracing {
+
+/// \addtogroup tracing-module
+/// @{
+
+/// Identifies a span within a trace, across shards and nodes.
+struct trace_context {
+    uint64_t trace_id = 0;
+    uint64_t span_id = 0;
+    /// Checks whether this is the context of a sampled span.
+    explicit operator bool() const noexcept {
+        return trace_id != 0;
+    }
+};
+
+/// @}
+
+}
+
+/// \cond internal
+namespace internal {
+
+// Spans that can be inherited by tasks live in a per-shard table, and
+// tasks refer to them by a 4 byte index, rather than a pointer. Index 0
+// means no span.
+inline
+uint32_t* current_trace_slot_ptr() noexcept {
+    // Slow unless zero-initialized
+    static thread_local uint32_t slot;
+    return &slot;
+}
+
+// Returns slot, with a new reference, or 0 if its span has ended
+uint32_t add_trace_slot_ref(uint32_t slot) noexcept;
+void release_trace_slot_ref(uint32_t slot) noexcept;
+// Empty if the span has ended
+tracing::trace_context trace_slot_context(uint32_t slot) noexcept;
+
+// Takes a reference to the current span, for a new task. A span that
+// has ended is not inherited, even if the current task still refers to
+// it.
+inline
+uint32_t inherit_trace_slot() noexcept {
+    auto slot = *current_trace_slot_ptr();
+    return slot ? add_trace_slot_ref(slot) : 0;
+}
+
+inline
+void release_trace_slot(uint32_t slot) noexcept {
+    if (slot) {
+        release_trace_slot_ref(slot);
+    }
+}
+
+// Makes a span current for the duration of a scope that doesn't run in
+// a task of its own, such as message processing done by a poller.
+class trace_slot_scope {
+    uint32_t _saved;
+public:
+    trace_slot_scope() noexcept : _saved(*current_trace_slot_ptr()) {}
+    trace_slot_scope(const trace_slot_scope&) = delete;
+    ~trace_slot_scope() {
+        *current_trace_slot_ptr() = _saved;
+    }
+};
+
+}
+/// \endcond
+
+namespace tracing {
+
+/// \addtogroup tracing-module
+/// @{
+
+/// A timed, named operation within a trace.
+///
+/// A span is recorded when it is ended, either explicitly or when it is
+/// destroyed. A span which is not part of a sampled trace is inactive;
+/// it records nothing and costs almost nothing.
+class span {
+    uint32_t _slot = 0;
+    uint32_t _parent_slot = 0;
+public:
+    /// Constructs an inactive span.
+    span() noexcept = default;
+    /// Starts a child of the current span, if there is one, and makes it
+    /// current, so that tasks created from now on inherit it.
+    ///
+    /// \param name name of the operation; must have static storage duration
+    explicit span(const char* name) noexcept;
+    /// Starts a child of a span on another shard or node, and makes it
+    /// current. Does nothing if \c parent is empty.
+    ///
+    /// \param name name of the operation; must have static storage duration
+    span(trace_context parent, const char* name) noexcept;
+    span(span&& x) noexcept
+            : _slot(std::exchange(x._slot, 0))
+            , _parent_slot(std::exchange(x._parent_slot, 0)) {
+    }
+    span& operator=(span&& x) noexcept {
+        if (this != &x) {
+            end();
+            _slot = std::exchange(x._slot, 0);
+            _parent_slot = std::exchange(x._parent_slot, 0);
+        }
+        return *this;
+    }
+    ~span() {
+        end();
+    }
+    /// Checks whether the span is being recorded.
+    bool active() const noexcept {
+        return _slot;
+    }
+    /// Returns the span's context, to be passed to another shard or node.
+    trace_context context() const noexcept;
+    /// Ends and records the span. If it is current, its parent on this
+    /// shard becomes current again.
+    void end() noexcept {
+        if (_slot) {
+            do_end();
+        }
+    }
+private:
+    void do_end() noexcept;
+};
+
+/// Starts a new trace, whose root span becomes current, if this call is
+/// sampled; otherwise, returns an inactive span.
+///
+/// \param name name of the operation; must have static storage duration
+span start_trace(const char* name) noexcept;
+
+/// Sets the fraction of start_trace() calls on this shard that start a
+/// trace. Defaults to 0, which disables tracing.
+void set_sample_rate(double rate);
+
+/// Returns the context of the current span, or an empty context.
+inline
+trace_context current_trace_context() noexcept {
+    auto slot = *internal::current_trace_slot_ptr();
+    return slot ? internal::trace_slot_context(slot) : trace_context();
+}
+
+/// @}
+
+}
+
+}
@@ -31,6 +31,7 @@
 #include <seastar/core/temporary_buffer.hh>
 #include <seastar/core/iostream.hh>
 #include <seastar/util/std-compat.hh>
+#include <seastar/util/noncopyable_function.hh>
 #include <sys/types.h>
 
 namespace seastar {
@@ -191,6 +192,23 @@ class connected_socket {
     /// This is useful to abort operations on a socket that is not making
     /// progress due to a peer failure.
     void shutdown_input();
+
+    /// Moves the connection to another shard, and calls \c func there
+    /// with it.
+    ///
+    /// Lets a busy shard hand connections over to less loaded ones (see
+    /// smp::load()). No reads or writes may be in progress, and the
+    /// streams returned by input() and output() must not be used or
+    /// closed afterwards; data they have buffered is not carried over.
+    /// So a connection is best moved before it is used, or between
+    /// requests of a protocol in which the peer waits for each reply.
+    ///
+    /// Only connections of the posix network stack can be moved.
+    ///
+    /// \param shard the shard to move the connection to
+    /// \param func called on \c shard with the connection
+    /// \return a future that resolves with the one returned by \c func
+    future<> move_to(unsigned shard, noncopyable_function<future<> (connected_socket)> func) &&;
 };
 /// @}
 
@@ -244,6 +262,11 @@ class server_socket {
         // to a specific shard in a server given it knows how many shards server has by choosing
         // src port number accordingly.
         port,
+        // This algorithm sends each new connection to the less loaded of two
+        // shards chosen at random, judging by the load they last published
+        // (see smp::load()). With the posix stack, connections are then
+        // accepted by a single shard even if SO_REUSEPORT is available.
+        load,
         default_ = connection_distribution
     };
     /// Constructs a \c server_socket not corresponding to a connection
@@ -59,6 +59,10 @@ class conntrack {
             _cpu_load[cpu]++;
             return cpu;
         }
+        void moved_cpu(shard_id from, shard_id to) {
+            _cpu_load[from]--;
+            _cpu_load[to]++;
+        }
     };
 
     lw_shared_ptr<load_balancer> _lb;
@@ -90,6 +94,17 @@ class conntrack {
         shard_id cpu() {
             return _target_cpu;
         }
+        // Counts the connection against another shard, once the returned
+        // future resolves
+        future<> move_to(shard_id cpu) {
+            if (!_lb) {
+                return make_ready_future<>();
+            }
+            auto from = std::exchange(_target_cpu, cpu);
+            return smp::submit_to(_host_cpu, [lb = _lb.get(), from, cpu] {
+                lb->moved_cpu(from, cpu);
+            });
+        }
     };
     friend class handle;
 
@@ -42,6 +42,10 @@ class connected_socket_impl {
     virtual bool get_keepalive() const = 0;
     virtual void set_keepalive_parameters(const keepalive_params&) = 0;
     virtual keepalive_params get_keepalive_parameters() const = 0;
+    // Prepares the connection for moving to another shard, and returns a
+    // function which re-creates it on the shard that calls it; see
+    // connected_socket::move_to().
+    virtual future<noncopyable_function<connected_socket ()>> detach(unsigned shard);
 };
 
 class socket_impl {
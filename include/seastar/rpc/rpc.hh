@@ -94,6 +94,10 @@ struct client_options {
     bool tcp_nodelay = true;
     compressor::factory* compressor_factory = nullptr;
     bool send_timeout_data = true;
+    /// Whether to send the caller's trace context with each request, so
+    /// that the server's handling becomes part of the caller's trace
+    /// (see \ref tracing-module). Only used if the server supports it.
+    bool send_trace_context = true;
     connection_id stream_parent = invalid_connection_id;
     /// Configures how this connection is isolated from other connection on the same server.
     ///
@@ -146,6 +150,7 @@ enum class protocol_features : uint32_t {
     CONNECTION_ID = 2,
     STREAM_PARENT = 3,
     ISOLATION = 4,
+    TRACING = 5,
 };
 
 // internal representation of feature data
@@ -214,6 +219,7 @@ class connection {
     future<> _send_loop_stopped = make_ready_future<>();
     std::unique_ptr<compressor> _compressor;
     bool _timeout_negotiated = false;
+    bool _tracing_negotiated = false;
     // stream related fields
     bool _is_stream = false;
     connection_id _id = invalid_connection_id;
@@ -434,6 +440,7 @@ class client : public rpc::connection, public weakly_referencable<client> {
             client_options o = _options;
             o.stream_parent = this->get_connection_id();
             o.send_timeout_data = false;
+            o.send_trace_context = false;
             auto c = make_shared<client>(_logger, _serializer, o, std::move(socket), _server_addr);
             c->_parent = this->weak_from_this();
             c->_is_stream = true;
@@ -464,7 +471,7 @@ class server {
         compat::optional<isolation_config> _isolation_config;
     private:
         future<> negotiate_protocol(input_stream<char>& in);
-        future<compat::optional<uint64_t>, uint64_t, int64_t, compat::optional<rcv_buf>>
+        future<compat::optional<uint64_t>, uint64_t, int64_t, compat::optional<rcv_buf>, tracing::trace_context>
         read_request_frame_compressed(input_stream<char>& in);
         future<feature_map> negotiate(feature_map requested);
         void send_loop() {
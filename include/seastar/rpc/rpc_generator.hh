@@ -0,0 +1,64 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB Ltd.
+ */
+
+#pragma once
+
+#include <seastar/core/generator.hh>
+#include <seastar/rpc/rpc_types.hh>
+#include <tuple>
+
+namespace seastar {
+
+namespace rpc {
+
+/// Returns a generator of the values received by an rpc stream source.
+template <typename... In>
+generator<std::tuple<In...>> make_generator(source<In...> in) {
+    while (auto value = co_await in()) {
+        co_yield std::move(*value);
+    }
+}
+
+/// Sends the values of a generator to an rpc stream sink, and then
+/// flushes and closes it. The sink is closed even if the generator or the
+/// sink fails, and the error is returned.
+template <typename... Out>
+future<> write_to(generator<std::tuple<Out...>> gen, sink<Out...> out) {
+    std::exception_ptr ex;
+    try {
+        while (auto value = co_await gen.next()) {
+            co_await std::apply([&out] (const Out&... args) {
+                return out(args...);
+            }, *value);
+        }
+        co_await out.flush();
+    } catch (...) {
+        ex = std::current_exception();
+    }
+    co_await out.close();
+    if (ex) {
+        std::rethrow_exception(std::move(ex));
+    }
+}
+
+}
+
+}
@@ -440,12 +440,18 @@ auto send_helper(MsgType xt, signature<Ret (InArgs...)> xsig) {
 
             // send message
             auto msg_id = dst.next_message_id();
-            snd_buf data = marshall(dst.template serializer<Serializer>(), 28, args...);
-            static_assert(snd_buf::chunk_size >= 28, "send buffer chunk size is too small");
-            auto p = data.front().get_write() + 8; // 8 extra bytes for expiration timer
+            snd_buf data = marshall(dst.template serializer<Serializer>(), 44, args...);
+            static_assert(snd_buf::chunk_size >= 44, "send buffer chunk size is too small");
+            auto p = data.front().get_write();
+            // 16 extra bytes for the trace context, captured here rather
+            // than in the send loop, and 8 for the expiration timer
+            auto trace = tracing::current_trace_context();
+            write_le<uint64_t>(p, trace.trace_id);
+            write_le<uint64_t>(p + 8, trace.span_id);
+            p += 24;
             write_le<uint64_t>(p, uint64_t(t));
             write_le<int64_t>(p + 8, msg_id);
-            write_le<uint32_t>(p + 16, data.size - 28);
+            write_le<uint32_t>(p + 16, data.size - 44);
 
             // prepare reply handler, if return type is now_wait_type this does nothing, since no reply will be sent
             using wait = wait_signature_t<Ret>;
@@ -555,7 +561,15 @@ auto recv_helper(signature<Ret (InArgs...)> sig, Func&& func, WantClientInfo wci
                 with_gate(client->get_server().reply_gate(), [client, timeout, msg_id, data = std::move(data), permit = std::move(permit), &func] () mutable {
                     try {
                         auto args = unmarshall<Serializer, InArgs...>(*client, std::move(data));
-                        return apply(func, client->info(), timeout, WantClientInfo(), WantTimePoint(), signature(), std::move(args)).then_wrapped([client, timeout, msg_id, permit = std::move(permit)] (futurize_t<Ret> ret) mutable {
+                        // The handler's tasks carry the request's timeout as
+                        // their deadline, but sending the reply does not.
+                        compat::optional<internal::deadline_scope> deadline;
+                        if (timeout) {
+                            deadline.emplace(deadline_clock::now() + (*timeout - rpc_clock_type::now()));
+                        }
+                        auto f = apply(func, client->info(), timeout, WantClientInfo(), WantTimePoint(), signature(), std::move(args));
+                        deadline = compat::nullopt;
+                        return std::move(f).then_wrapped([client, timeout, msg_id, permit = std::move(permit)] (futurize_t<Ret> ret) mutable {
                             return reply<Serializer>(wait_style(), std::move(ret), msg_id, client, timeout).handle_exception([permit = std::move(permit), client, msg_id] (std::exception_ptr eptr) {
                                 client->get_logger()(client->info(), msg_id, format("got exception while processing a message: {}", eptr));
                             });
@@ -0,0 +1,70 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+#include <seastar/core/arena.hh>
+#include <seastar/core/memory.hh>
+#include <algorithm>
+#include <limits>
+
+namespace seastar {
+
+// Chunks are page aligned
+static constexpr size_t chunk_alignment = 4096;
+
+void* arena::allocate_slow(size_t size, size_t align) {
+    // Space before the object in its chunk. With larger alignments, the
+    // object's offset depends on where the chunk is, so leave room for
+    // the worst case.
+    auto header = align <= chunk_alignment ? align_up(sizeof(chunk), align) : sizeof(chunk) + align - 1;
+    if (size > std::numeric_limits<size_t>::max() - header) {
+        throw std::bad_alloc();
+    }
+    auto object = [align] (chunk* c) {
+        return reinterpret_cast<char*>(align_up(reinterpret_cast<uintptr_t>(c + 1), uintptr_t(align)));
+    };
+    if (size > _next_chunk_size / 4 || header + size > _next_chunk_size) {
+        // Too large to share a chunk: give it a chunk of its own, and keep
+        // allocating from the current one.
+        auto c = new (memory::allocate_arena_chunk(header + size)) chunk{_chunks};
+        _chunks = c;
+        _memory += header + size;
+        return object(c);
+    }
+    auto chunk_size = _next_chunk_size;
+    auto c = new (memory::allocate_arena_chunk(chunk_size)) chunk{_chunks};
+    _chunks = c;
+    _memory += chunk_size;
+    _next_chunk_size = std::min(_next_chunk_size * 2, std::max(max_chunk_size, _next_chunk_size));
+    auto p = object(c);
+    _pos = p + size;
+    _end = reinterpret_cast<char*>(c) + chunk_size;
+    return p;
+}
+
+void arena::reset() noexcept {
+    while (_chunks) {
+        memory::free_arena_chunk(std::exchange(_chunks, _chunks->next));
+    }
+    _pos = _end = nullptr;
+    _memory = 0;
+}
+
+}
@@ -21,6 +21,7 @@
 
 #include <seastar/core/execution_stage.hh>
 #include <seastar/core/print.hh>
+#include <algorithm>
 
 namespace seastar {
 
@@ -90,6 +91,8 @@ execution_stage::~execution_stage()
 execution_stage::execution_stage(execution_stage&& other)
     : _sg(other._sg)
     , _stats(other._stats)
+    , _batch_size(other._batch_size)
+    , _latency_budget(other._latency_budget)
     , _name(std::move(other._name))
     , _metric_group(std::move(other._metric_group))
 {
@@ -127,17 +130,65 @@ execution_stage::execution_stage(const sstring& name, scheduling_group sg)
                                   [name, &esm = internal::execution_stage_manager::get()] {
                                       return esm.get_stage(name)->get_stats().function_calls_executed;
                                   }),
+             metrics::make_histogram("batch_size",
+                                  metrics::description("Histogram of the number of function calls executed by each task"),
+                                  { metrics::label_instance("execution_stage", name), },
+                                  [name, &esm = internal::execution_stage_manager::get()] {
+                                      return esm.get_stage(name)->_batch_sizes.to_metrics_histogram();
+                                  }),
+             metrics::make_histogram("queue_delay_us",
+                                  metrics::description("Histogram of how long the oldest function call of each batch was queued, in microseconds"),
+                                  { metrics::label_instance("execution_stage", name), },
+                                  [name, &esm = internal::execution_stage_manager::get()] {
+                                      return esm.get_stage(name)->_queue_delays.to_metrics_histogram();
+                                  }),
            });
+    update_batch_size();
     undo.cancel();
 }
 
+std::chrono::nanoseconds execution_stage::latency_budget() const noexcept {
+    return _latency_budget ? *_latency_budget : internal::execution_stage_manager::get().default_latency_budget();
+}
+
+void execution_stage::set_latency_budget(std::chrono::nanoseconds budget) noexcept {
+    _latency_budget = budget;
+    update_batch_size();
+}
+
+void execution_stage::update_batch_size() noexcept {
+    auto budget = latency_budget().count();
+    if (budget <= 0) {
+        _batch_size = 1;
+    } else if (_call_cost == 0) {
+        // Nothing measured yet; rely on the poller to flush
+        _batch_size = max_batch_size;
+    } else {
+        _batch_size = std::clamp<size_t>(budget / _call_cost, 1, max_batch_size);
+    }
+}
+
+void execution_stage::run_batch() noexcept {
+    auto start = clock_type::now();
+    _queue_delays.add(start - _first_enqueued);
+    auto executed = _stats.function_calls_executed;
+    do_flush();
+    executed = _stats.function_calls_executed - executed;
+    _batch_sizes.add(executed);
+    if (executed) {
+        double cost = std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / executed;
+        _call_cost = _call_cost == 0 ? cost : _call_cost * 0.875 + cost * 0.125;
+    }
+    update_batch_size();
+}
+
 bool execution_stage::flush() noexcept {
     if (_empty || _flush_scheduled) {
         return false;
     }
     _stats.tasks_scheduled++;
     schedule(make_task(_sg, [this] {
-        do_flush();
+        run_batch();
         _flush_scheduled = false;
     }));
     _flush_scheduled = true;
@@ -0,0 +1,166 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+#include <seastar/core/foreign_buffer.hh>
+#include <seastar/core/task.hh>
+#include <algorithm>
+#include <vector>
+
+namespace seastar {
+
+namespace internal {
+
+// Deleters of foreign buffers dropped on this shard, waiting to be sent
+// back to their owners. A batch is sent once it's full, or by a task
+// scheduled when the first deleter is queued, so that all the buffers
+// freed by the currently runnable tasks share a message.
+//
+// Deleters are returned from destructors, so adding one must not fail:
+// the batches are allocated up front and again as soon as they are sent,
+// and if that or scheduling the flush runs out of memory, the deleter is
+// sent on its own.
+class foreign_deleter_batches {
+    static constexpr size_t max_batch = 128;
+    // The message only points to the deleters, which the owner runs by
+    // freeing them. Until the message is queued, they are still ours, so
+    // that if submitting it fails, they can be kept.
+    struct release_deleters {
+        std::vector<deleter>* deleters;
+        void operator()() {
+            delete deleters;
+        }
+    };
+    std::vector<std::vector<deleter>> _pending;
+    bool _flush_scheduled = false;
+public:
+    // At thread exit, deleters can no longer be sent to their owners, and
+    // must not run here
+    ~foreign_deleter_batches() {
+        for (auto& batch : _pending) {
+            for (auto& d : batch) {
+                leak(std::move(d));
+            }
+        }
+    }
+    void add(unsigned owner, deleter d) noexcept {
+        try {
+            prepare(owner);
+        } catch (...) {
+            send_one(owner, std::move(d));
+            return;
+        }
+        auto& batch = _pending[owner];
+        batch.push_back(std::move(d));
+        if (batch.size() >= max_batch) {
+            send(owner);
+        } else if (!_flush_scheduled) {
+            try {
+                schedule(make_task(default_scheduling_group(), [this] {
+                    flush();
+                }));
+                _flush_scheduled = true;
+            } catch (...) {
+                send(owner);
+            }
+        }
+    }
+private:
+    void prepare(unsigned owner) {
+        if (_pending.empty()) {
+            _pending.resize(smp::count);
+            for (auto& batch : _pending) {
+                batch.reserve(max_batch);
+            }
+        }
+        // A batch kept after failing to send it may be full
+        auto& batch = _pending[owner];
+        batch.reserve(std::max(max_batch, batch.size() + 1));
+    }
+    void flush() noexcept {
+        _flush_scheduled = false;
+        for (unsigned owner = 0; owner != _pending.size(); ++owner) {
+            if (!_pending[owner].empty()) {
+                send(owner);
+            }
+        }
+    }
+    void send(unsigned owner) noexcept {
+        if (!submit(owner, _pending[owner])) {
+            // Kept for the next flush
+            return;
+        }
+        try {
+            _pending[owner].reserve(max_batch);
+        } catch (...) {
+            // Reserved again by the next add()
+        }
+    }
+    void send_one(unsigned owner, deleter d) noexcept {
+        std::vector<deleter> batch;
+        try {
+            batch.push_back(std::move(d));
+        } catch (...) {
+            // Out of memory: running the deleter here, on the wrong shard,
+            // isn't safe, so leak it (and what it frees) instead.
+            leak(std::move(d));
+            return;
+        }
+        if (!submit(owner, batch)) {
+            leak(std::move(batch.back()));
+        }
+    }
+    // Moves the deleters in batch to owner. If that runs out of memory,
+    // they are left in batch.
+    static bool submit(unsigned owner, std::vector<deleter>& batch) noexcept {
+        std::vector<deleter>* deleters;
+        try {
+            deleters = new std::vector<deleter>(std::move(batch));
+        } catch (...) {
+            return false;
+        }
+        try {
+            (void)smp::submit_to(owner, release_deleters{deleters});
+            return true;
+        } catch (...) {
+            batch = std::move(*deleters);
+            delete deleters;
+            return false;
+        }
+    }
+    static void leak(deleter d) noexcept {
+        union leaked {
+            deleter d;
+            explicit leaked(deleter&& x) noexcept : d(std::move(x)) {}
+            ~leaked() {}
+        };
+        leaked l(std::move(d));
+    }
+};
+
+static thread_local foreign_deleter_batches foreign_deleters;
+
+void return_foreign_deleter(unsigned owner, deleter d) noexcept {
+    foreign_deleters.add(owner, std::move(d));
+}
+
+}
+
+}
@@ -0,0 +1,142 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+#include "core/linux-uring.hh"
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <errno.h>
+
+namespace seastar {
+
+namespace internal {
+
+using namespace linux_abi;
+
+// The io_uring system calls share their numbers across all architectures
+// (except alpha), so provide them if the libc headers are too old.
+#ifndef __NR_io_uring_setup
+#  define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#  define __NR_io_uring_enter 426
+#endif
+#ifndef __NR_io_uring_register
+#  define __NR_io_uring_register 427
+#endif
+
+int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return ::syscall(__NR_io_uring_setup, entries, params);
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const sigset_t* sigmask) {
+    // Can't use sizeof(*sigmask) because user and kernel sigset_t are inconsistent
+    return ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, sigmask, 8);
+}
+
+int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return ::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+bool io_uring_supports(std::initializer_list<io_uring_op> ops) {
+    io_uring_params params{};
+    auto fd = io_uring_setup(1, &params);
+    if (fd == -1) {
+        return false;
+    }
+    io_uring_probe probe{};
+    auto r = io_uring_register(fd, IORING_REGISTER_PROBE, &probe, 256);
+    ::close(fd);
+    if (r == -1 || !(params.features & IORING_FEAT_NODROP)) {
+        return false;
+    }
+    for (auto op : ops) {
+        auto i = unsigned(op);
+        if (i > probe.last_op || !(probe.ops[i].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static mmap_area map_ring(int fd, size_t size, uint64_t offset) {
+    void* x = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    throw_system_error_on(x == MAP_FAILED, "mmap");
+    return mmap_area(static_cast<char*>(x), mmap_deleter{size});
+}
+
+template <typename T>
+static T* at_offset(const mmap_area& area, uint32_t offset) {
+    return reinterpret_cast<T*>(area.get() + offset);
+}
+
+uring::uring(unsigned sq_entries, unsigned cq_entries) {
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = cq_entries;
+    _fd = io_uring_setup(sq_entries, &params);
+    throw_system_error_on(_fd == -1, "io_uring_setup");
+    try {
+        auto& sq = params.sq_off;
+        auto& cq = params.cq_off;
+        _sq_ring = map_ring(_fd, sq.array + params.sq_entries * sizeof(uint32_t), IORING_OFF_SQ_RING);
+        _cq_ring = map_ring(_fd, cq.cqes + params.cq_entries * sizeof(io_uring_cqe), IORING_OFF_CQ_RING);
+        _sqes_area = map_ring(_fd, params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES);
+        _sq_head = at_offset<std::atomic<uint32_t>>(_sq_ring, sq.head);
+        _sq_tail = at_offset<std::atomic<uint32_t>>(_sq_ring, sq.tail);
+        _sq_mask = *at_offset<uint32_t>(_sq_ring, sq.ring_mask);
+        _sq_entries = *at_offset<uint32_t>(_sq_ring, sq.ring_entries);
+        _sq_array = at_offset<uint32_t>(_sq_ring, sq.array);
+        _sqes = reinterpret_cast<io_uring_sqe*>(_sqes_area.get());
+        _cq_head = at_offset<std::atomic<uint32_t>>(_cq_ring, cq.head);
+        _cq_tail = at_offset<std::atomic<uint32_t>>(_cq_ring, cq.tail);
+        _cq_mask = *at_offset<uint32_t>(_cq_ring, cq.ring_mask);
+        _cqes = at_offset<io_uring_cqe>(_cq_ring, cq.cqes);
+        _sqe_tail = _sq_tail->load(std::memory_order_relaxed);
+    } catch (...) {
+        ::close(_fd);
+        throw;
+    }
+}
+
+uring::~uring() {
+    _sqes_area.reset();
+    _cq_ring.reset();
+    _sq_ring.reset();
+    ::close(_fd);
+}
+
+int uring::submit(unsigned wait_nr, const sigset_t* sigmask) {
+    auto to_submit = pending_submissions();
+    if (to_submit) {
+        // The kernel reads the entries after observing the new tail, so make
+        // sure our writes to them are visible first.
+        _sq_tail->store(_sqe_tail, std::memory_order_release);
+    }
+    if (!to_submit && !wait_nr) {
+        return 0;
+    }
+    return io_uring_enter(_fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0, sigmask);
+}
+
+}
+
+}
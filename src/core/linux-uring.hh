@@ -0,0 +1,246 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+#pragma once
+
+#include <seastar/core/posix.hh>
+#include <signal.h>
+#include <cstdint>
+#include <atomic>
+#include <initializer_list>
+
+namespace seastar {
+
+namespace internal {
+
+// Like linux-aio.hh, we carry our own copy of the kernel ABI so we don't
+// depend on liburing or on recent kernel headers being installed.
+namespace linux_abi {
+
+enum class io_uring_op : uint8_t {
+    NOP = 0,
+    READV = 1,
+    WRITEV = 2,
+    FSYNC = 3,
+    POLL_ADD = 6,
+    POLL_REMOVE = 7,
+    SENDMSG = 9,
+    RECVMSG = 10,
+    TIMEOUT = 11,
+    ACCEPT = 13,
+    ASYNC_CANCEL = 14,
+    READ = 22,
+    WRITE = 23,
+    SEND = 26,
+    RECV = 27,
+};
+
+constexpr uint32_t IORING_FSYNC_DATASYNC = 1;
+
+struct io_uring_sqe {
+    io_uring_op opcode;
+    uint8_t flags;
+    uint16_t ioprio;
+    int32_t fd;
+    uint64_t off;
+    uint64_t addr;
+    uint32_t len;
+    // rw_flags, fsync_flags, poll_events, msg_flags, timeout_flags or accept_flags,
+    // depending on the opcode
+    uint32_t op_flags;
+    uint64_t user_data;
+    uint16_t buf_index;
+    uint16_t personality;
+    int32_t splice_fd_in;
+    uint64_t pad[2];
+};
+
+static_assert(sizeof(io_uring_sqe) == 64, "bad io_uring_sqe layout");
+
+struct io_uring_cqe {
+    uint64_t user_data;
+    int32_t res;
+    uint32_t flags;
+};
+
+struct io_sqring_offsets {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t ring_mask;
+    uint32_t ring_entries;
+    uint32_t flags;
+    uint32_t dropped;
+    uint32_t array;
+    uint32_t resv1;
+    uint64_t resv2;
+};
+
+struct io_cqring_offsets {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t ring_mask;
+    uint32_t ring_entries;
+    uint32_t overflow;
+    uint32_t cqes;
+    uint32_t flags;
+    uint32_t resv1;
+    uint64_t resv2;
+};
+
+struct io_uring_params {
+    uint32_t sq_entries;
+    uint32_t cq_entries;
+    uint32_t flags;
+    uint32_t sq_thread_cpu;
+    uint32_t sq_thread_idle;
+    uint32_t features;
+    uint32_t wq_fd;
+    uint32_t resv[3];
+    io_sqring_offsets sq_off;
+    io_cqring_offsets cq_off;
+};
+
+struct io_uring_probe_op {
+    uint8_t op;
+    uint8_t resv;
+    uint16_t flags;
+    uint32_t resv2;
+};
+
+struct io_uring_probe {
+    uint8_t last_op;
+    uint8_t ops_len;
+    uint16_t resv;
+    uint32_t resv2[3];
+    io_uring_probe_op ops[256];
+};
+
+struct kernel_timespec {
+    int64_t tv_sec;
+    long long tv_nsec;
+};
+
+constexpr uint32_t IORING_SETUP_CQSIZE = 1u << 3;
+constexpr uint32_t IORING_FEAT_NODROP = 1u << 1;
+constexpr uint32_t IORING_ENTER_GETEVENTS = 1u << 0;
+constexpr uint32_t IORING_REGISTER_PROBE = 8;
+constexpr uint16_t IO_URING_OP_SUPPORTED = 1u << 0;
+constexpr uint64_t IORING_OFF_SQ_RING = 0;
+constexpr uint64_t IORING_OFF_CQ_RING = 0x8000000;
+constexpr uint64_t IORING_OFF_SQES = 0x10000000;
+
+}
+
+int io_uring_setup(unsigned entries, linux_abi::io_uring_params* params);
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const sigset_t* sigmask);
+int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args);
+
+// Returns true if the running kernel supports all of the given opcodes, as
+// well as the IORING_FEAT_NODROP completion queue semantics we rely on.
+bool io_uring_supports(std::initializer_list<linux_abi::io_uring_op> ops);
+
+// A submission/completion queue pair shared with the kernel.
+//
+// Submissions are prepared in place with get_sqe(), and become visible to the
+// kernel only when submit() is called, so that a whole reactor iteration's
+// worth of work is handed over in a single io_uring_enter() call. Completions
+// are consumed directly from the shared ring, without a system call.
+class uring {
+    int _fd = -1;
+    mmap_area _sq_ring;
+    mmap_area _cq_ring;
+    mmap_area _sqes_area;
+    std::atomic<uint32_t>* _sq_head;
+    std::atomic<uint32_t>* _sq_tail;
+    uint32_t _sq_mask;
+    uint32_t _sq_entries;
+    uint32_t* _sq_array;
+    linux_abi::io_uring_sqe* _sqes;
+    std::atomic<uint32_t>* _cq_head;
+    std::atomic<uint32_t>* _cq_tail;
+    uint32_t _cq_mask;
+    linux_abi::io_uring_cqe* _cqes;
+    // Local copy of the submission tail; published to the kernel in submit()
+    uint32_t _sqe_tail = 0;
+public:
+    uring(unsigned sq_entries, unsigned cq_entries);
+    ~uring();
+    uring(const uring&) = delete;
+    void operator=(const uring&) = delete;
+
+    int get_fd() const { return _fd; }
+
+    // Returns a zeroed submission queue entry, or nullptr if the submission
+    // queue is full; in which case the caller should submit() and retry.
+    linux_abi::io_uring_sqe* get_sqe() {
+        auto head = _sq_head->load(std::memory_order_acquire);
+        if (_sqe_tail - head >= _sq_entries) {
+            return nullptr;
+        }
+        auto idx = _sqe_tail++ & _sq_mask;
+        auto sqe = &_sqes[idx];
+        *sqe = linux_abi::io_uring_sqe{};
+        _sq_array[idx] = idx;
+        return sqe;
+    }
+
+    // Entries prepared but not yet consumed by the kernel
+    unsigned pending_submissions() const {
+        return _sqe_tail - _sq_head->load(std::memory_order_acquire);
+    }
+
+    // Publishes all prepared entries to the kernel and, if wait_nr is nonzero,
+    // waits until that many completions are available. Returns the result of
+    // io_uring_enter(): number of entries consumed, or -1 with errno set.
+    int submit(unsigned wait_nr = 0, const sigset_t* sigmask = nullptr);
+
+    bool has_completions() const {
+        return _cq_head->load(std::memory_order_relaxed) != _cq_tail->load(std::memory_order_acquire);
+    }
+
+    // Calls func(const io_uring_cqe&) for every available completion, and
+    // returns the number of completions consumed. func may prepare new
+    // submissions.
+    template <typename Func>
+    unsigned for_each_completion(Func&& func) {
+        // We're the only writer to the head, so a relaxed load suffices; the
+        // kernel publishes entries with a release store to the tail.
+        auto head = _cq_head->load(std::memory_order_relaxed);
+        auto tail = _cq_tail->load(std::memory_order_acquire);
+        unsigned n = 0;
+        while (head != tail) {
+            linux_abi::io_uring_cqe cqe = _cqes[head & _cq_mask];
+            ++head;
+            ++n;
+            // Release the slot before processing, so that a completion
+            // handler that submits and reaps again doesn't see it twice.
+            _cq_head->store(head, std::memory_order_release);
+            func(cqe);
+            head = _cq_head->load(std::memory_order_relaxed);
+            tail = _cq_tail->load(std::memory_order_acquire);
+        }
+        return n;
+    }
+};
+
+}
+
+}
@@ -56,9 +56,13 @@
 #include <seastar/core/memory.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/print.hh>
+#include <seastar/core/future-util.hh>
 #include <seastar/util/alloc_failure_injector.hh>
 #include <seastar/util/std-compat.hh>
+#include <boost/range/irange.hpp>
+#include <fstream>
 #include <iostream>
+#include <map>
 
 namespace seastar {
 
@@ -90,6 +94,68 @@ disable_abort_on_alloc_failure_temporarily::~disable_abort_on_alloc_failure_temp
 static compat::polymorphic_allocator<char> static_malloc_allocator{compat::pmr_get_default_resource()};;
 compat::polymorphic_allocator<char>* malloc_allocator{&static_malloc_allocator};
 
+void heap_profile::merge(const heap_profile& o) {
+    if (!sample_period) {
+        sample_period = o.sample_period;
+    }
+    std::map<std::vector<uintptr_t>, size_t> index;
+    for (size_t i = 0; i < sites.size(); ++i) {
+        index.emplace(sites[i].backtrace, i);
+    }
+    for (auto& s : o.sites) {
+        auto i = index.find(s.backtrace);
+        if (i == index.end()) {
+            sites.push_back(s);
+            continue;
+        }
+        auto& dst = sites[i->second];
+        dst.live_objects += s.live_objects;
+        dst.live_bytes += s.live_bytes;
+        dst.total_objects += s.total_objects;
+        dst.total_bytes += s.total_bytes;
+    }
+}
+
+future<heap_profile> sample_heap_profile_on_all_shards() {
+    return map_reduce(boost::irange(0u, smp::count), [] (unsigned shard) {
+        return smp::submit_to(shard, [] {
+            return sample_heap_profile();
+        });
+    }, heap_profile(), [] (heap_profile merged, heap_profile shard) {
+        merged.merge(shard);
+        return merged;
+    });
+}
+
+// The format is the one tcmalloc uses for its sampled heap profiles:
+// each site lists its live and total samples, and the header's
+// "heap_v2/<period>" tells pprof to scale them back up.
+void write_heap_profile(std::ostream& out, const heap_profile& profile) {
+    heap_profile::site total;
+    for (auto& s : profile.sites) {
+        total.live_objects += s.live_objects;
+        total.live_bytes += s.live_bytes;
+        total.total_objects += s.total_objects;
+        total.total_bytes += s.total_bytes;
+    }
+    auto write_counts = [&out] (const heap_profile::site& s) {
+        out << s.live_objects << ": " << s.live_bytes << " [" << s.total_objects << ": " << s.total_bytes << "] @";
+    };
+    out << "heap profile: ";
+    write_counts(total);
+    out << " heap_v2/" << profile.sample_period << "\n";
+    for (auto& s : profile.sites) {
+        write_counts(s);
+        for (auto addr : s.backtrace) {
+            out << " 0x" << std::hex << addr << std::dec;
+        }
+        out << "\n";
+    }
+    out << "\nMAPPED_LIBRARIES:\n";
+    std::ifstream maps("/proc/self/maps");
+    out << maps.rdbuf();
+}
+
 }
 
 }
@@ -109,6 +175,7 @@ compat::polymorphic_allocator<char>* malloc_allocator{&static_malloc_allocator};
 #include <mutex>
 #include <seastar/util/std-compat.hh>
 #include <functional>
+#include <cmath>
 #include <cstring>
 #include <boost/intrusive/list.hpp>
 #include <sys/mman.h>
@@ -122,8 +189,10 @@ compat::polymorphic_allocator<char>* malloc_allocator{&static_malloc_allocator};
 namespace seastar {
 
 struct allocation_site {
-    mutable size_t count = 0; // number of live objects allocated at backtrace.
-    mutable size_t size = 0; // amount of bytes in live objects allocated at backtrace.
+    mutable size_t count = 0; // number of live sampled objects allocated at backtrace.
+    mutable size_t size = 0; // amount of bytes in live sampled objects allocated at backtrace.
+    mutable size_t total_count = 0; // number of objects ever sampled at backtrace.
+    mutable size_t total_size = 0; // amount of bytes in objects ever sampled at backtrace.
     mutable const allocation_site* next = nullptr;
     saved_backtrace backtrace;
 
@@ -157,7 +226,7 @@ namespace memory {
 
 seastar::logger seastar_memory_logger("seastar_memory");
 
-static allocation_site_ptr get_allocation_site() __attribute__((unused));
+static allocation_site_ptr get_allocation_site(size_t size) __attribute__((unused));
 
 static void on_allocation_failure(size_t size);
 
@@ -176,6 +245,7 @@ static thread_local uint64_t g_frees;
 static thread_local uint64_t g_cross_cpu_frees;
 static thread_local uint64_t g_reclaims;
 static thread_local uint64_t g_large_allocs;
+static thread_local uint64_t g_released_pages;
 
 using compat::optional;
 
@@ -193,6 +263,7 @@ class page_list_link {
     uint32_t _prev;
     uint32_t _next;
     friend class page_list;
+    friend struct cpu_pages;
     friend void on_allocation_failure(size_t);
 };
 
@@ -217,6 +288,11 @@ static char* mem_base() {
     return known;
 }
 
+// Number of pages in a huge page; spans of at least this many pages are
+// made of whole huge pages, since spans are naturally aligned.
+static constexpr uint32_t pages_per_huge_page = huge_page_size / page_size;
+static constexpr unsigned huge_page_order = log2ceil(pages_per_huge_page);
+
 constexpr bool is_page_aligned(size_t size) {
     return (size & (page_size - 1)) == 0;
 }
@@ -231,6 +307,12 @@ struct free_object {
     free_object* next;
 };
 
+// Tracks how much of a free span was returned to the kernel
+struct free_span_release {
+    uint32_t free_since; // cpu_pages::release_epoch when the span was freed
+    uint32_t nr_released_pages;
+};
+
 struct page {
     bool free;
     uint8_t offset_in_span;
@@ -238,7 +320,11 @@ struct page {
     uint32_t span_size; // in pages, if we're the head or the tail
     page_list_link link;
     small_pool* pool;  // if used in a small_pool
-    free_object* freelist;
+    union {
+        free_object* freelist; // if used in a small_pool
+        free_span_release release; // if the head of a free span
+        unsigned group; // if the head of a large allocation, the scheduling group it's accounted to
+    };
 #ifdef SEASTAR_HEAPPROF
     allocation_site_ptr alloc_site; // for objects whose size is multiple of page size, valid for head only
 #endif
@@ -282,6 +368,7 @@ class page_list {
         }
         _front = ary[_front].link._next;
     }
+    friend struct cpu_pages;
     friend void on_allocation_failure(size_t);
 };
 
@@ -297,10 +384,11 @@ class small_pool {
     unsigned _min_free;
     unsigned _max_free;
     unsigned _pages_in_use = 0;
+    unsigned _group;
     page_list _span_list;
     static constexpr unsigned idx_frac_bits = 2;
 public:
-    explicit small_pool(unsigned object_size) noexcept;
+    small_pool(unsigned object_size, unsigned group) noexcept;
     ~small_pool();
     void* allocate();
     void deallocate(void* object);
@@ -334,11 +422,15 @@ class small_pool_array {
 public:
     static constexpr unsigned nr_small_pools = small_pool::size_to_idx(4 * page_size) + 1;
 private:
+    // Each scheduling group has pools of its own, so that the spans of a
+    // pool are accounted to a single group.
     union u {
-        small_pool a[nr_small_pools];
+        small_pool a[max_accounted_scheduling_groups][nr_small_pools];
         u() {
-            for (unsigned i = 0; i < nr_small_pools; ++i) {
-                new (&a[i]) small_pool(small_pool::idx_to_size(i));
+            for (unsigned g = 0; g < max_accounted_scheduling_groups; ++g) {
+                for (unsigned i = 0; i < nr_small_pools; ++i) {
+                    new (&a[g][i]) small_pool(small_pool::idx_to_size(i), g);
+                }
             }
         }
         ~u() {
@@ -347,12 +439,21 @@ class small_pool_array {
         }
     } _u;
 public:
-    small_pool& operator[](unsigned idx) { return _u.a[idx]; }
+    small_pool& operator()(unsigned group, unsigned idx) { return _u.a[group][idx]; }
 };
 
 static constexpr size_t max_small_allocation
     = small_pool::idx_to_size(small_pool_array::nr_small_pools - 1);
 
+// The pages of an arena chunk point to this instead of a small_pool, so
+// that freeing an object in the chunk does nothing.
+static char arena_chunk_tag;
+
+static inline
+small_pool* arena_chunk_pool() {
+    return reinterpret_cast<small_pool*>(&arena_chunk_tag);
+}
+
 constexpr size_t object_size_with_alloc_site(size_t size) {
 #ifdef SEASTAR_HEAPPROF
     // For page-aligned sizes, allocation_site* lives in page::alloc_site, not with the object.
@@ -388,11 +489,46 @@ struct cpu_pages {
     page* pages;
     uint32_t nr_pages;
     uint32_t nr_free_pages;
+    uint32_t nr_free_huge_pages = 0;
+    uint32_t nr_released_pages = 0; // free pages returned to the kernel
+    uint32_t release_epoch = 0;
+    bool can_release_memory = true;
+    // Pages release_idle_spans() releases in a call
+    static constexpr uint32_t max_release_pages = (4 << 20) / page_size;
+    // The span release_idle_spans() stopped in, and how much of it (from
+    // its start) it released
+    struct {
+        pageidx span = 0;
+        uint32_t free_since = 0;
+        uint32_t nr_pages = 0;
+    } release_cursor;
     uint32_t current_min_free_pages = 0;
     size_t large_allocation_warning_threshold = std::numeric_limits<size_t>::max();
     unsigned cpu_id = -1U;
+    huge_pages_mode hp_mode = huge_pages_mode::transparent;
     std::function<void (std::function<void ()>)> reclaim_hook;
     std::vector<reclaimer*> reclaimers;
+    // Memory accounting of a scheduling group
+    struct group_memory {
+        uint32_t nr_pages = 0;
+        uint32_t soft_limit_pages = std::numeric_limits<uint32_t>::max();
+        uint32_t hard_limit_pages = std::numeric_limits<uint32_t>::max();
+        bool under_pressure = false;
+        bool reclaim_scheduled = false;
+        uint64_t hard_limit_failures = 0;
+        std::function<void (bool)> pressure_handler;
+        // Pages still in use by a destroyed group that had the same index,
+        // now charged to group 0. Freeing them can't be told apart from
+        // freeing the group's own pages, so they are assumed to be freed
+        // first.
+        uint32_t moved_pages = 0;
+    };
+    group_memory groups[max_accounted_scheduling_groups];
+    unsigned pending_group_reclaims = 0; // bitmask of groups
+    // Whether the last span allocation failed because of its group's hard
+    // limit, rather than because memory ran out
+    bool group_limit_failure = false;
+
     static constexpr unsigned nr_span_lists = 32;
     page_list free_spans[nr_span_lists];  // contains aligned spans with span_size == 2^idx
     small_pool_array small_pools;
@@ -408,6 +544,9 @@ struct cpu_pages {
     } asu;
     allocation_site_ptr alloc_site_list_head = nullptr; // For easy traversal of asu.alloc_sites from scylla-gdb.py
     bool collect_backtrace = false;
+    size_t heap_sample_period = 0;
+    int64_t bytes_until_sample = 0;
+    uint64_t heap_sample_rng = 0;
     char* mem() { return memory; }
 
     void link(page_list& list, page* span);
@@ -418,14 +557,19 @@ struct cpu_pages {
     };
     void maybe_reclaim();
     void* allocate_large_and_trim(unsigned nr_pages);
-    void* allocate_large(unsigned nr_pages);
-    void* allocate_large_aligned(unsigned align_pages, unsigned nr_pages);
+    void* allocate_large(unsigned nr_pages, unsigned group);
+    void* allocate_large_aligned(unsigned align_pages, unsigned nr_pages, unsigned group);
+    void* allocate_group_span(unsigned nr_pages, unsigned group);
+    bool group_may_allocate(unsigned group, unsigned nr_pages);
+    void charge(unsigned group, uint32_t nr_pages);
+    void uncharge(unsigned group, uint32_t nr_pages);
+    void reset_group(unsigned group);
     page* find_and_unlink_span(unsigned nr_pages);
     page* find_and_unlink_span_reclaiming(unsigned n_pages);
     void free_large(void* ptr);
-    bool grow_span(pageidx& start, uint32_t& nr_pages, unsigned idx);
+    bool grow_span(pageidx& start, uint32_t& nr_pages, unsigned idx, uint32_t& nr_released);
     void free_span(pageidx start, uint32_t nr_pages);
-    void free_span_no_merge(pageidx start, uint32_t nr_pages);
+    void free_span_no_merge(pageidx start, uint32_t nr_pages, uint32_t nr_released = 0);
     void free_span_unaligned(pageidx start, uint32_t nr_pages);
     void* allocate_small(unsigned size);
     void free(void* ptr);
@@ -442,14 +586,22 @@ struct cpu_pages {
     bool is_initialized() const;
     bool initialize();
     reclaiming_result run_reclaimers(reclaimer_scope, size_t pages_to_reclaim);
+    reclaiming_result reclaim_group(reclaimer_scope, unsigned group, uint32_t target_pages);
     void schedule_reclaim();
+    void schedule_group_reclaim();
+    void handle_group_memory(unsigned groups_mask);
+    void set_group_memory_limits(unsigned group, size_t soft_limit, size_t hard_limit);
     void set_reclaim_hook(std::function<void (std::function<void ()>)> hook);
     void set_min_free_pages(size_t pages);
     void resize(size_t new_size, allocate_system_memory_fn alloc_sys_mem);
     void do_resize(size_t new_size, allocate_system_memory_fn alloc_sys_mem);
     void replace_memory_backing(allocate_system_memory_fn alloc_sys_mem);
+    void advise_huge_pages(void* start, size_t size);
     void check_large_allocation(size_t size);
     void warn_large_allocation(size_t size);
+    size_t release_idle_spans();
+    void set_heap_sample_period(size_t period);
+    int64_t next_heap_sample_interval();
     memory::memory_layout memory_layout();
     ~cpu_pages();
 };
@@ -458,18 +610,54 @@ static thread_local cpu_pages cpu_mem;
 std::atomic<unsigned> cpu_pages::cpu_id_gen;
 cpu_pages* cpu_pages::all_cpus[max_cpus];
 
+static constexpr size_t default_heap_sample_period = 512 * 1024;
+
 void set_heap_profiling_enabled(bool enable) {
-    bool is_enabled = cpu_mem.collect_backtrace;
-    if (enable) {
-        if (!is_enabled) {
-            seastar_logger.info("Enabling heap profiler");
-        }
-    } else {
-        if (is_enabled) {
-            seastar_logger.info("Disabling heap profiler");
-        }
+    set_heap_profiling_sample_period(enable ? default_heap_sample_period : 0);
+}
+
+void set_heap_profiling_sample_period(size_t period) {
+#ifdef SEASTAR_HEAPPROF
+    auto old_period = cpu_mem.heap_sample_period;
+    if (period && period != old_period) {
+        seastar_logger.info("Enabling heap profiler, sampling every {} bytes", period);
+    } else if (!period && old_period) {
+        seastar_logger.info("Disabling heap profiler");
     }
-    cpu_mem.collect_backtrace = enable;
+    cpu_mem.set_heap_sample_period(period);
+#else
+    if (period) {
+        seastar_logger.warn("Seastar compiled without heap profiling support, heap profiler not enabled");
+    }
+#endif
+}
+
+size_t heap_profiling_sample_period() {
+    return cpu_mem.heap_sample_period;
+}
+
+void cpu_pages::set_heap_sample_period(size_t period) {
+    heap_sample_period = period;
+    collect_backtrace = period != 0;
+    if (!heap_sample_rng) {
+        heap_sample_rng = (0x9e3779b97f4a7c15 * (uint64_t(cpu_id) + 1)) | 1;
+    }
+    bytes_until_sample = period ? next_heap_sample_interval() : 0;
+}
+
+// The number of bytes allocated between two samples is exponentially
+// distributed, so that sampling is a Poisson process over the allocated
+// bytes and an allocation's chance of being sampled depends only on its
+// size, as pprof assumes when it scales the samples up.
+int64_t cpu_pages::next_heap_sample_interval() {
+    // xorshift64*; must not allocate
+    heap_sample_rng ^= heap_sample_rng >> 12;
+    heap_sample_rng ^= heap_sample_rng << 25;
+    heap_sample_rng ^= heap_sample_rng >> 27;
+    auto r = heap_sample_rng * 0x2545f4914f6cdd1d;
+    // Uniform in (0, 1]
+    double u = double((r >> 11) + 1) / double(uint64_t(1) << 53);
+    return int64_t(std::min(-std::log(u) * heap_sample_period, double(std::numeric_limits<int64_t>::max() / 2)));
 }
 
 // Smallest index i such that all spans stored in the index are >= pages.
@@ -484,25 +672,30 @@ unsigned index_of(unsigned pages) {
 void
 cpu_pages::unlink(page_list& list, page* span) {
     list.erase(pages, *span);
+    nr_free_huge_pages -= span->span_size >> huge_page_order;
+    nr_released_pages -= span->release.nr_released_pages;
 }
 
 void
 cpu_pages::link(page_list& list, page* span) {
     list.push_front(pages, *span);
+    nr_free_huge_pages += span->span_size >> huge_page_order;
+    nr_released_pages += span->release.nr_released_pages;
 }
 
-void cpu_pages::free_span_no_merge(uint32_t span_start, uint32_t nr_pages) {
+void cpu_pages::free_span_no_merge(uint32_t span_start, uint32_t nr_pages, uint32_t nr_released) {
     assert(nr_pages);
     nr_free_pages += nr_pages;
     auto span = &pages[span_start];
     auto span_end = &pages[span_start + nr_pages - 1];
     span->free = span_end->free = true;
     span->span_size = span_end->span_size = nr_pages;
+    span->release = free_span_release{release_epoch, nr_released};
     auto idx = index_of(nr_pages);
     link(free_spans[idx], span);
 }
 
-bool cpu_pages::grow_span(uint32_t& span_start, uint32_t& nr_pages, unsigned idx) {
+bool cpu_pages::grow_span(uint32_t& span_start, uint32_t& nr_pages, unsigned idx, uint32_t& nr_released) {
     auto which = (span_start >> idx) & 1; // 0=lower, 1=upper
     // locate first page of upper buddy or last page of lower buddy
     // examples: span_start = 0x10 nr_pages = 0x08 -> buddy = 0x18  (which = 0)
@@ -511,6 +704,7 @@ bool cpu_pages::grow_span(uint32_t& span_start, uint32_t& nr_pages, unsigned idx
     auto delta = ((which ^ 1) << idx) | -which;
     auto buddy = span_start + delta;
     if (pages[buddy].free && pages[buddy].span_size == nr_pages) {
+        nr_released += pages[span_start ^ nr_pages].release.nr_released_pages;
         unlink(free_spans[idx], &pages[span_start ^ nr_pages]);
         nr_free_pages -= nr_pages; // free_span_no_merge() will restore
         span_start &= ~nr_pages;
@@ -522,10 +716,11 @@ bool cpu_pages::grow_span(uint32_t& span_start, uint32_t& nr_pages, unsigned idx
 
 void cpu_pages::free_span(uint32_t span_start, uint32_t nr_pages) {
     auto idx = index_of(nr_pages);
-    while (grow_span(span_start, nr_pages, idx)) {
+    uint32_t nr_released = 0;
+    while (grow_span(span_start, nr_pages, idx, nr_released)) {
         ++idx;
     }
-    free_span_no_merge(span_start, nr_pages);
+    free_span_no_merge(span_start, nr_pages, nr_released);
 }
 
 // Internal, used during startup. Span is not aligned so needs to be broken up
@@ -540,6 +735,12 @@ void cpu_pages::free_span_unaligned(uint32_t span_start, uint32_t nr_pages) {
     }
 }
 
+// Takes the smallest free span that fits. A span smaller than a huge page
+// is free only while its buddy, and so the rest of its huge page, is at
+// least partly allocated, so new spans are only carved out of a free huge
+// page when no huge page in use has room for them. This keeps small pools
+// and small allocations packed into as few huge pages, and so TLB entries,
+// as possible.
 page*
 cpu_pages::find_and_unlink_span(unsigned n_pages) {
     auto idx = index_of(n_pages);
@@ -586,6 +787,67 @@ void cpu_pages::maybe_reclaim() {
     }
 }
 
+// Releases free spans of at least a huge page that were already free at
+// the previous call, largest first, as long as at least min_free_pages
+// stay in memory. Released pages remain free spans: the kernel faults
+// them back in, zeroed, when they are next used.
+//
+// MADV_FREE would be cheaper, but the kernel only takes pages released
+// with it back under memory pressure, so the process' memory usage would
+// not go down.
+//
+// Releasing costs time in proportion to the memory released, so a call
+// releases at most max_release_pages, and a larger span is released a
+// piece at a time, over several calls.
+size_t cpu_pages::release_idle_spans() {
+    if (!is_initialized() || !can_release_memory) {
+        return 0;
+    }
+    uint32_t resident_free_pages = nr_free_pages - nr_released_pages;
+    uint32_t budget = max_release_pages;
+    size_t released = 0;
+    for (unsigned idx = nr_span_lists; budget && idx-- > huge_page_order; ) {
+        for (auto i = free_spans[idx]._front; budget && i; i = pages[i].link._next) {
+            auto& span = pages[i];
+            if (span.release.free_since == release_epoch) {
+                // Freed since the previous call
+                continue;
+            }
+            if (span.release.nr_released_pages == span.span_size) {
+                continue;
+            }
+            // Which pages of a partly released span were released is not
+            // known, unless it's the span a previous call didn't finish.
+            uint32_t start = 0;
+            if (release_cursor.span == i && release_cursor.free_since == span.release.free_since) {
+                start = release_cursor.nr_pages;
+            }
+            auto n = std::min(span.span_size - start, budget);
+            if (resident_free_pages < size_t(min_free_pages) + n) {
+                continue;
+            }
+            if (::madvise(mem() + (size_t(i) + start) * page_size, size_t(n) * page_size, MADV_DONTNEED) != 0) {
+                continue;
+            }
+            budget -= n;
+            auto nr_released = start + n == span.span_size
+                    ? span.span_size
+                    : std::max(span.release.nr_released_pages, start + n);
+            if (start + n < span.span_size) {
+                release_cursor = {i, span.release.free_since, start + n};
+            }
+            auto newly_released = nr_released - span.release.nr_released_pages;
+            span.release.nr_released_pages = nr_released;
+            nr_released_pages += newly_released;
+            resident_free_pages -= std::min(resident_free_pages, n);
+            released += newly_released;
+        }
+    }
+    ++release_epoch;
+    g_released_pages += released;
+    return released * page_size;
+}
+
 void*
 cpu_pages::allocate_large_and_trim(unsigned n_pages) {
     // Avoid exercising the reclaimers for requests we'll not be able to satisfy
@@ -600,22 +862,20 @@ cpu_pages::allocate_large_and_trim(unsigned n_pages) {
     auto span_size = span->span_size;
     auto span_idx = span - pages;
     nr_free_pages -= span->span_size;
+    // Which pages of a partly released span were released is not known,
+    // so only the halves of a wholly released span are known to be.
+    bool released = span->release.nr_released_pages == span_size;
     while (span_size >= n_pages * 2) {
         span_size /= 2;
         auto other_span_idx = span_idx + span_size;
-        free_span_no_merge(other_span_idx, span_size);
+        free_span_no_merge(other_span_idx, span_size, released ? span_size : 0);
     }
     auto span_end = &pages[span_idx + span_size - 1];
     span->free = span_end->free = false;
     span->span_size = span_end->span_size = span_size;
     span->pool = nullptr;
 #ifdef SEASTAR_HEAPPROF
-    auto alloc_site = get_allocation_site();
-    span->alloc_site = alloc_site;
-    if (alloc_site) {
-        ++alloc_site->count;
-        alloc_site->size += span->span_size * page_size;
-    }
+    span->alloc_site = get_allocation_site(span->span_size * page_size);
 #endif
     maybe_reclaim();
     return mem() + span_idx * page_size;
@@ -637,16 +897,80 @@ cpu_pages::check_large_allocation(size_t size) {
 }
 
 void*
-cpu_pages::allocate_large(unsigned n_pages) {
+cpu_pages::allocate_large(unsigned n_pages, unsigned group) {
     check_large_allocation(n_pages * page_size);
-    return allocate_large_and_trim(n_pages);
+    return allocate_group_span(n_pages, group);
 }
 
 void*
-cpu_pages::allocate_large_aligned(unsigned align_pages, unsigned n_pages) {
+cpu_pages::allocate_large_aligned(unsigned align_pages, unsigned n_pages, unsigned group) {
     check_large_allocation(n_pages * page_size);
     // buddy allocation is always aligned
-    return allocate_large_and_trim(n_pages);
+    return allocate_group_span(n_pages, group);
+}
+
+// The scheduling group to account memory allocated now to
+static inline
+unsigned current_group() {
+    auto group = internal::scheduling_group_index(*internal::current_scheduling_group_ptr());
+    return group < max_accounted_scheduling_groups ? group : 0;
+}
+
+void*
+cpu_pages::allocate_group_span(unsigned n_pages, unsigned group) {
+    group_limit_failure = !group_may_allocate(group, n_pages);
+    if (group_limit_failure) {
+        return nullptr;
+    }
+    auto ptr = allocate_large_and_trim(n_pages);
+    if (ptr) {
+        auto span = to_page(ptr);
+        span->group = group;
+        charge(group, span->span_size);
+        schedule_group_reclaim();
+    }
+    return ptr;
+}
+
+// Checks that a span for n_pages keeps the group within its hard limit,
+// first running the reclaimers if it would not.
+bool cpu_pages::group_may_allocate(unsigned group, unsigned n_pages) {
+    auto& g = groups[group];
+    // Spans are rounded up to a power of two
+    uint64_t span_size = uint64_t(1) << index_of(n_pages);
+    if (__builtin_expect(g.nr_pages + span_size <= g.hard_limit_pages, true)) {
+        return true;
+    }
+    if (span_size <= g.hard_limit_pages) {
+        reclaim_group(reclaimer_scope::sync, group, g.hard_limit_pages - span_size);
+        if (g.nr_pages + span_size <= g.hard_limit_pages) {
+            return true;
+        }
+    }
+    ++g.hard_limit_failures;
+    return false;
+}
+
+void cpu_pages::charge(unsigned group, uint32_t n_pages) {
+    auto& g = groups[group];
+    g.nr_pages += n_pages;
+    if (__builtin_expect(g.nr_pages > g.soft_limit_pages, false) && !g.under_pressure && !g.reclaim_scheduled) {
+        pending_group_reclaims |= 1u << group;
+    }
+}
+
+void cpu_pages::uncharge(unsigned group, uint32_t n_pages) {
+    auto& g = groups[group];
+    if (__builtin_expect(g.moved_pages, 0)) {
+        auto moved = std::min(g.moved_pages, n_pages);
+        g.moved_pages -= moved;
+        n_pages -= moved;
+        uncharge(0, moved);
+    }
+    g.nr_pages -= n_pages;
+    if (__builtin_expect(g.under_pressure, false) && g.nr_pages <= g.soft_limit_pages && !g.reclaim_scheduled) {
+        pending_group_reclaims |= 1u << group;
+    }
 }
 
 #ifdef SEASTAR_HEAPPROF
@@ -677,11 +1001,18 @@ saved_backtrace get_backtrace() noexcept {
     return current_backtrace();
 }
 
+// Decides whether to sample an allocation of \c size bytes, and if so,
+// accounts it to its allocation site and returns the site.
 static
-allocation_site_ptr get_allocation_site() {
-    if (!cpu_mem.is_initialized() || !cpu_mem.collect_backtrace) {
+allocation_site_ptr get_allocation_site(size_t size) {
+    if (!cpu_mem.collect_backtrace) {
         return nullptr;
     }
+    cpu_mem.bytes_until_sample -= size;
+    if (cpu_mem.bytes_until_sample >= 0 || !cpu_mem.is_initialized()) {
+        return nullptr;
+    }
+    cpu_mem.bytes_until_sample = cpu_mem.next_heap_sample_interval();
     disable_backtrace_temporarily dbt;
     allocation_site new_alloc_site;
     new_alloc_site.backtrace = get_backtrace();
@@ -691,9 +1022,32 @@ allocation_site_ptr get_allocation_site() {
         alloc_site->next = cpu_mem.alloc_site_list_head;
         cpu_mem.alloc_site_list_head = alloc_site;
     }
+    ++alloc_site->count;
+    alloc_site->size += size;
+    ++alloc_site->total_count;
+    alloc_site->total_size += size;
     return alloc_site;
 }
 
+heap_profile sample_heap_profile() {
+    heap_profile profile;
+    disable_backtrace_temporarily dbt;
+    profile.sample_period = cpu_mem.heap_sample_period;
+    for (auto alloc_site = cpu_mem.alloc_site_list_head; alloc_site; alloc_site = alloc_site->next) {
+        heap_profile::site site;
+        for (auto& f : alloc_site->backtrace.frames()) {
+            // saved_backtrace keeps the address of the call instruction
+            site.backtrace.push_back(f.so->begin + f.addr + 1);
+        }
+        site.live_objects = alloc_site->count;
+        site.live_bytes = alloc_site->size;
+        site.total_objects = alloc_site->total_count;
+        site.total_bytes = alloc_site->total_size;
+        profile.sites.push_back(std::move(site));
+    }
+    return profile;
+}
+
 #ifdef SEASTAR_HEAPPROF
 
 allocation_site_ptr&
@@ -710,18 +1064,14 @@ small_pool::alloc_site_holder(void* ptr) {
 void*
 cpu_pages::allocate_small(unsigned size) {
     auto idx = small_pool::size_to_idx(size);
-    auto& pool = small_pools[idx];
+    auto& pool = small_pools(current_group(), idx);
     assert(size <= pool.object_size());
     auto ptr = pool.allocate();
 #ifdef SEASTAR_HEAPPROF
     if (!ptr) {
         return nullptr;
     }
-    allocation_site_ptr alloc_site = get_allocation_site();
-    if (alloc_site) {
-        ++alloc_site->count;
-        alloc_site->size += pool.object_size();
-    }
+    allocation_site_ptr alloc_site = get_allocation_site(pool.object_size());
     new (&pool.alloc_site_holder(ptr)) allocation_site_ptr{alloc_site};
 #endif
     return ptr;
@@ -737,11 +1087,16 @@ void cpu_pages::free_large(void* ptr) {
         alloc_site->size -= span->span_size * page_size;
     }
 #endif
+    uncharge(span->group, span->span_size);
     free_span(idx, span->span_size);
 }
 
 size_t cpu_pages::object_size(void* ptr) {
     page* span = to_page(ptr);
+    if (span->pool == arena_chunk_pool()) {
+        // Objects in an arena don't record their size
+        return 0;
+    }
     if (span->pool) {
         auto s = span->pool->object_size();
 #ifdef SEASTAR_HEAPPROF
@@ -788,6 +1143,10 @@ bool cpu_pages::drain_cross_cpu_freelist() {
 void cpu_pages::free(void* ptr) {
     page* span = to_page(ptr);
     if (span->pool) {
+        if (__builtin_expect(span->pool == arena_chunk_pool(), false)) {
+            // Freed with the arena
+            return;
+        }
         small_pool& pool = *span->pool;
 #ifdef SEASTAR_HEAPPROF
         allocation_site_ptr alloc_site = pool.alloc_site_holder(ptr);
@@ -800,27 +1159,13 @@ void cpu_pages::free(void* ptr) {
     } else {
         free_large(ptr);
     }
+    schedule_group_reclaim();
 }
 
 void cpu_pages::free(void* ptr, size_t size) {
-    // match action on allocate() so hit the right pool
-    if (size <= sizeof(free_object)) {
-        size = sizeof(free_object);
-    }
-    if (size <= max_small_allocation) {
-        size = object_size_with_alloc_site(size);
-        auto pool = &small_pools[small_pool::size_to_idx(size)];
-#ifdef SEASTAR_HEAPPROF
-        allocation_site_ptr alloc_site = pool->alloc_site_holder(ptr);
-        if (alloc_site) {
-            --alloc_site->count;
-            alloc_site->size -= pool->object_size();
-        }
-#endif
-        pool->deallocate(ptr);
-    } else {
-        free_large(ptr);
-    }
+    // The pool of a small object depends on the scheduling group that
+    // allocated it, not only on its size, so look it up in its page.
+    free(ptr);
 }
 
 bool
@@ -859,7 +1204,9 @@ void cpu_pages::shrink(void* ptr, size_t new_size) {
     span[new_size_pages - 1].free = false;
     span[new_size_pages - 1].span_size = new_size_pages;
     pageidx idx = span - pages;
+    uncharge(span->group, old_size_pages - new_size_pages);
     free_span_unaligned(idx + new_size_pages, old_size_pages - new_size_pages);
+    schedule_group_reclaim();
 }
 
 cpu_pages::~cpu_pages() {
@@ -911,6 +1258,43 @@ allocate_anonymous_memory(compat::optional<void*> where, size_t how_much) {
             MAP_PRIVATE | (where ? MAP_FIXED : 0));
 }
 
+// Shards map their memory concurrently when they start, so checking that
+// the pool has enough free pages and taking them must not be interleaved
+// with another shard doing the same.
+static std::mutex hugetlb_pool_mutex;
+
+static bool hugetlb_pool_has(size_t how_much) {
+    how_much = align_up(how_much, huge_page_size);
+    auto probe = ::mmap(nullptr, how_much, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (probe == MAP_FAILED) {
+        return false;
+    }
+    ::munmap(probe, how_much);
+    return true;
+}
+
+// Maps memory from the kernel's huge page pool, or, if the pool is too
+// small, anonymous memory backed by transparent huge pages. Must not
+// allocate, since replace_memory_backing() calls it while moving the
+// shard's memory.
+mmap_area
+allocate_hugetlb_memory(compat::optional<void*> where, size_t how_much) {
+    // Mapping over existing memory may lose it even if the mapping fails,
+    // so try a mapping elsewhere first. Private huge page mappings reserve
+    // their pages, so once mapped, they can't run out.
+    std::lock_guard<std::mutex> lock(hugetlb_pool_mutex);
+    if (!hugetlb_pool_has(how_much)) {
+        auto ret = allocate_anonymous_memory(where, how_much);
+        ::madvise(ret.get(), how_much, MADV_HUGEPAGE);
+        return ret;
+    }
+    return mmap_anonymous(where.value_or(nullptr),
+            how_much,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_HUGETLB | (where ? MAP_FIXED : 0));
+}
+
 mmap_area
 allocate_hugetlbfs_memory(file_desc& fd, compat::optional<void*> where, size_t how_much) {
     auto pos = fd.size();
@@ -939,6 +1323,21 @@ void cpu_pages::replace_memory_backing(allocate_system_memory_fn alloc_sys_mem)
     std::memcpy(old_mem, relocated_old_mem.get(), bytes);
 }
 
+void cpu_pages::advise_huge_pages(void* start, size_t size) {
+    switch (hp_mode) {
+    case huge_pages_mode::transparent:
+        ::madvise(start, size, MADV_HUGEPAGE);
+        break;
+    case huge_pages_mode::none:
+        ::madvise(start, size, MADV_NOHUGEPAGE);
+        break;
+    case huge_pages_mode::hugetlb:
+        // allocate_hugetlb_memory() advises what it could not map from
+        // the huge page pool.
+        break;
+    }
+}
+
 void cpu_pages::do_resize(size_t new_size, allocate_system_memory_fn alloc_sys_mem) {
     auto new_pages = new_size / page_size;
     if (new_pages <= nr_pages) {
@@ -949,11 +1348,14 @@ void cpu_pages::do_resize(size_t new_size, allocate_system_memory_fn alloc_sys_m
     auto mmap_size = new_size - old_size;
     auto mem = alloc_sys_mem({mmap_start}, mmap_size);
     mem.release();
-    ::madvise(mmap_start, mmap_size, MADV_HUGEPAGE);
+    advise_huge_pages(mmap_start, mmap_size);
     // one past last page structure is a sentinel
     auto new_page_array_pages = align_up(sizeof(page[new_pages + 1]), page_size) / page_size;
+    // The page array belongs to the allocator, so it isn't accounted
+    // to a scheduling group.
+    check_large_allocation(new_page_array_pages * page_size);
     auto new_page_array
-        = reinterpret_cast<page*>(allocate_large(new_page_array_pages));
+        = reinterpret_cast<page*>(allocate_large_and_trim(new_page_array_pages));
     if (!new_page_array) {
         throw std::bad_alloc();
     }
@@ -1007,6 +1409,105 @@ reclaiming_result cpu_pages::run_reclaimers(reclaimer_scope scope, size_t n_page
     return result;
 }
 
+// Runs the reclaimers until the group uses at most target_pages, or
+// until they stop reducing its usage, so that memory of other groups
+// is not reclaimed in vain.
+reclaiming_result cpu_pages::reclaim_group(reclaimer_scope scope, unsigned group, uint32_t target_pages) {
+    auto& g = groups[group];
+    reclaiming_result result = reclaiming_result::reclaimed_nothing;
+    while (g.nr_pages > target_pages) {
+        auto before = g.nr_pages;
+        bool made_progress = false;
+        ++g_reclaims;
+        for (auto&& r : reclaimers) {
+            if (r->scope() >= scope && g.nr_pages > target_pages) {
+                made_progress |= r->do_reclaim(size_t(g.nr_pages - target_pages) * page_size) == reclaiming_result::reclaimed_something;
+            }
+        }
+        if (!made_progress || g.nr_pages >= before) {
+            return result;
+        }
+        result = reclaiming_result::reclaimed_something;
+    }
+    return result;
+}
+
+// Reclaiming for a group over its soft limit, and notifying a group of
+// a change of its memory pressure, must not happen within the allocator,
+// so they are deferred to a task.
+void cpu_pages::schedule_group_reclaim() {
+    if (__builtin_expect(!pending_group_reclaims, true) || !reclaim_hook) {
+        return;
+    }
+    auto groups_mask = std::exchange(pending_group_reclaims, 0u);
+    for (unsigned i = 0; i < max_accounted_scheduling_groups; ++i) {
+        groups[i].reclaim_scheduled |= bool(groups_mask & (1u << i));
+    }
+    try {
+        reclaim_hook([this, groups_mask] {
+            handle_group_memory(groups_mask);
+        });
+    } catch (...) {
+        // Retry on the next allocation or free
+        for (unsigned i = 0; i < max_accounted_scheduling_groups; ++i) {
+            groups[i].reclaim_scheduled &= !(groups_mask & (1u << i));
+        }
+        pending_group_reclaims |= groups_mask;
+    }
+}
+
+void cpu_pages::handle_group_memory(unsigned groups_mask) {
+    for (unsigned i = 0; i < max_accounted_scheduling_groups; ++i) {
+        if (!(groups_mask & (1u << i))) {
+            continue;
+        }
+        auto& g = groups[i];
+        g.reclaim_scheduled = false;
+        if (g.nr_pages > g.soft_limit_pages) {
+            reclaim_group(reclaimer_scope::async, i, g.soft_limit_pages);
+        }
+        bool under_pressure = g.nr_pages > g.soft_limit_pages;
+        if (under_pressure != g.under_pressure) {
+            g.under_pressure = under_pressure;
+            if (g.pressure_handler) {
+                g.pressure_handler(under_pressure);
+            }
+        }
+    }
+}
+
+void cpu_pages::set_group_memory_limits(unsigned group, size_t soft_limit, size_t hard_limit) {
+    if (group >= max_accounted_scheduling_groups) {
+        throw std::out_of_range(format("scheduling group {} is accounted with the default group", group));
+    }
+    auto to_pages = [] (size_t bytes) {
+        return uint32_t(std::min<size_t>(bytes / page_size, std::numeric_limits<uint32_t>::max()));
+    };
+    auto& g = groups[group];
+    g.soft_limit_pages = to_pages(soft_limit);
+    g.hard_limit_pages = to_pages(hard_limit);
+    if (g.nr_pages > g.soft_limit_pages || g.under_pressure) {
+        if (!g.reclaim_scheduled) {
+            pending_group_reclaims |= 1u << group;
+        }
+        schedule_group_reclaim();
+    }
+}
+
+// Makes a destroyed group's index ready for reuse: memory the group still
+// uses is charged to group 0 from now on, and its limits are lifted.
+void cpu_pages::reset_group(unsigned group) {
+    auto& g = groups[group];
+    g.moved_pages += g.nr_pages;
+    charge(0, g.nr_pages);
+    g.nr_pages = 0;
+    g.soft_limit_pages = g.hard_limit_pages = std::numeric_limits<uint32_t>::max();
+    g.under_pressure = false;
+    g.pressure_handler = {};
+    pending_group_reclaims &= ~(1u << group);
+    schedule_group_reclaim();
+}
+
 void cpu_pages::schedule_reclaim() {
     current_min_free_pages = 0;
     reclaim_hook([this] {
@@ -1043,8 +1544,9 @@ void cpu_pages::set_min_free_pages(size_t pages) {
     maybe_reclaim();
 }
 
-small_pool::small_pool(unsigned object_size) noexcept
-    : _object_size(object_size) {
+small_pool::small_pool(unsigned object_size, unsigned group) noexcept
+    : _object_size(object_size)
+    , _group(group) {
     unsigned span_size = 1;
     auto span_bytes = [&] { return span_size * page_size; };
     auto waste = [&] { return (span_bytes() % _object_size) / (1.0 * span_bytes()); };
@@ -1114,10 +1616,10 @@ small_pool::add_more_objects() {
     while (_free_count < goal) {
         disable_backtrace_temporarily dbt;
         auto span_size = _span_sizes.preferred;
-        auto data = reinterpret_cast<char*>(cpu_mem.allocate_large(span_size));
+        auto data = reinterpret_cast<char*>(cpu_mem.allocate_large(span_size, _group));
         if (!data) {
             span_size = _span_sizes.fallback;
-            data = reinterpret_cast<char*>(cpu_mem.allocate_large(span_size));
+            data = reinterpret_cast<char*>(cpu_mem.allocate_large(span_size, _group));
             if (!data) {
                 return;
             }
@@ -1159,6 +1661,7 @@ small_pool::trim_free_list() {
         if (--span->nr_small_alloc == 0) {
             _pages_in_use -= span->span_size;
             _span_list.erase(cpu_mem.pages, *span);
+            cpu_mem.uncharge(_group, span->span_size);
             cpu_mem.free_span(span - cpu_mem.pages, span->span_size);
         }
     }
@@ -1178,7 +1681,7 @@ void* allocate_large(size_t size) {
     if ((size_t(size_in_pages) << page_bits) < size) {
         return nullptr; // (size + page_size - 1) caused an overflow
     }
-    return cpu_mem.allocate_large(size_in_pages);
+    return cpu_mem.allocate_large(size_in_pages, current_group());
 
 }
 
@@ -1186,11 +1689,32 @@ void* allocate_large_aligned(size_t align, size_t size) {
     abort_on_underflow(size);
     unsigned size_in_pages = (size + page_size - 1) >> page_bits;
     unsigned align_in_pages = std::max(align, page_size) >> page_bits;
-    return cpu_mem.allocate_large_aligned(align_in_pages, size_in_pages);
+    return cpu_mem.allocate_large_aligned(align_in_pages, size_in_pages, current_group());
 }
 
 void free_large(void* ptr) {
-    return cpu_mem.free_large(ptr);
+    cpu_mem.free_large(ptr);
+    cpu_mem.schedule_group_reclaim();
+}
+
+void* allocate_arena_chunk(size_t size) {
+    auto ptr = allocate_large(size);
+    if (!ptr) {
+        on_allocation_failure(size);
+        throw std::bad_alloc();
+    }
+    ++g_allocs;
+    auto span = cpu_mem.to_page(ptr);
+    for (unsigned i = 0; i < span->span_size; ++i) {
+        span[i].pool = arena_chunk_pool();
+    }
+    return ptr;
+}
+
+void free_arena_chunk(void* chunk) noexcept {
+    assert(object_cpu_id(chunk) == cpu_mem.cpu_id);
+    ++g_frees;
+    free_large(chunk);
 }
 
 size_t object_size(void* ptr) {
@@ -1322,13 +1846,14 @@ void disable_large_allocation_warning() {
 }
 
 void configure(std::vector<resource::memory> m, bool mbind,
-        optional<std::string> hugetlbfs_path) {
+        optional<std::string> hugetlbfs_path, huge_pages_mode hp_mode) {
     size_t total = 0;
 
     for (auto&& x : m) {
         total += x.bytes;
     }
     allocate_system_memory_fn sys_alloc = allocate_anonymous_memory;
+    cpu_mem.hp_mode = hp_mode;
     if (hugetlbfs_path) {
         // std::function is copyable, but file_desc is not, so we must use
         // a shared_ptr to allow sys_alloc to be copied around
@@ -1337,6 +1862,22 @@ void configure(std::vector<resource::memory> m, bool mbind,
             return allocate_hugetlbfs_memory(*fdp, where, how_much);
         };
         cpu_mem.replace_memory_backing(sys_alloc);
+        // Shared file pages stay in the file after MADV_DONTNEED
+        cpu_mem.can_release_memory = false;
+    } else if (hp_mode == huge_pages_mode::hugetlb) {
+        if (hugetlb_pool_has(total)) {
+            sys_alloc = allocate_hugetlb_memory;
+            cpu_mem.replace_memory_backing(sys_alloc);
+            // Pages returned to the pool may be gone when touched again,
+            // which would kill us with SIGBUS
+            cpu_mem.can_release_memory = false;
+        } else {
+            seastar_memory_logger.warn("The huge page pool has less than {} bytes free, using transparent huge pages", total);
+            cpu_mem.hp_mode = huge_pages_mode::transparent;
+        }
+    } else if (hp_mode == huge_pages_mode::none) {
+        // initialize() asked for transparent huge pages
+        cpu_mem.advise_huge_pages(cpu_mem.mem(), cpu_mem.nr_pages * page_size);
     }
 
     cpu_mem.resize(total, sys_alloc);
@@ -1362,9 +1903,31 @@ void configure(std::vector<resource::memory> m, bool mbind,
     }
 }
 
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+void prefault() {
+    auto start = cpu_mem.mem();
+    auto size = cpu_mem.nr_pages * page_size;
+    if (::madvise(start, size, MADV_POPULATE_WRITE) == 0 || errno != EINVAL) {
+        return;
+    }
+    // The kernel predates MADV_POPULATE_WRITE; take a write fault on every
+    // page. Some of the memory is already in use, so write it unchanged.
+    for (auto p = start; p < start + size; p += page_size) {
+        __atomic_fetch_add(p, 0, __ATOMIC_RELAXED);
+    }
+}
+
 statistics stats() {
     return statistics{g_allocs, g_frees, g_cross_cpu_frees,
-        cpu_mem.nr_pages * page_size, cpu_mem.nr_free_pages * page_size, g_reclaims, g_large_allocs};
+        cpu_mem.nr_pages * page_size, cpu_mem.nr_free_pages * page_size, g_reclaims, g_large_allocs,
+        cpu_mem.nr_free_huge_pages, cpu_mem.nr_released_pages * page_size, g_released_pages * page_size};
+}
+
+size_t release_idle_free_memory() {
+    return cpu_mem.release_idle_spans();
 }
 
 bool drain_cross_cpu_freelist() {
@@ -1383,6 +1946,31 @@ void set_min_free_pages(size_t pages) {
     cpu_mem.set_min_free_pages(pages);
 }
 
+size_t scheduling_group_memory_usage(unsigned group) {
+    return size_t(cpu_mem.groups[group].nr_pages) * page_size;
+}
+
+uint64_t scheduling_group_memory_limit_failures(unsigned group) {
+    return cpu_mem.groups[group].hard_limit_failures;
+}
+
+void set_scheduling_group_memory_limits(unsigned group, size_t soft_limit, size_t hard_limit) {
+    cpu_mem.set_group_memory_limits(group, soft_limit, hard_limit);
+}
+
+void set_scheduling_group_memory_pressure_handler(unsigned group, std::function<void (bool)> handler) {
+    if (group >= max_accounted_scheduling_groups) {
+        throw std::out_of_range(format("scheduling group {} is accounted with the default group", group));
+    }
+    cpu_mem.groups[group].pressure_handler = std::move(handler);
+}
+
+void reset_scheduling_group_memory(unsigned group) {
+    if (group < max_accounted_scheduling_groups) {
+        cpu_mem.reset_group(group);
+    }
+}
+
 static thread_local int report_on_alloc_failure_suppressed = 0;
 
 class disable_report_on_alloc_failure_temporarily {
@@ -1402,6 +1990,12 @@ void enable_abort_on_allocation_failure() {
 }
 
 void on_allocation_failure(size_t size) {
+    if (std::exchange(cpu_mem.group_limit_failure, false)) {
+        // Only the group over its limit fails, so this isn't worth a dump
+        // of the allocator's state, nor aborting with
+        // --abort-on-seastar-bad-alloc.
+        return;
+    }
     if (!report_on_alloc_failure_suppressed &&
             // report even suppressed failures if trace level is enabled
             (seastar_memory_logger.is_enabled(seastar::log_level::trace) ||
@@ -1414,10 +2008,17 @@ void on_allocation_failure(size_t size) {
         seastar_memory_logger.debug("Small pools:");
         seastar_memory_logger.debug("objsz spansz usedobj   memory       wst%");
         for (unsigned i = 0; i < cpu_mem.small_pools.nr_small_pools; i++) {
-            auto& sp = cpu_mem.small_pools[i];
-            auto use_count = sp._pages_in_use * page_size / sp.object_size() - sp._free_count;
-            auto memory = sp._pages_in_use * page_size;
-            auto wasted_percent = memory ? sp._free_count * sp.object_size() * 100.0 / memory : 0;
+            // Summed over the pools of all scheduling groups
+            auto& sp = cpu_mem.small_pools(0, i);
+            size_t pages_in_use = 0;
+            size_t free_count = 0;
+            for (unsigned g = 0; g < max_accounted_scheduling_groups; ++g) {
+                pages_in_use += cpu_mem.small_pools(g, i)._pages_in_use;
+                free_count += cpu_mem.small_pools(g, i)._free_count;
+            }
+            auto use_count = pages_in_use * page_size / sp.object_size() - free_count;
+            auto memory = pages_in_use * page_size;
+            auto wasted_percent = memory ? free_count * sp.object_size() * 100.0 / memory : 0;
             seastar_memory_logger.debug("{} {} {} {} {}", sp.object_size(), sp._span_sizes.preferred * page_size, use_count, memory, wasted_percent);
         }
         seastar_memory_logger.debug("Page spans:");
@@ -1827,6 +2428,20 @@ void set_heap_profiling_enabled(bool enabled) {
     seastar_logger.warn("Seastar compiled with default allocator, heap profiler not supported");
 }
 
+void set_heap_profiling_sample_period(size_t period) {
+    if (period) {
+        seastar_logger.warn("Seastar compiled with default allocator, heap profiler not supported");
+    }
+}
+
+size_t heap_profiling_sample_period() {
+    return 0;
+}
+
+heap_profile sample_heap_profile() {
+    return {};
+}
+
 void enable_abort_on_allocation_failure() {
     seastar_logger.warn("Seastar compiled with default allocator, will not abort on bad_alloc");
 }
@@ -1843,11 +2458,18 @@ reclaimer::~reclaimer() {
 void set_reclaim_hook(std::function<void (std::function<void ()>)> hook) {
 }
 
-void configure(std::vector<resource::memory> m, bool mbind, compat::optional<std::string> hugepages_path) {
+void configure(std::vector<resource::memory> m, bool mbind, compat::optional<std::string> hugepages_path, huge_pages_mode hp_mode) {
+}
+
+void prefault() {
 }
 
 statistics stats() {
-    return statistics{0, 0, 0, 1 << 30, 1 << 30, 0, 0};
+    return statistics{0, 0, 0, 1 << 30, 1 << 30, 0, 0, (1 << 30) / huge_page_size, 0, 0};
+}
+
+size_t release_idle_free_memory() {
+    return 0;
 }
 
 bool drain_cross_cpu_freelist() {
@@ -1866,6 +2488,38 @@ void set_min_free_pages(size_t pages) {
     // Ignore, reclaiming not supported for default allocator.
 }
 
+void* allocate_arena_chunk(size_t size) {
+    auto ptr = ::aligned_alloc(page_size, align_up(size, page_size));
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void free_arena_chunk(void* chunk) noexcept {
+    ::free(chunk);
+}
+
+size_t scheduling_group_memory_usage(unsigned group) {
+    return 0;
+}
+
+uint64_t scheduling_group_memory_limit_failures(unsigned group) {
+    return 0;
+}
+
+void set_scheduling_group_memory_limits(unsigned group, size_t soft_limit, size_t hard_limit) {
+    // Ignore, memory isn't accounted with the default allocator.
+}
+
+void set_scheduling_group_memory_pressure_handler(unsigned group, std::function<void (bool)> handler) {
+    // Ignore, memory isn't accounted with the default allocator.
+}
+
+void reset_scheduling_group_memory(unsigned group) {
+    // Ignore, memory isn't accounted with the default allocator.
+}
+
 void set_large_allocation_warning_threshold(size_t) {
     // Ignore, not supported for default allocator.
 }
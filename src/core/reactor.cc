@@ -23,6 +23,7 @@
 
 #include <cinttypes>
 #include <sys/syscall.h>
+#include <ucontext.h>
 #include <sys/vfs.h>
 #include <sys/statfs.h>
 #include <sys/time.h>
@@ -48,6 +49,7 @@
 #include <seastar/util/log.hh>
 #include "core/file-impl.hh"
 #include "syscall_work_queue.hh"
+#include "linux-uring.hh"
 #include "cgroup.hh"
 #include "uname.hh"
 #include <cassert>
@@ -69,6 +71,9 @@
 #include <boost/range/adaptor/map.hpp>
 #include <boost/version.hpp>
 #include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 #include <dirent.h>
 #include <linux/types.h> // for xfs, below
 #include <sys/ioctl.h>
@@ -90,9 +95,7 @@
 #include <cxxabi.h>
 #endif
 
-#ifdef SEASTAR_SHUFFLE_TASK_QUEUE
 #include <random>
-#endif
 
 #include <sys/mman.h>
 #include <sys/utsname.h>
@@ -154,6 +157,78 @@ struct convert<seastar::mountpoint_params> {
 
 namespace seastar {
 
+// The "reactor_backend" interface provides a method of waiting for various
+// basic events on one thread. We have one implementation based on epoll and
+// file-descriptors (reactor_backend_epoll), one based on linux aio
+// (reactor_backend_aio), one based on io_uring (reactor_backend_uring) and
+// one implementation based on OSv-specific file-descriptor-less mechanisms
+// (reactor_backend_osv).
+class reactor_backend {
+public:
+    virtual ~reactor_backend() {};
+    // Hands the disk I/O queued by reactor::submit_io() to the kernel, and
+    // reaps its completions. Returns true if work was done.
+    virtual bool kernel_submit_work() = 0;
+    virtual bool reap_kernel_completions() = 0;
+    // Returns true if completions of in-flight kernel work wake up a
+    // sleeping reactor, so it need not keep polling for them.
+    virtual bool kernel_events_can_sleep() const = 0;
+    // wait_and_process() waits for some events to become available, and
+    // processes one or more of them. If block==false, it doesn't wait,
+    // and just processes events that have already happened, if any.
+    // After the optional wait, just before processing the events, the
+    // pre_process() function is called.
+    virtual bool wait_and_process(int timeout = -1, const sigset_t* active_sigmask = nullptr) = 0;
+    // Methods that allow polling on file descriptors. This will only work on
+    // reactor_backend_epoll. Other reactor_backend will probably abort if
+    // they are called (which is fine if no file descriptors are waited on):
+    virtual future<> readable(pollable_fd_state& fd) = 0;
+    virtual future<> writeable(pollable_fd_state& fd) = 0;
+    virtual future<> readable_or_writeable(pollable_fd_state& fd) = 0;
+    virtual void forget(pollable_fd_state& fd) = 0;
+    // Socket operations submitted to the kernel as a whole, completing the
+    // future directly rather than waking up a readiness wait that is then
+    // followed by the system call. Only used (with --async-socket-io) if
+    // supports_async_socket_io() returns true.
+    virtual bool supports_async_socket_io() const { return false; }
+    virtual future<pollable_fd, socket_address> accept(pollable_fd_state& listenfd);
+    virtual future<size_t> recv(pollable_fd_state& fd, void* buffer, size_t len);
+    virtual future<size_t> send(pollable_fd_state& fd, const void* buffer, size_t len);
+    virtual future<size_t> sendmsg(pollable_fd_state& fd, const ::msghdr& msg);
+    // Calls reactor::signal_received(signo) when relevant
+    virtual void handle_signal(int signo) = 0;
+    virtual void start_tick() = 0;
+    virtual void stop_tick() = 0;
+    virtual void arm_highres_timer(const ::itimerspec& ts) = 0;
+    virtual void reset_preemption_monitor() = 0;
+    virtual void request_preemption() = 0;
+    virtual void start_handling_signal() = 0;
+};
+
+static std::logic_error async_socket_io_unsupported() {
+    return std::logic_error("reactor backend does not support asynchronous socket I/O");
+}
+
+future<pollable_fd, socket_address>
+reactor_backend::accept(pollable_fd_state& listenfd) {
+    return make_exception_future<pollable_fd, socket_address>(async_socket_io_unsupported());
+}
+
+future<size_t>
+reactor_backend::recv(pollable_fd_state& fd, void* buffer, size_t len) {
+    return make_exception_future<size_t>(async_socket_io_unsupported());
+}
+
+future<size_t>
+reactor_backend::send(pollable_fd_state& fd, const void* buffer, size_t len) {
+    return make_exception_future<size_t>(async_socket_io_unsupported());
+}
+
+future<size_t>
+reactor_backend::sendmsg(pollable_fd_state& fd, const ::msghdr& msg) {
+    return make_exception_future<size_t>(async_socket_io_unsupported());
+}
+
 io_priority_class
 reactor::register_one_priority_class(sstring name, uint32_t shares) {
     return io_queue::register_one_priority_class(std::move(name), shares);
@@ -168,6 +243,9 @@ reactor::update_shares_for_class(io_priority_class pc, uint32_t shares) {
 
 future<pollable_fd, socket_address>
 reactor::accept(pollable_fd_state& listenfd) {
+    if (_async_socket_io) {
+        return _backend->accept(listenfd);
+    }
     return readable_or_writeable(listenfd).then([&listenfd] () mutable {
         socket_address sa;
         socklen_t sl = sizeof(&sa.u.sas);
@@ -179,6 +257,9 @@ reactor::accept(pollable_fd_state& listenfd) {
 
 future<size_t>
 reactor::read_some(pollable_fd_state& fd, void* buffer, size_t len) {
+    if (_async_socket_io) {
+        return _backend->recv(fd, buffer, len);
+    }
     return readable(fd).then([this, &fd, buffer, len] () mutable {
         auto r = fd.fd.read(buffer, len);
         if (!r) {
@@ -210,6 +291,9 @@ reactor::read_some(pollable_fd_state& fd, const std::vector<iovec>& iov) {
 
 future<size_t>
 reactor::write_some(pollable_fd_state& fd, const void* buffer, size_t len) {
+    if (_async_socket_io) {
+        return _backend->send(fd, buffer, len);
+    }
     return writeable(fd).then([this, &fd, buffer, len] () mutable {
         auto r = fd.fd.send(buffer, len, MSG_NOSIGNAL);
         if (!r) {
@@ -262,15 +346,22 @@ future<> pollable_fd::write_all(const uint8_t* buffer, size_t size) {
 
 inline
 future<size_t> pollable_fd::write_some(net::packet& p) {
+    static_assert(offsetof(iovec, iov_base) == offsetof(net::fragment, base) &&
+        sizeof(iovec::iov_base) == sizeof(net::fragment::base) &&
+        offsetof(iovec, iov_len) == offsetof(net::fragment, size) &&
+        sizeof(iovec::iov_len) == sizeof(net::fragment::size) &&
+        alignof(iovec) == alignof(net::fragment) &&
+        sizeof(iovec) == sizeof(net::fragment)
+        , "net::fragment and iovec should be equivalent");
+    if (engine()._async_socket_io) {
+        // The fragment array stays alive until the future resolves; the
+        // backend keeps its own copy of the msghdr.
+        msghdr mh = {};
+        mh.msg_iov = reinterpret_cast<iovec*>(p.fragment_array());
+        mh.msg_iovlen = std::min<size_t>(p.nr_frags(), IOV_MAX);
+        return engine()._backend->sendmsg(*_s, mh);
+    }
     return engine().writeable(*_s).then([this, &p] () mutable {
-        static_assert(offsetof(iovec, iov_base) == offsetof(net::fragment, base) &&
-            sizeof(iovec::iov_base) == sizeof(net::fragment::base) &&
-            offsetof(iovec, iov_len) == offsetof(net::fragment, size) &&
-            sizeof(iovec::iov_len) == sizeof(net::fragment::size) &&
-            alignof(iovec) == alignof(net::fragment) &&
-            sizeof(iovec) == sizeof(net::fragment)
-            , "net::fragment and iovec should be equivalent");
-
         iovec* iov = reinterpret_cast<iovec*>(p.fragment_array());
         msghdr mh = {};
         mh.msg_iov = iov;
@@ -509,25 +600,40 @@ template class timer<steady_clock_type>;
 template class timer<lowres_clock>;
 template class timer<manual_clock>;
 
+class syscall_thread_pool;
+
+// A shard's connection to the syscall threads of its NUMA node
 class thread_pool {
     reactor* _reactor;
     uint64_t _aio_threaded_fallbacks = 0;
 #ifndef HAVE_OSV
     syscall_work_queue inter_thread_wq;
-    posix_thread _worker_thread;
-    std::atomic<bool> _stopped = { false };
+    // Only used if the reactor wasn't started by smp::configure()
+    std::unique_ptr<syscall_thread_pool> _own_pool;
+    syscall_thread_pool& _pool;
+    // Calls being processed by a syscall thread; guarded by the pool's lock
+    unsigned _in_flight = 0;
     std::atomic<bool> _main_thread_idle = { false };
+    internal::log_histogram _queue_wait;
+    internal::log_histogram _service_time;
 public:
     explicit thread_pool(reactor* r, sstring thread_name);
     ~thread_pool();
     template <typename T, typename Func>
-    future<T> submit(Func func) {
+    future<T> submit(Func func, syscall_priority priority = syscall_priority::normal) {
         ++_aio_threaded_fallbacks;
-        return inter_thread_wq.submit<T>(std::move(func));
+        return inter_thread_wq.submit<T>(std::move(func), priority);
     }
     uint64_t operation_count() const { return _aio_threaded_fallbacks; }
-
-    unsigned complete() { return inter_thread_wq.complete(); }
+    // From submission until a syscall thread picked up the call
+    const internal::log_histogram& queue_wait() const { return _queue_wait; }
+    // How long the call took to run on the syscall thread
+    const internal::log_histogram& service_time() const { return _service_time; }
+
+    // Tells the syscall threads about the calls submitted since the last
+    // time, so that a batch of calls costs at most one wakeup.
+    void announce();
+    unsigned complete();
     // Before we enter interrupt mode, we must make sure that the syscall thread will properly
     // generate signals to wake us up. This means we need to make sure that all modifications to
     // the pending and completed fields in the inter_thread_wq are visible to all threads.
@@ -543,12 +649,49 @@ class thread_pool {
 #else
 public:
     template <typename T, typename Func>
-    future<T> submit(Func func) { std::cout << "thread_pool not yet implemented on osv\n"; abort(); }
+    future<T> submit(Func func, syscall_priority priority = syscall_priority::normal) { std::cout << "thread_pool not yet implemented on osv\n"; abort(); }
 #endif
 private:
-    void work(sstring thread_name);
+    void wake_reactor();
+    friend class syscall_thread_pool;
+};
+
+#ifndef HAVE_OSV
+
+// Runs the blocking calls submitted by all the shards of a NUMA node, on a
+// bounded number of threads. Calls are picked up in priority order, and in
+// round-robin order across shards within a priority.
+class syscall_thread_pool {
+    using work_item = syscall_work_queue::work_item;
+    std::mutex _mutex;
+    std::condition_variable _work_available;
+    std::condition_variable _drained;
+    std::vector<thread_pool*> _clients;
+    unsigned _next_client = 0;
+    bool _stopped = false;
+    // Bumped by shards when they announce new calls
+    std::atomic<uint64_t> _submissions = { 0 };
+    std::atomic<unsigned> _idle_workers = { 0 };
+    compat::optional<cpu_set_t> _cpus;
+    std::vector<posix_thread> _workers;
+public:
+    // Starts nr_workers threads, allowed to run on cpus, or anywhere if it's empty.
+    syscall_thread_pool(sstring name, unsigned nr_workers, const std::vector<unsigned>& cpus);
+    ~syscall_thread_pool();
+    void add_client(thread_pool* tp);
+    // Waits for the client's calls which are being processed.
+    void remove_client(thread_pool* tp);
+    void announce(unsigned nr);
+private:
+    void work(sstring name);
+    std::pair<thread_pool*, work_item*> pop_pending();
 };
 
+// One per NUMA node, shared by the node's shards; set up by smp::configure()
+static std::vector<std::unique_ptr<syscall_thread_pool>> syscall_pools;
+
+#endif
+
 template <typename T>
 struct syscall_result {
     T result;
@@ -613,36 +756,6 @@ inline int alarm_signal() {
     return SIGRTMIN;
 }
 
-// The "reactor_backend" interface provides a method of waiting for various
-// basic events on one thread. We have one implementation based on epoll and
-// file-descriptors (reactor_backend_epoll) and one implementation based on
-// OSv-specific file-descriptor-less mechanisms (reactor_backend_osv).
-class reactor_backend {
-public:
-    virtual ~reactor_backend() {};
-    // wait_and_process() waits for some events to become available, and
-    // processes one or more of them. If block==false, it doesn't wait,
-    // and just processes events that have already happened, if any.
-    // After the optional wait, just before processing the events, the
-    // pre_process() function is called.
-    virtual bool wait_and_process(int timeout = -1, const sigset_t* active_sigmask = nullptr) = 0;
-    // Methods that allow polling on file descriptors. This will only work on
-    // reactor_backend_epoll. Other reactor_backend will probably abort if
-    // they are called (which is fine if no file descriptors are waited on):
-    virtual future<> readable(pollable_fd_state& fd) = 0;
-    virtual future<> writeable(pollable_fd_state& fd) = 0;
-    virtual future<> readable_or_writeable(pollable_fd_state& fd) = 0;
-    virtual void forget(pollable_fd_state& fd) = 0;
-    // Calls reactor::signal_received(signo) when relevant
-    virtual void handle_signal(int signo) = 0;
-    virtual void start_tick() = 0;
-    virtual void stop_tick() = 0;
-    virtual void arm_highres_timer(const ::itimerspec& ts) = 0;
-    virtual void reset_preemption_monitor() = 0;
-    virtual void request_preemption() = 0;
-    virtual void start_handling_signal() = 0;
-};
-
 // reactor backend using file-descriptor & epoll, suitable for running on
 // Linux. Can wait on multiple file descriptors, and converts other events
 // (such as timers, signals, inter-thread notifications) into file descriptors
@@ -662,6 +775,9 @@ class reactor_backend_epoll : public reactor_backend {
 public:
     explicit reactor_backend_epoll(reactor* r);
     virtual ~reactor_backend_epoll() override;
+    virtual bool kernel_submit_work() override;
+    virtual bool reap_kernel_completions() override;
+    virtual bool kernel_events_can_sleep() const override;
     virtual bool wait_and_process(int timeout, const sigset_t* active_sigmask) override;
     virtual future<> readable(pollable_fd_state& fd) override;
     virtual future<> writeable(pollable_fd_state& fd) override;
@@ -706,68 +822,61 @@ void setup_aio_context(size_t nr, linux_abi::aio_context_t* io_context) {
     }
 }
 
-class reactor_backend_aio : public reactor_backend {
-    static constexpr size_t max_polls = 10000;
-    reactor* _r;
-    // We use two aio contexts, one for preempting events (the timer tick and
-    // signals), the other for non-preempting events (fd poll).
-    struct context {
-        explicit context(size_t nr) : iocbs(new iocb*[nr]) {
-            setup_aio_context(nr, &io_context);
-        }
-        ~context() {
-            io_destroy(io_context);
-        }
-        linux_abi::aio_context_t io_context{};
-        std::unique_ptr<linux_abi::iocb*[]> iocbs;
-        iocb** last = iocbs.get();
-        void replenish(linux_abi::iocb* iocb, bool& flag) {
-            if (!flag) {
-                flag = true;
-                queue(iocb);
-            }
-        }
-        void queue(linux_abi::iocb* iocb) {
-            *last++ = iocb;
+// An aio context that iocbs are queued to, and submitted in batches by flush().
+struct aio_general_context {
+    explicit aio_general_context(size_t nr) : iocbs(new iocb*[nr]) {
+        setup_aio_context(nr, &io_context);
+    }
+    ~aio_general_context() {
+        io_destroy(io_context);
+    }
+    linux_abi::aio_context_t io_context{};
+    std::unique_ptr<linux_abi::iocb*[]> iocbs;
+    iocb** last = iocbs.get();
+    void replenish(linux_abi::iocb* iocb, bool& flag) {
+        if (!flag) {
+            flag = true;
+            queue(iocb);
         }
-        void flush() {
-            if (last != iocbs.get()) {
-                auto nr = last - iocbs.get();
-                last = iocbs.get();
-                io_submit(io_context, nr, iocbs.get());
-            }
+    }
+    void queue(linux_abi::iocb* iocb) {
+        *last++ = iocb;
+    }
+    void flush() {
+        if (last != iocbs.get()) {
+            auto nr = last - iocbs.get();
+            last = iocbs.get();
+            io_submit(io_context, nr, iocbs.get());
         }
-    };
-    context _preempting_io{2}; // Used for the timer tick and the high resolution timer
-    context _polling_io{max_polls}; // FIXME: unify with disk aio_context
-    file_desc _steady_clock_timer = make_timerfd();
+    }
+};
+
+// Polls the task quota timer and the high resolution timer through a small aio
+// context whose completion ring doubles as the preemption monitor, so that
+// the kernel preempts a running task by queuing a completion event.
+class preempt_io_context {
+    reactor* _r;
+    file_desc& _steady_clock_timer;
+    aio_general_context _preempting_io{2}; // Used for the timer tick and the high resolution timer
     linux_abi::iocb _task_quota_timer_iocb;
     linux_abi::iocb _timerfd_iocb;
-    linux_abi::iocb _smp_wakeup_iocb;
     bool _task_quota_timer_in_preempting_io = false;
     bool _timerfd_in_preempting_io = false;
-    bool _timerfd_in_polling_io = false;
-    bool _smp_wakeup_in_polling_io = false;
-    std::stack<std::unique_ptr<linux_abi::iocb>> _iocb_pool;
 private:
-    linux_abi::iocb* new_iocb() {
-        if (_iocb_pool.empty()) {
-            return new linux_abi::iocb;
-        }
-        auto ret = _iocb_pool.top().release();
-        _iocb_pool.pop();
-        return ret;
-    }
-    void free_iocb(linux_abi::iocb* iocb) {
-        _iocb_pool.push(std::unique_ptr<linux_abi::iocb>(iocb));
-    }
-    static file_desc make_timerfd() {
-        return file_desc::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK);
-    }
     void process_task_quota_timer() {
         uint64_t v;
         (void)_r->_task_quota_timer.read(&v, 8);
     }
+public:
+    preempt_io_context(reactor* r, file_desc& steady_clock_timer)
+            : _r(r), _steady_clock_timer(steady_clock_timer) {
+        _task_quota_timer_iocb = make_poll_iocb(_r->_task_quota_timer.get(), POLLIN);
+        _timerfd_iocb = make_poll_iocb(_steady_clock_timer.get(), POLLIN);
+        // Protect against spurious wakeups - if we get notified that the timer has
+        // expired when it really hasn't, we don't want to block in read(tfd, ...).
+        auto tfd = _r->_task_quota_timer.get();
+        ::fcntl(tfd, F_SETFL, ::fcntl(tfd, F_GETFL) | O_NONBLOCK);
+    }
     void process_timerfd() {
         uint64_t expirations = 0;
         _steady_clock_timer.read(&expirations, 8);
@@ -775,10 +884,6 @@ class reactor_backend_aio : public reactor_backend {
             _r->service_highres_timer();
         }
     }
-    void process_smp_wakeup() {
-        uint64_t ignore = 0;
-        _r->_notify_eventfd.read(&ignore, 8);
-    }
     bool service_preempting_io() {
         linux_abi::io_event a[2];
         auto r = io_getevents(_preempting_io.io_context, 0, 2, a, 0);
@@ -796,6 +901,71 @@ class reactor_backend_aio : public reactor_backend {
         }
         return did_work;
     }
+    void start_tick() {
+        // Preempt whenever an event (timer tick or signal) is available on the
+        // _preempting_io ring
+        g_need_preempt = reinterpret_cast<const preemption_monitor*>(_preempting_io.io_context + 8);
+        // reactor::request_preemption() will write to reactor::_preemption_monitor, which is now ignored
+    }
+    void stop_tick() {
+        g_need_preempt = &_r->_preemption_monitor;
+    }
+    void reset_preemption_monitor() {
+        service_preempting_io();
+        _preempting_io.replenish(&_timerfd_iocb, _timerfd_in_preempting_io);
+        _preempting_io.replenish(&_task_quota_timer_iocb, _task_quota_timer_in_preempting_io);
+        _preempting_io.flush();
+    }
+    void request_preemption() {
+        ::itimerspec expired = {};
+        expired.it_value.tv_nsec = 1;
+        _steady_clock_timer.timerfd_settime(TFD_TIMER_ABSTIME, expired); // will trigger immediately, triggering the preemption monitor
+
+        // This might have been called from poll_once. If that is the case, we cannot assume that timerfd is being
+        // monitored.
+        _preempting_io.replenish(&_timerfd_iocb, _timerfd_in_preempting_io);
+        _preempting_io.flush();
+
+        // The kernel is not obliged to deliver the completion immediately, so wait for it
+        while (!need_preempt()) {
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        }
+    }
+};
+
+static file_desc make_timerfd() {
+    return file_desc::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK);
+}
+
+class reactor_backend_aio : public reactor_backend {
+    static constexpr size_t max_polls = 10000;
+    reactor* _r;
+    // We use two aio contexts, one for preempting events (the timer tick and
+    // signals), the other for non-preempting events (fd poll).
+    file_desc _steady_clock_timer = make_timerfd();
+    preempt_io_context _preempt_io_context;
+    aio_general_context _polling_io{max_polls}; // FIXME: unify with disk aio_context
+    linux_abi::iocb _timerfd_iocb;
+    linux_abi::iocb _smp_wakeup_iocb;
+    bool _timerfd_in_polling_io = false;
+    bool _smp_wakeup_in_polling_io = false;
+    std::stack<std::unique_ptr<linux_abi::iocb>> _iocb_pool;
+private:
+    linux_abi::iocb* new_iocb() {
+        if (_iocb_pool.empty()) {
+            return new linux_abi::iocb;
+        }
+        auto ret = _iocb_pool.top().release();
+        _iocb_pool.pop();
+        return ret;
+    }
+    void free_iocb(linux_abi::iocb* iocb) {
+        _iocb_pool.push(std::unique_ptr<linux_abi::iocb>(iocb));
+    }
+    void process_smp_wakeup() {
+        uint64_t ignore = 0;
+        _r->_notify_eventfd.read(&ignore, 8);
+    }
     bool await_events(int timeout, const sigset_t* active_sigmask) {
         ::timespec ts = {};
         ::timespec* tsp = [&] () -> ::timespec* {
@@ -824,7 +994,7 @@ class reactor_backend_aio : public reactor_backend {
                 auto iocb = get_iocb(event);
                 if (iocb == &_timerfd_iocb) {
                     _timerfd_in_polling_io = false;
-                    process_timerfd();
+                    _preempt_io_context.process_timerfd();
                     continue;
                 } else if (iocb == &_smp_wakeup_iocb) {
                     _smp_wakeup_in_polling_io = false;
@@ -845,10 +1015,348 @@ class reactor_backend_aio : public reactor_backend {
         engine()._signals.action(signo, siginfo, ignore);
     }
 private:
-    class io_poll_poller : public reactor::pollfn {
-        reactor_backend_aio* _backend;
+    class io_poll_poller : public reactor::pollfn {
+        reactor_backend_aio* _backend;
+    public:
+        explicit io_poll_poller(reactor_backend_aio* b) : _backend(b) {}
+        virtual bool poll() override {
+            return _backend->wait_and_process(0, nullptr);
+        }
+        virtual bool pure_poll() override {
+            return _backend->wait_and_process(0, nullptr);
+        }
+        virtual bool try_enter_interrupt_mode() override {
+            return true;
+        }
+        virtual void exit_interrupt_mode() override {}
+    };
+public:
+    explicit reactor_backend_aio(reactor* r)
+            : _r(r)
+            , _preempt_io_context(r, _steady_clock_timer) {
+        _timerfd_iocb = make_poll_iocb(_steady_clock_timer.get(), POLLIN);
+        _smp_wakeup_iocb = make_poll_iocb(_r->_notify_eventfd.get(), POLLIN);
+    }
+    virtual bool kernel_submit_work() override {
+        return _r->flush_pending_aio();
+    }
+    virtual bool reap_kernel_completions() override {
+        return _r->process_io();
+    }
+    virtual bool kernel_events_can_sleep() const override {
+        return false;
+    }
+    virtual bool wait_and_process(int timeout, const sigset_t* active_sigmask) override {
+        bool did_work = _preempt_io_context.service_preempting_io();
+        if (did_work) {
+            timeout = 0;
+        }
+        _polling_io.replenish(&_timerfd_iocb, _timerfd_in_polling_io);
+        _polling_io.replenish(&_smp_wakeup_iocb, _smp_wakeup_in_polling_io);
+        _polling_io.flush();
+        did_work |= await_events(timeout, active_sigmask);
+        did_work |= _preempt_io_context.service_preempting_io(); // clear task quota timer
+        return did_work;
+    }
+    future<> poll(pollable_fd_state& fd, promise<> pollable_fd_state::*promise_field, int events) {
+        if (!_r->_epoll_poller) {
+            _r->_epoll_poller = reactor::poller(std::make_unique<io_poll_poller>(this));
+        }
+        try {
+            if (events & fd.events_known) {
+                fd.events_known &= ~events;
+                return make_ready_future<>();
+            }
+            auto iocb = new_iocb(); // FIXME: merge with pollable_fd_state
+            *iocb = make_poll_iocb(fd.fd.get(), events);
+            fd.events_rw = events == (POLLIN|POLLOUT);
+            auto pr = &(fd.*promise_field);
+            *pr = promise<>();
+            set_user_data(*iocb, pr);
+            _polling_io.queue(iocb);
+            return pr->get_future();
+        } catch (...) {
+            return make_exception_future<>(std::current_exception());
+        }
+    }
+    virtual future<> readable(pollable_fd_state& fd) override {
+        return poll(fd, &pollable_fd_state::pollin, POLLIN);
+    }
+    virtual future<> writeable(pollable_fd_state& fd) override {
+        return poll(fd, &pollable_fd_state::pollout, POLLOUT);
+    }
+    virtual future<> readable_or_writeable(pollable_fd_state& fd) override {
+        return poll(fd, &pollable_fd_state::pollin, POLLIN|POLLOUT);
+    }
+    virtual void forget(pollable_fd_state& fd) override {
+        // ?
+    }
+    virtual void handle_signal(int signo) override {
+        struct sigaction sa;
+        sa.sa_sigaction = signal_received;
+        sa.sa_mask = make_empty_sigset_mask();
+        sa.sa_flags = SA_SIGINFO | SA_RESTART;
+        auto r = ::sigaction(signo, &sa, nullptr);
+        throw_system_error_on(r == -1);
+        auto mask = make_sigset_mask(signo);
+        r = ::pthread_sigmask(SIG_UNBLOCK, &mask, NULL);
+        throw_pthread_error(r);
+    }
+    virtual void start_tick() override {
+        _preempt_io_context.start_tick();
+    }
+    virtual void stop_tick() override {
+        _preempt_io_context.stop_tick();
+    }
+    virtual void arm_highres_timer(const ::itimerspec& its) override {
+        _steady_clock_timer.timerfd_settime(TFD_TIMER_ABSTIME, its);
+    }
+    virtual void reset_preemption_monitor() override {
+        _preempt_io_context.reset_preemption_monitor();
+    }
+    virtual void request_preemption() override {
+        _preempt_io_context.request_preemption();
+    }
+    virtual void start_handling_signal() override {
+        // The aio backend only uses SIGHUP/SIGTERM/SIGINT. We don't need to handle them right away and our
+        // implementation of request_preemption is not signal safe, so do nothing.
+    }
+};
+
+// reactor backend using io_uring. Disk I/O, file descriptor polls, the high
+// resolution timer and the smp wakeup eventfd are all queued to a single
+// submission ring, which is handed to the kernel once per reactor iteration;
+// completions are reaped from the shared completion ring without a system
+// call. Preemption uses the same aio-based monitor as reactor_backend_aio.
+class reactor_backend_uring : public reactor_backend {
+    static constexpr unsigned queue_len = 1024;
+    static constexpr unsigned completion_queue_len = 16384;
+    // Completions are routed by the low bits of user_data; the remaining bits
+    // hold a pointer to the object the completion is for.
+    enum class completion_kind : uint64_t {
+        disk_io = 0,    // linux_abi::iocb* from reactor::_iocb_pool
+        fd_pollin = 1,  // pollable_fd_state*, completes pollin
+        fd_pollout = 2, // pollable_fd_state*, completes pollout
+        timerfd = 3,
+        smp_wakeup = 4,
+        ignore = 5,     // poll removals, cancellations and wait timeouts
+        socket_op = 6,  // socket_op*, with --async-socket-io
+    };
+    static constexpr uint64_t completion_kind_mask = 7;
+    static_assert(alignof(pollable_fd_state) > completion_kind_mask, "pollable_fd_state pointers can't be tagged");
+    static_assert(alignof(linux_abi::iocb) > completion_kind_mask, "iocb pointers can't be tagged");
+    // A socket operation submitted as a whole. It owns whatever the kernel
+    // accesses until completion (other than the data buffers), and occupies
+    // one of the fd's async_read/async_write slots so forget() can cancel it.
+    class socket_op {
+        pollable_fd_state& _fd;
+        uint64_t pollable_fd_state::* _slot;
+    public:
+        socket_op(pollable_fd_state& fd, uint64_t pollable_fd_state::* slot) : _fd(fd), _slot(slot) {}
+        virtual ~socket_op() {}
+        pollable_fd_state& fd() { return _fd; }
+        uint64_t pollable_fd_state::* slot() const { return _slot; }
+        void complete(int res) {
+            _fd.*_slot = 0;
+            do_complete(res);
+        }
+    private:
+        virtual void do_complete(int res) = 0;
+    };
+    static_assert(alignof(socket_op) > completion_kind_mask, "socket_op pointers can't be tagged");
+    // recv, send and sendmsg
+    class transfer_op final : public socket_op {
+        const char* _what;
+    public:
+        promise<size_t> pr;
+        ::msghdr msg = {};
+        transfer_op(pollable_fd_state& fd, uint64_t pollable_fd_state::* slot, const char* what)
+                : socket_op(fd, slot), _what(what) {}
+    private:
+        virtual void do_complete(int res) override {
+            if (res < 0) {
+                pr.set_exception(std::system_error(-res, std::system_category(), _what));
+            } else {
+                pr.set_value(res);
+            }
+        }
+    };
+    class accept_op final : public socket_op {
+    public:
+        promise<pollable_fd, socket_address> pr;
+        socket_address sa;
+        socklen_t sl = sizeof(sa.u.sas);
+        explicit accept_op(pollable_fd_state& listenfd) : socket_op(listenfd, &pollable_fd_state::async_read) {}
+    private:
+        virtual void do_complete(int res) override {
+            if (res < 0) {
+                pr.set_exception(std::system_error(-res, std::system_category(), "accept4"));
+                return;
+            }
+            try {
+                pollable_fd pfd(file_desc::from_fd(res), pollable_fd::speculation(EPOLLOUT));
+                pr.set_value(std::move(pfd), std::move(sa));
+            } catch (...) {
+                pr.set_exception(std::current_exception());
+            }
+        }
+    };
+    reactor* _r;
+    uring _uring{queue_len, completion_queue_len};
+    file_desc _steady_clock_timer = make_timerfd();
+    preempt_io_context _preempt_io_context;
+    linux_abi::kernel_timespec _wait_timeout = {};
+    bool _timerfd_polled = false;
+    bool _smp_wakeup_polled = false;
+    bool _socket_ops_supported = false;
+private:
+    static uint64_t make_user_data(const void* p, completion_kind kind) {
+        return reinterpret_cast<uintptr_t>(p) | uint64_t(kind);
+    }
+    static completion_kind get_kind(uint64_t user_data) {
+        return completion_kind(user_data & completion_kind_mask);
+    }
+    template <typename T>
+    static T* get_object(uint64_t user_data) {
+        return reinterpret_cast<T*>(uintptr_t(user_data & ~completion_kind_mask));
+    }
+    linux_abi::io_uring_sqe& get_sqe() {
+        auto sqe = _uring.get_sqe();
+        while (!sqe) {
+            // The submission queue is full, hand it over to the kernel now
+            submit(0, nullptr);
+            sqe = _uring.get_sqe();
+        }
+        return *sqe;
+    }
+    // Returns false if interrupted by a signal
+    bool submit(unsigned wait_nr, const sigset_t* active_sigmask) {
+        auto r = _uring.submit(wait_nr, active_sigmask);
+        if (r == -1) {
+            if (errno == EINTR) {
+                return false;
+            }
+            if (errno == EBUSY || errno == EAGAIN) {
+                // The kernel has a backlog of completions; make room for them
+                // and try again on the next call.
+                reap_completions();
+                return true;
+            }
+            throw_system_error_on(true, "io_uring_enter");
+        }
+        return true;
+    }
+    void prepare_disk_io(const linux_abi::iocb& io) {
+        auto& sqe = get_sqe();
+        switch (io.aio_lio_opcode) {
+        case linux_abi::iocb_cmd::PREAD:
+            sqe.opcode = linux_abi::io_uring_op::READ;
+            break;
+        case linux_abi::iocb_cmd::PWRITE:
+            sqe.opcode = linux_abi::io_uring_op::WRITE;
+            break;
+        case linux_abi::iocb_cmd::PREADV:
+            sqe.opcode = linux_abi::io_uring_op::READV;
+            break;
+        case linux_abi::iocb_cmd::PWRITEV:
+            sqe.opcode = linux_abi::io_uring_op::WRITEV;
+            break;
+        case linux_abi::iocb_cmd::FSYNC:
+            sqe.opcode = linux_abi::io_uring_op::FSYNC;
+            break;
+        case linux_abi::iocb_cmd::FDSYNC:
+            sqe.opcode = linux_abi::io_uring_op::FSYNC;
+            sqe.op_flags = linux_abi::IORING_FSYNC_DATASYNC;
+            break;
+        default:
+            abort();
+        }
+        sqe.fd = io.aio_fildes;
+        sqe.addr = io.aio_buf;
+        sqe.len = io.aio_nbytes;
+        sqe.off = io.aio_offset;
+        if (sqe.opcode != linux_abi::io_uring_op::FSYNC) {
+            sqe.op_flags = io.aio_rw_flags;
+#ifdef RWF_NOWAIT
+            // io_uring falls back to its own workers instead of failing with EAGAIN
+            sqe.op_flags &= ~RWF_NOWAIT;
+#endif
+        }
+        sqe.user_data = make_user_data(&io, completion_kind::disk_io);
+    }
+    void poll_fd(int fd, int events, uint64_t user_data) {
+        auto& sqe = get_sqe();
+        sqe.opcode = linux_abi::io_uring_op::POLL_ADD;
+        sqe.fd = fd;
+        sqe.op_flags = events;
+        sqe.user_data = user_data;
+    }
+    void replenish(int fd, completion_kind kind, bool& flag) {
+        if (!flag) {
+            flag = true;
+            poll_fd(fd, POLLIN, make_user_data(this, kind));
+        }
+    }
+    void complete_fd_poll(pollable_fd_state& fd, int slot, promise<> pollable_fd_state::* pr, int res) {
+        fd.events_epoll &= ~slot;
+        if (res == -ECANCELED) {
+            // Removed by forget()
+            return;
+        }
+        (fd.*pr).set_value();
+    }
+    void process_smp_wakeup() {
+        uint64_t ignore = 0;
+        _r->_notify_eventfd.read(&ignore, 8);
+    }
+    void process_completion(const linux_abi::io_uring_cqe& cqe) {
+        auto user_data = cqe.user_data;
+        switch (get_kind(user_data)) {
+        case completion_kind::disk_io: {
+            auto iocb = get_object<linux_abi::iocb>(user_data);
+            io_event ev{};
+            ev.data = iocb->aio_data;
+            ev.obj = reinterpret_cast<uintptr_t>(iocb);
+            ev.res = cqe.res;
+            _r->complete_aio(ev);
+            break;
+        }
+        case completion_kind::fd_pollin:
+            complete_fd_poll(*get_object<pollable_fd_state>(user_data), POLLIN, &pollable_fd_state::pollin, cqe.res);
+            break;
+        case completion_kind::fd_pollout:
+            complete_fd_poll(*get_object<pollable_fd_state>(user_data), POLLOUT, &pollable_fd_state::pollout, cqe.res);
+            break;
+        case completion_kind::timerfd:
+            _timerfd_polled = false;
+            _preempt_io_context.process_timerfd();
+            break;
+        case completion_kind::smp_wakeup:
+            _smp_wakeup_polled = false;
+            process_smp_wakeup();
+            break;
+        case completion_kind::ignore:
+            break;
+        case completion_kind::socket_op: {
+            std::unique_ptr<socket_op> op(get_object<socket_op>(user_data));
+            op->complete(cqe.res);
+            break;
+        }
+        }
+    }
+    bool reap_completions() {
+        return _uring.for_each_completion([this] (const linux_abi::io_uring_cqe& cqe) {
+            process_completion(cqe);
+        });
+    }
+    static void signal_received(int signo, siginfo_t* siginfo, void* ignore) {
+        engine()._signals.action(signo, siginfo, ignore);
+    }
+private:
+    class uring_poller : public reactor::pollfn {
+        reactor_backend_uring* _backend;
     public:
-        explicit io_poll_poller(reactor_backend_aio* b) : _backend(b) {}
+        explicit uring_poller(reactor_backend_uring* b) : _backend(b) {}
         virtual bool poll() override {
             return _backend->wait_and_process(0, nullptr);
         }
@@ -861,59 +1369,198 @@ class reactor_backend_aio : public reactor_backend {
         virtual void exit_interrupt_mode() override {}
     };
 public:
-    explicit reactor_backend_aio(reactor* r) : _r(r) {
-        _task_quota_timer_iocb = make_poll_iocb(_r->_task_quota_timer.get(), POLLIN);
-        _timerfd_iocb = make_poll_iocb(_steady_clock_timer.get(), POLLIN);
-        _smp_wakeup_iocb = make_poll_iocb(_r->_notify_eventfd.get(), POLLIN);
-        // Protect against spurious wakeups - if we get notified that the timer has
-        // expired when it really hasn't, we don't want to block in read(tfd, ...).
-        auto tfd = _r->_task_quota_timer.get();
-        ::fcntl(tfd, F_SETFL, ::fcntl(tfd, F_GETFL) | O_NONBLOCK);
+    void register_poller() {
+        if (!_r->_epoll_poller) {
+            _r->_epoll_poller = reactor::poller(std::make_unique<uring_poller>(this));
+        }
+    }
+    // Queues op for submission on the next poll, and returns its sqe for the
+    // caller to fill in the operation's arguments.
+    linux_abi::io_uring_sqe& prepare_socket_op(std::unique_ptr<socket_op> op, linux_abi::io_uring_op opcode) {
+        register_poller();
+        auto& fd = op->fd();
+        assert(!(fd.*op->slot()));
+        auto& sqe = get_sqe();
+        sqe.opcode = opcode;
+        sqe.fd = fd.fd.get();
+        sqe.user_data = make_user_data(op.get(), completion_kind::socket_op);
+        fd.*op->slot() = sqe.user_data;
+        op.release();
+        return sqe;
+    }
+    future<size_t> transfer(pollable_fd_state& fd, uint64_t pollable_fd_state::* slot, const char* what,
+            linux_abi::io_uring_op opcode, const void* buffer, size_t len, const ::msghdr* msg) {
+        try {
+            auto op = std::make_unique<transfer_op>(fd, slot, what);
+            auto f = op->pr.get_future();
+            uint64_t addr = reinterpret_cast<uintptr_t>(buffer);
+            if (msg) {
+                op->msg = *msg;
+                addr = reinterpret_cast<uintptr_t>(&op->msg);
+                len = 1;
+            }
+            auto& sqe = prepare_socket_op(std::move(op), opcode);
+            sqe.addr = addr;
+            sqe.len = len;
+            if (slot == &pollable_fd_state::async_write) {
+                sqe.op_flags = MSG_NOSIGNAL;
+            }
+            return f;
+        } catch (...) {
+            return make_exception_future<size_t>(std::current_exception());
+        }
     }
-    virtual bool wait_and_process(int timeout, const sigset_t* active_sigmask) override {
-        bool did_work = service_preempting_io();
-        if (did_work) {
-            timeout = 0;
+public:
+    explicit reactor_backend_uring(reactor* r)
+            : _r(r)
+            , _preempt_io_context(r, _steady_clock_timer) {
+        using op = linux_abi::io_uring_op;
+        _socket_ops_supported = io_uring_supports({op::RECV, op::SEND, op::SENDMSG, op::ACCEPT, op::ASYNC_CANCEL});
+    }
+    static bool supported() {
+        using op = linux_abi::io_uring_op;
+        return io_uring_supports({op::READ, op::WRITE, op::READV, op::WRITEV, op::FSYNC,
+                op::POLL_ADD, op::POLL_REMOVE, op::TIMEOUT});
+    }
+    virtual bool kernel_submit_work() override {
+        for (auto& ioq : _r->my_io_queues) {
+            ioq->poll_io_queue();
+        }
+        auto& pending = _r->_pending_aio;
+        bool did_work = !pending.empty();
+        for (size_t i = 0; i != pending.size(); ++i) {
+            prepare_disk_io(*pending[i]);
+        }
+        pending.clear();
+        // Once an fd is polled, wait_and_process() runs on every iteration and
+        // submits everything queued so far; leave it to that call, so that an
+        // iteration only enters the kernel once.
+        if (!_r->_epoll_poller) {
+            submit(0, nullptr);
         }
-        _polling_io.replenish(&_timerfd_iocb, _timerfd_in_polling_io);
-        _polling_io.replenish(&_smp_wakeup_iocb, _smp_wakeup_in_polling_io);
-        _polling_io.flush();
-        did_work |= await_events(timeout, active_sigmask);
-        did_work |= service_preempting_io(); // clear task quota timer
         return did_work;
     }
-    future<> poll(pollable_fd_state& fd, promise<> pollable_fd_state::*promise_field, int events) {
-        if (!_r->_epoll_poller) {
-            _r->_epoll_poller = reactor::poller(std::make_unique<io_poll_poller>(this));
+    virtual bool reap_kernel_completions() override {
+        return reap_completions();
+    }
+    virtual bool kernel_events_can_sleep() const override {
+        return true;
+    }
+    virtual bool wait_and_process(int timeout, const sigset_t* active_sigmask) override {
+        bool did_work = _preempt_io_context.service_preempting_io();
+        replenish(_steady_clock_timer.get(), completion_kind::timerfd, _timerfd_polled);
+        replenish(_r->_notify_eventfd.get(), completion_kind::smp_wakeup, _smp_wakeup_polled);
+        did_work |= reap_completions();
+        unsigned wait_nr = 0;
+        if (!did_work && timeout != 0) {
+            wait_nr = 1;
+            if (timeout > 0) {
+                auto ts = posix::to_timespec(timeout * 1ms);
+                _wait_timeout.tv_sec = ts.tv_sec;
+                _wait_timeout.tv_nsec = ts.tv_nsec;
+                auto& sqe = get_sqe();
+                sqe.opcode = linux_abi::io_uring_op::TIMEOUT;
+                sqe.addr = reinterpret_cast<uintptr_t>(&_wait_timeout);
+                sqe.len = 1;
+                sqe.off = 1; // also complete when any other completion arrives
+                sqe.user_data = make_user_data(this, completion_kind::ignore);
+            }
+        }
+        if (!submit(wait_nr, active_sigmask)) {
+            return true;
         }
+        did_work |= reap_completions();
+        did_work |= _preempt_io_context.service_preempting_io(); // clear task quota timer
+        return did_work;
+    }
+    future<> poll(pollable_fd_state& fd, promise<> pollable_fd_state::*promise_field, int events, completion_kind kind) {
+        register_poller();
         try {
             if (events & fd.events_known) {
                 fd.events_known &= ~events;
                 return make_ready_future<>();
             }
-            auto iocb = new_iocb(); // FIXME: merge with pollable_fd_state
-            *iocb = make_poll_iocb(fd.fd.get(), events);
             fd.events_rw = events == (POLLIN|POLLOUT);
             auto pr = &(fd.*promise_field);
             *pr = promise<>();
-            set_user_data(*iocb, pr);
-            _polling_io.queue(iocb);
+            poll_fd(fd.fd.get(), events, make_user_data(&fd, kind));
+            fd.events_epoll |= kind == completion_kind::fd_pollin ? POLLIN : POLLOUT;
             return pr->get_future();
         } catch (...) {
             return make_exception_future<>(std::current_exception());
         }
     }
     virtual future<> readable(pollable_fd_state& fd) override {
-        return poll(fd, &pollable_fd_state::pollin, POLLIN);
+        return poll(fd, &pollable_fd_state::pollin, POLLIN, completion_kind::fd_pollin);
     }
     virtual future<> writeable(pollable_fd_state& fd) override {
-        return poll(fd, &pollable_fd_state::pollout, POLLOUT);
+        return poll(fd, &pollable_fd_state::pollout, POLLOUT, completion_kind::fd_pollout);
     }
     virtual future<> readable_or_writeable(pollable_fd_state& fd) override {
-        return poll(fd, &pollable_fd_state::pollin, POLLIN|POLLOUT);
+        return poll(fd, &pollable_fd_state::pollin, POLLIN|POLLOUT, completion_kind::fd_pollin);
+    }
+    virtual bool supports_async_socket_io() const override {
+        return _socket_ops_supported;
+    }
+    virtual future<pollable_fd, socket_address> accept(pollable_fd_state& listenfd) override {
+        try {
+            auto op = std::make_unique<accept_op>(listenfd);
+            auto f = op->pr.get_future();
+            auto sa = &op->sa;
+            auto sl = &op->sl;
+            auto& sqe = prepare_socket_op(std::move(op), linux_abi::io_uring_op::ACCEPT);
+            sqe.addr = reinterpret_cast<uintptr_t>(&sa->u.sa);
+            sqe.off = reinterpret_cast<uintptr_t>(sl);
+            sqe.op_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            return f;
+        } catch (...) {
+            return make_exception_future<pollable_fd, socket_address>(std::current_exception());
+        }
+    }
+    virtual future<size_t> recv(pollable_fd_state& fd, void* buffer, size_t len) override {
+        return transfer(fd, &pollable_fd_state::async_read, "recv", linux_abi::io_uring_op::RECV, buffer, len, nullptr);
+    }
+    virtual future<size_t> send(pollable_fd_state& fd, const void* buffer, size_t len) override {
+        return transfer(fd, &pollable_fd_state::async_write, "send", linux_abi::io_uring_op::SEND, buffer, len, nullptr);
+    }
+    virtual future<size_t> sendmsg(pollable_fd_state& fd, const ::msghdr& msg) override {
+        return transfer(fd, &pollable_fd_state::async_write, "sendmsg", linux_abi::io_uring_op::SENDMSG, nullptr, 0, &msg);
     }
     virtual void forget(pollable_fd_state& fd) override {
-        // ?
+        auto in_flight = [&] {
+            return fd.events_epoll || fd.async_read || fd.async_write;
+        };
+        if (!in_flight()) {
+            return;
+        }
+        auto remove = [&] (int slot, completion_kind kind) {
+            if (fd.events_epoll & slot) {
+                auto& sqe = get_sqe();
+                sqe.opcode = linux_abi::io_uring_op::POLL_REMOVE;
+                sqe.addr = make_user_data(&fd, kind);
+                sqe.user_data = make_user_data(this, completion_kind::ignore);
+            }
+        };
+        auto cancel = [&] (uint64_t user_data) {
+            if (user_data) {
+                auto& sqe = get_sqe();
+                sqe.opcode = linux_abi::io_uring_op::ASYNC_CANCEL;
+                sqe.addr = user_data;
+                sqe.user_data = make_user_data(this, completion_kind::ignore);
+            }
+        };
+        remove(POLLIN, completion_kind::fd_pollin);
+        remove(POLLOUT, completion_kind::fd_pollout);
+        cancel(fd.async_read);
+        cancel(fd.async_write);
+        // Removed polls and cancelled socket operations still complete (with
+        // -ECANCELED) and refer to fd and its buffers, so wait for them before
+        // it is destroyed. Removal is processed synchronously by the kernel,
+        // so this doesn't block for long.
+        while (in_flight()) {
+            submit(1, nullptr);
+            reap_completions();
+        }
     }
     virtual void handle_signal(int signo) override {
         struct sigaction sa;
@@ -927,41 +1574,22 @@ class reactor_backend_aio : public reactor_backend {
         throw_pthread_error(r);
     }
     virtual void start_tick() override {
-        // Preempt whenever an event (timer tick or signal) is available on the
-        // _preempting_io ring
-        g_need_preempt = reinterpret_cast<const preemption_monitor*>(_preempting_io.io_context + 8);
-        // reactor::request_preemption() will write to reactor::_preemption_monitor, which is now ignored
+        _preempt_io_context.start_tick();
     }
     virtual void stop_tick() override {
-        g_need_preempt = &_r->_preemption_monitor;
+        _preempt_io_context.stop_tick();
     }
     virtual void arm_highres_timer(const ::itimerspec& its) override {
         _steady_clock_timer.timerfd_settime(TFD_TIMER_ABSTIME, its);
     }
     virtual void reset_preemption_monitor() override {
-        service_preempting_io();
-        _preempting_io.replenish(&_timerfd_iocb, _timerfd_in_preempting_io);
-        _preempting_io.replenish(&_task_quota_timer_iocb, _task_quota_timer_in_preempting_io);
-        _preempting_io.flush();
+        _preempt_io_context.reset_preemption_monitor();
     }
     virtual void request_preemption() override {
-        ::itimerspec expired = {};
-        expired.it_value.tv_nsec = 1;
-        arm_highres_timer(expired); // will trigger immediately, triggering the preemption monitor
-
-        // This might have been called from poll_once. If that is the case, we cannot assume that timerfd is being
-        // monitored.
-        _preempting_io.replenish(&_timerfd_iocb, _timerfd_in_preempting_io);
-        _preempting_io.flush();
-
-        // The kernel is not obliged to deliver the completion immediately, so wait for it
-        while (!need_preempt()) {
-            std::atomic_signal_fence(std::memory_order_seq_cst);
-        }
+        _preempt_io_context.request_preemption();
     }
     virtual void start_handling_signal() override {
-        // The aio backend only uses SIGHUP/SIGTERM/SIGINT. We don't need to handle them right away and our
-        // implementation of request_preemption is not signal safe, so do nothing.
+        // Like the aio backend, we only use SIGHUP/SIGTERM/SIGINT, and don't need to handle them right away.
     }
 };
 
@@ -1188,11 +1816,17 @@ static decltype(auto) install_signal_handler_stack() {
     });
 }
 
-reactor::task_queue::task_queue(unsigned id, sstring name, float shares)
+reactor::sched_entity::sched_entity(task_queue_group* parent, bool is_group, sstring name, float shares)
         : _shares(std::max(shares, 1.0f))
         , _reciprocal_shares_times_2_power_32((uint64_t(1) << 32) / _shares)
-        , _id(id)
-        , _name(name) {
+        , _is_group(is_group)
+        , _parent(parent)
+        , _name(std::move(name)) {
+}
+
+reactor::task_queue::task_queue(task_queue_group* parent, unsigned id, sstring name, float shares)
+        : sched_entity(parent, false, std::move(name), shares)
+        , _id(id) {
     namespace sm = seastar::metrics;
     static auto group = sm::label("group");
     auto group_label = group(_name);
@@ -1204,7 +1838,7 @@ reactor::task_queue::task_queue(unsigned id, sstring name, float shares)
         sm::make_counter("tasks_processed", _tasks_processed,
                 sm::description("Count of tasks executing on this queue; indicates together with runtime_ms indicates length of tasks"),
                 {group_label}),
-        sm::make_gauge("queue_length", [this] { return _q.size(); },
+        sm::make_gauge("queue_length", [this] { return size(); },
                 sm::description("Size of backlog on this queue, in tasks; indicates whether the queue is busy and/or contended"),
                 {group_label}),
         sm::make_gauge("shares", [this] { return _shares; },
@@ -1214,6 +1848,75 @@ reactor::task_queue::task_queue(unsigned id, sstring name, float shares)
                 return _time_spent_on_task_quota_violations / 1ms;
         }, sm::description("Total amount in milliseconds we were in violation of the task quota"),
            {group_label}),
+        sm::make_histogram("queue_delay_us", [this] { return _delay_histogram.to_metrics_histogram(); },
+                sm::description("Distribution of the time this queue waited, from becoming runnable until it ran; "
+                        "high values indicate starvation by other groups or long tasks"),
+                {group_label}),
+        sm::make_histogram("quantum_runtime_us", [this] { return _quantum_histogram.to_metrics_histogram(); },
+                sm::description("Distribution of the time this queue ran for each time it was scheduled"),
+                {group_label}),
+        sm::make_gauge("memory_usage", [this] {
+                return _id < memory::max_accounted_scheduling_groups ? memory::scheduling_group_memory_usage(_id) : 0;
+        },
+                sm::description("Memory allocated by this group and not yet freed, in bytes"),
+                {group_label}),
+        sm::make_derive("memory_limit_failures", [this] {
+                return _id < memory::max_accounted_scheduling_groups ? memory::scheduling_group_memory_limit_failures(_id) : 0;
+        }, sm::description("Number of allocations that failed since they would have exceeded this group's hard memory limit"),
+           {group_label}),
+        sm::make_counter("tasks_cancelled", _tasks_cancelled,
+                sm::description("Count of tasks dropped because their deadline passed before they could run"),
+                {group_label}),
+    });
+}
+
+void reactor::task_queue::push_by_deadline(std::unique_ptr<task> t) {
+    auto deadline = t->deadline();
+    _by_deadline.push_back(deadline_task{deadline, _deadline_seq++, std::move(t)});
+    std::push_heap(_by_deadline.begin(), _by_deadline.end(), later_deadline());
+}
+
+std::unique_ptr<task> reactor::task_queue::pop_by_deadline() {
+    // Tasks without a deadline get every fourth turn, so that a steady
+    // stream of tasks with deadlines cannot starve them.
+    if (!_q.empty() && ++_deadline_turn % 4 == 0) {
+        return _q.pop_front();
+    }
+    std::pop_heap(_by_deadline.begin(), _by_deadline.end(), later_deadline());
+    auto t = std::move(_by_deadline.back().t);
+    _by_deadline.pop_back();
+    return t;
+}
+
+void reactor::task_queue::set_deadline_ordering(bool enabled) {
+    _deadline_ordering = enabled;
+    if (!enabled) {
+        // Keep running the queued tasks earliest deadline first
+        std::sort_heap(_by_deadline.begin(), _by_deadline.end(), later_deadline());
+        for (auto i = _by_deadline.rbegin(); i != _by_deadline.rend(); ++i) {
+            _q.push_back(std::move(i->t));
+        }
+        _by_deadline.clear();
+    }
+}
+
+reactor::task_queue_group::task_queue_group(task_queue_group* parent, unsigned id, sstring name, float shares)
+        : sched_entity(parent, true, std::move(name), shares)
+        , _id(id) {
+    if (!parent) {
+        return;
+    }
+    namespace sm = seastar::metrics;
+    static auto supergroup = sm::label("supergroup");
+    auto supergroup_label = supergroup(_name);
+    _metrics.add_group("scheduler", {
+        sm::make_counter("supergroup_runtime_ms", [this] {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(_runtime).count();
+        }, sm::description("Accumulated runtime of all scheduling groups in this supergroup"),
+            {supergroup_label}),
+        sm::make_gauge("supergroup_shares", [this] { return _shares; },
+                sm::description("Shares allocated to this supergroup"),
+                {supergroup_label}),
     });
 }
 
@@ -1224,14 +1927,14 @@ __attribute__((no_sanitize("undefined"))) // multiplication below may overflow;
 #endif
 inline
 int64_t
-reactor::task_queue::to_vruntime(sched_clock::duration runtime) const {
+reactor::sched_entity::to_vruntime(sched_clock::duration runtime) const {
     auto scaled = (runtime.count() * _reciprocal_shares_times_2_power_32) >> 32;
     // Prevent overflow from returning ridiculous values
     return std::max<int64_t>(scaled, 0);
 }
 
 void
-reactor::task_queue::set_shares(float shares) {
+reactor::sched_entity::set_shares(float shares) {
     _shares = std::max(shares, 1.0f);
     _reciprocal_shares_times_2_power_32 = (uint64_t(1) << 32) / _shares;
 }
@@ -1241,8 +1944,11 @@ reactor::account_runtime(task_queue& tq, sched_clock::duration runtime) {
     if (runtime > (2 * _task_quota)) {
         tq._time_spent_on_task_quota_violations += runtime - _task_quota;
     }
-    tq._vruntime += tq.to_vruntime(runtime);
-    tq._runtime += runtime;
+    // Charge the queue and each of its supergroups, at their own level
+    for (sched_entity* se = &tq; se->_parent; se = se->_parent) {
+        se->_vruntime += se->to_vruntime(runtime);
+        se->_runtime += runtime;
+    }
 }
 
 void
@@ -1250,9 +1956,9 @@ reactor::account_idle(sched_clock::duration runtime) {
     // anything to do here?
 }
 
-struct reactor::task_queue::indirect_compare {
-    bool operator()(const task_queue* tq1, const task_queue* tq2) const {
-        return tq1->_vruntime < tq2->_vruntime;
+struct reactor::sched_entity::indirect_compare {
+    bool operator()(const sched_entity* se1, const sched_entity* se2) const {
+        return se1->_vruntime < se2->_vruntime;
     }
 };
 
@@ -1288,6 +1994,8 @@ class reactor_backend_selector {
     std::unique_ptr<reactor_backend> create(reactor* r) {
         if (_name == "linux-aio") {
             return std::make_unique<reactor_backend_aio>(r);
+        } else if (_name == "io_uring") {
+            return std::make_unique<reactor_backend_uring>(r);
         } else if (_name == "epoll") {
             return std::make_unique<reactor_backend_epoll>(r);
         }
@@ -1300,6 +2008,10 @@ class reactor_backend_selector {
         std::vector<reactor_backend_selector> ret;
         if (detect_aio_poll()) {
             ret.push_back(reactor_backend_selector("linux-aio"));
+            // The io_uring backend relies on aio for preemption
+            if (reactor_backend_uring::supported()) {
+                ret.push_back(reactor_backend_selector("io_uring"));
+            }
         }
         ret.push_back(reactor_backend_selector("epoll"));
         return ret;
@@ -1334,11 +2046,13 @@ reactor::reactor(unsigned id, reactor_backend_selector rbs, reactor_config cfg)
 #endif
     , _cpu_started(0)
     , _cpu_stall_detector(std::make_unique<cpu_stall_detector>(this))
+    , _cpu_profiler(std::make_unique<cpu_profiler>())
     , _io_context(0)
     , _reuseport(posix_reuseport_detect())
     , _thread_pool(std::make_unique<thread_pool>(this, seastar::format("syscall-{}", id))) {
-    _task_queues.push_back(std::make_unique<task_queue>(0, "main", 1000));
-    _task_queues.push_back(std::make_unique<task_queue>(1, "atexit", 1000));
+    _task_queue_groups.push_back(std::make_unique<task_queue_group>(nullptr, 0, "root", 1000));
+    _task_queues.push_back(std::make_unique<task_queue>(_task_queue_groups[0].get(), 0, "main", 1000));
+    _task_queues.push_back(std::make_unique<task_queue>(_task_queue_groups[0].get(), 1, "atexit", 1000));
     _at_destroy_tasks = _task_queues.back().get();
     g_need_preempt = &_preemption_monitor;
     seastar::thread_impl::init();
@@ -1437,6 +2151,18 @@ reactor::reset_preemption_monitor() {
     return _backend->reset_preemption_monitor();
 }
 
+bool reactor_backend_epoll::kernel_submit_work() {
+    return _r->flush_pending_aio();
+}
+
+bool reactor_backend_epoll::reap_kernel_completions() {
+    return _r->process_io();
+}
+
+bool reactor_backend_epoll::kernel_events_can_sleep() const {
+    return false;
+}
+
 void reactor_backend_epoll::reset_preemption_monitor() {
     _r->_preemption_monitor.head.store(0, std::memory_order_relaxed);
 }
@@ -1577,6 +2303,91 @@ void cpu_stall_detector::start_sleep() {
 void cpu_stall_detector::end_sleep() {
 }
 
+cpu_profiler::cpu_profiler() {
+    struct sigevent sev = {};
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = cpu_stall_detector::signal_number();
+    sev.sigev_value.sival_int = timer_tag;
+    sev._sigev_un._tid = syscall(SYS_gettid);
+    int err = timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &_timer);
+    if (err) {
+        throw std::system_error(std::error_code(err, std::system_category()));
+    }
+}
+
+cpu_profiler::~cpu_profiler() {
+    timer_delete(_timer);
+}
+
+void cpu_profiler::set_period(std::chrono::nanoseconds period) {
+    if (period.count() && !_ring) {
+        _ring = std::make_unique<spsc_ring<cpu_profiler_sample, ring_capacity>>();
+        // The first backtrace() call may allocate and take locks, so it
+        // must not happen in the signal handler
+        current_backtrace();
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+    _period = period;
+    auto its = posix::to_relative_itimerspec(period, period);
+    timer_settime(_timer, 0, &its, nullptr);
+}
+
+static uintptr_t interrupted_pc(void* uctx) {
+#if defined(__x86_64__)
+    return static_cast<ucontext_t*>(uctx)->uc_mcontext.gregs[REG_RIP];
+#elif defined(__aarch64__)
+    return static_cast<ucontext_t*>(uctx)->uc_mcontext.pc;
+#else
+    return 0;
+#endif
+}
+
+void cpu_profiler::on_signal(void* uctx) noexcept {
+    if (!_ring) {
+        return;
+    }
+    saved_backtrace::vector_type frames;
+    backtrace([&] (frame f) {
+        if (frames.size() < frames.capacity()) {
+            frames.emplace_back(f);
+        }
+    });
+    // Drop the signal handler's own frames, which are the same in every
+    // sample, so that stacks start at the interrupted function.
+    if (auto pc = interrupted_pc(uctx)) {
+        auto top = std::find(frames.begin(), frames.end(), decorate(pc - 1));
+        if (top != frames.end()) {
+            frames.erase(frames.begin(), top);
+        }
+    }
+    cpu_profiler_sample sample{saved_backtrace(std::move(frames)), current_scheduling_group()};
+    if (_ring->push(&sample, &sample + 1) == &sample) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool cpu_profiler::drain() {
+    if (!_ring || _ring->empty()) {
+        return false;
+    }
+    cpu_profiler_sample sample;
+    while (_ring->pop(&sample, 1)) {
+        key k{sample.sg.name(), std::move(sample.backtrace)};
+        if (_profile.size() < max_profile_size) {
+            ++_profile[std::move(k)];
+        } else {
+            auto i = _profile.find(k);
+            if (i == _profile.end()) {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            ++i->second;
+        }
+        ++_samples;
+    }
+    return true;
+}
+
 void
 reactor::task_quota_timer_thread_fn() {
     auto thread_name = seastar::format("timer-{}", _id);
@@ -1641,8 +2452,74 @@ reactor::get_stall_detector_report_function() const {
 }
 
 void
-reactor::block_notifier(int) {
-    engine()._cpu_stall_detector->on_signal();
+reactor::block_notifier(int, siginfo_t* si, void* uctx) {
+    if (si->si_code == SI_TIMER && si->si_value.sival_int == cpu_profiler::timer_tag) {
+        engine()._cpu_profiler->on_signal(uctx);
+    } else {
+        engine()._cpu_stall_detector->on_signal();
+    }
+}
+
+void
+reactor::set_cpu_profiler_period(std::chrono::microseconds period) {
+    _cpu_profiler->set_period(period);
+}
+
+std::chrono::microseconds
+reactor::get_cpu_profiler_period() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(_cpu_profiler->period());
+}
+
+// Folded stacks, as consumed by flamegraph.pl: frames from the outermost
+// to the innermost, separated by semicolons, prefixed by the scheduling
+// group. Frames are not symbolized; they are shown as object+offset, as
+// in stall reports, and can be resolved with seastar-addr2line.
+std::unordered_map<sstring, uint64_t>
+reactor::get_cpu_profile(bool reset) {
+    _cpu_profiler->drain();
+    std::unordered_map<sstring, uint64_t> ret;
+    for (auto&& e : _cpu_profiler->get_profile()) {
+        std::ostringstream os;
+        os << e.first.group;
+        auto& frames = e.first.backtrace.frames();
+        for (auto f = frames.rbegin(); f != frames.rend(); ++f) {
+            os << ';';
+            if (!f->so->name.empty()) {
+                os << f->so->name << '+';
+            }
+            os << format("0x{:x}", f->addr);
+        }
+        ret[os.str()] += e.second;
+    }
+    if (reset) {
+        _cpu_profiler->clear_profile();
+    }
+    return ret;
+}
+
+future<sstring> collect_cpu_profile(bool reset) {
+    using profile = std::unordered_map<sstring, uint64_t>;
+    return smp::broadcast_map_reduce([reset] {
+        return engine().get_cpu_profile(reset);
+    }, profile(), [] (profile a, profile b) {
+        if (a.size() < b.size()) {
+            std::swap(a, b);
+        }
+        for (auto&& e : b) {
+            a[e.first] += e.second;
+        }
+        return a;
+    }).then([] (profile p) {
+        std::vector<std::pair<sstring, uint64_t>> stacks(p.begin(), p.end());
+        std::sort(stacks.begin(), stacks.end(), [] (auto& a, auto& b) {
+            return a.second > b.second;
+        });
+        std::ostringstream os;
+        for (auto&& e : stacks) {
+            os << e.first << ' ' << e.second << '\n';
+        }
+        return sstring(os.str());
+    });
 }
 
 void
@@ -1766,8 +2643,12 @@ void reactor::configure(boost::program_options::variables_map vm) {
     csdc.threshold = blocked_time;
     csdc.stall_detector_reports_per_minute = vm["blocked-reactor-reports-per-minute"].as<unsigned>();
     _cpu_stall_detector->update_config(csdc);
+    _cpu_profiler_period = vm["cpu-profiler-period-us"].as<unsigned>() * 1us;
+    _release_idle_memory_period = vm["release-idle-memory-ms"].as<unsigned>() * 1ms;
+    tracing::set_sample_rate(vm["trace-sample-rate"].as<double>());
 
     _max_task_backlog = vm["max-task-backlog"].as<unsigned>();
+    internal::execution_stage_manager::get().set_default_latency_budget(vm["execution-stage-latency-budget-us"].as<unsigned>() * 1us);
     _max_poll_time = vm["idle-poll-time-us"].as<unsigned>() * 1us;
     if (vm.count("poll-mode")) {
         _max_poll_time = std::chrono::nanoseconds::max();
@@ -1777,6 +2658,8 @@ void reactor::configure(boost::program_options::variables_map vm) {
            && !vm.count("poll-mode")) {
         _max_poll_time = 0us;
     }
+    _idle_poll_adaptive = vm.count("idle-poll-adaptive") && !vm.count("poll-mode");
+    _idle_poll_predictor.set_max_poll_time(_max_poll_time);
     set_strict_dma(!vm.count("relaxed-dma"));
     if (!vm["poll-aio"].as<bool>()
             || (vm["poll-aio"].defaulted() && vm.count("overprovisioned"))) {
@@ -1785,6 +2668,13 @@ void reactor::configure(boost::program_options::variables_map vm) {
     set_bypass_fsync(vm["unsafe-bypass-fsync"].as<bool>());
     _force_io_getevents_syscall = vm["force-aio-syscalls"].as<bool>();
     aio_nowait_supported = vm["linux-aio-nowait"].as<bool>();
+    if (vm["async-socket-io"].as<bool>()) {
+        if (_backend->supports_async_socket_io()) {
+            _async_socket_io = true;
+        } else if (_id == 0) {
+            seastar_logger.warn("--async-socket-io is not supported by the selected reactor backend, ignoring");
+        }
+    }
 }
 
 future<> reactor_backend_epoll::get_epoll_future(pollable_fd_state& pfd,
@@ -2035,7 +2925,7 @@ reactor::flush_pending_aio() {
         _thread_pool->submit<syscall_result<int>>([this, retries] () mutable {
             auto r = io_submit(_io_context, retries.size(), retries.data());
             return wrap_syscall<int>(r);
-        }).then([this, retries] (syscall_result<int> result) {
+        }, syscall_priority::high).then([this, retries] (syscall_result<int> result) {
             auto iocbs = retries.data();
             size_t nr_consumed = 0;
             if (result.result == -1) {
@@ -2091,15 +2981,19 @@ bool reactor::process_io()
             _pending_aio_retry.push_back(iocb);
             continue;
         }
-        _free_iocbs.push(iocb);
-        auto desc = reinterpret_cast<io_desc*>(ev[i].data);
-        desc->set_value(ev[i]);
-        desc->notify_requests_finished();
-        delete desc;
+        complete_aio(ev[i]);
     }
     return n;
 }
 
+void reactor::complete_aio(io_event& ev) {
+    _free_iocbs.push(get_iocb(ev));
+    auto desc = reinterpret_cast<io_desc*>(ev.data);
+    desc->set_value(ev);
+    desc->notify_requests_finished();
+    delete desc;
+}
+
 fair_queue::config io_queue::make_fair_queue_config(config iocfg) {
     fair_queue::config cfg;
     cfg.capacity = std::min(iocfg.capacity, reactor::max_aio_per_queue);
@@ -2251,7 +3145,14 @@ io_queue::queue_request(const io_priority_class& pc, size_t len, io_queue::reque
         auto desc = std::make_unique<io_desc>(this, weight, size);
         auto fq_desc = desc->fq_descriptor();
         auto fut = desc->get_future();
-        _fq.queue(pclass.ptr, std::move(fq_desc), [&pclass, start, prepare_io = std::move(prepare_io), desc = std::move(desc), len, this] () mutable noexcept {
+        tracing::span queued;
+        {
+            // Recorded, but not inherited by the tasks created below
+            internal::trace_slot_scope scope;
+            queued = tracing::span("io_queue_wait");
+        }
+        _fq.queue(pclass.ptr, std::move(fq_desc), [&pclass, start, prepare_io = std::move(prepare_io), desc = std::move(desc), len, queued = std::move(queued), this] () mutable noexcept {
+            queued.end();
             try {
                 pclass.nr_queued--;
                 pclass.ops++;
@@ -2314,6 +3215,11 @@ posix_file_impl::query_dma_alignment() {
 
 namespace internal {
 
+const std::exception_ptr& deadline_exceeded_exception() noexcept {
+    static thread_local const std::exception_ptr ex = std::make_exception_ptr(deadline_exceeded_error());
+    return ex;
+}
+
 size_t sanitize_iovecs(std::vector<iovec>& iov, size_t disk_alignment) noexcept {
     if (iov.size() > IOV_MAX) {
         iov.resize(IOV_MAX);
@@ -3235,7 +4141,7 @@ posix_file_impl::flush(void) {
     }
     return engine()._thread_pool->submit<syscall_result<int>>([this] {
         return wrap_syscall<int>(::fdatasync(_fd));
-    }).then([] (syscall_result<int> sr) {
+    }, syscall_priority::low).then([] (syscall_result<int> sr) {
         sr.throw_if_error();
         return make_ready_future<>();
     });
@@ -3257,7 +4163,7 @@ future<>
 posix_file_impl::truncate(uint64_t length) {
     return engine()._thread_pool->submit<syscall_result<int>>([this, length] {
         return wrap_syscall<int>(::ftruncate(_fd, length));
-    }).then([] (syscall_result<int> sr) {
+    }, syscall_priority::low).then([] (syscall_result<int> sr) {
         sr.throw_if_error();
         return make_ready_future<>();
     });
@@ -3277,7 +4183,7 @@ posix_file_impl::discard(uint64_t offset, uint64_t length) {
     return engine()._thread_pool->submit<syscall_result<int>>([this, offset, length] () mutable {
         return wrap_syscall<int>(::fallocate(_fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
             offset, length));
-    }).then([] (syscall_result<int> sr) {
+    }, syscall_priority::low).then([] (syscall_result<int> sr) {
         sr.throw_if_error();
         return make_ready_future<>();
     });
@@ -3298,7 +4204,7 @@ posix_file_impl::allocate(uint64_t position, uint64_t length) {
             supported = false; // Racy, but harmless.  At most we issue an extra call or two.
         }
         return wrap_syscall<int>(ret);
-    }).then([] (syscall_result<int> sr) {
+    }, syscall_priority::low).then([] (syscall_result<int> sr) {
         sr.throw_if_error();
         return make_ready_future<>();
     });
@@ -3312,7 +4218,7 @@ blockdev_file_impl::discard(uint64_t offset, uint64_t length) {
     return engine()._thread_pool->submit<syscall_result<int>>([this, offset, length] () mutable {
         uint64_t range[2] { offset, length };
         return wrap_syscall<int>(::ioctl(_fd, BLKDISCARD, &range));
-    }).then([] (syscall_result<int> sr) {
+    }, syscall_priority::low).then([] (syscall_result<int> sr) {
         sr.throw_if_error();
         return make_ready_future<>();
     });
@@ -3576,18 +4482,16 @@ void reactor::exit(int ret) {
 
 uint64_t
 reactor::pending_task_count() const {
-    uint64_t ret = 0;
-    for (auto&& tq : _task_queues) {
-        ret += tq->_q.size();
-    }
-    return ret;
+    return _tasks_pending;
 }
 
 uint64_t
 reactor::tasks_processed() const {
     uint64_t ret = 0;
     for (auto&& tq : _task_queues) {
-        ret += tq->_tasks_processed;
+        if (tq) {
+            ret += tq->_tasks_processed;
+        }
     }
     return ret;
 }
@@ -3605,6 +4509,15 @@ void reactor::register_metrics() {
             sm::make_gauge("utilization", [this] { return (1-_load)  * 100; }, sm::description("CPU utilization")),
             sm::make_derive("cpu_busy_ms", [this] () -> int64_t { return total_busy_time() / 1ms; },
                     sm::description("Total cpu busy time in milliseconds")),
+            sm::make_derive("idle_poll_time_ms", [this] () -> int64_t { return _total_idle_poll / 1ms; },
+                    sm::description("Total time spent polling for work while idle, in milliseconds")),
+            sm::make_derive("sleep_time_ms", [this] () -> int64_t { return _total_sleep / 1ms; },
+                    sm::description("Total time spent sleeping while idle, in milliseconds")),
+            sm::make_derive("sleeps", _sleeps, sm::description("Number of times the reactor went to sleep while idle")),
+            sm::make_gauge("idle_poll_time_us", [this] { return idle_poll_time() / 1us; },
+                    sm::description("How long the reactor polls for work once idle, before going to sleep")),
+            sm::make_histogram("idle_period_us", [this] { return _idle_periods.to_metrics_histogram(); },
+                    sm::description("Histogram of the time from running out of work until new work arrived, in microseconds")),
             sm::make_derive("cpu_steal_time_ms", [this] () -> int64_t { return total_steal_time() / 1ms; },
                     sm::description("Total steal time, the time in which some other process was running while Seastar was not trying to run (not sleeping)."
                                      "Because this is in userspace, some time that could be legitimally thought as steal time is not accounted as such. For example, if we are sleeping and can wake up but the kernel hasn't woken us up yet.")),
@@ -3621,6 +4534,10 @@ void reactor::register_metrics() {
             // total_operations value:DERIVE:0:U
             sm::make_derive("io_threaded_fallbacks", std::bind(&thread_pool::operation_count, _thread_pool.get()),
                     sm::description("Total number of io-threaded-fallbacks operations")),
+            sm::make_histogram("syscall_queue_wait_us", [this] { return _thread_pool->queue_wait().to_metrics_histogram(); },
+                    sm::description("Histogram of the time blocking calls waited for a syscall thread, in microseconds")),
+            sm::make_histogram("syscall_service_time_us", [this] { return _thread_pool->service_time().to_metrics_histogram(); },
+                    sm::description("Histogram of the time blocking calls took to run on a syscall thread, in microseconds")),
 
     });
 
@@ -3633,13 +4550,25 @@ void reactor::register_metrics() {
             sm::make_current_bytes("free_memory", [] { return memory::stats().free_memory(); }, sm::description("Free memeory size in bytes")),
             sm::make_current_bytes("total_memory", [] { return memory::stats().total_memory(); }, sm::description("Total memeory size in bytes")),
             sm::make_current_bytes("allocated_memory", [] { return memory::stats().allocated_memory(); }, sm::description("Allocated memeory size in bytes")),
-            sm::make_derive("reclaims_operations", [] { return memory::stats().reclaims(); }, sm::description("Total reclaims operations"))
+            sm::make_derive("reclaims_operations", [] { return memory::stats().reclaims(); }, sm::description("Total reclaims operations")),
+            sm::make_gauge("huge_pages_in_use", [] { return memory::stats().huge_pages_in_use(); },
+                    sm::description("Number of huge pages holding allocated memory, approximating the TLB entries needed to reach it")),
+            sm::make_gauge("free_huge_pages", [] { return memory::stats().free_huge_pages(); },
+                    sm::description("Number of huge pages holding no allocated memory")),
+            sm::make_current_bytes("released_memory", [] { return memory::stats().released_memory(); },
+                    sm::description("Free memory returned to the kernel, in bytes")),
+            sm::make_derive("released_memory_bytes", [] { return memory::stats().total_released_memory(); },
+                    sm::description("Total free memory returned to the kernel, in bytes"))
     });
 
     _metric_groups.add_group("reactor", {
             sm::make_derive("logging_failures", [] { return logging_failures; }, sm::description("Total number of logging failures")),
             // total_operations value:DERIVE:0:U
             sm::make_derive("cpp_exceptions", _cxx_exceptions, sm::description("Total number of C++ exceptions")),
+            sm::make_derive("cpu_profiler_samples", [this] { return _cpu_profiler->samples(); },
+                    sm::description("Total number of stack samples taken by the CPU profiler")),
+            sm::make_derive("cpu_profiler_dropped_samples", [this] { return _cpu_profiler->dropped_samples(); },
+                    sm::description("Total number of CPU profiler samples dropped because the sample ring or the profile was full")),
     });
 
     auto ioq_group = sm::label("mountpoint");
@@ -3679,22 +4608,52 @@ void reactor::register_metrics() {
     });
 }
 
+#ifndef SEASTAR_TASKS_PER_PREEMPTION_CHECK
+#define SEASTAR_TASKS_PER_PREEMPTION_CHECK 4
+#endif
+
+// How many tasks run_tasks() runs between checks for preemption. Checking
+// less often makes tiny tasks cheaper to run, but lets a task queue overrun
+// its time slice by up to as many tasks, less one.
+static constexpr unsigned tasks_per_preemption_check = SEASTAR_TASKS_PER_PREEMPTION_CHECK;
+static_assert(tasks_per_preemption_check > 0, "SEASTAR_TASKS_PER_PREEMPTION_CHECK must be positive");
+
 void reactor::run_tasks(task_queue& tq) {
     // Make sure new tasks will inherit our scheduling group
     *internal::current_scheduling_group_ptr() = scheduling_group(tq._id);
-    auto& tasks = tq._q;
-    while (!tasks.empty()) {
-        auto tsk = std::move(tasks.front());
-        tasks.pop_front();
+    unsigned until_preemption_check = tasks_per_preemption_check;
+    while (!tq.empty()) {
+        auto tsk = tq.pop_front();
+        --_tasks_pending;
+        // Load the next task while this one runs; run_and_dispose() starts
+        // by reading its vtable pointer.
+        if (auto next = tq._q.front()) {
+            __builtin_prefetch(next);
+        }
         STAP_PROBE(seastar, reactor_run_tasks_single_start);
         task_histogram_add_task(*tsk);
-        tsk->run_and_dispose();
+        // Make new tasks inherit this one's span and deadline, if any
+        *internal::current_trace_slot_ptr() = tsk->trace_slot();
+        *internal::current_deadline_ptr() = tsk->deadline();
+        if (__builtin_expect(tq._deadline_ordering, false)
+                && tsk->deadline() != deadline_clock::time_point()
+                && tsk->deadline() <= deadline_clock::now()) {
+            ++tq._tasks_cancelled;
+            tsk->cancel_and_dispose();
+        } else {
+            tsk->run_and_dispose();
+        }
         tsk.release();
         STAP_PROBE(seastar, reactor_run_tasks_single_end);
         ++tq._tasks_processed;
-        // check at end of loop, to allow at least one task to run
+        // Preemption is only checked after every tasks_per_preemption_check
+        // tasks, so at least that many run (if queued) before yielding
+        if (--until_preemption_check) {
+            continue;
+        }
+        until_preemption_check = tasks_per_preemption_check;
         if (need_preempt()) {
-            if (tasks.size() <= _max_task_backlog) {
+            if (tq.size() <= _max_task_backlog) {
                 break;
             } else {
                 // While need_preempt() is set, task execution is inefficient due to
@@ -3704,14 +4663,24 @@ void reactor::run_tasks(task_queue& tq) {
             }
         }
     }
+    // Pollers and other code running outside of tasks must not inherit
+    // the last task's span or deadline
+    *internal::current_trace_slot_ptr() = 0;
+    *internal::current_deadline_ptr() = deadline_clock::time_point();
 }
 
 #ifdef SEASTAR_SHUFFLE_TASK_QUEUE
-void reactor::shuffle(std::unique_ptr<task>& t, task_queue& q) {
+void reactor::shuffle(std::unique_ptr<task>&& t, task_queue& q) {
     static thread_local std::mt19937 gen = std::mt19937(std::default_random_engine()());
-    std::uniform_int_distribution<size_t> tasks_dist{0, q._q.size() - 1};
-    auto& to_swap = q._q[tasks_dist(gen)];
-    std::swap(to_swap, t);
+    // Either queue the task last, or swap it with the first task, which is
+    // queued last instead. Reaching further into the list would be linear.
+    if (q._q.empty() || std::bernoulli_distribution()(gen)) {
+        q._q.push_back(std::move(t));
+    } else {
+        auto head = q._q.pop_front();
+        q._q.push_front(std::move(t));
+        q._q.push_back(std::move(head));
+    }
 }
 #endif
 
@@ -3783,7 +4752,7 @@ class reactor::io_pollfn final : public reactor::pollfn {
 public:
     io_pollfn(reactor& r) : _r(r) {}
     virtual bool poll() override final {
-        return _r.process_io();
+        return _r._backend->reap_kernel_completions();
     }
     virtual bool pure_poll() override final {
         return poll(); // actually performs work, but triggers no user continuations, so okay
@@ -3792,7 +4761,11 @@ class reactor::io_pollfn final : public reactor::pollfn {
         // Because aio depends on polling, it cannot generate events to wake us up, Therefore, sleep
         // is only possible if there are no in-flight aios. If there are, we need to keep polling.
         //
-        // Alternatively, if we enabled _aio_eventfd, we can always enter
+        // Alternatively, if we enabled _aio_eventfd, or the backend is woken
+        // by I/O completions, we can always enter
+        if (_r._backend->kernel_events_can_sleep()) {
+            return true;
+        }
         unsigned executing = 0;
         for (auto& ioq : _r.my_io_queues) {
             executing += ioq->requests_currently_executing();
@@ -3859,7 +4832,7 @@ class reactor::aio_batch_submit_pollfn final : public reactor::pollfn {
 public:
     aio_batch_submit_pollfn(reactor& r) : _r(r) {}
     virtual bool poll() final override {
-        return _r.flush_pending_aio();
+        return _r._backend->kernel_submit_work();
     }
     virtual bool pure_poll() override final {
         return poll(); // actually performs work, but triggers no user continuations, so okay
@@ -3893,6 +4866,25 @@ class reactor::drain_cross_cpu_freelist_pollfn final : public reactor::pollfn {
     }
 };
 
+class reactor::cpu_profiler_pollfn final : public reactor::pollfn {
+    reactor& _r;
+public:
+    explicit cpu_profiler_pollfn(reactor& r) : _r(r) {}
+    virtual bool poll() final override {
+        return _r._cpu_profiler->drain();
+    }
+    virtual bool pure_poll() override final {
+        return poll(); // actually performs work, but triggers no user continuations, so okay
+    }
+    virtual bool try_enter_interrupt_mode() override {
+        // The profiler's timer measures CPU time, so no samples are taken
+        // while we sleep.
+        return true;
+    }
+    virtual void exit_interrupt_mode() override final {
+    }
+};
+
 class reactor::lowres_timer_pollfn final : public reactor::pollfn {
     reactor& _r;
     // A highres timer is implemented as a waking  signal; so
@@ -3989,6 +4981,7 @@ class reactor::syscall_pollfn final : public reactor::pollfn {
 public:
     syscall_pollfn(reactor& r) : _r(r) {}
     virtual bool poll() final override {
+        _r._thread_pool->announce();
         return _r._thread_pool->complete();
     }
     virtual bool pure_poll() override final {
@@ -4062,20 +5055,20 @@ void reactor::stop_aio_eventfd_loop() {
 inline
 bool
 reactor::have_more_tasks() const {
-    return _active_task_queues.size() + _activating_task_queues.size();
+    return _task_queue_groups[0]->has_active();
 }
 
-void reactor::insert_active_task_queue(task_queue* tq) {
-    tq->_active = true;
-    auto& atq = _active_task_queues;
-    auto less = task_queue::indirect_compare();
-    if (atq.empty() || less(atq.back(), tq)) {
+void reactor::task_queue_group::insert_active(sched_entity* se) {
+    se->_active = true;
+    auto& atq = _active;
+    auto less = sched_entity::indirect_compare();
+    if (atq.empty() || less(atq.back(), se)) {
         // Common case: idle->working
         // Common case: CPU intensive task queue going to the back
-        atq.push_back(tq);
+        atq.push_back(se);
     } else {
         // Common case: newly activated queue preempting everything else
-        atq.push_front(tq);
+        atq.push_front(se);
         // Less common case: newly activated queue behind something already active
         size_t i = 0;
         while (i + 1 != atq.size() && !less(atq[i], atq[i+1])) {
@@ -4086,12 +5079,49 @@ void reactor::insert_active_task_queue(task_queue* tq) {
 }
 
 void
-reactor::insert_activating_task_queues() {
-    // Quadratic, but since we expect the common cases in insert_active_task_queue() to dominate, faster
-    for (auto&& tq : _activating_task_queues) {
-        insert_active_task_queue(tq);
+reactor::task_queue_group::insert_activating() {
+    // Quadratic, but since we expect the common cases in insert_active() to dominate, faster
+    for (auto&& se : _activating) {
+        insert_active(se);
+    }
+    _activating.clear();
+}
+
+// Descends from the root, at each level taking the member with the lowest
+// vruntime out of its parent's active list, until reaching a task queue.
+// requeue() puts the path back once the queue has run.
+reactor::task_queue*
+reactor::pop_next_task_queue() {
+    auto group = _task_queue_groups[0].get();
+    for (;;) {
+        group->insert_activating();
+        auto se = group->_active.front();
+        group->_active.pop_front();
+        group->_last_vruntime = std::max(se->_vruntime, group->_last_vruntime);
+        if (!se->_is_group) {
+            return static_cast<task_queue*>(se);
+        }
+        group = static_cast<task_queue_group*>(se);
+    }
+}
+
+void
+reactor::requeue(task_queue& tq, sched_clock::time_point now) {
+    sched_entity* se = &tq;
+    bool active = !tq.empty();
+    tq._runnable_since = now;
+    while (se->_parent) {
+        auto parent = se->_parent;
+        if (active) {
+            parent->insert_active(se);
+        } else {
+            se->_active = false;
+        }
+        // Members activated while we ran were queued in _activating, so a
+        // supergroup stays active if any of its members still are.
+        active = parent->has_active();
+        se = parent;
     }
-    _activating_task_queues.clear();
 }
 
 void
@@ -4107,25 +5137,21 @@ reactor::run_some_tasks() {
     _cpu_stall_detector->start_task_run(t_run_completed);
     do {
         auto t_run_started = t_run_completed;
-        insert_activating_task_queues();
-        auto tq = _active_task_queues.front();
-        _active_task_queues.pop_front();
+        auto tq = pop_next_task_queue();
+        tq->_delay_histogram.add(t_run_started - tq->_runnable_since);
         sched_print("running tq {} {}", (void*)tq, tq->_name);
         tq->_current = true;
-        _last_vruntime = std::max(tq->_vruntime, _last_vruntime);
         run_tasks(*tq);
         tq->_current = false;
         t_run_completed = std::chrono::steady_clock::now();
         auto delta = t_run_completed - t_run_started;
         account_runtime(*tq, delta);
+        tq->_quantum_histogram.add(delta);
         sched_print("run complete ({} {}); time consumed {} usec; final vruntime {} empty {}",
-                (void*)tq, tq->_name, delta / 1us, tq->_vruntime, tq->_q.empty());
-        if (!tq->_q.empty()) {
-            insert_active_task_queue(tq);
-        } else {
-            tq->_active = false;
-        }
+                (void*)tq, tq->_name, delta / 1us, tq->_vruntime, tq->empty());
+        requeue(*tq, t_run_completed);
     } while (have_more_tasks() && !need_preempt());
+    smp::publish_tasks_pending(_id, pending_task_count());
     _cpu_stall_detector->end_task_run(t_run_completed);
     STAP_PROBE(seastar, reactor_run_tasks_end);
     *internal::current_scheduling_group_ptr() = default_scheduling_group(); // Prevent inheritance from last group run
@@ -4133,22 +5159,27 @@ reactor::run_some_tasks() {
 }
 
 void
-reactor::activate(task_queue& tq) {
-    if (tq._active) {
-        return;
-    }
-    sched_print("activating {} {}", (void*)&tq, tq._name);
-    // If activate() was called, the task queue is likely network-bound or I/O bound, not CPU-bound. As
-    // such its vruntime will be low, and it will have a large advantage over other task queues. Limit
-    // the advantage so it doesn't dominate scheduling for a long time, in case it _does_ become CPU
-    // bound later.
-    //
-    // FIXME: different scheduling groups have different sensitivity to jitter, take advantage
-    if (_last_vruntime > tq._vruntime) {
-        sched_print("tq {} {} losing vruntime {} due to sleep", (void*)&tq, tq._name, _last_vruntime - tq._vruntime);
+reactor::activate(sched_entity& se) {
+    if (!se._is_group && !se._active) {
+        static_cast<task_queue&>(se)._runnable_since = sched_clock::now();
+    }
+    // Activate the queue, and each of its supergroups that isn't active yet
+    for (auto e = &se; !e->_active && e->_parent; e = e->_parent) {
+        auto parent = e->_parent;
+        sched_print("activating {} {}", (void*)e, e->_name);
+        // If activate() was called, the task queue is likely network-bound or I/O bound, not CPU-bound. As
+        // such its vruntime will be low, and it will have a large advantage over other task queues. Limit
+        // the advantage so it doesn't dominate scheduling for a long time, in case it _does_ become CPU
+        // bound later.
+        //
+        // FIXME: different scheduling groups have different sensitivity to jitter, take advantage
+        if (parent->_last_vruntime > e->_vruntime) {
+            sched_print("tq {} {} losing vruntime {} due to sleep", (void*)e, e->_name, parent->_last_vruntime - e->_vruntime);
+        }
+        e->_vruntime = std::max(parent->_last_vruntime, e->_vruntime);
+        e->_active = true;
+        parent->_activating.push_back(e);
     }
-    tq._vruntime = std::max(_last_vruntime, tq._vruntime);
-    _activating_task_queues.push_back(&tq);
 }
 
 void reactor::service_highres_timer() {
@@ -4211,6 +5242,8 @@ int reactor::run() {
 
     poller drain_cross_cpu_freelist(std::make_unique<drain_cross_cpu_freelist_pollfn>());
 
+    poller drain_cpu_profiler(std::make_unique<cpu_profiler_pollfn>(*this));
+
     // expire_lowres_timers must be before sig_poller, because lowres_timer_pollfn
     // may arm the first highres timer, which can add a new signal to be registerd. If the order
     // is reversed, then signal_pollfn::exit_interrupt_mode() can re-block the timer signal.
@@ -4221,6 +5254,9 @@ int reactor::run() {
     timer<lowres_clock> load_timer;
     auto last_idle = _total_idle;
     auto idle_start = sched_clock::now(), idle_end = idle_start;
+    // Unlike idle_start, these aren't moved by the load timer: the start
+    // of the current idle period, and of its latest stretch of polling.
+    auto idle_since = idle_start, poll_start = idle_start;
     load_timer.set_callback([this, &last_idle, &idle_start, &idle_end] () mutable {
         _total_idle += idle_end - idle_start;
         auto load = double((_total_idle - last_idle).count()) / double(std::chrono::duration_cast<sched_clock::duration>(1s).count());
@@ -4234,18 +5270,29 @@ int reactor::run() {
             _load -= (drop/5);
         }
         _load += (load/5);
+        smp::publish_busy(_id, 1 - load);
     });
     load_timer.arm_periodic(1s);
 
+    timer<lowres_clock> release_idle_memory_timer([] {
+        memory::release_idle_free_memory();
+    });
+    if (_release_idle_memory_period.count()) {
+        release_idle_memory_timer.arm_periodic(_release_idle_memory_period);
+    }
+
     itimerspec its = seastar::posix::to_relative_itimerspec(_task_quota, _task_quota);
     _task_quota_timer.timerfd_settime(0, its);
     auto& task_quote_itimerspec = its;
 
     struct sigaction sa_block_notifier = {};
-    sa_block_notifier.sa_handler = &reactor::block_notifier;
-    sa_block_notifier.sa_flags = SA_RESTART;
+    sa_block_notifier.sa_sigaction = &reactor::block_notifier;
+    sa_block_notifier.sa_flags = SA_SIGINFO | SA_RESTART;
     auto r = sigaction(cpu_stall_detector::signal_number(), &sa_block_notifier, nullptr);
     assert(r == 0);
+    if (_cpu_profiler_period.count()) {
+        _cpu_profiler->set_period(_cpu_profiler_period);
+    }
 
     bool idle = false;
 
@@ -4259,6 +5306,7 @@ int reactor::run() {
         run_some_tasks();
         if (_stopped) {
             load_timer.cancel();
+            release_idle_memory_timer.cancel();
             // Final tasks may include sending the last response to cpu 0, so run them
             while (have_more_tasks()) {
                 run_some_tasks();
@@ -4279,13 +5327,18 @@ int reactor::run() {
             if (idle) {
                 _total_idle += idle_end - idle_start;
                 account_idle(idle_end - idle_start);
+                _total_idle_poll += idle_end - poll_start;
+                _idle_periods.add(idle_end - idle_since);
+                if (_idle_poll_adaptive) {
+                    _idle_poll_predictor.record(idle_end - idle_since);
+                }
                 idle_start = idle_end;
                 idle = false;
             }
         } else {
             idle_end = sched_clock::now();
             if (!idle) {
-                idle_start = idle_end;
+                idle_start = idle_since = poll_start = idle_end;
                 idle = true;
             }
             bool go_to_sleep = true;
@@ -4300,17 +5353,20 @@ int reactor::run() {
             }
             if (go_to_sleep) {
                 internal::cpu_relax();
-                if (idle_end - idle_start > _max_poll_time) {
+                if (idle_end - idle_start > idle_poll_time() && !timer_due_within(idle_end, _max_poll_time)) {
                     // Turn off the task quota timer to avoid spurious wakeups
                     struct itimerspec zero_itimerspec = {};
                     _task_quota_timer.timerfd_settime(0, zero_itimerspec);
                     auto start_sleep = sched_clock::now();
+                    _total_idle_poll += start_sleep - poll_start;
+                    ++_sleeps;
                     _cpu_stall_detector->start_sleep();
                     sleep();
                     _cpu_stall_detector->end_sleep();
                     // We may have slept for a while, so freshen idle_end
                     idle_end = sched_clock::now();
                     _total_sleep += idle_end - start_sleep;
+                    poll_start = idle_end;
                     _task_quota_timer.timerfd_settime(0, task_quote_itimerspec);
                 }
             } else {
@@ -4328,6 +5384,25 @@ int reactor::run() {
     return _return;
 }
 
+std::chrono::nanoseconds
+reactor::idle_poll_time() const {
+    return _idle_poll_adaptive ? _idle_poll_predictor.poll_time() : _max_poll_time;
+}
+
+// The high resolution timer is armed while sleeping, so a sleep ends
+// right at the next timer's deadline. But if that deadline is nearer
+// than the poll time, polling until it is cheaper than sleeping, and
+// wakes up with less delay. A deadline in the past may be left over
+// from a cancelled timer, so it doesn't count.
+bool
+reactor::timer_due_within(sched_clock::time_point now, std::chrono::nanoseconds d) const {
+    if (!_idle_poll_adaptive) {
+        return false;
+    }
+    auto next = _timers.get_next_timeout();
+    return next > now && next - now <= d;
+}
+
 void
 reactor::sleep() {
     for (auto i = _pollers.begin(); i != _pollers.end(); ++i) {
@@ -4507,32 +5582,17 @@ reactor_backend_epoll::wait_and_process(int timeout, const sigset_t* active_sigm
 
 syscall_work_queue::syscall_work_queue()
     : _pending()
-    , _completed()
-    , _start_eventfd(0) {
+    , _completed() {
 }
 
 void syscall_work_queue::submit_item(std::unique_ptr<syscall_work_queue::work_item> item) {
+    item->submitted = work_item::clock_type::now();
     _queue_has_room.wait().then([this, item = std::move(item)] () mutable {
-        _pending.push(item.release());
-        _start_eventfd.signal(1);
+        _pending[unsigned(item->priority)].push(item.release());
+        ++_unannounced;
     });
 }
 
-unsigned syscall_work_queue::complete() {
-    std::array<work_item*, queue_length> tmp_buf;
-    auto end = tmp_buf.data();
-    auto nr = _completed.consume_all([&] (work_item* wi) {
-        *end++ = wi;
-    });
-    for (auto p = tmp_buf.data(); p != end; ++p) {
-        auto wi = *p;
-        wi->complete();
-        delete wi;
-    }
-    _queue_has_room.signal(nr);
-    return nr;
-}
-
 
 struct smp_service_group_impl {
     std::vector<semaphore> clients;   // one client per server shard
@@ -4595,12 +5655,21 @@ void init_default_smp_service_group() {
 smp_message_queue::smp_message_queue(reactor* from, reactor* to)
     : _pending(to)
     , _completed(from)
+    , _to_summary(smp::_peer_summaries[to->_id].get())
+    , _from_index(_to_summary->index_of(from->_id))
+    , _from_summary(smp::_peer_summaries[from->_id].get())
+    , _to_index(_from_summary->index_of(to->_id))
 {
 }
 
 smp_message_queue::~smp_message_queue()
 {
     if (_pending.remote != _completed.remote) {
+        auto destroy = [this] (work_item* wi) {
+            destroy_work_item(wi);
+        };
+        _pending.consume_all(destroy);
+        _completed.consume_all(destroy);
         _tx.a.~aa();
     }
 }
@@ -4609,14 +5678,63 @@ void smp_message_queue::stop() {
     _metrics.clear();
 }
 
+smp_message_queue::tx_side::aa::~aa() {
+    while (free_slots) {
+        auto next = *reinterpret_cast<void**>(free_slots);
+        ::free(free_slots);
+        free_slots = next;
+    }
+}
+
+void* smp_message_queue::allocate_pooled_slot() {
+    auto& tx = _tx.a;
+    if (auto slot = tx.free_slots) {
+        tx.free_slots = *reinterpret_cast<void**>(slot);
+        --tx.nr_free_slots;
+        return slot;
+    }
+    // Aligned so that the remote shard never shares a cache line with
+    // other objects of this one
+    auto slot = ::aligned_alloc(cache_line_size, pooled_item_size);
+    if (!slot) {
+        throw std::bad_alloc();
+    }
+    return slot;
+}
+
+void smp_message_queue::release_pooled_slot(void* slot) noexcept {
+    auto& tx = _tx.a;
+    if (tx.nr_free_slots >= queue_length) {
+        ::free(slot);
+        return;
+    }
+    *reinterpret_cast<void**>(slot) = tx.free_slots;
+    tx.free_slots = slot;
+    ++tx.nr_free_slots;
+}
+
+void smp_message_queue::destroy_work_item(work_item* wi) noexcept {
+    auto pooled = wi->pooled;
+    wi->~work_item();
+    if (pooled) {
+        release_pooled_slot(wi);
+    } else {
+        ::operator delete(wi);
+    }
+}
+
 void smp_message_queue::move_pending() {
     auto begin = _tx.a.pending_fifo.cbegin();
     auto end = _tx.a.pending_fifo.cend();
     end = _pending.push(begin, end);
+    if (end != _tx.a.pending_fifo.cend()) {
+        ++_send_ring_full;
+    }
     if (begin == end) {
         return;
     }
     auto nr = end - begin;
+    _to_summary->mark_remote(_from_index);
     _pending.maybe_wakeup();
     _tx.a.pending_fifo.erase(begin, end);
     _current_queue_length += nr;
@@ -4624,13 +5742,7 @@ void smp_message_queue::move_pending() {
     _sent += nr;
 }
 
-bool smp_message_queue::pure_poll_tx() const {
-    // can't use read_available(), not available on older boost
-    // empty() is not const, so need const_cast.
-    return !const_cast<lf_queue&>(_completed).empty();
-}
-
-void smp_message_queue::submit_item(shard_id t, std::unique_ptr<smp_message_queue::work_item> item) {
+void smp_message_queue::submit_item(shard_id t, smp_message_queue::work_item_ptr item) {
   // matching signal() in process_completions()
   auto ssg_id = internal::smp_service_group_id(item->ssg);
   auto& sem = smp_service_groups[ssg_id].clients[t];
@@ -4639,6 +5751,7 @@ void smp_message_queue::submit_item(shard_id t, std::unique_ptr<smp_message_queu
     // no exceptions from this point
     item.release();
     u.release();
+    _from_summary->mark_local(_to_index);
     if (_tx.a.pending_fifo.size() >= batch_size) {
         move_pending();
     }
@@ -4647,6 +5760,7 @@ void smp_message_queue::submit_item(shard_id t, std::unique_ptr<smp_message_queu
 
 void smp_message_queue::respond(work_item* item) {
     _completed_fifo.push_back(item);
+    _to_summary->mark_local(_from_index);
     if (_completed_fifo.size() >= batch_size || engine()._stopped) {
         flush_response_batch();
     }
@@ -4660,6 +5774,7 @@ void smp_message_queue::flush_response_batch() {
         if (begin == end) {
             return;
         }
+        _from_summary->mark_remote(_to_index);
         _completed.maybe_wakeup();
         _completed_fifo.erase(begin, end);
     }
@@ -4669,10 +5784,8 @@ bool smp_message_queue::has_unflushed_responses() const {
     return !_completed_fifo.empty();
 }
 
-bool smp_message_queue::pure_poll_rx() const {
-    // can't use read_available(), not available on older boost
-    // empty() is not const, so need const_cast.
-    return !const_cast<lf_queue&>(_pending).empty();
+bool smp_message_queue::has_unflushed_requests() const {
+    return !_tx.a.pending_fifo.empty();
 }
 
 void
@@ -4692,42 +5805,33 @@ smp_message_queue::lf_queue::maybe_wakeup() {
     }
 }
 
-smp_message_queue::lf_queue::~lf_queue() {
-    consume_all([] (work_item* ptr) {
-        delete ptr;
-    });
-}
-
 
 template<size_t PrefetchCnt, typename Func>
 size_t smp_message_queue::process_queue(lf_queue& q, Func process) {
     // copy batch to local memory in order to minimize
-    // time in which cross-cpu data is accessed
+    // time in which cross-cpu data is accessed; the whole batch is
+    // released to the producer with a single index update
     work_item* items[queue_length + PrefetchCnt];
-    work_item* wi;
-    if (!q.pop(wi))
+    auto nr = q.pop(items, queue_length);
+    if (!nr) {
         return 0;
-    // start prefetching first item before popping the rest to overlap memory
-    // access with potential cache miss the second pop may cause
-    prefetch<2>(wi);
-    auto nr = q.pop(items);
-    std::fill(std::begin(items) + nr, std::begin(items) + nr + PrefetchCnt, nr ? items[nr - 1] : wi);
-    unsigned i = 0;
-    do {
-        prefetch_n<2>(std::begin(items) + i, std::begin(items) + i + PrefetchCnt);
-        process(wi);
-        wi = items[i++];
-    } while(i <= nr);
+    }
+    std::fill(std::begin(items) + nr, std::begin(items) + nr + PrefetchCnt, items[nr - 1]);
+    prefetch<2>(items[0]);
+    for (size_t i = 0; i != nr; ++i) {
+        prefetch_n<2>(std::begin(items) + i + 1, std::begin(items) + i + 1 + PrefetchCnt);
+        process(items[i]);
+    }
 
-    return nr + 1;
+    return nr;
 }
 
 size_t smp_message_queue::process_completions(shard_id t) {
-    auto nr = process_queue<prefetch_cnt*2>(_completed, [t] (work_item* wi) {
+    auto nr = process_queue<prefetch_cnt*2>(_completed, [this, t] (work_item* wi) {
         wi->complete();
         auto ssg_id = smp_service_group_id(wi->ssg);
         smp_service_groups[ssg_id].clients[t].signal();
-        delete wi;
+        destroy_work_item(wi);
     });
     _current_queue_length -= nr;
     _compl += nr;
@@ -4768,50 +5872,166 @@ void smp_message_queue::start(unsigned cpuid) {
             // total_operations value:DERIVE:0:U
             sm::make_derive("total_sent_messages", _sent, sm::description("Total number of sent messages"), {sm::shard_label(instance)})(sm::metric_disabled),
             // total_operations value:DERIVE:0:U
-            sm::make_derive("total_completed_messages", _compl, sm::description("Total number of messages completed"), {sm::shard_label(instance)})(sm::metric_disabled)
+            sm::make_derive("total_completed_messages", _compl, sm::description("Total number of messages completed"), {sm::shard_label(instance)})(sm::metric_disabled),
+            sm::make_queue_length("send_ring_occupancy", [this] { return _pending.occupancy(); }, sm::description("Number of messages in the send ring not yet picked up by the destination shard"), {sm::shard_label(instance)})(sm::metric_disabled),
+            sm::make_queue_length("completion_ring_occupancy", [this] { return _completed.occupancy(); }, sm::description("Number of completed messages in the completion ring not yet picked up by the source shard"), {sm::shard_label(instance)})(sm::metric_disabled),
+            // total_operations value:DERIVE:0:U
+            sm::make_derive("send_ring_full", _send_ring_full, sm::description("Number of times a batch of messages did not fit in the send ring"), {sm::shard_label(instance)})(sm::metric_disabled),
+            // total_operations value:DERIVE:0:U
+            sm::make_derive("total_unpooled_messages", _unpooled_items, sm::description("Total number of sent messages too large for the pooled work item slots"), {sm::shard_label(instance)})(sm::metric_disabled)
     });
 }
 
 /* not yet implemented for OSv. TODO: do the notification like we do class smp. */
 #ifndef HAVE_OSV
-thread_pool::thread_pool(reactor* r, sstring name) : _reactor(r), _worker_thread([this, name] { work(name); }) {
+static syscall_thread_pool& get_syscall_pool(unsigned shard, std::unique_ptr<syscall_thread_pool>& own_pool, sstring name) {
+    auto node = smp::numa_node_of(shard);
+    if (node < syscall_pools.size() && syscall_pools[node]) {
+        return *syscall_pools[node];
+    }
+    own_pool = std::make_unique<syscall_thread_pool>(std::move(name), 1, std::vector<unsigned>());
+    return *own_pool;
+}
+
+thread_pool::thread_pool(reactor* r, sstring name)
+        : _reactor(r)
+        , _pool(get_syscall_pool(r->cpu_id(), _own_pool, std::move(name))) {
+    _pool.add_client(this);
+}
+
+thread_pool::~thread_pool() {
+    // Calls still pending are leaked, since their promises can't be
+    // broken while the reactor is going away.
+    _pool.remove_client(this);
+}
+
+void thread_pool::announce() {
+    if (inter_thread_wq._unannounced) {
+        _pool.announce(std::exchange(inter_thread_wq._unannounced, 0));
+    }
+}
+
+unsigned thread_pool::complete() {
+    return inter_thread_wq.complete([this] (const syscall_work_queue::work_item& wi) {
+        _queue_wait.add(wi.started - wi.submitted);
+        _service_time.add(wi.finished - wi.started);
+    });
+}
+
+void thread_pool::wake_reactor() {
+    uint64_t one = 1;
+    ::write(_reactor->_notify_eventfd.get(), &one, 8);
+}
+
+syscall_thread_pool::syscall_thread_pool(sstring name, unsigned nr_workers, const std::vector<unsigned>& cpus) {
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu : cpus) {
+            CPU_SET(cpu, &set);
+        }
+        _cpus = set;
+    }
+    _workers.reserve(nr_workers);
+    for (unsigned i = 0; i < nr_workers; ++i) {
+        auto thread_name = nr_workers == 1 ? name : seastar::format("{}-{}", name, i);
+        _workers.emplace_back([this, thread_name] { work(thread_name); });
+    }
+}
+
+syscall_thread_pool::~syscall_thread_pool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopped = true;
+    }
+    _work_available.notify_all();
+    for (auto&& t : _workers) {
+        t.join();
+    }
+}
+
+void syscall_thread_pool::add_client(thread_pool* tp) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _clients.push_back(tp);
+}
+
+void syscall_thread_pool::remove_client(thread_pool* tp) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _clients.erase(std::remove(_clients.begin(), _clients.end(), tp), _clients.end());
+    _next_client = 0;
+    _drained.wait(lock, [tp] { return tp->_in_flight == 0; });
+}
+
+void syscall_thread_pool::announce(unsigned nr) {
+    // Pairs with the idle worker's check of _submissions: either the
+    // worker sees the new calls, or we see it idle and wake it up.
+    _submissions.fetch_add(nr, std::memory_order_seq_cst);
+    if (_idle_workers.load(std::memory_order_seq_cst)) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (nr == 1) {
+            _work_available.notify_one();
+        } else {
+            _work_available.notify_all();
+        }
+    }
+}
+
+std::pair<thread_pool*, syscall_thread_pool::work_item*> syscall_thread_pool::pop_pending() {
+    auto nr_clients = _clients.size();
+    for (unsigned prio = 0; prio < syscall_work_queue::nr_priorities; ++prio) {
+        for (unsigned i = 0; i < nr_clients; ++i) {
+            auto tp = _clients[(_next_client + i) % nr_clients];
+            if (auto wi = tp->inter_thread_wq.pop_pending(prio)) {
+                _next_client = (_next_client + i + 1) % nr_clients;
+                return { tp, wi };
+            }
+        }
+    }
+    return { nullptr, nullptr };
 }
 
-void thread_pool::work(sstring name) {
+void syscall_thread_pool::work(sstring name) {
     pthread_setname_np(pthread_self(), name.c_str());
     sigset_t mask;
     sigfillset(&mask);
     auto r = ::pthread_sigmask(SIG_BLOCK, &mask, NULL);
     throw_pthread_error(r);
-    std::array<syscall_work_queue::work_item*, syscall_work_queue::queue_length> tmp_buf;
+    if (_cpus) {
+        r = pthread_setaffinity_np(pthread_self(), sizeof(*_cpus), &*_cpus);
+        throw_pthread_error(r);
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
     while (true) {
-        uint64_t count;
-        auto r = ::read(inter_thread_wq._start_eventfd.get_read_fd(), &count, sizeof(count));
-        assert(r == sizeof(count));
-        if (_stopped.load(std::memory_order_relaxed)) {
-            break;
+        auto seen = _submissions.load(std::memory_order_seq_cst);
+        thread_pool* tp;
+        work_item* wi;
+        std::tie(tp, wi) = pop_pending();
+        if (!wi) {
+            if (_stopped) {
+                break;
+            }
+            _idle_workers.fetch_add(1, std::memory_order_seq_cst);
+            _work_available.wait(lock, [this, seen] {
+                return _stopped || _submissions.load(std::memory_order_seq_cst) != seen;
+            });
+            _idle_workers.fetch_sub(1, std::memory_order_relaxed);
+            continue;
         }
-        auto end = tmp_buf.data();
-        inter_thread_wq._pending.consume_all([&] (syscall_work_queue::work_item* wi) {
-            *end++ = wi;
-        });
-        for (auto p = tmp_buf.data(); p != end; ++p) {
-            auto wi = *p;
-            wi->process();
-            inter_thread_wq._completed.push(wi);
+        ++tp->_in_flight;
+        lock.unlock();
+        wi->started = work_item::clock_type::now();
+        wi->process();
+        wi->finished = work_item::clock_type::now();
+        lock.lock();
+        tp->inter_thread_wq._completed.push(wi);
+        if (tp->_main_thread_idle.load(std::memory_order_seq_cst)) {
+            tp->wake_reactor();
         }
-        if (_main_thread_idle.load(std::memory_order_seq_cst)) {
-            uint64_t one = 1;
-            ::write(_reactor->_notify_eventfd.get(), &one, 8);
+        if (--tp->_in_flight == 0) {
+            _drained.notify_all();
         }
     }
 }
-
-thread_pool::~thread_pool() {
-    _stopped.store(true, std::memory_order_relaxed);
-    inter_thread_wq._start_eventfd.signal(1);
-    _worker_thread.join();
-}
 #endif
 
 readable_eventfd writeable_eventfd::read_side() {
@@ -4921,12 +6141,20 @@ reactor::get_options_description(reactor_config cfg) {
         ("poll-mode", "poll continuously (100% cpu use)")
         ("idle-poll-time-us", bpo::value<unsigned>()->default_value(calculate_poll_time() / 1us),
                 "idle polling time in microseconds (reduce for overprovisioned environments or laptops)")
+        ("idle-poll-adaptive", "learn how long to poll when idle, up to --idle-poll-time-us, from how soon work arrived in recent idle periods")
         ("poll-aio", bpo::value<bool>()->default_value(true),
                 "busy-poll for disk I/O (reduces latency and increases throughput)")
         ("task-quota-ms", bpo::value<double>()->default_value(cfg.task_quota / 1ms), "Max time (ms) between polls")
         ("max-task-backlog", bpo::value<unsigned>()->default_value(1000), "Maximum number of task backlog to allow; above this we ignore I/O")
+        ("execution-stage-latency-budget-us", bpo::value<unsigned>()->default_value(0), "Latency (us) execution stages may add to calls to batch them; execution stages size their batches to run within it (0: flush every call right away)")
         ("blocked-reactor-notify-ms", bpo::value<unsigned>()->default_value(2000), "threshold in miliseconds over which the reactor is considered blocked if no progress is made")
         ("blocked-reactor-reports-per-minute", bpo::value<unsigned>()->default_value(5), "Maximum number of backtraces reported by stall detector per minute")
+        ("trace-sample-rate", bpo::value<double>()->default_value(0),
+                "fraction of tracing::start_trace() calls that start a trace (0 to disable tracing)")
+        ("cpu-profiler-period-us", bpo::value<unsigned>()->default_value(0),
+                "sample the reactor's stack every this many microseconds of CPU time, for collect_cpu_profile() (0 to disable)")
+        ("release-idle-memory-ms", bpo::value<unsigned>()->default_value(0),
+                "return free memory that stayed unused for this long (in milliseconds, up to twice as long) to the kernel (0 to disable)")
         ("relaxed-dma", "allow using buffered I/O if DMA is not available (reduces performance)")
         ("linux-aio-nowait",
                 bpo::value<bool>()->default_value(aio_nowait_supported),
@@ -4937,10 +6165,14 @@ reactor::get_options_description(reactor_config cfg) {
         ("force-aio-syscalls", bpo::value<bool>()->default_value(false),
                 "Force io_getevents(2) to issue a system call, instead of bypassing the kernel when possible."
                 " This makes strace output more useful, but slows down the application")
+        ("async-socket-io", bpo::value<bool>()->default_value(false),
+                "Submit socket accept, receive and send operations to the kernel instead of waiting for readiness"
+                " and then issuing a system call (requires --reactor-backend=io_uring)")
         ("reactor-backend", bpo::value<reactor_backend_selector>()->default_value(reactor_backend_selector::default_backend()),
                 format("Internal reactor implementation ({})", reactor_backend_selector::available()).c_str())
 #ifdef SEASTAR_HEAPPROF
-        ("heapprof", "enable seastar heap profiling")
+        ("heapprof", bpo::value<size_t>()->implicit_value(512 * 1024),
+                "enable seastar heap profiling, sampling an allocation every given number of bytes on average")
 #endif
         ;
     if (cfg.auto_handle_sigint_sigterm) {
@@ -4963,8 +6195,13 @@ smp::get_options_description()
         ("memory,m", bpo::value<std::string>(), "memory to use, in bytes (ex: 4G) (default: all)")
         ("reserve-memory", bpo::value<std::string>(), "memory reserved to OS (if --memory not specified)")
         ("hugepages", bpo::value<std::string>(), "path to accessible hugetlbfs mount (typically /dev/hugepages/something)")
+        ("hugepages-mode", bpo::value<std::string>()->default_value("transparent"),
+                "how to back memory with huge pages, unless --hugepages is given: transparent (transparent huge pages),"
+                " hugetlb (the kernel's reserved huge page pool, falling back to transparent huge pages) or none")
         ("lock-memory", bpo::value<bool>(), "lock all memory (prevents swapping)")
+        ("prefault-memory", bpo::value<bool>()->default_value(false), "fault in all of each shard's memory at startup, in parallel and on the shard's NUMA node, rather than on first use")
         ("thread-affinity", bpo::value<bool>()->default_value(true), "pin threads to their cpus (disable for overprovisioning)")
+        ("syscall-threads-per-node", bpo::value<unsigned>(), "number of threads running blocking system calls for the shards of each NUMA node (default: one per shard, up to 8)")
 #ifdef SEASTAR_HAVE_HWLOC
         ("num-io-queues", bpo::value<unsigned>(), "Number of IO queues. Each IO unit will be responsible for a fraction of the IO requests. Defaults to the number of threads")
         ("max-io-requests", bpo::value<unsigned>(), "Maximum amount of concurrent requests to be sent to the disk. Defaults to 128 times the number of IO queues")
@@ -5000,11 +6237,51 @@ std::vector<posix_thread> smp::_threads;
 std::vector<std::function<void ()>> smp::_thread_loops;
 compat::optional<boost::barrier> smp::_all_event_loops_done;
 std::vector<reactor*> smp::_reactors;
+std::vector<unsigned> smp::_numa_nodes;
+std::vector<std::unique_ptr<smp_peer_summary>> smp::_peer_summaries;
+std::unique_ptr<smp::published_load[]> smp::_loads;
 std::unique_ptr<smp_message_queue*[], smp::qs_deleter> smp::_qs;
 std::thread::id smp::_tmain;
 unsigned smp::count = 1;
 bool smp::_using_dpdk;
 
+void smp::publish_busy(shard_id shard, float busy) {
+    if (_loads) {
+        _loads[shard].busy.store(busy, std::memory_order_relaxed);
+    }
+}
+
+void smp::publish_tasks_pending(shard_id shard, uint32_t tasks) {
+    if (_loads) {
+        _loads[shard].tasks_pending.store(tasks, std::memory_order_relaxed);
+    }
+}
+
+static bool less_loaded(const shard_load& a, const shard_load& b) {
+    return a.busy < b.busy || (a.busy == b.busy && a.tasks_pending < b.tasks_pending);
+}
+
+shard_id smp::least_loaded_shard() {
+    shard_id best = 0;
+    auto best_load = load(0);
+    for (shard_id i = 1; i < smp::count; ++i) {
+        auto l = load(i);
+        if (less_loaded(l, best_load)) {
+            best = i;
+            best_load = l;
+        }
+    }
+    return best;
+}
+
+shard_id smp::less_loaded_of_two_shards() {
+    static thread_local std::default_random_engine random_engine{std::random_device{}()};
+    std::uniform_int_distribution<shard_id> dist(0, smp::count - 1);
+    auto a = dist(random_engine);
+    auto b = dist(random_engine);
+    return less_loaded(load(b), load(a)) ? b : a;
+}
+
 void smp::start_all_queues()
 {
     for (unsigned c = 0; c < count; c++) {
@@ -5124,6 +6401,90 @@ static void sigabrt_action() noexcept {
     print_with_backtrace("Aborting");
 }
 
+smp_peer_summary::smp_peer_summary(unsigned self)
+    : _nr_words((smp::count + bits_per_word - 1) / bits_per_word)
+    , _remote(new std::atomic<uint64_t>[_nr_words])
+    , _local(new uint64_t[_nr_words])
+    , _index_of(smp::count, -1u) {
+    for (unsigned w = 0; w < _nr_words; ++w) {
+        _remote[w].store(0, std::memory_order_relaxed);
+        _local[w] = 0;
+    }
+    auto node = smp::numa_node_of(self);
+    for (unsigned i = 0; i < smp::count; i++) {
+        if (i != self && smp::numa_node_of(i) == node) {
+            _peers.push_back(i);
+        }
+    }
+    for (unsigned i = 0; i < smp::count; i++) {
+        if (smp::numa_node_of(i) != node) {
+            _peers.push_back(i);
+        }
+    }
+    for (unsigned index = 0; index < _peers.size(); index++) {
+        _index_of[_peers[index]] = index;
+    }
+}
+
+void smp::allocate_incoming_queues(unsigned id) {
+    // Runs on the receiving shard, so the queues are allocated on its NUMA node
+    _qs[id] = reinterpret_cast<smp_message_queue*>(operator new[] (sizeof(smp_message_queue) * smp::count));
+    for (unsigned j = 0; j < smp::count; ++j) {
+        new (&_qs[id][j]) smp_message_queue(_reactors[j], _reactors[id]);
+    }
+}
+
+namespace internal {
+
+broadcast_plan::broadcast_plan(unsigned caller) {
+    order.reserve(smp::count);
+    auto node = smp::numa_node_of(caller);
+    order.push_back(caller);
+    for (unsigned i = 0; i < smp::count; i++) {
+        if (i != caller && smp::numa_node_of(i) == node) {
+            order.push_back(i);
+        }
+    }
+    node_ends.push_back(order.size());
+    auto others = order.size();
+    for (unsigned i = 0; i < smp::count; i++) {
+        if (smp::numa_node_of(i) != node) {
+            order.push_back(i);
+        }
+    }
+    std::stable_sort(order.begin() + others, order.end(), [] (unsigned a, unsigned b) {
+        return smp::numa_node_of(a) < smp::numa_node_of(b);
+    });
+    for (auto i = others; i < order.size(); i++) {
+        if (i + 1 == order.size() || smp::numa_node_of(order[i]) != smp::numa_node_of(order[i + 1])) {
+            node_ends.push_back(i + 1);
+        }
+    }
+}
+
+std::vector<std::pair<unsigned, unsigned>>
+broadcast_plan::children(unsigned b, unsigned e) const {
+    std::vector<std::pair<unsigned, unsigned>> ret;
+    auto split = [&ret] (unsigned from, unsigned to) {
+        auto chunk = (to - from + fanout - 1) / fanout;
+        for (auto i = from; i < to; i += chunk) {
+            ret.emplace_back(i, std::min(i + chunk, to));
+        }
+    };
+    if (b == 0) {
+        // The calling shard: one message per remote node
+        split(1, node_ends[0]);
+        for (unsigned i = 1; i < node_ends.size(); i++) {
+            ret.emplace_back(node_ends[i - 1], node_ends[i]);
+        }
+    } else {
+        split(b + 1, e);
+    }
+    return ret;
+}
+
+}
+
 void smp::qs_deleter::operator()(smp_message_queue** qs) const {
     for (unsigned i = 0; i < smp::count; i++) {
         for (unsigned j = 0; j < smp::count; j++) {
@@ -5280,6 +6641,7 @@ void smp::register_network_stacks() {
 
 void smp::configure(boost::program_options::variables_map configuration, reactor_config reactor_cfg)
 {
+    auto configure_start = std::chrono::steady_clock::now();
 #ifndef SEASTAR_NO_EXCEPTION_HACK
     if (configuration["enable-glibc-exception-scaling-workaround"].as<bool>()) {
         init_phdr_cache();
@@ -5392,6 +6754,16 @@ void smp::configure(boost::program_options::variables_map configuration, reactor
     if (configuration.count("hugepages")) {
         hugepages_path = configuration["hugepages"].as<std::string>();
     }
+    static const std::unordered_map<std::string, memory::huge_pages_mode> hugepages_modes = {
+        { "transparent", memory::huge_pages_mode::transparent },
+        { "hugetlb", memory::huge_pages_mode::hugetlb },
+        { "none", memory::huge_pages_mode::none },
+    };
+    auto hugepages_mode_name = configuration["hugepages-mode"].as<std::string>();
+    if (!hugepages_modes.count(hugepages_mode_name)) {
+        throw std::runtime_error(format("Unknown --hugepages-mode: {}", hugepages_mode_name));
+    }
+    auto hugepages_mode = hugepages_modes.at(hugepages_mode_name);
     auto mlock = false;
     if (configuration.count("lock-memory")) {
         mlock = configuration["lock-memory"].as<bool>();
@@ -5414,19 +6786,54 @@ void smp::configure(boost::program_options::variables_map configuration, reactor
     }
 
     auto resources = resource::allocate(rc);
+    auto resources_allocated = std::chrono::steady_clock::now();
     std::vector<resource::cpu> allocations = std::move(resources.cpus);
+    _numa_nodes.resize(smp::count);
+    for (unsigned i = 0; i < smp::count; i++) {
+        auto& mem = allocations[i].mem;
+        auto largest = std::max_element(mem.begin(), mem.end(), [] (const resource::memory& a, const resource::memory& b) {
+            return a.bytes < b.bytes;
+        });
+        _numa_nodes[i] = largest != mem.end() ? largest->nodeid : 0;
+    }
     if (thread_affinity) {
         smp::pin(allocations[0].cpu_id);
     }
 
-    memory::configure(allocations[0].mem, mbind, hugepages_path);
+    // Phases which run on each shard's own thread, timed for the startup report
+    struct shard_startup_times {
+        std::chrono::steady_clock::duration memory;
+        std::chrono::steady_clock::duration prefault;
+    };
+    static std::vector<shard_startup_times> shard_times;
+    shard_times.resize(smp::count);
+    auto prefault = configuration["prefault-memory"].as<bool>();
+
+    auto memory_start = std::chrono::steady_clock::now();
+    memory::configure(allocations[0].mem, mbind, hugepages_path, hugepages_mode);
+    shard_times[0].memory = std::chrono::steady_clock::now() - memory_start;
 
     if (configuration.count("abort-on-seastar-bad-alloc")) {
         memory::enable_abort_on_allocation_failure();
     }
 
-    bool heapprof_enabled = configuration.count("heapprof");
-    memory::set_heap_profiling_enabled(heapprof_enabled);
+    size_t heapprof_sample_period = configuration.count("heapprof") ? configuration["heapprof"].as<size_t>() : 0;
+    memory::set_heap_profiling_sample_period(heapprof_sample_period);
+
+#ifndef HAVE_OSV
+    std::map<unsigned, std::vector<unsigned>> node_cpus;
+    for (unsigned i = 0; i < smp::count; i++) {
+        node_cpus[_numa_nodes[i]].push_back(allocations[i].cpu_id);
+    }
+    syscall_pools.resize(node_cpus.rbegin()->first + 1);
+    for (auto& nc : node_cpus) {
+        auto nr_threads = configuration.count("syscall-threads-per-node")
+                ? std::max(configuration["syscall-threads-per-node"].as<unsigned>(), 1u)
+                : std::min<unsigned>(nc.second.size(), 8);
+        syscall_pools[nc.first] = std::make_unique<syscall_thread_pool>(seastar::format("syscall-{}", nc.first), nr_threads,
+                thread_affinity ? nc.second : std::vector<unsigned>());
+    }
+#endif
 
 #ifdef SEASTAR_HAVE_DPDK
     if (smp::_using_dpdk) {
@@ -5479,6 +6886,9 @@ void smp::configure(boost::program_options::variables_map configuration, reactor
     };
 
     _all_event_loops_done.emplace(smp::count);
+    _peer_summaries.resize(smp::count);
+    _loads.reset(new published_load[smp::count]);
+    smp::_qs = decltype(smp::_qs){new smp_message_queue* [smp::count], qs_deleter{}};
 
     auto backend_selector = configuration["reactor-backend"].as<reactor_backend_selector>();
 
@@ -5486,15 +6896,21 @@ void smp::configure(boost::program_options::variables_map configuration, reactor
 
     for (i = 1; i < smp::count; i++) {
         auto allocation = allocations[i];
-        create_thread([configuration, &disk_config, hugepages_path, i, allocation, assign_io_queue, alloc_io_queue, thread_affinity, heapprof_enabled, mbind, backend_selector, reactor_cfg] {
+        create_thread([configuration, &disk_config, hugepages_path, hugepages_mode, i, allocation, assign_io_queue, alloc_io_queue, thread_affinity, heapprof_sample_period, mbind, prefault, backend_selector, reactor_cfg] {
           try {
             auto thread_name = seastar::format("reactor-{}", i);
             pthread_setname_np(pthread_self(), thread_name.c_str());
             if (thread_affinity) {
                 smp::pin(allocation.cpu_id);
             }
-            memory::configure(allocation.mem, mbind, hugepages_path);
-            memory::set_heap_profiling_enabled(heapprof_enabled);
+            auto memory_start = std::chrono::steady_clock::now();
+            memory::configure(allocation.mem, mbind, hugepages_path, hugepages_mode);
+            auto memory_end = std::chrono::steady_clock::now();
+            if (prefault) {
+                memory::prefault();
+            }
+            shard_times[i] = { memory_end - memory_start, std::chrono::steady_clock::now() - memory_end };
+            memory::set_heap_profiling_sample_period(heapprof_sample_period);
             sigset_t mask;
             sigfillset(&mask);
             for (auto sig : { SIGSEGV }) {
@@ -5505,10 +6921,12 @@ void smp::configure(boost::program_options::variables_map configuration, reactor
             init_default_smp_service_group();
             allocate_reactor(i, backend_selector, reactor_cfg);
             _reactors[i] = &engine();
+            _peer_summaries[i] = std::make_unique<smp_peer_summary>(i);
             for (auto& dev_id : disk_config.device_ids()) {
                 alloc_io_queue(i, dev_id);
             }
             reactors_registered.wait();
+            allocate_incoming_queues(i);
             smp_queues_constructed.wait();
             start_all_queues();
             for (auto& dev_id : disk_config.device_ids()) {
@@ -5524,6 +6942,13 @@ void smp::configure(boost::program_options::variables_map configuration, reactor
         });
     }
 
+    // Shard 0 faults its memory in while the other shards do the same
+    if (prefault) {
+        auto prefault_start = std::chrono::steady_clock::now();
+        memory::prefault();
+        shard_times[0].prefault = std::chrono::steady_clock::now() - prefault_start;
+    }
+
     init_default_smp_service_group();
     try {
         allocate_reactor(0, backend_selector, reactor_cfg);
@@ -5548,14 +6973,9 @@ void smp::configure(boost::program_options::variables_map configuration, reactor
     }
 #endif
 
+    _peer_summaries[0] = std::make_unique<smp_peer_summary>(0);
     reactors_registered.wait();
-    smp::_qs = decltype(smp::_qs){new smp_message_queue* [smp::count], qs_deleter{}};
-    for(unsigned i = 0; i < smp::count; i++) {
-        smp::_qs[i] = reinterpret_cast<smp_message_queue*>(operator new[] (sizeof(smp_message_queue) * smp::count));
-        for (unsigned j = 0; j < smp::count; ++j) {
-            new (&smp::_qs[i][j]) smp_message_queue(_reactors[j], _reactors[i]);
-        }
-    }
+    allocate_incoming_queues(0);
     alien::smp::_qs = alien::smp::create_qs(_reactors);
     smp_queues_constructed.wait();
     start_all_queues();
@@ -5567,37 +6987,56 @@ void smp::configure(boost::program_options::variables_map configuration, reactor
     engine().configure(configuration);
     // The raw `new` is necessary because of the private constructor of `lowres_clock_impl`.
     engine()._lowres_clock_impl = std::unique_ptr<lowres_clock_impl>(new lowres_clock_impl);
+
+    auto ms = [] (std::chrono::steady_clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+    auto slowest = [] (std::chrono::steady_clock::duration shard_startup_times::*phase) {
+        std::chrono::steady_clock::duration ret{};
+        for (auto& t : shard_times) {
+            ret = std::max(ret, t.*phase);
+        }
+        return ret;
+    };
+    seastar_logger.info("Started {} shards in {} ms: resource allocation {} ms, memory setup {} ms and prefault {} ms on the slowest shard",
+            smp::count, ms(std::chrono::steady_clock::now() - configure_start), ms(resources_allocated - configure_start),
+            ms(slowest(&shard_startup_times::memory)), ms(slowest(&shard_startup_times::prefault)));
 }
 
 bool smp::poll_queues() {
     size_t got = 0;
-    for (unsigned i = 0; i < count; i++) {
-        if (engine().cpu_id() != i) {
-            auto& rxq = _qs[engine().cpu_id()][i];
-            rxq.flush_response_batch();
-            got += rxq.has_unflushed_responses();
-            got += rxq.process_incoming();
-            auto& txq = _qs[i][engine()._id];
-            txq.flush_request_batch();
-            got += txq.process_completions(i);
+    auto me = engine().cpu_id();
+    auto& summary = *_peer_summaries[me];
+    summary.consume([&] (unsigned i, unsigned index) {
+        auto& rxq = _qs[me][i];
+        rxq.flush_response_batch();
+        got += rxq.has_unflushed_responses();
+        got += rxq.process_incoming();
+        auto& txq = _qs[i][me];
+        txq.flush_request_batch();
+        got += txq.process_completions(i);
+        if (rxq.has_unflushed_responses() || txq.has_unflushed_requests()) {
+            summary.mark_local(index);
         }
-    }
+    });
     return got != 0;
 }
 
 bool smp::pure_poll_queues() {
-    for (unsigned i = 0; i < count; i++) {
-        if (engine().cpu_id() != i) {
-            auto& rxq = _qs[engine().cpu_id()][i];
-            rxq.flush_response_batch();
-            auto& txq = _qs[i][engine()._id];
-            txq.flush_request_batch();
-            if (rxq.pure_poll_rx() || txq.pure_poll_tx() || rxq.has_unflushed_responses()) {
-                return true;
-            }
+    auto me = engine().cpu_id();
+    auto& summary = *_peer_summaries[me];
+    bool unflushed_responses = false;
+    summary.consume_local([&] (unsigned i, unsigned index) {
+        auto& rxq = _qs[me][i];
+        rxq.flush_response_batch();
+        auto& txq = _qs[i][me];
+        txq.flush_request_batch();
+        unflushed_responses |= rxq.has_unflushed_responses();
+        if (rxq.has_unflushed_responses() || txq.has_unflushed_requests()) {
+            summary.mark_local(index);
         }
-    }
-    return false;
+    });
+    return unflushed_responses || summary.has_remote();
 }
 
 internal::preemption_monitor bootstrap_preemption_monitor{};
@@ -5940,40 +7379,77 @@ std::chrono::nanoseconds reactor::total_steal_time() {
            std::chrono::duration_cast<std::chrono::nanoseconds>(thread_cputime_clock::now().time_since_epoch());
 }
 
-static std::atomic<unsigned long> s_used_scheduling_group_ids_bitmap{3}; // 0=main, 1=atexit
-
-static
-unsigned
-allocate_scheduling_group_id() {
-    static_assert(max_scheduling_groups() <= std::numeric_limits<unsigned long>::digits, "more scheduling groups than available bits");
-    auto b = s_used_scheduling_group_ids_bitmap.load(std::memory_order_relaxed);
-    auto nb = b;
-    unsigned i = 0;
-    do {
-        if (__builtin_popcountl(b) == max_scheduling_groups()) {
-            throw std::runtime_error("Scheduling group limit exceeded");
+// Scheduling group and supergroup ids index per-shard vectors, so they are
+// kept dense by reusing the ids of destroyed groups, and are below
+// internal::scheduling_group_limit.
+class scheduling_group_id_allocator {
+    std::mutex _mtx;
+    std::vector<bool> _used;
+public:
+    explicit scheduling_group_id_allocator(unsigned reserved) : _used(reserved, true) {}
+    unsigned allocate() {
+        std::lock_guard<std::mutex> g(_mtx);
+        auto i = std::find(_used.begin(), _used.end(), false);
+        if (i != _used.end()) {
+            *i = true;
+            return i - _used.begin();
         }
-        i = count_trailing_zeros(~b);
-        nb = b | (1ul << i);
-    } while (!s_used_scheduling_group_ids_bitmap.compare_exchange_weak(b, nb, std::memory_order_relaxed));
-    return i;
-}
+        if (_used.size() == internal::scheduling_group_limit) {
+            throw_with_backtrace<std::runtime_error>("Scheduling group limit exceeded");
+        }
+        _used.push_back(true);
+        return _used.size() - 1;
+    }
+    void deallocate(unsigned id) {
+        std::lock_guard<std::mutex> g(_mtx);
+        _used[id] = false;
+    }
+};
 
-static
-void
-deallocate_scheduling_group_id(unsigned id) {
-    s_used_scheduling_group_ids_bitmap.fetch_and(~(1ul << id), std::memory_order_relaxed);
-}
+static scheduling_group_id_allocator s_scheduling_group_ids{2}; // 0=main, 1=atexit
+static scheduling_group_id_allocator s_scheduling_supergroup_ids{1}; // 0=root
 
 void
-reactor::init_scheduling_group(seastar::scheduling_group sg, sstring name, float shares) {
+reactor::init_scheduling_group(seastar::scheduling_group sg, sstring name, float shares, scheduling_supergroup parent) {
+    auto group = _task_queue_groups[parent._id].get();
     _task_queues.resize(std::max<size_t>(_task_queues.size(), sg._id + 1));
-    _task_queues[sg._id] = std::make_unique<task_queue>(sg._id, name, shares);
+    _task_queues[sg._id] = std::make_unique<task_queue>(group, sg._id, name, shares);
+    ++group->_nr_children;
 }
 
 void
 reactor::destroy_scheduling_group(scheduling_group sg) {
+    // Samples refer to the group, which is about to go away
+    _cpu_profiler->drain();
+    --_task_queues[sg._id]->_parent->_nr_children;
+    _tasks_pending -= _task_queues[sg._id]->size();
     _task_queues[sg._id].reset();
+    // The index may be reused by a new group
+    memory::reset_scheduling_group_memory(sg._id);
+}
+
+void
+reactor::init_scheduling_supergroup(scheduling_supergroup sg, sstring name, float shares, scheduling_supergroup parent) {
+    auto group = _task_queue_groups[parent._id].get();
+    _task_queue_groups.resize(std::max<size_t>(_task_queue_groups.size(), sg._id + 1));
+    _task_queue_groups[sg._id] = std::make_unique<task_queue_group>(group, sg._id, name, shares);
+    ++group->_nr_children;
+}
+
+void
+reactor::destroy_scheduling_supergroup(scheduling_supergroup sg) {
+    --_task_queue_groups[sg._id]->_parent->_nr_children;
+    _task_queue_groups[sg._id].reset();
+}
+
+void
+reactor::check_scheduling_supergroup(scheduling_supergroup sg, bool empty) const {
+    if (sg._id >= _task_queue_groups.size() || !_task_queue_groups[sg._id]) {
+        throw_with_backtrace<std::runtime_error>("Scheduling supergroup does not exist");
+    }
+    if (empty && _task_queue_groups[sg._id]->_nr_children) {
+        throw_with_backtrace<std::runtime_error>("Attempt to destroy a scheduling supergroup that still has members");
+    }
 }
 
 const sstring&
@@ -5986,13 +7462,47 @@ scheduling_group::set_shares(float shares) {
     engine()._task_queues[_id]->set_shares(shares);
 }
 
+void
+scheduling_group::set_deadline_ordering(bool enabled) {
+    engine()._task_queues[_id]->set_deadline_ordering(enabled);
+}
+
+void
+scheduling_group::set_memory_limits(size_t soft_limit, size_t hard_limit) {
+    memory::set_scheduling_group_memory_limits(_id, soft_limit, hard_limit);
+}
+
+void
+scheduling_group::set_memory_pressure_handler(std::function<void (bool)> handler) {
+    memory::set_scheduling_group_memory_pressure_handler(_id, std::move(handler));
+}
+
+size_t
+scheduling_group::memory_usage() const {
+    return _id < memory::max_accounted_scheduling_groups ? memory::scheduling_group_memory_usage(_id) : 0;
+}
+
+const sstring&
+scheduling_supergroup::name() const {
+    return engine()._task_queue_groups[_id]->_name;
+}
+
+void
+scheduling_supergroup::set_shares(float shares) {
+    engine()._task_queue_groups[_id]->set_shares(shares);
+}
+
 future<scheduling_group>
 create_scheduling_group(sstring name, float shares) {
-    auto id = allocate_scheduling_group_id();
-    assert(id < max_scheduling_groups());
-    auto sg = scheduling_group(id);
-    return smp::invoke_on_all([sg, name, shares] {
-        engine().init_scheduling_group(sg, name, shares);
+    return create_scheduling_group(std::move(name), shares, scheduling_supergroup());
+}
+
+future<scheduling_group>
+create_scheduling_group(sstring name, float shares, scheduling_supergroup parent) {
+    engine().check_scheduling_supergroup(parent, false);
+    auto sg = scheduling_group(s_scheduling_group_ids.allocate());
+    return smp::invoke_on_all([sg, name, shares, parent] {
+        engine().init_scheduling_group(sg, name, shares, parent);
     }).then([sg] {
         return make_ready_future<scheduling_group>(sg);
     });
@@ -6009,7 +7519,36 @@ destroy_scheduling_group(scheduling_group sg) {
     return smp::invoke_on_all([sg] {
         engine().destroy_scheduling_group(sg);
     }).then([sg] {
-        deallocate_scheduling_group_id(sg._id);
+        s_scheduling_group_ids.deallocate(sg._id);
+    });
+}
+
+future<scheduling_supergroup>
+create_scheduling_supergroup(sstring name, float shares, scheduling_supergroup parent) {
+    engine().check_scheduling_supergroup(parent, false);
+    auto sg = scheduling_supergroup(s_scheduling_supergroup_ids.allocate());
+    return smp::invoke_on_all([sg, name, shares, parent] {
+        engine().init_scheduling_supergroup(sg, name, shares, parent);
+    }).then([sg] {
+        return make_ready_future<scheduling_supergroup>(sg);
+    });
+}
+
+future<>
+destroy_scheduling_supergroup(scheduling_supergroup sg) {
+    if (sg.is_root()) {
+        throw_with_backtrace<std::runtime_error>("Attempt to destroy the root scheduling supergroup");
+    }
+    // Members are created and destroyed on each shard in turn, so one may
+    // only exist on some of them yet
+    return smp::invoke_on_all([sg] {
+        engine().check_scheduling_supergroup(sg, true);
+    }).then([sg] {
+        return smp::invoke_on_all([sg] {
+            engine().destroy_scheduling_supergroup(sg);
+        });
+    }).then([sg] {
+        s_scheduling_supergroup_ids.deallocate(sg._id);
     });
 }
 
@@ -26,7 +26,13 @@
 #include <limits>
 #include <chrono>
 #include <functional>
+#include <memory>
+#include <unordered_map>
 #include <seastar/core/posix.hh>
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/internal/spsc_ring.hh>
+#include <seastar/util/backtrace.hh>
 
 namespace seastar {
 
@@ -78,5 +84,73 @@ class cpu_stall_detector {
     void end_sleep();
 };
 
+struct cpu_profiler_sample {
+    saved_backtrace backtrace;
+    scheduling_group sg;
+};
+
+// Samples the reactor thread's stack at fixed intervals of its CPU time.
+//
+// The samples are taken by a second timer delivering the stall detector's
+// signal, told apart by its sigev_value. The signal handler only pushes
+// the sample into a ring; the reactor drains the ring from a poller and
+// counts samples per distinct (scheduling group, stack) pair. Since the
+// timer measures thread CPU time, a sleeping reactor is not sampled.
+//
+// Groups are recorded by name, as their ids may be reused once they are
+// destroyed, so the ring must be drained before destroying a group.
+class cpu_profiler {
+public:
+    static constexpr int timer_tag = 1;
+    static constexpr size_t ring_capacity = 128;
+    // Distinct stacks kept; samples of new stacks beyond that are dropped
+    static constexpr size_t max_profile_size = 4096;
+    struct key {
+        sstring group;
+        saved_backtrace backtrace;
+        bool operator==(const key& o) const {
+            return group == o.group && backtrace == o.backtrace;
+        }
+    };
+    struct key_hash {
+        size_t operator()(const key& k) const {
+            return k.backtrace.hash() ^ std::hash<sstring>()(k.group);
+        }
+    };
+    using profile = std::unordered_map<key, uint64_t, key_hash>;
+private:
+    timer_t _timer;
+    std::chrono::nanoseconds _period{0};
+    // Allocated when the profiler is first started, and kept until
+    // destruction, so the signal handler never races with freeing it
+    std::unique_ptr<spsc_ring<cpu_profiler_sample, ring_capacity>> _ring;
+    std::atomic<uint64_t> _dropped = { 0 };
+    uint64_t _samples = 0;
+    profile _profile;
+public:
+    cpu_profiler();
+    ~cpu_profiler();
+    void set_period(std::chrono::nanoseconds period);
+    std::chrono::nanoseconds period() const {
+        return _period;
+    }
+    // Called from the signal handler, with its ucontext
+    void on_signal(void* uctx) noexcept;
+    // Moves samples from the ring into the profile
+    bool drain();
+    const profile& get_profile() const {
+        return _profile;
+    }
+    void clear_profile() {
+        _profile.clear();
+    }
+    uint64_t samples() const {
+        return _samples;
+    }
+    uint64_t dropped_samples() const {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+};
+
 }
 }
@@ -27,19 +27,39 @@
 #include <seastar/util/std-compat.hh>
 #include <seastar/util/noncopyable_function.hh>
 #include <boost/lockfree/spsc_queue.hpp>
+#include <array>
+#include <chrono>
 
 namespace seastar {
 
+// Calls of a higher priority are picked up by the syscall workers first.
+enum class syscall_priority : uint8_t {
+    high,   // calls on the I/O path, such as resubmitting deferred aio
+    normal, // metadata and other short calls
+    low,    // calls which may take long, such as flushes and fallocate
+};
+
 class syscall_work_queue {
     static constexpr size_t queue_length = 128;
+    static constexpr unsigned nr_priorities = unsigned(syscall_priority::low) + 1;
     struct work_item;
     using lf_queue = boost::lockfree::spsc_queue<work_item*,
                             boost::lockfree::capacity<queue_length>>;
-    lf_queue _pending;
+    // Pushed by the shard, and popped by the syscall workers, which are
+    // serialized by their pool's lock.
+    std::array<lf_queue, nr_priorities> _pending;
+    // Pushed by the syscall workers, under their pool's lock, and popped
+    // by the shard.
     lf_queue _completed;
-    writeable_eventfd _start_eventfd;
+    // Items pushed to _pending since the workers were last told about them
+    unsigned _unannounced = 0;
     semaphore _queue_has_room = { queue_length };
     struct work_item {
+        using clock_type = std::chrono::steady_clock;
+        clock_type::time_point submitted;
+        clock_type::time_point started;
+        clock_type::time_point finished;
+        syscall_priority priority = syscall_priority::normal;
         virtual ~work_item() {}
         virtual void process() = 0;
         virtual void complete() = 0;
@@ -57,24 +77,51 @@ class syscall_work_queue {
 public:
     syscall_work_queue();
     template <typename T>
-    future<T> submit(noncopyable_function<T ()> func) {
+    future<T> submit(noncopyable_function<T ()> func, syscall_priority priority = syscall_priority::normal) {
         auto wi = std::make_unique<work_item_returning<T>>(std::move(func));
+        wi->priority = priority;
         auto fut = wi->get_future();
         submit_item(std::move(wi));
         return fut;
     }
 private:
-    void work();
-    // Scans the _completed queue, that contains the requests already handled by the syscall thread,
+    // Scans the _completed queue, that contains the requests already handled by the syscall threads,
     // effectively opening up space for more requests to be submitted. One consequence of this is
     // that from the reactor's point of view, a request is not considered handled until it is
     // removed from the _completed queue.
     //
-    // Returns the number of requests handled.
-    unsigned complete();
+    // Calls func on each completed item before completing it, and returns the
+    // number of requests handled.
+    template <typename Func>
+    unsigned complete(Func&& func);
     void submit_item(std::unique_ptr<syscall_work_queue::work_item> wi);
+    // Pops the next pending item of the given priority, if any. Must be
+    // called with the pool's lock held.
+    work_item* pop_pending(unsigned priority) {
+        work_item* wi = nullptr;
+        _pending[priority].pop(wi);
+        return wi;
+    }
 
     friend class thread_pool;
+    friend class syscall_thread_pool;
 };
 
+template <typename Func>
+unsigned syscall_work_queue::complete(Func&& func) {
+    std::array<work_item*, queue_length> tmp_buf;
+    auto end = tmp_buf.data();
+    auto nr = _completed.consume_all([&] (work_item* wi) {
+        *end++ = wi;
+    });
+    for (auto p = tmp_buf.data(); p != end; ++p) {
+        auto wi = *p;
+        func(*wi);
+        wi->complete();
+        delete wi;
+    }
+    _queue_has_room.signal(nr);
+    return nr;
+}
+
 }
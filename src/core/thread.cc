@@ -214,6 +214,7 @@ thread_context::setup() {
     initial_context.uc_link = nullptr;
     makecontext(&initial_context, main, 2, int(q), int(q >> 32));
     _context.thread = this;
+    _arenas = std::exchange(internal::current_arena_state(), {});
     _context.initial_switch_in(&initial_context, _stack.get(), _stack_size);
 }
 
@@ -225,6 +226,7 @@ thread_context::switch_in() {
     } else {
         _context.yield_at = {};
     }
+    std::swap(_arenas, internal::current_arena_state());
     _context.switch_in();
 }
 
@@ -233,6 +235,7 @@ thread_context::switch_out() {
     if (_attr.scheduling_group) {
         _attr.scheduling_group->account_stop();
     }
+    std::swap(_arenas, internal::current_arena_state());
     _context.switch_out();
 }
 
@@ -322,6 +325,7 @@ thread_context::main() {
     if (_attr.scheduling_group) {
         _attr.scheduling_group->account_stop();
     }
+    std::swap(_arenas, internal::current_arena_state());
 
     _context.final_switch_out();
 }
@@ -0,0 +1,298 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+#include <seastar/core/tracing.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/fstream.hh>
+#include <seastar/core/print.hh>
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace seastar {
+
+namespace tracing {
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+struct span_record {
+    trace_context ctx;
+    uint64_t parent_id;
+    const char* name;
+    clock_type::time_point start;
+    clock_type::time_point end;
+};
+
+// Per-shard state: the spans that are started and can be inherited by
+// tasks, and a ring of the last spans that ended.
+class tracer {
+    static constexpr size_t max_records = 16384;
+    struct slot {
+        trace_context ctx;
+        uint64_t parent_id;
+        const char* name;
+        clock_type::time_point start;
+        uint32_t refs;
+        uint32_t next_free;
+        // Set once the span is recorded; tasks may still refer to it, but
+        // it isn't current for anything started from now on
+        bool ended;
+    };
+    // Slot 0 stands for no span, and is never allocated
+    std::vector<slot> _slots{1};
+    uint32_t _free = 0;
+    std::vector<span_record> _records;
+    size_t _next_record = 0;
+    double _sample_rate = 0;
+    std::mt19937_64 _rng{std::random_device()()};
+public:
+    void set_sample_rate(double rate) {
+        _sample_rate = rate;
+    }
+    bool sample() {
+        return _sample_rate > 0
+                && std::uniform_real_distribution<double>(0, 1)(_rng) < _sample_rate;
+    }
+    uint64_t new_id() {
+        uint64_t id;
+        do {
+            id = _rng();
+        } while (!id);
+        return id;
+    }
+    uint32_t allocate(trace_context ctx, uint64_t parent_id, const char* name) {
+        uint32_t i = _free;
+        if (i) {
+            _free = _slots[i].next_free;
+        } else {
+            i = _slots.size();
+            _slots.emplace_back();
+        }
+        _slots[i] = slot{ctx, parent_id, name, clock_type::now(), 1, 0, false};
+        return i;
+    }
+    slot& get(uint32_t i) {
+        return _slots[i];
+    }
+    bool live(uint32_t i) const {
+        return i && !_slots[i].ended;
+    }
+    void add_ref(uint32_t i) {
+        ++_slots[i].refs;
+    }
+    void release(uint32_t i) {
+        if (--_slots[i].refs == 0) {
+            _slots[i].next_free = _free;
+            _free = i;
+            // Don't let tasks inherit a slot that may be reused
+            auto current = internal::current_trace_slot_ptr();
+            if (*current == i) {
+                *current = 0;
+            }
+        }
+    }
+    void record(uint32_t i) {
+        auto& s = _slots[i];
+        span_record r{s.ctx, s.parent_id, s.name, s.start, clock_type::now()};
+        try {
+            if (_records.size() < max_records) {
+                _records.push_back(r);
+                return;
+            }
+        } catch (...) {
+            return;
+        }
+        _records[_next_record] = r;
+        _next_record = (_next_record + 1) % max_records;
+    }
+    // Oldest first
+    std::vector<span_record> records(bool reset) {
+        std::vector<span_record> ret;
+        ret.reserve(_records.size());
+        ret.insert(ret.end(), _records.begin() + _next_record, _records.end());
+        ret.insert(ret.end(), _records.begin(), _records.begin() + _next_record);
+        if (reset) {
+            _records.clear();
+            _next_record = 0;
+        }
+        return ret;
+    }
+};
+
+thread_local tracer local_tracer;
+
+}
+
+span::span(const char* name) noexcept {
+    auto current = internal::current_trace_slot_ptr();
+    auto parent = *current;
+    if (!local_tracer.live(parent)) {
+        return;
+    }
+    auto& ps = local_tracer.get(parent);
+    auto trace_id = ps.ctx.trace_id;
+    auto parent_id = ps.ctx.span_id;
+    try {
+        _slot = local_tracer.allocate(trace_context{trace_id, local_tracer.new_id()}, parent_id, name);
+    } catch (...) {
+        return;
+    }
+    _parent_slot = parent;
+    local_tracer.add_ref(parent);
+    *current = _slot;
+}
+
+span::span(trace_context parent, const char* name) noexcept {
+    if (!parent) {
+        return;
+    }
+    try {
+        _slot = local_tracer.allocate(trace_context{parent.trace_id, local_tracer.new_id()}, parent.span_id, name);
+    } catch (...) {
+        return;
+    }
+    // Restored when the span ends
+    auto current = internal::current_trace_slot_ptr();
+    if (local_tracer.live(*current)) {
+        _parent_slot = *current;
+        local_tracer.add_ref(_parent_slot);
+    }
+    *current = _slot;
+}
+
+trace_context span::context() const noexcept {
+    return _slot ? local_tracer.get(_slot).ctx : trace_context();
+}
+
+void span::do_end() noexcept {
+    local_tracer.record(_slot);
+    local_tracer.get(_slot).ended = true;
+    auto current = internal::current_trace_slot_ptr();
+    if (*current == _slot) {
+        *current = _parent_slot;
+    }
+    local_tracer.release(_slot);
+    internal::release_trace_slot(_parent_slot);
+    _slot = _parent_slot = 0;
+}
+
+span start_trace(const char* name) noexcept {
+    if (!local_tracer.sample()) {
+        return span();
+    }
+    // A parent with no span id makes the new span a root
+    return span(trace_context{local_tracer.new_id(), 0}, name);
+}
+
+void set_sample_rate(double rate) {
+    local_tracer.set_sample_rate(rate);
+}
+
+// Span names are arbitrary strings
+static sstring json_escape(const char* s) {
+    sstring ret;
+    for (; *s; ++s) {
+        auto c = *s;
+        if (c == '"' || c == '\\') {
+            const char escaped[] = {'\\', c};
+            ret.append(escaped, 2);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            ret += format("\\u{:04x}", unsigned(c));
+        } else {
+            ret.append(&c, 1);
+        }
+    }
+    return ret;
+}
+
+// Chrome's trace event format, one complete ("X") event per span, with
+// shards shown as threads.
+static sstring format_records(const std::vector<span_record>& records) {
+    sstring ret;
+    auto us = [] (clock_type::duration d) {
+        return std::chrono::duration<double, std::micro>(d).count();
+    };
+    for (auto&& r : records) {
+        if (!ret.empty()) {
+            ret += ",\n";
+        }
+        ret += format("{{\"name\":\"{}\",\"cat\":\"seastar\",\"ph\":\"X\",\"pid\":0,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f},"
+                "\"args\":{{\"trace_id\":\"{:016x}\",\"span_id\":\"{:016x}\",\"parent_id\":\"{:016x}\"}}}}",
+                json_escape(r.name), engine().cpu_id(), us(r.start.time_since_epoch()), us(r.end - r.start),
+                r.ctx.trace_id, r.ctx.span_id, r.parent_id);
+    }
+    return ret;
+}
+
+future<sstring> collect_chrome_trace(bool reset) {
+    return smp::broadcast_map_reduce([reset] {
+        return format_records(local_tracer.records(reset));
+    }, sstring(), [] (sstring a, sstring b) {
+        if (a.empty()) {
+            return b;
+        }
+        if (!b.empty()) {
+            a += ",\n";
+            a += b;
+        }
+        return a;
+    }).then([] (sstring events) {
+        return "{\"traceEvents\":[\n" + events + "\n]}\n";
+    });
+}
+
+future<> write_chrome_trace(sstring path, bool reset) {
+    return collect_chrome_trace(reset).then([path = std::move(path)] (sstring trace) {
+        return open_file_dma(path, open_flags::wo | open_flags::create | open_flags::truncate).then([trace = std::move(trace)] (file f) {
+            return do_with(make_file_output_stream(std::move(f)), std::move(trace), [] (output_stream<char>& out, sstring& trace) {
+                return out.write(trace).then([&out] {
+                    return out.close();
+                });
+            });
+        });
+    });
+}
+
+}
+
+namespace internal {
+
+uint32_t add_trace_slot_ref(uint32_t slot) noexcept {
+    if (!tracing::local_tracer.live(slot)) {
+        return 0;
+    }
+    tracing::local_tracer.add_ref(slot);
+    return slot;
+}
+
+void release_trace_slot_ref(uint32_t slot) noexcept {
+    tracing::local_tracer.release(slot);
+}
+
+tracing::trace_context trace_slot_context(uint32_t slot) noexcept {
+    return tracing::local_tracer.live(slot) ? tracing::local_tracer.get(slot).ctx : tracing::trace_context();
+}
+
+}
+
+}
@@ -146,6 +146,21 @@ class posix_connected_socket_impl final : public connected_socket_impl, posix_co
     keepalive_params get_keepalive_parameters() const override {
         return _ops::get_keepalive_parameters(_fd->get_file_desc());
     }
+    virtual future<noncopyable_function<connected_socket ()>> detach(unsigned shard) override {
+        // A duplicate descriptor carries the connection over, while this
+        // one is unregistered from the reactor and closed along with _fd.
+        int fd = ::fcntl(_fd->get_file_desc().get(), F_DUPFD_CLOEXEC, 0);
+        throw_system_error_on(fd == -1, "fcntl(F_DUPFD_CLOEXEC)");
+        auto dup = file_desc::from_fd(fd);
+        auto f = _handle.move_to(shard);
+        return f.then([fd = std::move(dup), handle = std::move(_handle), allocator = _allocator] () mutable {
+            return noncopyable_function<connected_socket ()>([fd = std::move(fd), handle = std::move(handle), allocator] () mutable {
+                std::unique_ptr<connected_socket_impl> csi(
+                        new posix_connected_socket_impl<Transport>(make_lw_shared<pollable_fd>(std::move(fd)), std::move(handle), allocator));
+                return connected_socket(std::move(csi));
+            });
+        });
+    }
     friend class posix_server_socket_impl<Transport>;
     friend class posix_ap_server_socket_impl<Transport>;
     friend class posix_reuseport_server_socket_impl<Transport>;
@@ -213,8 +228,16 @@ template <transport Transport>
 future<connected_socket, socket_address>
 posix_server_socket_impl<Transport>::accept() {
     return _lfd.accept().then([this] (pollable_fd fd, socket_address sa) {
-        auto cth = _lba == server_socket::load_balancing_algorithm::connection_distribution ?
-                _conntrack.get_handle() : _conntrack.get_handle(ntoh(sa.as_posix_sockaddr_in().sin_port) % smp::count);
+        auto cth = [&] {
+            switch (_lba) {
+            case server_socket::load_balancing_algorithm::port:
+                return _conntrack.get_handle(ntoh(sa.as_posix_sockaddr_in().sin_port) % smp::count);
+            case server_socket::load_balancing_algorithm::load:
+                return _conntrack.get_handle(smp::less_loaded_of_two_shards());
+            default:
+                return _conntrack.get_handle();
+            }
+        }();
         auto cpu = cth.cpu();
         if (cpu == engine().cpu_id()) {
             std::unique_ptr<connected_socket_impl> csi(
@@ -367,13 +390,15 @@ posix_data_sink_impl::close() {
 
 server_socket
 posix_network_stack::listen(socket_address sa, listen_options opt) {
+    // Balancing by load needs a single shard to accept connections
+    auto reuseport = _reuseport && opt.lba != server_socket::load_balancing_algorithm::load;
     if (opt.proto == transport::TCP) {
-        return _reuseport ?
+        return reuseport ?
             server_socket(std::make_unique<posix_reuseport_server_tcp_socket_impl>(sa, engine().posix_listen(sa, opt), _allocator))
             :
             server_socket(std::make_unique<posix_server_tcp_socket_impl>(sa, engine().posix_listen(sa, opt), opt.lba, _allocator));
     } else {
-        return _reuseport ?
+        return reuseport ?
             server_socket(std::make_unique<posix_reuseport_server_sctp_socket_impl>(sa, engine().posix_listen(sa, opt), _allocator))
             :
             server_socket(std::make_unique<posix_server_sctp_socket_impl>(sa, engine().posix_listen(sa, opt), opt.lba, _allocator));
@@ -392,13 +417,14 @@ thread_local std::unordered_multimap<socket_address, typename posix_ap_server_so
 
 server_socket
 posix_ap_network_stack::listen(socket_address sa, listen_options opt) {
+    auto reuseport = _reuseport && opt.lba != server_socket::load_balancing_algorithm::load;
     if (opt.proto == transport::TCP) {
-        return _reuseport ?
+        return reuseport ?
             server_socket(std::make_unique<posix_reuseport_server_tcp_socket_impl>(sa, engine().posix_listen(sa, opt)))
             :
             server_socket(std::make_unique<posix_tcp_ap_server_socket_impl>(sa));
     } else {
-        return _reuseport ?
+        return reuseport ?
             server_socket(std::make_unique<posix_reuseport_server_sctp_socket_impl>(sa, engine().posix_listen(sa, opt)))
             :
             server_socket(std::make_unique<posix_sctp_ap_server_socket_impl>(sa));
@@ -121,6 +121,27 @@ void connected_socket::shutdown_input() {
     _csi->shutdown_input();
 }
 
+future<> connected_socket::move_to(unsigned shard, noncopyable_function<future<> (connected_socket)> func) && {
+    if (shard == engine().cpu_id()) {
+        return func(std::move(*this));
+    }
+    auto csi = std::move(_csi);
+    auto f = csi->detach(shard);
+    return f.then([csi = std::move(csi), shard, func = std::move(func)] (noncopyable_function<connected_socket ()> attach) mutable {
+        // Release the connection here before it is used there
+        csi.reset();
+        return smp::submit_to(shard, [attach = std::move(attach), func = std::move(func)] () mutable {
+            return func(attach());
+        });
+    });
+}
+
+future<noncopyable_function<connected_socket ()>>
+net::connected_socket_impl::detach(unsigned shard) {
+    return make_exception_future<noncopyable_function<connected_socket ()>>(
+            std::runtime_error("this network stack cannot move connections across shards"));
+}
+
 socket::~socket()
 {}
 
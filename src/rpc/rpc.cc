@@ -1,6 +1,7 @@
 #include <seastar/rpc/rpc.hh>
 #include <seastar/core/print.hh>
 #include <boost/range/adaptor/map.hpp>
+#include <cstring>
 
 namespace seastar {
 
@@ -115,14 +116,25 @@ namespace rpc {
                   d.pcancel->cancel_send = std::function<void()>(); // request is no longer cancellable
               }
               if (QueueType == outgoing_queue_type::request) {
-                  static_assert(snd_buf::chunk_size >= 8, "send buffer chunk size is too small");
+                  static_assert(snd_buf::chunk_size >= 24, "send buffer chunk size is too small");
+                  if (!_tracing_negotiated) {
+                      d.buf.front().trim_front(16);
+                      d.buf.size -= 16;
+                  }
                   if (_timeout_negotiated) {
                       auto expire = d.t.get_timeout();
                       uint64_t left = 0;
                       if (expire != typename timer<rpc_clock_type>::time_point()) {
                           left = std::chrono::duration_cast<std::chrono::milliseconds>(expire - timer<rpc_clock_type>::clock::now()).count();
                       }
-                      write_le<uint64_t>(d.buf.front().get_write(), left);
+                      // after the trace context, if it was kept
+                      write_le<uint64_t>(d.buf.front().get_write() + (_tracing_negotiated ? 16 : 0), left);
+                  } else if (_tracing_negotiated) {
+                      // drop the timeout slot, which follows the trace context
+                      auto p = d.buf.front().get_write();
+                      std::memmove(p + 8, p, 16);
+                      d.buf.front().trim_front(8);
+                      d.buf.size -= 8;
                   } else {
                       d.buf.front().trim_front(8);
                       d.buf.size -= 8;
@@ -512,6 +524,9 @@ namespace rpc {
           case protocol_features::TIMEOUT:
               _timeout_negotiated = true;
               break;
+          case protocol_features::TRACING:
+              _tracing_negotiated = true;
+              break;
           case protocol_features::CONNECTION_ID: {
               _id = deserialize_connection_id(e.second);
               break;
@@ -635,6 +650,9 @@ namespace rpc {
           if (_options.send_timeout_data) {
               features[protocol_features::TIMEOUT] = "";
           }
+          if (_options.send_trace_context) {
+              features[protocol_features::TRACING] = "";
+          }
           if (_options.stream_parent) {
               features[protocol_features::STREAM_PARENT] = serialize_connection_id(_options.stream_parent);
           }
@@ -740,6 +758,10 @@ namespace rpc {
               _timeout_negotiated = true;
               ret[protocol_features::TIMEOUT] = "";
               break;
+          case protocol_features::TRACING:
+              _tracing_negotiated = true;
+              ret[protocol_features::TRACING] = "";
+              break;
           case protocol_features::STREAM_PARENT: {
               if (!_server._options.streaming_domain) {
                   f = make_exception_future<>(std::runtime_error("streaming is not configured for the server"));
@@ -794,8 +816,8 @@ namespace rpc {
 
   struct request_frame {
       using opt_buf_type = compat::optional<rcv_buf>;
-      using return_type = future<compat::optional<uint64_t>, uint64_t, int64_t, opt_buf_type>;
-      using header_type = std::tuple<compat::optional<uint64_t>, uint64_t, int64_t, uint32_t>;
+      using return_type = future<compat::optional<uint64_t>, uint64_t, int64_t, opt_buf_type, tracing::trace_context>;
+      using header_type = std::tuple<compat::optional<uint64_t>, uint64_t, int64_t, uint32_t, tracing::trace_context>;
       static size_t header_size() {
           return 20;
       }
@@ -803,19 +825,19 @@ namespace rpc {
           return "server";
       }
       static auto empty_value() {
-          return make_ready_future<compat::optional<uint64_t>, uint64_t, int64_t, opt_buf_type>(compat::nullopt, uint64_t(0), 0, compat::nullopt);
+          return make_ready_future<compat::optional<uint64_t>, uint64_t, int64_t, opt_buf_type, tracing::trace_context>(compat::nullopt, uint64_t(0), 0, compat::nullopt, tracing::trace_context());
       }
       static header_type decode_header(const char* ptr) {
           auto type = read_le<uint64_t>(ptr);
           auto msgid = read_le<int64_t>(ptr + 8);
           auto size = read_le<uint32_t>(ptr + 16);
-          return std::make_tuple(compat::nullopt, type, msgid, size);
+          return std::make_tuple(compat::nullopt, type, msgid, size, tracing::trace_context());
       }
       static uint32_t get_size(const header_type& t) {
           return std::get<3>(t);
       }
       static auto make_value(const header_type& t, rcv_buf data) {
-          return make_ready_future<compat::optional<uint64_t>, uint64_t, int64_t, opt_buf_type>(std::get<0>(t), std::get<1>(t), std::get<2>(t), std::move(data));
+          return make_ready_future<compat::optional<uint64_t>, uint64_t, int64_t, opt_buf_type, tracing::trace_context>(std::get<0>(t), std::get<1>(t), std::get<2>(t), std::move(data), std::get<4>(t));
       }
   };
 
@@ -831,8 +853,27 @@ namespace rpc {
       }
   };
 
-  future<compat::optional<uint64_t>, uint64_t, int64_t, compat::optional<rcv_buf>>
+  template <typename Base>
+  struct request_frame_with_trace : Base {
+      static size_t header_size() {
+          return Base::header_size() + 16;
+      }
+      static typename Base::header_type decode_header(const char* ptr) {
+          auto h = Base::decode_header(ptr + 16);
+          std::get<4>(h) = tracing::trace_context{read_le<uint64_t>(ptr), read_le<uint64_t>(ptr + 8)};
+          return h;
+      }
+  };
+
+  future<compat::optional<uint64_t>, uint64_t, int64_t, compat::optional<rcv_buf>, tracing::trace_context>
   server::connection::read_request_frame_compressed(input_stream<char>& in) {
+      if (_tracing_negotiated) {
+          if (_timeout_negotiated) {
+              return read_frame_compressed<request_frame_with_trace<request_frame_with_timeout>>(_info.addr, _compressor, in);
+          } else {
+              return read_frame_compressed<request_frame_with_trace<request_frame>>(_info.addr, _compressor, in);
+          }
+      }
       if (_timeout_negotiated) {
           return read_frame_compressed<request_frame_with_timeout>(_info.addr, _compressor, in);
       } else {
@@ -877,7 +918,7 @@ future<> server::connection::send_unknown_verb_reply(compat::optional<rpc_clock_
               if (is_stream()) {
                   return handle_stream_frame();
               }
-              return read_request_frame_compressed(_read_buf).then([this] (compat::optional<uint64_t> expire, uint64_t type, int64_t msg_id, compat::optional<rcv_buf> data) {
+              return read_request_frame_compressed(_read_buf).then([this] (compat::optional<uint64_t> expire, uint64_t type, int64_t msg_id, compat::optional<rcv_buf> data, tracing::trace_context trace) {
                   if (!data) {
                       _error = true;
                       return make_ready_future<>();
@@ -890,14 +931,17 @@ future<> server::connection::send_unknown_verb_reply(compat::optional<rpc_clock_
                       // If the new method of per-connection scheduling group was used, honor it.
                       // Otherwise, use the old per-handler scheduling group.
                       auto sg = _isolation_config ? _isolation_config->sched_group : h.first ? h.first->sg : scheduling_group();
-                      return with_scheduling_group(sg, [this, timeout, type, msg_id, h, data = std::move(data.value())] () mutable {
+                      return with_scheduling_group(sg, [this, timeout, type, msg_id, h, data = std::move(data.value()), trace] () mutable {
                           // with_scheduling_group may defer and the callback might be unregistered already when the code runs
                           // verify it by checking that handlers table version did not change, otherwise search for the handler again
                           if (h.first && h.second != _server._proto->get_handlers_table_version()) {
                               h = _server._proto->get_handler(type);
                           }
                           if (h.first) {
-                              return h.first->func(shared_from_this(), timeout, msg_id, std::move(data));
+                              // Continue the caller's trace, if it's sampled, while the handler runs
+                              internal::trace_slot_scope scope;
+                              tracing::span span(trace, "rpc_handler");
+                              return h.first->func(shared_from_this(), timeout, msg_id, std::move(data)).finally([span = std::move(span)] {});
                           } else {
                               return send_unknown_verb_reply(timeout, msg_id, type);
                           }
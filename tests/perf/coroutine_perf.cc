@@ -0,0 +1,125 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB Ltd.
+ */
+
+#include <seastar/core/coroutine.hh>
+#include <seastar/core/future-util.hh>
+
+#include "perf_tests.hh"
+
+// Each test does the same four steps, as a coroutine and as a chain of
+// continuations, so that the two can be compared pairwise.
+
+[[gnu::noinline]]
+future<int> ready(int v) {
+    return make_ready_future<int>(v + 1);
+}
+
+[[gnu::noinline]]
+future<int> suspend(int v) {
+    return later().then([v] {
+        return v + 1;
+    });
+}
+
+future<int> await_ready(int v) {
+    v = co_await ready(v);
+    v = co_await ready(v);
+    v = co_await ready(v);
+    v = co_await ready(v);
+    co_return v;
+}
+
+future<int> chain_ready(int v) {
+    return ready(v).then([] (int v) {
+        return ready(v);
+    }).then([] (int v) {
+        return ready(v);
+    }).then([] (int v) {
+        return ready(v);
+    });
+}
+
+future<int> await_suspend(int v) {
+    v = co_await suspend(v);
+    v = co_await suspend(v);
+    v = co_await suspend(v);
+    v = co_await suspend(v);
+    co_return v;
+}
+
+future<int> chain_suspend(int v) {
+    return suspend(v).then([] (int v) {
+        return suspend(v);
+    }).then([] (int v) {
+        return suspend(v);
+    }).then([] (int v) {
+        return suspend(v);
+    });
+}
+
+// A coroutine per step, each with a frame of its own
+[[gnu::noinline]]
+future<int> step_coroutine(int v) {
+    co_return co_await ready(v);
+}
+
+future<int> await_coroutines(int v) {
+    v = co_await step_coroutine(v);
+    v = co_await step_coroutine(v);
+    v = co_await step_coroutine(v);
+    v = co_await step_coroutine(v);
+    co_return v;
+}
+
+PERF_TEST(coroutine, ready)
+{
+    return await_ready(0).then([] (int v) {
+        perf_tests::do_not_optimize(v);
+    });
+}
+
+PERF_TEST(continuation, ready)
+{
+    return chain_ready(0).then([] (int v) {
+        perf_tests::do_not_optimize(v);
+    });
+}
+
+PERF_TEST(coroutine, suspend)
+{
+    return await_suspend(0).then([] (int v) {
+        perf_tests::do_not_optimize(v);
+    });
+}
+
+PERF_TEST(continuation, suspend)
+{
+    return chain_suspend(0).then([] (int v) {
+        perf_tests::do_not_optimize(v);
+    });
+}
+
+PERF_TEST(coroutine, nested)
+{
+    return await_coroutines(0).then([] (int v) {
+        perf_tests::do_not_optimize(v);
+    });
+}
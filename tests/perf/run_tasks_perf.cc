@@ -0,0 +1,87 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB Ltd.
+ */
+
+#include <seastar/core/future-util.hh>
+#include <seastar/core/task.hh>
+
+#include "perf_tests.hh"
+
+// Each test runs a batch of tasks that do nothing, so that the results
+// are dominated by the reactor's cost of queueing and running a task.
+// They report the time per task.
+struct run_tasks {
+    static constexpr size_t batch = 1000;
+    size_t remaining = 0;
+    promise<> done;
+};
+
+// A deep queue: the whole batch is runnable at once.
+PERF_TEST_F(run_tasks, empty_tasks)
+{
+    remaining = batch;
+    done = promise<>();
+    for (size_t i = 0; i != batch; ++i) {
+        schedule(make_task([this] {
+            if (!--remaining) {
+                done.set_value();
+            }
+        }));
+    }
+    return done.get_future().then([] {
+        return batch;
+    });
+}
+
+// A shallow queue: each continuation becomes runnable when the one
+// before it completes.
+PERF_TEST_F(run_tasks, empty_continuations)
+{
+    promise<> start;
+    auto f = start.get_future();
+    for (size_t i = 0; i != batch; ++i) {
+        f = f.then([] { });
+    }
+    start.set_value();
+    return f.then([] {
+        return batch;
+    });
+}
+
+// Many independent continuations, all made runnable at once.
+PERF_TEST_F(run_tasks, empty_continuations_fan_out)
+{
+    std::vector<promise<>> promises(batch);
+    remaining = batch;
+    done = promise<>();
+    for (auto& p : promises) {
+        p.get_future().then([this] {
+            if (!--remaining) {
+                done.set_value();
+            }
+        });
+    }
+    for (auto& p : promises) {
+        p.set_value();
+    }
+    return done.get_future().then([] {
+        return batch;
+    });
+}
@@ -0,0 +1,169 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB Ltd.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <seastar/core/timer-set.hh>
+#include <seastar/core/timer-wheel.hh>
+
+#include "perf_tests.hh"
+
+using namespace std::chrono_literals;
+
+struct test_timer {
+    using clock = std::chrono::steady_clock;
+    using time_point = clock::time_point;
+    using duration = clock::duration;
+
+    time_point expiry;
+    boost::intrusive::list_member_hook<> link;
+
+    time_point get_timeout() const {
+        return expiry;
+    }
+    // needed by timer_set and timer_wheel; the fixtures clear() them instead
+    bool cancel() {
+        return false;
+    }
+};
+
+// Drives a timer container with a simulated clock, so that runs don't
+// depend on how long the previous ones took.
+template <typename TimerSet>
+class timers {
+protected:
+    static constexpr size_t nr_timers = 10000;
+
+    TimerSet _set;
+    std::vector<test_timer> _timers{nr_timers};
+    std::vector<test_timer::duration> _delays;
+    // Timers are armed in random order, as they would be by unrelated
+    // connections, rather than in the order they're laid out in memory
+    std::vector<test_timer*> _order;
+    test_timer::time_point _now{1h};
+    size_t _expired = 0;
+
+    timers() {
+        // A mix of short (retransmit-like) and long (request timeout-like) delays
+        std::default_random_engine eng;
+        std::uniform_int_distribution<int64_t> short_us(100, 10000);
+        std::uniform_int_distribution<int64_t> long_ms(100, 60000);
+        for (size_t i = 0; i < nr_timers; ++i) {
+            if (i % 2) {
+                _delays.emplace_back(std::chrono::microseconds(short_us(eng)));
+            } else {
+                _delays.emplace_back(std::chrono::milliseconds(long_ms(eng)));
+            }
+            _order.push_back(&_timers[i]);
+        }
+        std::shuffle(_order.begin(), _order.end(), eng);
+        advance({});
+    }
+
+    ~timers() {
+        _set.clear();
+    }
+
+    void advance(test_timer::duration d) {
+        _now += d;
+        auto exp = _set.expire(_now);
+        _expired += exp.size();
+        exp.clear();
+    }
+public:
+    // Arms every timer and cancels it before it fires, the common case
+    // for I/O timeouts.
+    size_t arm_cancel() {
+        for (size_t i = 0; i < nr_timers; ++i) {
+            _order[i]->expiry = _now + _delays[i];
+            _set.insert(*_order[i]);
+        }
+        for (auto t : _order) {
+            _set.remove(*t);
+        }
+        perf_tests::do_not_optimize(_set);
+        return nr_timers;
+    }
+
+    // Keeps all timers armed and re-arms each of them once, as a
+    // connection does with its idle timer on every request.
+    size_t rearm() {
+        for (size_t i = 0; i < nr_timers; ++i) {
+            _order[i]->expiry = _now + _delays[i];
+            _set.insert(*_order[i]);
+        }
+        for (size_t i = 0; i < nr_timers; ++i) {
+            auto& t = *_order[i];
+            _set.remove(t);
+            t.expiry = _now + _delays[nr_timers - 1 - i];
+            _set.insert(t);
+        }
+        _set.clear();
+        return 2 * nr_timers;
+    }
+
+    // Arms every timer and lets all of them fire, advancing the clock by
+    // a fixed tick, as the reactor's timer poller would.
+    size_t arm_expire() {
+        for (size_t i = 0; i < nr_timers; ++i) {
+            _order[i]->expiry = _now + _delays[i] % 20ms;
+            _set.insert(*_order[i]);
+        }
+        _expired = 0;
+        while (_expired < nr_timers) {
+            advance(100us);
+        }
+        return nr_timers;
+    }
+};
+
+using timer_set_t = seastar::timer_set<test_timer, &test_timer::link>;
+using timer_wheel_t = seastar::timer_wheel<test_timer, &test_timer::link>;
+
+struct timer_set_timers : timers<timer_set_t> { };
+struct timer_wheel_timers : timers<timer_wheel_t> { };
+
+PERF_TEST_F(timer_set_timers, arm_cancel) {
+    return arm_cancel();
+}
+
+PERF_TEST_F(timer_wheel_timers, arm_cancel) {
+    return arm_cancel();
+}
+
+PERF_TEST_F(timer_set_timers, rearm) {
+    return rearm();
+}
+
+PERF_TEST_F(timer_wheel_timers, rearm) {
+    return rearm();
+}
+
+PERF_TEST_F(timer_set_timers, arm_expire) {
+    return arm_expire();
+}
+
+PERF_TEST_F(timer_wheel_timers, arm_expire) {
+    return arm_expire();
+}
@@ -20,9 +20,12 @@
  */
 
 #include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
 #include <seastar/core/memory.hh>
 #include <seastar/core/reactor.hh>
 #include <seastar/core/temporary_buffer.hh>
+#include <cmath>
+#include <sstream>
 #include <vector>
 
 using namespace seastar;
@@ -94,3 +97,139 @@ SEASTAR_TEST_CASE(test_temporary_buffer_aligned) {
     }
     return make_ready_future<>();
 }
+
+SEASTAR_TEST_CASE(test_huge_page_statistics) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    auto before = memory::stats();
+    BOOST_REQUIRE_EQUAL(before.huge_pages(), before.total_memory() / memory::huge_page_size);
+    BOOST_REQUIRE_LE(before.free_huge_pages() * memory::huge_page_size, before.free_memory());
+    auto obj = malloc(2 * memory::huge_page_size);
+    BOOST_REQUIRE(obj != nullptr);
+    auto during = memory::stats();
+    BOOST_REQUIRE_EQUAL(during.huge_pages_in_use(), before.huge_pages_in_use() + 2);
+    free(obj);
+    auto after = memory::stats();
+    BOOST_REQUIRE_EQUAL(after.free_huge_pages(), before.free_huge_pages());
+#endif
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_release_idle_free_memory) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    constexpr size_t size = 16 * memory::huge_page_size;
+    auto obj = static_cast<char*>(malloc(size));
+    BOOST_REQUIRE(obj != nullptr);
+    std::fill_n(obj, size, 1);
+    free(obj);
+    // The span was just freed, so it's only released by later calls,
+    // which release a few MB at most each
+    memory::release_idle_free_memory();
+    auto before = memory::stats();
+    size_t released = 0;
+    while (auto r = memory::release_idle_free_memory()) {
+        BOOST_REQUIRE_LE(r, 4 << 20);
+        released += r;
+    }
+    BOOST_REQUIRE_GE(released, size);
+    auto after = memory::stats();
+    BOOST_REQUIRE_GE(after.released_memory(), before.released_memory() + size);
+    BOOST_REQUIRE_GE(after.total_released_memory(), before.total_released_memory() + size);
+    BOOST_REQUIRE_LE(after.released_memory(), after.free_memory() - memory::min_free_memory());
+
+    // Released memory is faulted back in when it's allocated again
+    obj = static_cast<char*>(malloc(size));
+    BOOST_REQUIRE(obj != nullptr);
+    std::fill_n(obj, size, 2);
+    BOOST_REQUIRE_EQUAL(obj[size - 1], 2);
+    BOOST_REQUIRE_LE(memory::stats().released_memory(), after.released_memory());
+    free(obj);
+#endif
+    return make_ready_future<>();
+}
+
+// Estimates the number of objects a heap profile's samples stand for,
+// the way pprof does.
+static double estimated_live_objects(const memory::heap_profile& profile) {
+    double objects = 0;
+    for (auto& s : profile.sites) {
+        if (s.live_objects) {
+            double avg_size = double(s.live_bytes) / s.live_objects;
+            objects += s.live_objects / (1 - std::exp(-avg_size / profile.sample_period));
+        }
+    }
+    return objects;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_sampled_heap_profile) {
+    memory::set_heap_profiling_sample_period(64 * 1024);
+    if (!memory::heap_profiling_sample_period()) {
+        BOOST_TEST_MESSAGE("Seastar built without heap profiling, skipping");
+        return;
+    }
+    auto profile_before = memory::sample_heap_profile();
+    constexpr size_t nr_objects = 100000;
+    std::vector<std::unique_ptr<char[]>> objects;
+    objects.reserve(nr_objects);
+    for (size_t i = 0; i < nr_objects; ++i) {
+        objects.push_back(std::make_unique<char[]>(1000));
+    }
+    auto profile = memory::sample_heap_profile();
+    memory::set_heap_profiling_sample_period(0);
+
+    // Only about 1.5% of the objects are sampled, but their estimate
+    // should be close to the truth.
+    auto live = estimated_live_objects(profile) - estimated_live_objects(profile_before);
+    BOOST_TEST_MESSAGE("estimated " << live << " live objects");
+    BOOST_REQUIRE_GT(live, nr_objects * 0.8);
+    BOOST_REQUIRE_LT(live, nr_objects * 1.2);
+
+    objects.clear();
+    auto profile_after = memory::sample_heap_profile();
+    BOOST_REQUIRE_LT(estimated_live_objects(profile_after) - estimated_live_objects(profile_before), nr_objects * 0.1);
+    size_t total_before = 0, total_after = 0;
+    for (auto& s : profile.sites) {
+        total_before += s.total_objects;
+    }
+    for (auto& s : profile_after.sites) {
+        total_after += s.total_objects;
+    }
+    BOOST_REQUIRE_EQUAL(total_before, total_after);
+
+    std::ostringstream out;
+    memory::write_heap_profile(out, profile);
+    auto dump = out.str();
+    BOOST_REQUIRE_EQUAL(dump.find("heap profile: "), 0);
+    BOOST_REQUIRE(dump.find("@ heap_v2/65536\n") != std::string::npos);
+    BOOST_REQUIRE(dump.find("\nMAPPED_LIBRARIES:\n") != std::string::npos);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_merged_heap_profile) {
+    smp::invoke_on_all([] {
+        memory::set_heap_profiling_sample_period(4096);
+    }).get();
+    if (!memory::heap_profiling_sample_period()) {
+        BOOST_TEST_MESSAGE("Seastar built without heap profiling, skipping");
+        return;
+    }
+    smp::invoke_on_all([] {
+        auto objects = std::vector<std::unique_ptr<char[]>>(1000);
+        for (auto& o : objects) {
+            o = std::make_unique<char[]>(1000);
+        }
+    }).get();
+    auto merged = memory::sample_heap_profile_on_all_shards().get0();
+    smp::invoke_on_all([] {
+        memory::set_heap_profiling_sample_period(0);
+    }).get();
+    BOOST_REQUIRE_EQUAL(merged.sample_period, 4096);
+    BOOST_REQUIRE(!merged.sites.empty());
+
+    // Merging a profile into itself doubles the samples at every site
+    auto doubled = merged;
+    doubled.merge(merged);
+    BOOST_REQUIRE_EQUAL(doubled.sites.size(), merged.sites.size());
+    for (size_t i = 0; i < merged.sites.size(); ++i) {
+        BOOST_REQUIRE_EQUAL(doubled.sites[i].total_objects, 2 * merged.sites[i].total_objects);
+        BOOST_REQUIRE_EQUAL(doubled.sites[i].live_bytes, 2 * merged.sites[i].live_bytes);
+    }
+}
@@ -0,0 +1,185 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/arena.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/sstring.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/future-util.hh>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <vector>
+
+using namespace seastar;
+
+SEASTAR_TEST_CASE(test_arena_allocate) {
+    arena a;
+    BOOST_REQUIRE_EQUAL(a.memory(), 0);
+    std::vector<char*> objs;
+    for (size_t size = 1; size < 2000; size += 7) {
+        auto p = static_cast<char*>(a.allocate(size));
+        BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(p) % alignof(std::max_align_t), 0);
+        std::memset(p, size & 0xff, size);
+        objs.push_back(p);
+    }
+    auto p = static_cast<char*>(a.allocate(3, 64));
+    BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(p) % 64, 0);
+    // Larger than a chunk
+    auto big = static_cast<char*>(a.allocate(1 << 20));
+    std::memset(big, 0xff, 1 << 20);
+    for (size_t i = 0, size = 1; size < 2000; ++i, size += 7) {
+        BOOST_REQUIRE_EQUAL(objs[i][0], char(size & 0xff));
+        BOOST_REQUIRE_EQUAL(objs[i][size - 1], char(size & 0xff));
+    }
+    BOOST_REQUIRE_GE(a.memory(), (1 << 20) + 250000);
+
+    a.reset();
+    BOOST_REQUIRE_EQUAL(a.memory(), 0);
+    // Usable again
+    std::memset(a.allocate(100), 0, 100);
+    BOOST_REQUIRE_GT(a.memory(), 0);
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_arena_large_alignment) {
+    for (size_t align : {size_t(4096), size_t(16384), size_t(65536)}) {
+        arena a;
+        auto p = static_cast<char*>(a.allocate(3, align));
+        BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(p) % align, 0);
+        std::memset(p, 0, 3);
+        // Still usable after the fresh chunk
+        auto q = static_cast<char*>(a.allocate(100, align));
+        BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(q) % align, 0);
+        std::memset(q, 0, 100);
+        BOOST_REQUIRE_GE(a.memory(), align + 3);
+    }
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_arena_huge_size) {
+    arena a;
+    std::memset(a.allocate(10), 0, 10);
+    BOOST_REQUIRE_THROW(a.allocate(std::numeric_limits<size_t>::max()), std::bad_alloc);
+    BOOST_REQUIRE_THROW(a.allocate(size_t(1) << 62, 64), std::bad_alloc);
+    // A failed allocation leaves the arena usable
+    std::memset(a.allocate(10), 0, 10);
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_arena_allocator) {
+    arena a;
+    {
+        std::vector<int, arena_allocator<int>> v{arena_allocator<int>(a)};
+        for (int i = 0; i < 10000; ++i) {
+            v.push_back(i);
+        }
+        using map_allocator = arena_allocator<std::pair<const int, int>>;
+        std::map<int, int, std::less<int>, map_allocator> m{map_allocator(a)};
+        for (int i = 0; i < 1000; ++i) {
+            m.emplace(i, v[i * 10]);
+        }
+        BOOST_REQUIRE_EQUAL(m[999], 9990);
+        m.erase(m.begin());
+    }
+    BOOST_REQUIRE_GE(a.memory(), 10000 * sizeof(int));
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_current_arena) {
+    arena a;
+    BOOST_REQUIRE(!current_arena());
+    {
+        arena::scope s(a);
+        BOOST_REQUIRE_EQUAL(current_arena(), &a);
+        {
+            arena inner;
+            arena::scope s2(inner);
+            BOOST_REQUIRE_EQUAL(current_arena(), &inner);
+        }
+        BOOST_REQUIRE_EQUAL(current_arena(), &a);
+        // Other allocations are not affected
+        auto str = std::make_unique<sstring>(1000, 'x');
+        BOOST_REQUIRE_EQUAL(a.memory(), 0);
+    }
+    BOOST_REQUIRE(!current_arena());
+    return make_ready_future<>();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_lw_shared_ptr_and_continuations_in_arena) {
+    arena a;
+    std::vector<lw_shared_ptr<sstring>> ptrs;
+    future<int> f = make_ready_future<int>(0);
+    promise<> p;
+    {
+        arena::scope s(a, true);
+        for (int i = 0; i < 100; ++i) {
+            ptrs.push_back(make_lw_shared<sstring>(to_sstring(i)));
+        }
+        f = p.get_future().then([ptr = ptrs[42]] {
+            return std::stoi(std::string(ptr->begin(), ptr->end()));
+        });
+    }
+    BOOST_REQUIRE_GT(a.memory(), 0);
+    auto memory = a.memory();
+    // Objects in the arena can be destroyed one by one, which doesn't
+    // free their memory
+    ptrs.resize(50);
+    p.set_value();
+    BOOST_REQUIRE_EQUAL(f.get0(), 42);
+    BOOST_REQUIRE_EQUAL(*ptrs[10], "10");
+    ptrs.clear();
+    BOOST_REQUIRE_EQUAL(a.memory(), memory);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_continuations_not_in_arena_by_default) {
+    arena a;
+    promise<> p;
+    future<> f = make_ready_future<>();
+    {
+        arena::scope s(a);
+        f = p.get_future().then([] {});
+    }
+    BOOST_REQUIRE_EQUAL(a.memory(), 0);
+    // The continuation may outlive the arena
+    a.reset();
+    p.set_value();
+    f.get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_arena_scope_in_thread) {
+    arena a;
+    bool ran = false;
+    auto other = later().then([&ran] {
+        ran = true;
+        BOOST_REQUIRE(!current_arena());
+    });
+    arena::scope s(a);
+    // Tasks that run while the thread waits don't allocate in the arena
+    later().get();
+    BOOST_REQUIRE(ran);
+    BOOST_REQUIRE_EQUAL(current_arena(), &a);
+    other.get();
+    BOOST_REQUIRE_EQUAL(current_arena(), &a);
+}
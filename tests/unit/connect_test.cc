@@ -1,6 +1,8 @@
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/test_runner.hh>
+#include <seastar/testing/thread_test_case.hh>
 #include <seastar/net/ip.hh>
+#include <seastar/core/reactor.hh>
 
 using namespace seastar;
 using namespace net;
@@ -71,3 +73,53 @@ SEASTAR_TEST_CASE(test_accept_after_abort) {
         });
     });
 }
+
+SEASTAR_THREAD_TEST_CASE(test_move_connection_to_another_shard) {
+    std::default_random_engine& rnd = testing::local_random_engine;
+    auto distr = std::uniform_int_distribution<uint16_t>(12000, 65000);
+    auto sa = make_ipv4_address({"127.0.0.1", distr(rnd)});
+    auto listener = engine().net().listen(sa, listen_options());
+    auto accepted = listener.accept();
+    auto client = engine().net().connect(sa).get0();
+    connected_socket server;
+    std::tie(server, std::ignore) = accepted.get();
+
+    // The new shard answers each request with its id
+    auto target = (engine().cpu_id() + 1) % smp::count;
+    auto served = std::move(server).move_to(target, [] (connected_socket s) {
+        return do_with(std::move(s), [] (connected_socket& s) {
+            return do_with(s.input(), s.output(), [] (input_stream<char>& in, output_stream<char>& out) {
+                return in.read_exactly(4).then([&out] (temporary_buffer<char> buf) {
+                    BOOST_REQUIRE_EQUAL(sstring(buf.get(), buf.size()), "ping");
+                    return out.write(to_sstring(engine().cpu_id()));
+                }).then([&out] {
+                    return out.close();
+                });
+            });
+        });
+    });
+
+    auto in = client.input();
+    auto out = client.output();
+    out.write("ping").get();
+    out.flush().get();
+    sstring reply;
+    while (auto buf = in.read().get0()) {
+        reply += sstring(buf.get(), buf.size());
+    }
+    served.get();
+    BOOST_REQUIRE_EQUAL(reply, to_sstring(target));
+    out.close().get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_shard_load) {
+    // Loads are published when a shard finishes running tasks
+    later().get();
+    for (unsigned i = 0; i < smp::count; ++i) {
+        auto l = smp::load(i);
+        BOOST_REQUIRE_GE(l.busy, 0);
+        BOOST_REQUIRE_LE(l.busy, 1);
+    }
+    BOOST_REQUIRE_LT(smp::least_loaded_shard(), smp::count);
+    BOOST_REQUIRE_LT(smp::less_loaded_of_two_shards(), smp::count);
+}
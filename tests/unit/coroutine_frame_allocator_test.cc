@@ -0,0 +1,72 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/included/unit_test.hpp>
+#include <seastar/core/internal/coroutine_frame_allocator.hh>
+#include <cstring>
+#include <vector>
+
+using namespace seastar;
+using internal::coroutine_frame_allocator;
+
+BOOST_AUTO_TEST_CASE(test_frames_are_reused_within_a_size_class) {
+    coroutine_frame_allocator a;
+    auto p = a.allocate(100);
+    std::memset(p, 0, 100);
+    a.deallocate(p, 100);
+    BOOST_REQUIRE_EQUAL(a.cached(100), 1u);
+    // Rounded up to the same class
+    auto q = a.allocate(128);
+    BOOST_REQUIRE_EQUAL(p, q);
+    std::memset(q, 0, 128);
+    BOOST_REQUIRE_EQUAL(a.cached(100), 0u);
+    a.deallocate(q, 128);
+    // A different class doesn't reuse it
+    auto r = a.allocate(200);
+    BOOST_REQUIRE_NE(r, q);
+    a.deallocate(r, 200);
+    BOOST_REQUIRE_EQUAL(a.cached(100), 1u);
+    BOOST_REQUIRE_EQUAL(a.cached(200), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(test_free_lists_are_bounded) {
+    coroutine_frame_allocator a;
+    std::vector<void*> frames;
+    for (unsigned i = 0; i != coroutine_frame_allocator::max_cached_per_class + 10; ++i) {
+        frames.push_back(a.allocate(64));
+    }
+    for (auto p : frames) {
+        a.deallocate(p, 64);
+    }
+    BOOST_REQUIRE_EQUAL(a.cached(64), coroutine_frame_allocator::max_cached_per_class);
+}
+
+BOOST_AUTO_TEST_CASE(test_large_frames_are_not_cached) {
+    coroutine_frame_allocator a;
+    auto size = coroutine_frame_allocator::max_cached_size + 1;
+    auto p = a.allocate(size);
+    std::memset(p, 0, size);
+    a.deallocate(p, size);
+    BOOST_REQUIRE_EQUAL(a.cached(size), 0u);
+}
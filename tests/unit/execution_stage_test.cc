@@ -320,6 +320,46 @@ SEASTAR_THREAD_TEST_CASE(test_inheriting_concrete_execution_stage) {
     th2.join().get();
 }
 
+SEASTAR_THREAD_TEST_CASE(test_make_inheriting_execution_stage) {
+    auto sg = seastar::create_scheduling_group("sg", 100).get0();
+    auto ksg = seastar::defer([&] { seastar::destroy_scheduling_group(sg).get(); });
+    auto es = seastar::make_inheriting_execution_stage("stage", [] (int x) {
+        return std::make_pair(x, seastar::current_scheduling_group());
+    });
+    auto r = seastar::with_scheduling_group(sg, [&] {
+        return es(1);
+    }).get0();
+    BOOST_REQUIRE_EQUAL(r.first, 1);
+    BOOST_REQUIRE(r.second == sg);
+    BOOST_REQUIRE(es(2).get0().second == seastar::default_scheduling_group());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_execution_stage_latency_budget) {
+    auto stage = seastar::make_execution_stage("test", [] (int x) { return x; });
+    stage.set_latency_budget(0ns);
+    BOOST_REQUIRE_EQUAL(stage.batch_size(), 1u);
+
+    // Until a call was timed, calls are left for the poller to flush
+    stage.set_latency_budget(1ms);
+    BOOST_REQUIRE_EQUAL(stage.batch_size(), seastar::execution_stage::max_batch_size);
+    std::vector<future<int>> fs;
+    for (int i = 0; i < 10; ++i) {
+        fs.push_back(stage(i));
+    }
+    BOOST_REQUIRE_EQUAL(stage.get_stats().tasks_scheduled, 0u);
+    for (int i = 0; i < 10; ++i) {
+        BOOST_REQUIRE_EQUAL(fs[i].get0(), i);
+    }
+    BOOST_REQUIRE_EQUAL(stage.get_stats().tasks_scheduled, 1u);
+
+    // No call fits in a tiny budget, so each is flushed right away
+    stage.set_latency_budget(1ns);
+    BOOST_REQUIRE_EQUAL(stage.batch_size(), 1u);
+    auto f = stage(10);
+    BOOST_REQUIRE_EQUAL(stage.get_stats().tasks_scheduled, 2u);
+    BOOST_REQUIRE_EQUAL(f.get0(), 10);
+}
+
 struct a_struct {};
 
 SEASTAR_THREAD_TEST_CASE(test_inheriting_concrete_execution_stage_reference_parameters) {
@@ -28,7 +28,9 @@
 #include <seastar/core/reactor.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/stall_sampler.hh>
+#include <seastar/core/print.hh>
 #include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/irange.hpp>
 #include <iostream>
 
 #include "core/file-impl.hh"
@@ -449,3 +451,23 @@ SEASTAR_THREAD_TEST_CASE(test_recursive_touch_directory_permissions) {
 
     umask(orig_umask);
 }
+
+SEASTAR_THREAD_TEST_CASE(test_concurrent_syscalls_from_all_shards) {
+    // More calls than fit in a shard's queue, from all the shards at once,
+    // all served by the shared syscall threads.
+    smp::invoke_on_all([] {
+        return parallel_for_each(boost::irange(0, 300), [] (int i) {
+            auto filename = seastar::format("testfile-{}-{}.tmp", engine().cpu_id(), i);
+            return open_file_dma(filename, open_flags::rw | open_flags::create).then([filename] (file f) {
+                return f.flush().then([f] () mutable {
+                    return f.close().finally([f] {});
+                }).then([filename] {
+                    return file_stat(filename);
+                }).then([filename] (stat_data sd) {
+                    BOOST_REQUIRE_EQUAL(sd.size, 0u);
+                    return remove_file(filename);
+                });
+            });
+        });
+    }).get();
+}
@@ -22,9 +22,12 @@
 #include <seastar/testing/test_case.hh>
 
 #include <seastar/core/distributed.hh>
+#include <seastar/core/foreign_buffer.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/sleep.hh>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 
 using namespace seastar;
@@ -109,3 +112,82 @@ SEASTAR_TEST_CASE(foreign_ptr_cpu_test) {
         return seastar::sleep(100ms);
     });
 }
+
+static std::atomic<unsigned> foreign_buffers_freed;
+static std::atomic<unsigned> foreign_buffers_freed_elsewhere;
+
+static temporary_buffer<char> make_owned_buffer(size_t size) {
+    temporary_buffer<char> buf(size);
+    auto owner = engine().cpu_id();
+    return temporary_buffer<char>(buf.get_write(), buf.size(), make_deleter(buf.release(), [owner] {
+        if (engine().cpu_id() != owner) {
+            ++foreign_buffers_freed_elsewhere;
+        }
+        ++foreign_buffers_freed;
+    }));
+}
+
+static future<> wait_for_foreign_buffers_freed(unsigned n) {
+    return do_until([n] { return foreign_buffers_freed == n; }, [] {
+        using namespace std::chrono_literals;
+        return seastar::sleep(1ms);
+    });
+}
+
+SEASTAR_TEST_CASE(foreign_buffer_local_test) {
+    foreign_buffers_freed = 0;
+    auto fb = make_foreign_buffer(make_owned_buffer(10));
+    auto p = fb.get();
+    auto buf = fb.release();
+    BOOST_REQUIRE(!fb);
+    BOOST_REQUIRE_EQUAL(buf.get(), p);
+    BOOST_REQUIRE_EQUAL(buf.size(), 10u);
+    buf = {};
+    BOOST_REQUIRE_EQUAL(foreign_buffers_freed, 1u);
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(foreign_buffer_cross_shard_test) {
+    if (smp::count == 1) {
+        std::cerr << "Skipping multi-cpu foreign_buffer tests. Run with --smp=2 to test them.";
+        return make_ready_future<>();
+    }
+    foreign_buffers_freed = 0;
+    foreign_buffers_freed_elsewhere = 0;
+    return seastar::async([] {
+        constexpr unsigned nr = 1000;
+        auto bufs = smp::submit_to(1, [] {
+            std::vector<foreign_buffer<char>> ret;
+            for (unsigned i = 0; i < nr; ++i) {
+                auto buf = make_owned_buffer(100);
+                std::fill_n(buf.get_write(), buf.size(), char(i));
+                ret.push_back(make_foreign_buffer(std::move(buf)));
+            }
+            return make_foreign(std::make_unique<std::vector<foreign_buffer<char>>>(std::move(ret)));
+        }).get0();
+
+        std::vector<temporary_buffer<char>> shared;
+        for (unsigned i = 0; i < nr; ++i) {
+            auto& fb = (*bufs)[i];
+            BOOST_REQUIRE_EQUAL(fb.get_owner_shard(), 1u);
+            auto p = fb.get();
+            if (i % 2) {
+                // Consumed in place, without copying
+                auto buf = fb.release();
+                BOOST_REQUIRE_EQUAL(buf.get(), p);
+                BOOST_REQUIRE_EQUAL(buf.size(), 100u);
+                BOOST_REQUIRE(std::all_of(buf.begin(), buf.end(), [i] (char c) { return c == char(i); }));
+                shared.push_back(buf.share(10, 20));
+            } else {
+                // Dropped without being released
+                fb.reset();
+            }
+        }
+        // The shared parts keep their buffers alive
+        BOOST_REQUIRE_LE(foreign_buffers_freed, nr / 2);
+        shared.clear();
+        bufs.reset();
+        wait_for_foreign_buffers_freed(nr).get();
+        BOOST_REQUIRE_EQUAL(foreign_buffers_freed_elsewhere, 0u);
+    });
+}
@@ -0,0 +1,162 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB Ltd.
+ */
+
+#include <seastar/core/generator.hh>
+#include <seastar/core/future-util.hh>
+#include <seastar/testing/test_case.hh>
+#include <vector>
+
+using namespace seastar;
+
+namespace {
+
+generator<int> count_to(int n, int& produced) {
+    for (int i = 0; i != n; ++i) {
+        ++produced;
+        co_yield i;
+    }
+}
+
+generator<int> count_slowly_to(int n) {
+    for (int i = 0; i != n; ++i) {
+        co_await later();
+        co_yield i;
+    }
+}
+
+generator<int> count_and_fail(int n) {
+    for (int i = 0; i != n; ++i) {
+        co_yield i;
+    }
+    co_await later();
+    throw std::runtime_error("failed");
+}
+
+struct set_on_destruction {
+    bool& destroyed;
+    ~set_on_destruction() {
+        destroyed = true;
+    }
+};
+
+generator<int> wait_for(future<> f, bool& destroyed) {
+    set_on_destruction guard{destroyed};
+    co_yield 1;
+    co_await std::move(f);
+    co_yield 2;
+}
+
+generator<temporary_buffer<char>> chunks(int n) {
+    for (int i = 0; i != n; ++i) {
+        co_await later();
+        co_yield temporary_buffer<char>("chunk", 5);
+    }
+}
+
+future<std::vector<int>> consume(generator<int>& gen) {
+    std::vector<int> ret;
+    while (auto v = co_await gen.next()) {
+        ret.push_back(*v);
+    }
+    co_return ret;
+}
+
+std::vector<int> iota(int n) {
+    std::vector<int> ret;
+    for (int i = 0; i != n; ++i) {
+        ret.push_back(i);
+    }
+    return ret;
+}
+
+}
+
+SEASTAR_TEST_CASE(test_generator_yields_in_batches) {
+    int produced = 0;
+    auto gen = count_to(100, produced);
+    BOOST_REQUIRE_EQUAL(produced, 0);
+    gen.set_max_buffered(10);
+    BOOST_REQUIRE_EQUAL(*co_await gen.next(), 0);
+    BOOST_REQUIRE_EQUAL(produced, 10);
+    for (int i = 1; i != 10; ++i) {
+        BOOST_REQUIRE_EQUAL(*co_await gen.next(), i);
+    }
+    BOOST_REQUIRE_EQUAL(produced, 10);
+    BOOST_REQUIRE_EQUAL(*co_await gen.next(), 10);
+    BOOST_REQUIRE_EQUAL(produced, 20);
+    auto rest = co_await consume(gen);
+    BOOST_REQUIRE_EQUAL(rest.size(), 89u);
+    BOOST_REQUIRE(!co_await gen.next());
+}
+
+SEASTAR_TEST_CASE(test_generator_awaiting_futures) {
+    auto gen = count_slowly_to(50);
+    BOOST_REQUIRE(co_await consume(gen) == iota(50));
+}
+
+SEASTAR_TEST_CASE(test_generator_exception) {
+    auto gen = count_and_fail(3);
+    for (int i = 0; i != 3; ++i) {
+        BOOST_REQUIRE_EQUAL(*co_await gen.next(), i);
+    }
+    BOOST_REQUIRE_THROW(co_await gen.next(), std::runtime_error);
+}
+
+SEASTAR_TEST_CASE(test_generator_abandoned_while_awaiting) {
+    bool destroyed = false;
+    promise<> p;
+    {
+        auto gen = wait_for(p.get_future(), destroyed);
+        BOOST_REQUIRE_EQUAL(*co_await gen.next(), 1);
+        BOOST_REQUIRE(!gen.next().available());
+    }
+    BOOST_REQUIRE(!destroyed);
+    p.set_value();
+    co_await later();
+    BOOST_REQUIRE(destroyed);
+}
+
+SEASTAR_TEST_CASE(test_generator_abandoned_while_suspended) {
+    bool destroyed = false;
+    {
+        auto gen = wait_for(make_ready_future<>(), destroyed);
+        BOOST_REQUIRE_EQUAL(*co_await gen.next(), 1);
+    }
+    BOOST_REQUIRE(destroyed);
+}
+
+SEASTAR_TEST_CASE(test_generator_input_stream) {
+    auto in = make_generator_input_stream(chunks(10));
+    auto gen = make_generator(std::move(in));
+    size_t bytes = 0;
+    while (auto buf = co_await gen.next()) {
+        bytes += buf->size();
+    }
+    BOOST_REQUIRE_EQUAL(bytes, 50u);
+}
+
+SEASTAR_TEST_CASE(test_generator_pipe) {
+    seastar::pipe<int> p(4);
+    auto written = write_to(count_slowly_to(100), std::move(p.writer));
+    auto gen = make_generator(std::move(p.reader));
+    BOOST_REQUIRE(co_await consume(gen) == iota(100));
+    co_await std::move(written);
+}
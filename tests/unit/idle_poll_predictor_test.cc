@@ -0,0 +1,74 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/included/unit_test.hpp>
+#include <seastar/core/internal/idle_poll_predictor.hh>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+using internal::idle_poll_predictor;
+
+static void record_window(idle_poll_predictor& p, idle_poll_predictor::duration d) {
+    for (unsigned i = 0; i < idle_poll_predictor::window; ++i) {
+        p.record(d);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_starts_at_max_poll_time) {
+    idle_poll_predictor p(200us);
+    BOOST_REQUIRE(p.poll_time() == 200us);
+    for (unsigned i = 0; i < idle_poll_predictor::window - 1; ++i) {
+        p.record(1s);
+    }
+    BOOST_REQUIRE(p.poll_time() == 200us);
+}
+
+BOOST_AUTO_TEST_CASE(test_sleeps_at_once_when_mostly_idle) {
+    idle_poll_predictor p(200us);
+    record_window(p, 10ms);
+    BOOST_REQUIRE(p.poll_time() == 0us);
+    // Work arriving often again brings polling back
+    record_window(p, 20us);
+    BOOST_REQUIRE(p.poll_time() == 40us);
+}
+
+BOOST_AUTO_TEST_CASE(test_polls_past_most_periods) {
+    idle_poll_predictor p(200us);
+    for (unsigned i = 0; i < idle_poll_predictor::window; ++i) {
+        // A few outliers don't stretch the poll time
+        p.record(i < 2 ? 1s : i * 1us);
+    }
+    BOOST_REQUIRE(p.poll_time() >= 2 * 28us);
+    BOOST_REQUIRE(p.poll_time() <= 2 * 31us);
+}
+
+BOOST_AUTO_TEST_CASE(test_capped_by_max_poll_time) {
+    idle_poll_predictor p(200us);
+    record_window(p, 150us);
+    BOOST_REQUIRE(p.poll_time() == 200us);
+    p.set_max_poll_time(0us);
+    BOOST_REQUIRE(p.poll_time() == 0us);
+    record_window(p, 0us);
+    BOOST_REQUIRE(p.poll_time() == 0us);
+}
@@ -0,0 +1,81 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/included/unit_test.hpp>
+#include <seastar/core/internal/log_histogram.hh>
+
+using namespace seastar;
+using internal::log_histogram;
+
+BOOST_AUTO_TEST_CASE(test_buckets_cover_values) {
+    // Every value falls in a bucket whose bounds contain it, and buckets are
+    // contiguous and increasing.
+    uint64_t lower = 0;
+    for (unsigned b = 0; b < log_histogram::nr_buckets; ++b) {
+        auto upper = log_histogram::upper_bound(b);
+        BOOST_REQUIRE_GE(upper, lower);
+        BOOST_REQUIRE_EQUAL(log_histogram::bucket_of(lower), b);
+        BOOST_REQUIRE_EQUAL(log_histogram::bucket_of(upper), b);
+        lower = upper + 1;
+    }
+    BOOST_REQUIRE_EQUAL(lower, uint64_t(1) << log_histogram::max_exponent);
+    BOOST_REQUIRE_EQUAL(log_histogram::bucket_of(lower), log_histogram::nr_buckets);
+}
+
+BOOST_AUTO_TEST_CASE(test_relative_error_is_bounded) {
+    for (uint64_t v = 1; v < (uint64_t(1) << log_histogram::max_exponent); v = v * 3 / 2 + 1) {
+        auto upper = log_histogram::upper_bound(log_histogram::bucket_of(v));
+        BOOST_REQUIRE_LE(double(upper - v) / v, 0.125);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_export_is_cumulative) {
+    log_histogram h;
+    h.add(std::chrono::microseconds(1));
+    h.add(std::chrono::microseconds(100));
+    h.add(std::chrono::milliseconds(10));
+    h.add(std::chrono::seconds(100));
+    h.add(std::chrono::microseconds(-5)); // clamped to 0
+    auto mh = h.to_metrics_histogram();
+    BOOST_REQUIRE_EQUAL(mh.sample_count, 5);
+    BOOST_REQUIRE_EQUAL(mh.sample_sum, 1 + 100 + 10000 + 100000000);
+    BOOST_REQUIRE_EQUAL(mh.buckets.size(), log_histogram::nr_buckets);
+    auto count_le = [&] (double bound) {
+        uint64_t c = 0;
+        for (auto& b : mh.buckets) {
+            if (b.upper_bound <= bound) {
+                c = b.count;
+            }
+        }
+        return c;
+    };
+    // 100us is in [96, 103], 10ms in [9216, 10239]
+    BOOST_REQUIRE_EQUAL(count_le(1), 2);
+    BOOST_REQUIRE_EQUAL(count_le(95), 2);
+    BOOST_REQUIRE_EQUAL(count_le(103), 3);
+    BOOST_REQUIRE_EQUAL(count_le(9215), 3);
+    BOOST_REQUIRE_EQUAL(count_le(10239), 4);
+    // The 100s sample only shows in the count (the +Inf bucket)
+    BOOST_REQUIRE_EQUAL(mh.buckets.back().count, 4);
+}
@@ -30,6 +30,7 @@
 #include <seastar/testing/test_runner.hh>
 #include <seastar/core/thread.hh>
 #include <seastar/core/sleep.hh>
+#include <seastar/core/tracing.hh>
 #include <seastar/util/defer.hh>
 
 using namespace seastar;
@@ -168,7 +169,7 @@ SEASTAR_TEST_CASE(test_rpc_connect) {
     std::vector<future<>> fs;
 
     for (auto i = 0; i < 2; i++) {
-        for (auto j = 0; j < 4; j++) {
+        for (auto j = 0; j < 8; j++) {
             auto factory = std::make_unique<cfactory>();
             rpc::server_options so;
             rpc::client_options co;
@@ -179,6 +180,7 @@ SEASTAR_TEST_CASE(test_rpc_connect) {
                 co.compressor_factory = factory.get();
             }
             co.send_timeout_data = j & 2;
+            co.send_trace_context = j & 4;
             auto f = with_rpc_env({}, so, true, false, [co] (test_rpc_proto& proto, test_rpc_proto::server& s, make_socket_fn make_socket) {
                 return seastar::async([&proto, make_socket, co] {
                     test_rpc_proto::client c1(proto, co, make_socket(), ipv4_addr());
@@ -465,6 +467,57 @@ SEASTAR_TEST_CASE(test_rpc_scheduling) {
     });
 }
 
+SEASTAR_TEST_CASE(test_rpc_tracing) {
+    return with_rpc_env({}, {}, true, false, [] (test_rpc_proto& proto, test_rpc_proto::server& s, make_socket_fn make_socket) {
+        return seastar::async([&proto, make_socket] {
+            test_rpc_proto::client c1(proto, {}, make_socket(), ipv4_addr());
+            auto call = proto.register_handler(1, [] () {
+                return make_ready_future<uint64_t>(tracing::current_trace_context().trace_id);
+            });
+            // Not traced
+            BOOST_REQUIRE_EQUAL(call(c1).get0(), 0u);
+
+            tracing::set_sample_rate(1);
+            auto root = tracing::start_trace("rpc_test");
+            auto ctx = root.context();
+            BOOST_REQUIRE(ctx);
+            BOOST_REQUIRE_EQUAL(call(c1).get0(), ctx.trace_id);
+            root.end();
+            tracing::set_sample_rate(0);
+            c1.stop().get();
+        });
+    });
+}
+
+SEASTAR_THREAD_TEST_CASE(test_rpc_tracing_parent) {
+    for (bool send_timeout_data : {true, false}) {
+        rpc::client_options co;
+        co.send_timeout_data = send_timeout_data;
+        with_rpc_env({}, {}, true, false, [co] (test_rpc_proto& proto, test_rpc_proto::server& s, make_socket_fn make_socket) {
+            return seastar::async([&proto, make_socket, co] {
+                test_rpc_proto::client c1(proto, co, make_socket(), ipv4_addr());
+                auto call = proto.register_handler(1, [] () {
+                    return make_ready_future<uint64_t>(tracing::current_trace_context().trace_id);
+                });
+                tracing::set_sample_rate(1);
+                auto reset_rate = defer([] { tracing::set_sample_rate(0); });
+                tracing::collect_chrome_trace(true).get();
+                auto root = tracing::start_trace("rpc_test");
+                auto ctx = root.context();
+                BOOST_REQUIRE_EQUAL(call(c1).get0(), ctx.trace_id);
+                root.end();
+                auto trace = tracing::collect_chrome_trace(true).get0();
+                auto handler = trace.find("\"name\":\"rpc_handler\"");
+                BOOST_REQUIRE_NE(handler, sstring::npos);
+                auto record = trace.substr(handler, trace.find("}}", handler) - handler);
+                BOOST_REQUIRE_NE(record.find(format("\"trace_id\":\"{:016x}\"", ctx.trace_id)), sstring::npos);
+                BOOST_REQUIRE_NE(record.find(format("\"parent_id\":\"{:016x}\"", ctx.span_id)), sstring::npos);
+                c1.stop().get();
+            });
+        }).get();
+    }
+}
+
 SEASTAR_THREAD_TEST_CASE(test_rpc_scheduling_connection_based) {
     auto sg1 = create_scheduling_group("sg1", 100).get0();
     auto sg1_kill = defer([&] { destroy_scheduling_group(sg1).get(); });
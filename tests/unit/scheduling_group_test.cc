@@ -0,0 +1,358 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+#include <seastar/core/scheduling.hh>
+#include <seastar/core/memory.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/core/future-util.hh>
+#include <seastar/core/print.hh>
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/util/defer.hh>
+#include <boost/range/irange.hpp>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+using namespace seastar;
+using namespace std::chrono_literals;
+
+// Runs a CPU-bound thread in each of the groups for a while, and returns the
+// amount of work each of them got done.
+static std::vector<uint64_t> compete(const std::vector<scheduling_group>& groups, std::chrono::milliseconds duration) {
+    std::vector<uint64_t> counters(groups.size());
+    bool stop = false;
+    auto threads = parallel_for_each(boost::irange<size_t>(0, groups.size()), [&] (size_t i) {
+        auto attr = thread_attributes();
+        attr.sched_group = groups[i];
+        return async(attr, [&stop, &counter = counters[i]] {
+            while (!stop) {
+                auto end = std::chrono::steady_clock::now() + 50us;
+                while (std::chrono::steady_clock::now() < end) {
+                }
+                ++counter;
+                thread::yield();
+            }
+        });
+    });
+    sleep(duration).get();
+    stop = true;
+    threads.get();
+    return counters;
+}
+
+SEASTAR_THREAD_TEST_CASE(test_many_scheduling_groups) {
+    // Well beyond the former compile-time limit of 16
+    std::vector<scheduling_group> groups;
+    auto destroy = defer([&] {
+        for (auto sg : groups) {
+            destroy_scheduling_group(sg).get();
+        }
+    });
+    for (auto i : boost::irange(0, 100)) {
+        groups.push_back(create_scheduling_group(format("sg{}", i), 100).get0());
+    }
+    unsigned ran = 0;
+    parallel_for_each(groups, [&ran] (scheduling_group sg) {
+        return with_scheduling_group(sg, [&ran, sg] {
+            BOOST_REQUIRE(sg.active());
+            ++ran;
+        });
+    }).get();
+    BOOST_REQUIRE_EQUAL(ran, groups.size());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_scheduling_group_ids_are_reused) {
+    auto sg1 = create_scheduling_group("sg1", 100).get0();
+    auto id = internal::scheduling_group_index(sg1);
+    destroy_scheduling_group(sg1).get();
+    auto sg2 = create_scheduling_group("sg2", 100).get0();
+    BOOST_REQUIRE_EQUAL(internal::scheduling_group_index(sg2), id);
+    BOOST_REQUIRE_EQUAL(sg2.name(), "sg2");
+    destroy_scheduling_group(sg2).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(test_supergroups_isolate_their_members) {
+    auto tenant1 = create_scheduling_supergroup("tenant1", 100).get0();
+    auto tenant2 = create_scheduling_supergroup("tenant2", 100).get0();
+    BOOST_REQUIRE_EQUAL(tenant1.name(), "tenant1");
+    std::vector<scheduling_group> groups;
+    groups.push_back(create_scheduling_group("tenant1.query", 100, tenant1).get0());
+    for (auto i : boost::irange(0, 4)) {
+        groups.push_back(create_scheduling_group(format("tenant2.sg{}", i), 100, tenant2).get0());
+    }
+    auto destroy = defer([&] {
+        for (auto sg : groups) {
+            destroy_scheduling_group(sg).get();
+        }
+        destroy_scheduling_supergroup(tenant1).get();
+        destroy_scheduling_supergroup(tenant2).get();
+    });
+
+    auto work = compete(groups, 500ms);
+    auto tenant1_work = double(work[0]);
+    auto tenant2_work = double(work[1] + work[2] + work[3] + work[4]);
+    BOOST_TEST_MESSAGE(format("tenant1: {} tenant2: {}", tenant1_work, tenant2_work));
+    // Without the hierarchy, tenant2's four groups would get 4/5 of the CPU
+    BOOST_REQUIRE_GT(tenant1_work / tenant2_work, 0.66);
+    BOOST_REQUIRE_LT(tenant1_work / tenant2_work, 1.5);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_nested_supergroup_shares) {
+    auto outer = create_scheduling_supergroup("outer", 100).get0();
+    auto inner = create_scheduling_supergroup("inner", 200, outer).get0();
+    std::vector<scheduling_group> groups;
+    groups.push_back(create_scheduling_group("outer.sg", 100, outer).get0());
+    groups.push_back(create_scheduling_group("inner.sg1", 100, inner).get0());
+    groups.push_back(create_scheduling_group("inner.sg2", 100, inner).get0());
+    auto destroy = defer([&] {
+        for (auto sg : groups) {
+            destroy_scheduling_group(sg).get();
+        }
+        destroy_scheduling_supergroup(inner).get();
+        destroy_scheduling_supergroup(outer).get();
+    });
+
+    auto work = compete(groups, 500ms);
+    // inner has twice the shares of outer.sg, split evenly between its members
+    auto ratio = double(work[1] + work[2]) / work[0];
+    BOOST_TEST_MESSAGE(format("inner/outer.sg: {}", ratio));
+    BOOST_REQUIRE_GT(ratio, 1.5);
+    BOOST_REQUIRE_LT(ratio, 2.66);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_destroy_supergroup_with_members) {
+    auto tenant = create_scheduling_supergroup("tenant", 100).get0();
+    auto sg = create_scheduling_group("tenant.sg", 100, tenant).get0();
+    BOOST_REQUIRE_THROW(destroy_scheduling_supergroup(tenant).get(), std::runtime_error);
+    destroy_scheduling_group(sg).get();
+    destroy_scheduling_supergroup(tenant).get();
+    BOOST_REQUIRE_THROW(destroy_scheduling_supergroup(scheduling_supergroup()).get(), std::runtime_error);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_destroyed_supergroup_is_not_a_parent) {
+    auto tenant = create_scheduling_supergroup("tenant", 100).get0();
+    destroy_scheduling_supergroup(tenant).get();
+    BOOST_REQUIRE_THROW(create_scheduling_group("tenant.sg", 100, tenant).get(), std::runtime_error);
+    BOOST_REQUIRE_THROW(create_scheduling_supergroup("tenant.inner", 100, tenant).get(), std::runtime_error);
+    BOOST_REQUIRE_THROW(destroy_scheduling_supergroup(tenant).get(), std::runtime_error);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_with_deadline_keeps_earliest) {
+    auto now = deadline_clock::now();
+    BOOST_REQUIRE(current_deadline() == deadline_clock::time_point());
+    with_deadline(now + 1s, [&] {
+        BOOST_REQUIRE(current_deadline() == now + 1s);
+        with_deadline(now + 2s, [&] {
+            BOOST_REQUIRE(current_deadline() == now + 1s);
+        });
+        with_deadline(now + 500ms, [&] {
+            BOOST_REQUIRE(current_deadline() == now + 500ms);
+        });
+        BOOST_REQUIRE(current_deadline() == now + 1s);
+    }).get();
+    BOOST_REQUIRE(current_deadline() == deadline_clock::time_point());
+}
+
+SEASTAR_THREAD_TEST_CASE(test_deadline_ordering) {
+    auto sg = create_scheduling_group("edf", 100).get0();
+    auto destroy = defer([&] {
+        destroy_scheduling_group(sg).get();
+    });
+    sg.set_deadline_ordering(true);
+
+    // Queued from this thread, in another group, the tasks only run once
+    // the thread yields.
+    std::vector<int> order;
+    auto now = deadline_clock::now();
+    for (auto i : {3, 1, 2}) {
+        with_deadline(now + i * 1s, [&, i] {
+            schedule(make_task(sg, [&order, i] {
+                order.push_back(i);
+            }));
+        }).get();
+    }
+    schedule(make_task(sg, [&order] {
+        order.push_back(0);
+    }));
+    while (order.size() < 4) {
+        later().get();
+    }
+    order.erase(std::remove(order.begin(), order.end(), 0), order.end());
+    BOOST_REQUIRE(order == (std::vector<int>{1, 2, 3}));
+}
+
+SEASTAR_THREAD_TEST_CASE(test_expired_continuations_are_cancelled) {
+    auto sg = create_scheduling_group("edf", 100).get0();
+    auto destroy = defer([&] {
+        destroy_scheduling_group(sg).get();
+    });
+    sg.set_deadline_ordering(true);
+
+    promise<> p;
+    bool started = false;
+    bool ran = false;
+    bool finally_ran = false;
+    auto f = with_scheduling_group(sg, [&] {
+        started = true;
+        return with_deadline(deadline_clock::now() - 1ms, [&] {
+            return p.get_future().then([&] {
+                ran = true;
+            }).finally([&] {
+                finally_ran = true;
+            });
+        });
+    });
+    while (!started) {
+        later().get();
+    }
+    p.set_value();
+    BOOST_REQUIRE_THROW(f.get(), deadline_exceeded_error);
+    BOOST_REQUIRE(!ran);
+    BOOST_REQUIRE(finally_ran);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_no_deadline_is_not_cancelled) {
+    auto sg = create_scheduling_group("edf", 100).get0();
+    auto destroy = defer([&] {
+        destroy_scheduling_group(sg).get();
+    });
+    sg.set_deadline_ordering(true);
+
+    promise<> p;
+    bool ran = false;
+    future<> background = make_ready_future<>();
+    with_scheduling_group(sg, [&] {
+        auto deadline = deadline_clock::now() - 1ms;
+        return with_deadline(deadline, [&] {
+            {
+                no_deadline nd;
+                BOOST_REQUIRE(current_deadline() == deadline_clock::time_point());
+                background = p.get_future().then([&] {
+                    ran = true;
+                });
+            }
+            BOOST_REQUIRE(current_deadline() == deadline);
+        });
+    }).get();
+    p.set_value();
+    background.get();
+    BOOST_REQUIRE(ran);
+}
+
+SEASTAR_THREAD_TEST_CASE(test_scheduling_group_memory_limits) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    auto sg = create_scheduling_group("limited", 100).get0();
+    auto destroy = defer([&] {
+        destroy_scheduling_group(sg).get();
+    });
+    std::vector<bool> pressure;
+    sg.set_memory_pressure_handler([&] (bool under_pressure) {
+        pressure.push_back(under_pressure);
+    });
+    sg.set_memory_limits(8 << 20, 16 << 20);
+
+    auto usage = sg.memory_usage();
+    auto buf = with_scheduling_group(sg, [] {
+        return std::make_unique<char[]>(4 << 20);
+    }).get0();
+    BOOST_REQUIRE_GE(sg.memory_usage(), usage + (4 << 20));
+    BOOST_REQUIRE(pressure.empty());
+
+    // Over the soft limit
+    auto buf2 = with_scheduling_group(sg, [] {
+        return std::make_unique<char[]>(6 << 20);
+    }).get0();
+    sleep(1ms).get();
+    BOOST_REQUIRE(pressure == std::vector<bool>({true}));
+
+    // Over the hard limit
+    BOOST_REQUIRE_THROW(with_scheduling_group(sg, [] {
+        return std::make_unique<char[]>(8 << 20);
+    }).get(), std::bad_alloc);
+    // Other groups are not limited
+    auto buf3 = std::make_unique<char[]>(8 << 20);
+
+    // Memory is credited to the group that allocated it, wherever it's freed
+    buf2.reset();
+    BOOST_REQUIRE_LT(sg.memory_usage(), 8 << 20);
+    sleep(1ms).get();
+    BOOST_REQUIRE(pressure == std::vector<bool>({true, false}));
+#endif
+}
+
+SEASTAR_THREAD_TEST_CASE(test_reused_group_starts_without_memory) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    auto sg1 = create_scheduling_group("sg1", 100).get0();
+    auto id = internal::scheduling_group_index(sg1);
+    auto buf = with_scheduling_group(sg1, [] {
+        return std::make_unique<char[]>(8 << 20);
+    }).get0();
+    BOOST_REQUIRE_GE(sg1.memory_usage(), 8 << 20);
+    auto default_usage = default_scheduling_group().memory_usage();
+    destroy_scheduling_group(sg1).get();
+    // Charged to the default group instead
+    BOOST_REQUIRE_GE(default_scheduling_group().memory_usage(), default_usage + (8 << 20));
+
+    auto sg2 = create_scheduling_group("sg2", 100).get0();
+    auto destroy = defer([&] {
+        destroy_scheduling_group(sg2).get();
+    });
+    BOOST_REQUIRE_EQUAL(internal::scheduling_group_index(sg2), id);
+    BOOST_REQUIRE_LT(sg2.memory_usage(), 1 << 20);
+    sg2.set_memory_limits(2 << 20, 4 << 20);
+    auto buf2 = with_scheduling_group(sg2, [] {
+        return std::make_unique<char[]>(1 << 20);
+    }).get0();
+    // Freeing the old group's memory credits the default group
+    buf.reset();
+    BOOST_REQUIRE_GE(sg2.memory_usage(), 1 << 20);
+    BOOST_REQUIRE_LT(sg2.memory_usage(), 2 << 20);
+    BOOST_REQUIRE_LT(default_scheduling_group().memory_usage(), default_usage + (8 << 20));
+#endif
+}
+
+// Enabling abort on allocation failure can't be undone, so this test
+// comes last.
+SEASTAR_THREAD_TEST_CASE(test_hard_limit_does_not_abort) {
+#ifndef SEASTAR_DEFAULT_ALLOCATOR
+    memory::enable_abort_on_allocation_failure();
+    auto sg = create_scheduling_group("limited", 100).get0();
+    auto destroy = defer([&] {
+        destroy_scheduling_group(sg).get();
+    });
+    sg.set_memory_limits(1 << 20, 2 << 20);
+    BOOST_REQUIRE_THROW(with_scheduling_group(sg, [] {
+        return std::make_unique<char[]>(4 << 20);
+    }).get(), std::bad_alloc);
+    // Small objects, from the group's pools
+    BOOST_REQUIRE_THROW(with_scheduling_group(sg, [] {
+        std::vector<std::unique_ptr<char[]>> objs;
+        while (true) {
+            objs.push_back(std::make_unique<char[]>(1000));
+        }
+    }).get(), std::bad_alloc);
+    BOOST_REQUIRE_GE(memory::scheduling_group_memory_limit_failures(internal::scheduling_group_index(sg)), 2u);
+#endif
+}
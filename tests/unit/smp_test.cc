@@ -22,6 +22,9 @@
 #include <seastar/core/reactor.hh>
 #include <seastar/core/app-template.hh>
 #include <seastar/core/print.hh>
+#include <algorithm>
+#include <atomic>
+#include <vector>
 
 using namespace seastar;
 
@@ -57,6 +60,47 @@ future<bool> test_smp_exception() {
     });
 }
 
+future<bool> test_broadcast() {
+    auto hits = make_lw_shared<std::vector<std::atomic<unsigned>>>(smp::count);
+    std::atomic<unsigned>* p = hits->data();
+    return smp::broadcast([p] {
+        return later().then([p] {
+            p[engine().cpu_id()]++;
+        });
+    }).then([hits] {
+        return std::all_of(hits->begin(), hits->end(), [] (const std::atomic<unsigned>& h) {
+            return h.load() == 1;
+        });
+    });
+}
+
+future<bool> test_broadcast_map_reduce(unsigned caller) {
+    return smp::submit_to(caller, [] {
+        return smp::broadcast_map_reduce([] {
+            return make_ready_future<unsigned>(engine().cpu_id() + 1);
+        }, 0u, std::plus<unsigned>());
+    }).then([] (unsigned sum) {
+        return sum == smp::count * (smp::count + 1) / 2;
+    });
+}
+
+future<bool> test_broadcast_exception() {
+    return smp::broadcast([] {
+        if (engine().cpu_id() == smp::count - 1) {
+            throw nasty_exception();
+        }
+    }).then_wrapped([] (future<> f) {
+        try {
+            f.get();
+            return false;
+        } catch (nasty_exception&) {
+            return true;
+        } catch (...) {
+            return false;
+        }
+    });
+}
+
 int tests, fails;
 
 future<>
@@ -72,6 +116,14 @@ int main(int ac, char** av) {
     return app_template().run_deprecated(ac, av, [] {
        return report("smp call", test_smp_call()).then([] {
            return report("smp exception", test_smp_exception());
+       }).then([] {
+           return report("smp broadcast", test_broadcast());
+       }).then([] {
+           return report("smp broadcast map-reduce", test_broadcast_map_reduce(0));
+       }).then([] {
+           return report("smp broadcast map-reduce from another shard", test_broadcast_map_reduce(smp::count - 1));
+       }).then([] {
+           return report("smp broadcast exception", test_broadcast_exception());
        }).then([] {
            fmt::print("\n{:d} tests / {:d} failures\n", tests, fails);
            engine().exit(fails ? 1 : 0);
@@ -22,8 +22,11 @@
 #include <seastar/core/reactor.hh>
 #include <seastar/testing/test_case.hh>
 #include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/future-util.hh>
 #include <atomic>
 #include <chrono>
+#include <sstream>
 
 using namespace seastar;
 using namespace std::chrono_literals;
@@ -84,3 +87,53 @@ SEASTAR_THREAD_TEST_CASE(simple_stalls) {
 }
 
 
+
+SEASTAR_THREAD_TEST_CASE(cpu_profiler_samples) {
+    std::atomic<unsigned> reports{};
+    temporary_stall_detector_settings tsds(10ms, [&] { ++reports; });
+    auto sg = create_scheduling_group("profiled", 100).get0();
+    engine().set_cpu_profiler_period(1ms);
+    with_scheduling_group(sg, [] {
+        return seastar::async([] {
+            spin_some_cooperatively(300ms);
+        });
+    }).get();
+    engine().set_cpu_profiler_period(0us);
+
+    // Sharing the stall detector's signal must not trigger stall reports
+    BOOST_REQUIRE_EQUAL(reports, 0);
+
+    auto profile = collect_cpu_profile(true).get0();
+    std::istringstream is(profile);
+    std::string stack;
+    uint64_t count, total = 0, in_group = 0;
+    while (is >> stack >> count) {
+        total += count;
+        if (stack.compare(0, 9, "profiled;") == 0) {
+            in_group += count;
+        }
+    }
+    BOOST_REQUIRE_GE(total, 20u);
+    BOOST_REQUIRE_GE(in_group, total / 2);
+    BOOST_REQUIRE(collect_cpu_profile().get0().empty());
+    destroy_scheduling_group(sg).get();
+}
+
+SEASTAR_THREAD_TEST_CASE(cpu_profile_of_destroyed_group) {
+    auto sg = create_scheduling_group("destroyed", 100).get0();
+    engine().set_cpu_profiler_period(1ms);
+    with_scheduling_group(sg, [] {
+        return seastar::async([] {
+            spin_some_cooperatively(100ms);
+        });
+    }).get();
+    engine().set_cpu_profiler_period(0us);
+    destroy_scheduling_group(sg).get();
+    // Its id may be reused, but the samples keep the group's name
+    auto reused = create_scheduling_group("reused", 100).get0();
+
+    auto profile = collect_cpu_profile(true).get0();
+    BOOST_REQUIRE_NE(profile.find("destroyed;"), sstring::npos);
+    BOOST_REQUIRE_EQUAL(profile.find("reused;"), sstring::npos);
+    destroy_scheduling_group(reused).get();
+}
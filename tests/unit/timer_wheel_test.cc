@@ -0,0 +1,166 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+
+#define BOOST_TEST_MODULE core
+
+#include <boost/test/included/unit_test.hpp>
+#include <seastar/core/timer-wheel.hh>
+#include <chrono>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace seastar;
+
+struct test_timer {
+    using clock = std::chrono::steady_clock;
+    using time_point = clock::time_point;
+    using duration = clock::duration;
+
+    time_point expiry;
+    bool armed = false;
+    boost::intrusive::list_member_hook<> link;
+
+    time_point get_timeout() const {
+        return expiry;
+    }
+    bool cancel() {
+        return false;
+    }
+};
+
+using wheel = timer_wheel<test_timer, &test_timer::link>;
+
+static test_timer::time_point at(int64_t ticks) {
+    return test_timer::time_point(test_timer::duration(ticks));
+}
+
+static int64_t ticks(test_timer::time_point tp) {
+    return tp.time_since_epoch().count();
+}
+
+BOOST_AUTO_TEST_CASE(test_expire_and_next_timeout) {
+    wheel w;
+    std::vector<test_timer> timers(4);
+    timers[0].expiry = at(5);
+    timers[1].expiry = at(100);
+    timers[2].expiry = at(64 * 64 + 3);
+    timers[3].expiry = at(1); // expires on the first call
+
+    BOOST_REQUIRE(w.insert(timers[0]));
+    BOOST_REQUIRE(!w.insert(timers[1]));
+    BOOST_REQUIRE(!w.insert(timers[2]));
+    BOOST_REQUIRE(w.insert(timers[3]));
+    BOOST_REQUIRE_EQUAL(w.size(), 4u);
+    BOOST_REQUIRE_EQUAL(ticks(w.get_next_timeout()), 1);
+
+    auto exp = w.expire(at(4));
+    BOOST_REQUIRE_EQUAL(exp.size(), 1u);
+    BOOST_REQUIRE_EQUAL(&exp.front(), &timers[3]);
+    exp.clear();
+    BOOST_REQUIRE_EQUAL(ticks(w.get_next_timeout()), 5);
+
+    exp = w.expire(at(100));
+    BOOST_REQUIRE_EQUAL(exp.size(), 2u);
+    exp.clear();
+    BOOST_REQUIRE_EQUAL(ticks(w.get_next_timeout()), 64 * 64 + 3);
+
+    w.remove(timers[2]);
+    BOOST_REQUIRE(w.empty());
+    BOOST_REQUIRE_EQUAL(w.size(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_insert_in_the_past) {
+    wheel w;
+    test_timer t;
+    w.expire(at(1000)).clear();
+    t.expiry = at(10);
+    BOOST_REQUIRE(w.insert(t));
+    BOOST_REQUIRE_EQUAL(ticks(w.get_next_timeout()), 1000);
+    auto exp = w.expire(at(1000));
+    BOOST_REQUIRE_EQUAL(exp.size(), 1u);
+    exp.clear();
+    BOOST_REQUIRE(w.empty());
+}
+
+// Cross-checks against a sorted set of timeouts, with timeouts spread over
+// many levels, random cancellations and clock jumps of varying size.
+BOOST_AUTO_TEST_CASE(test_random_against_reference) {
+    std::default_random_engine eng(42);
+    std::uniform_int_distribution<int> op(0, 9);
+    std::uniform_int_distribution<int> shift(0, 40);
+    std::vector<test_timer> timers(1000);
+    std::set<std::pair<int64_t, test_timer*>> ref;
+    wheel w;
+    int64_t now = 0;
+
+    for (int i = 0; i < 200000; ++i) {
+        auto& t = timers[eng() % timers.size()];
+        switch (op(eng)) {
+        case 0: case 1: case 2: case 3: case 4: {
+            if (t.armed) {
+                w.remove(t);
+                ref.erase({ticks(t.expiry), &t});
+            }
+            t.expiry = at(now + int64_t(eng() % (uint64_t(1) << shift(eng))));
+            t.armed = true;
+            auto earliest = ref.empty() || ticks(t.expiry) < ref.begin()->first;
+            auto next = ticks(w.get_next_timeout());
+            ref.emplace(ticks(t.expiry), &t);
+            auto became_first = w.insert(t);
+            if (became_first) {
+                BOOST_REQUIRE(earliest);
+            } else {
+                BOOST_REQUIRE_LE(next, ticks(t.expiry));
+            }
+            break;
+        }
+        case 5: case 6:
+            if (t.armed) {
+                w.remove(t);
+                ref.erase({ticks(t.expiry), &t});
+                t.armed = false;
+            }
+            break;
+        default: {
+            now += int64_t(eng() % (uint64_t(1) << shift(eng)));
+            auto exp = w.expire(at(now));
+            while (!exp.empty()) {
+                auto& e = exp.front();
+                exp.pop_front();
+                BOOST_REQUIRE_LE(ticks(e.expiry), now);
+                BOOST_REQUIRE(ref.erase({ticks(e.expiry), &e}));
+                e.armed = false;
+            }
+            BOOST_REQUIRE(ref.empty() || ref.begin()->first > now);
+            break;
+        }
+        }
+        BOOST_REQUIRE_EQUAL(w.size(), ref.size());
+        BOOST_REQUIRE_EQUAL(w.empty(), ref.empty());
+        if (!ref.empty()) {
+            // The wheel never reports a deadline later than the earliest timer
+            BOOST_REQUIRE_LE(ticks(w.get_next_timeout()), std::max(now, ref.begin()->first));
+        }
+    }
+    w.clear();
+}
@@ -0,0 +1,127 @@
+/*
+ * This file is open source software, licensed to you under the terms
+ * of the Apache License, Version 2.0 (the "License").  See the NOTICE file
+ * distributed with this work for additional information regarding copyright
+ * ownership.  You may not use this file except in compliance with the License.
+ *
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+/*
+ * Copyright (C) 2019 ScyllaDB
+ */
+
+#include <seastar/testing/test_case.hh>
+#include <seastar/testing/thread_test_case.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/thread.hh>
+#include <seastar/core/tracing.hh>
+#include <seastar/core/future-util.hh>
+#include <seastar/core/print.hh>
+#include <seastar/util/defer.hh>
+
+using namespace seastar;
+
+SEASTAR_TEST_CASE(test_unsampled) {
+    auto root = tracing::start_trace("unsampled");
+    BOOST_REQUIRE(!root.active());
+    BOOST_REQUIRE(!tracing::current_trace_context());
+    tracing::span child("child");
+    BOOST_REQUIRE(!child.active());
+    return make_ready_future<>();
+}
+
+SEASTAR_TEST_CASE(test_continuations_inherit_span) {
+    tracing::set_sample_rate(1);
+    auto root = tracing::start_trace("root");
+    BOOST_REQUIRE(root.active());
+    auto ctx = root.context();
+    BOOST_REQUIRE(ctx);
+    BOOST_REQUIRE_EQUAL(tracing::current_trace_context().span_id, ctx.span_id);
+    return later().then([ctx] {
+        BOOST_REQUIRE_EQUAL(tracing::current_trace_context().span_id, ctx.span_id);
+        tracing::span child("child");
+        auto cctx = child.context();
+        BOOST_REQUIRE_EQUAL(cctx.trace_id, ctx.trace_id);
+        BOOST_REQUIRE_NE(cctx.span_id, ctx.span_id);
+        return later().then([cctx] {
+            BOOST_REQUIRE_EQUAL(tracing::current_trace_context().span_id, cctx.span_id);
+        }).finally([child = std::move(child)] {});
+    }).then([ctx] {
+        // Created while the root span was current
+        BOOST_REQUIRE_EQUAL(tracing::current_trace_context().span_id, ctx.span_id);
+    }).finally([root = std::move(root)] {
+        tracing::set_sample_rate(0);
+    });
+}
+
+SEASTAR_TEST_CASE(test_ended_span_is_not_inherited) {
+    tracing::set_sample_rate(1);
+    auto root = tracing::start_trace("root");
+    auto ctx = root.context();
+    BOOST_REQUIRE(ctx);
+    // Outlives the span
+    auto f = later().then([] {
+        // The task still refers to the ended span, but it's no longer
+        // current, nor a parent
+        BOOST_REQUIRE(!tracing::current_trace_context());
+        tracing::span child("child");
+        BOOST_REQUIRE(!child.active());
+        return later();
+    }).then([] {
+        BOOST_REQUIRE(!tracing::current_trace_context());
+    });
+    root.end();
+    BOOST_REQUIRE(!tracing::current_trace_context());
+    return f.finally([] {
+        tracing::set_sample_rate(0);
+    });
+}
+
+SEASTAR_THREAD_TEST_CASE(test_submit_to_continues_trace) {
+    tracing::set_sample_rate(1);
+    auto reset_rate = defer([] { tracing::set_sample_rate(0); });
+    tracing::collect_chrome_trace(true).get();
+    auto root = tracing::start_trace("cross_shard");
+    auto ctx = root.context();
+    auto remote = smp::submit_to(smp::count - 1, [] {
+        return later().then([] {
+            return tracing::current_trace_context();
+        });
+    }).get0();
+    BOOST_REQUIRE_EQUAL(remote.trace_id, ctx.trace_id);
+    BOOST_REQUIRE_NE(remote.span_id, ctx.span_id);
+    root.end();
+
+    auto trace = tracing::collect_chrome_trace().get0();
+    BOOST_REQUIRE_NE(trace.find("\"name\":\"cross_shard\""), sstring::npos);
+    BOOST_REQUIRE_NE(trace.find("\"name\":\"submit_to\""), sstring::npos);
+    BOOST_REQUIRE_NE(trace.find(format("\"parent_id\":\"{:016x}\"", ctx.span_id)), sstring::npos);
+    BOOST_REQUIRE_EQUAL(tracing::collect_chrome_trace().get0(), "{\"traceEvents\":[\n\n]}\n");
+}
+
+SEASTAR_THREAD_TEST_CASE(test_remote_parent_restores_current_span) {
+    tracing::set_sample_rate(1);
+    auto reset_rate = defer([] { tracing::set_sample_rate(0); });
+    tracing::collect_chrome_trace(true).get();
+    auto root = tracing::start_trace("root");
+    auto ctx = root.context();
+    {
+        tracing::span remote(tracing::trace_context{ctx.trace_id + 1, 42}, "remote \"child\"\n");
+        BOOST_REQUIRE_EQUAL(tracing::current_trace_context().span_id, remote.context().span_id);
+    }
+    BOOST_REQUIRE_EQUAL(tracing::current_trace_context().span_id, ctx.span_id);
+    root.end();
+    BOOST_REQUIRE(!tracing::current_trace_context());
+
+    auto trace = tracing::collect_chrome_trace().get0();
+    BOOST_REQUIRE_NE(trace.find("\"name\":\"remote \\\"child\\\"\\u000a\""), sstring::npos);
+}